@@ -154,6 +154,12 @@ namespace net_utils
     /// Handle completion of a write operation.
     void handle_write(const boost::system::error_code& e, size_t cb);
 
+    /// Start the next queued write, once the out throttle allows it.
+    void handle_write_resume(const boost::system::error_code& e);
+
+    /// Start the next read, once the in throttle allows it.
+    void handle_read_resume(const boost::system::error_code& e);
+
     /// reset connection timeout timer and callback
     void reset_timer(boost::posix_time::milliseconds ms, bool add);
     boost::posix_time::milliseconds get_default_timeout();
@@ -187,6 +193,9 @@ namespace net_utils
     boost::mutex m_throttle_speed_out_mutex;
 
     boost::asio::deadline_timer m_timer;
+    // hold off reads and writes over the speed limits, so throttling never sleeps an io thread
+    boost::asio::deadline_timer m_read_throttle_timer;
+    boost::asio::deadline_timer m_write_throttle_timer;
     bool m_local;
     bool m_ready_to_close;
     std::string m_host;
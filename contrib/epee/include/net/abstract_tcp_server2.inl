@@ -105,6 +105,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 								m_throttle_speed_in("speed_in", "throttle_speed_in"),
 								m_throttle_speed_out("speed_out", "throttle_speed_out"),
 								m_timer(GET_IO_SERVICE(socket_)),
+								m_read_throttle_timer(GET_IO_SERVICE(socket_)),
+								m_write_throttle_timer(GET_IO_SERVICE(socket_)),
 								m_local(false),
 								m_ready_to_close(false)
 	{
@@ -324,32 +326,16 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			}
 			context.m_current_speed_down = current_speed_down;
 			context.m_max_speed_down = std::max(context.m_max_speed_down, current_speed_down);
+			double delay = 0; // how long to hold off the next read to obey the speed limit
 			{
 				CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::network_throttle_manager::m_lock_get_global_throttle_in);
-				epee::net_utils::network_throttle_manager::network_throttle_manager::get_global_throttle_in().handle_trafic_exact(bytes_transferred);
+				i_network_throttle &throttle_in = epee::net_utils::network_throttle_manager::network_throttle_manager::get_global_throttle_in();
+				if(rpc_speed_limit_is_enabled())
+					delay = throttle_in.handle_trafic_throttled(bytes_transferred, context.m_remote_address.get_zone());
+				else
+					throttle_in.handle_trafic_exact(bytes_transferred);
 			}
 
-			double delay = 0; // will be calculated - how much we should sleep to obey speed limit etc
-
-			if(rpc_speed_limit_is_enabled())
-			{
-				do // keep sleeping if we should sleep
-				{
-					{ //_scope_dbg1("CRITICAL_REGION_LOCAL");
-						CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_in);
-						delay = epee::net_utils::network_throttle_manager::get_global_throttle_in().get_sleep_time_after_tick(bytes_transferred);
-					}
-
-					delay *= 0.5;
-					if(delay > 0)
-					{
-						long int ms = (long int)(delay * 100);
-						reset_timer(boost::posix_time::milliseconds(ms + 1), true);
-						boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
-					}
-				} while(delay > 0);
-			} // any form of sleeping
-
 			//_info("[sock " << socket().native_handle() << "] RECV " << bytes_transferred);
 			logger_handle_net_read(bytes_transferred);
 			context.m_last_recv = time(NULL);
@@ -372,8 +358,18 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			} else
 			{
 				reset_timer(get_timeout_from_bytes_read(bytes_transferred), false);
-				async_read_some(boost::asio::buffer(buffer_), strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_read, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1, boost::placeholders::_2)));
-				//_info("[sock " << socket().native_handle() << "]Async read requested.");
+				if(delay > 0)
+				{
+					const long int ms = (long int)(delay * 1000) + 1;
+					MTRACE("Holding off the next read for " << ms << " ms after " << bytes_transferred << " bytes");
+					reset_timer(boost::posix_time::milliseconds(ms), true);
+					m_read_throttle_timer.expires_from_now(boost::posix_time::milliseconds(ms));
+					m_read_throttle_timer.async_wait(strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_read_resume, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1)));
+				}
+				else
+				{
+					handle_read_resume(boost::system::error_code());
+				}
 			}
 		} else
 		{
@@ -399,6 +395,17 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 	}
 	//---------------------------------------------------------------------------------
 	template<class t_protocol_handler>
+	void connection<t_protocol_handler>::handle_read_resume(const boost::system::error_code& e)
+	{
+		TRY_ENTRY();
+		if(e == boost::asio::error::operation_aborted || m_was_shutdown)
+			return;
+		async_read_some(boost::asio::buffer(buffer_), strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_read, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1, boost::placeholders::_2)));
+		//_info("[sock " << socket().native_handle() << "]Async read requested.");
+		CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_read_resume", void());
+	}
+	//---------------------------------------------------------------------------------
+	template<class t_protocol_handler>
 	void connection<t_protocol_handler>::handle_receive(const boost::system::error_code& e, std::size_t bytes_transferred)
 	{
 		TRY_ENTRY();
@@ -738,6 +745,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		m_was_shutdown = true;
 		// Initiate graceful connection closure.
 		m_timer.cancel();
+		m_read_throttle_timer.cancel();
+		m_write_throttle_timer.cancel();
 		boost::system::error_code ignored_ec;
 		if(m_ssl_support == epee::net_utils::ssl_support_t::e_ssl_support_enabled)
 		{
@@ -808,11 +817,29 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		}
 		logger_handle_net_write(cb);
 
-		// The single sleeping that is needed for correctly handling "out" speed throttling
+		// The single place handling "out" speed throttling: the next write waits on a timer
 		if(rpc_speed_limit_is_enabled())
 		{
-			sleep_before_packet(cb, 1, 1);
+			const double delay = throttle_after_packet(cb, context.m_remote_address.get_zone());
+			if(delay > 0)
+			{
+				const long int ms = (long int)(delay * 1000) + 1;
+				MTRACE("Holding off the next write for " << ms << " ms after packet_size=" << cb);
+				m_write_throttle_timer.expires_from_now(boost::posix_time::milliseconds(ms));
+				m_write_throttle_timer.async_wait(strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_write_resume, connection<t_protocol_handler>::shared_from_this(), boost::placeholders::_1)));
+				return;
+			}
 		}
+		handle_write_resume(boost::system::error_code());
+		CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_write", void());
+	}
+	//---------------------------------------------------------------------------------
+	template<class t_protocol_handler>
+	void connection<t_protocol_handler>::handle_write_resume(const boost::system::error_code& e)
+	{
+		TRY_ENTRY();
+		if(e == boost::asio::error::operation_aborted || m_was_shutdown)
+			return;
 
 		bool do_shutdown = false;
 		CRITICAL_REGION_BEGIN(m_send_que_lock);
@@ -848,7 +875,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		{
 			shutdown();
 		}
-		CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_write", void());
+		CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_write_resume", void());
 	}
 	//---------------------------------------------------------------------------------
 	template<class t_protocol_handler>
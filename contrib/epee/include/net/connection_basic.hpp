@@ -180,8 +180,8 @@ class connection_basic { // not-templated base class for rapid developmet of som
       static void set_tos_flag(int tos); // ToS / QoS flag
       static int get_tos_flag();
 
-      // handlers and sleep
-      void sleep_before_packet(size_t packet_size, int phase, int q_len); // execute a sleep ; phase is not really used now(?)
+      // handlers and throttling
+      double throttle_after_packet(size_t packet_size, zone z); // counts a sent packet against the global out limit ; returns how long (seconds) to hold off the next one, never sleeps
       static void save_limit_to_file(int limit); ///< for dr-arqma
       static double get_sleep_time(size_t cb);
 
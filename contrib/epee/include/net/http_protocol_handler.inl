@@ -308,7 +308,10 @@ namespace net_utils
 					break;
 				}
 			case http_state_retriving_body:
-				return handle_retriving_query_body();
+				// keep going afterwards: a pipelined request may already be in the cache
+				if(!handle_retriving_query_body())
+					return false;
+				break;
 			case http_state_connection_close:
 				return false;
 			default:
@@ -45,6 +45,24 @@ namespace net_utils
 {
 
 
+/***
+@brief Token bucket refilled at the target speed, holding up to one second worth of tokens
+
+Transfers always take their tokens, going into debt if needed so packets larger
+than the bucket still pass; the debt is how long the next transfer has to wait.
+*/
+class token_bucket {
+	public:
+		token_bucket();
+		void set_rate(network_speed_bps rate);
+		network_time_seconds take(size_t bytes, network_time_seconds now); ///< returns how long to wait before the next transfer
+
+	private:
+		network_speed_bps m_rate;
+		double m_tokens;
+		network_time_seconds m_last_refill;
+};
+
 class network_throttle : public i_network_throttle {
 	private:
 		struct packet_info {
@@ -69,6 +87,9 @@ class network_throttle : public i_network_throttle {
 		uint64_t m_total_packets;
 		uint64_t m_total_bytes;
 
+		token_bucket m_bucket;
+		zone_throttle_stats m_zone_stats[4]; // by zone
+
 		std::string m_name; // my name for debug and logs
 		std::string m_nameshort; // my name for debug and logs (used in log file name)
 
@@ -99,6 +120,9 @@ class network_throttle : public i_network_throttle {
 		virtual double get_current_speed() const;
 		virtual void get_stats(uint64_t &total_packets, uint64_t &total_bytes) const;
 
+		virtual network_time_seconds handle_trafic_throttled(size_t packet_size, zone z);
+		virtual void get_stats(zone z, zone_throttle_stats &stats) const;
+
 	private:
 		virtual network_time_seconds time_to_slot(network_time_seconds t) const { return std::floor( t ); } // convert exact time eg 13.7 to rounded time for slot number in history 13
         virtual void _handle_trafic_exact(size_t packet_size, size_t orginal_size);
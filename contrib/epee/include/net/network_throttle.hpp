@@ -55,6 +55,7 @@
 #include "syncobj.h"
 
 #include "net/net_utils_base.h"
+#include "net/enums.h"
 #include "misc_log_ex.h"
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/lambda.hpp>
@@ -98,6 +99,16 @@ struct calculate_times_struct {
 };
 typedef calculate_times_struct calculate_times_struct;
 
+/***
+@brief Traffic of one network zone through a throttle, and how much it was held back
+*/
+struct zone_throttle_stats {
+		uint64_t packets;
+		uint64_t bytes;
+		uint64_t deferrals; ///< transfers held off to stay within the limit
+		uint64_t deferred_ms; ///< total time they were held off for
+};
+
 
 /***
 @brief Access to simple throttles, with singlton to access global network limits
@@ -155,6 +166,9 @@ class i_network_throttle {
 		virtual void logger_handle_net(const std::string &filename, double time, size_t size) = 0;
 		virtual void get_stats(uint64_t &total_packets, uint64_t &total_bytes) const = 0;
 
+		virtual network_time_seconds handle_trafic_throttled(size_t packet_size, zone z) = 0; // count the new traffic like handle_trafic_exact, take it from the token bucket, and return how long to hold off the next transfer (0 if not needed) ; never sleeps
+		virtual void get_stats(zone z, zone_throttle_stats &stats) const = 0;
+
 
 };
 
@@ -26,12 +26,14 @@
 
 #pragma once
 
+#include <cstring>
 #include <set>
 #include <list>
 #include <vector>
 #include <deque>
 #include <boost/mpl/vector.hpp>
 #include <boost/mpl/contains_fwd.hpp>
+#include "span.h"
 
 #undef WALLSTREETBETS_DEFAULT_LOG_CATEGORY
 #define WALLSTREETBETS_DEFAULT_LOG_CATEGORY "serialization"
@@ -66,14 +68,25 @@ namespace epee
       return stg.set_value(pname, blob, hparent_section);
     }
     //-------------------------------------------------------------------------------------------------------------------
+    // storages that can hand out string values in place overload this (see portable_storage_flat.h)
+    template<class t_storage>
+    static bool get_blob_value(t_storage& stg, typename t_storage::hsection hparent_section, const char* pname, std::string& buff, epee::span<const uint8_t>& blob)
+    {
+      if(!stg.get_value(pname, buff, hparent_section))
+        return false;
+      blob = epee::strspan<uint8_t>(buff);
+      return true;
+    }
+    //-------------------------------------------------------------------------------------------------------------------
     template<class t_type, class t_storage>
     static bool unserialize_t_val_as_blob(t_type& d, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
     {
-      std::string blob;
-      if(!stg.get_value(pname, blob, hparent_section))
+      std::string buff;
+      epee::span<const uint8_t> blob;
+      if(!get_blob_value(stg, hparent_section, pname, buff, blob))
         return false;
       CHECK_AND_ASSERT_MES(blob.size() == sizeof(d), false, "unserialize_t_val_as_blob: size of " << typeid(t_type).name() << " = " << sizeof(t_type) << ", but stored blod size = " << blob.size() << ", value name = " << pname);
-      d = *(const t_type*)blob.data();
+      memcpy(&d, blob.data(), sizeof(d));
       return true;
     }
     //-------------------------------------------------------------------------------------------------------------------
@@ -157,18 +170,24 @@ namespace epee
     {
       container.clear();
       std::string buff;
-      bool res = stg.get_value(pname, buff, hparent_section);
+      epee::span<const uint8_t> blob;
+      bool res = get_blob_value(stg, hparent_section, pname, buff, blob);
       if(res)
       {
-        size_t loaded_size = buff.size();
-        typename stl_container::value_type* pelem =  (typename stl_container::value_type*)buff.data();
+        size_t loaded_size = blob.size();
+        const uint8_t* pelem = blob.data();
         CHECK_AND_ASSERT_MES(!(loaded_size%sizeof(typename stl_container::value_type)),
           false,
           "size in blob " << loaded_size << " not have not zero modulo for sizeof(value_type) = " << sizeof(typename stl_container::value_type) << ", type " << typeid(typename stl_container::value_type).name());
         size_t count = (loaded_size/sizeof(typename stl_container::value_type));
         hint_resize(container, count);
-        for(size_t i = 0; i < count; i++)
-          container.insert(container.end(), *(pelem++));
+        for(size_t i = 0; i < count; i++, pelem += sizeof(typename stl_container::value_type))
+        {
+          // the blob may be a view into a receive buffer, so no alignment is assumed
+          typename stl_container::value_type v;
+          memcpy(&v, pelem, sizeof(v));
+          container.insert(container.end(), v);
+        }
       }
       return res;
     }
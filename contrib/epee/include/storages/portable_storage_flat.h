@@ -0,0 +1,531 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <boost/mpl/contains.hpp>
+
+#include "misc_log_ex.h"
+#include "span.h"
+#include "int-util.h"
+#include "parserse_base_utils.h"
+#include "portable_storage_base.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_val_converters.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /* Bump pointer arena: chunks only grow, and are all freed together     */
+    /************************************************************************/
+    class storage_arena
+    {
+    public:
+      storage_arena(): m_ptr(nullptr), m_left(0), m_chunk_size(0), m_next_chunk_size(4096) {}
+      storage_arena(const storage_arena&) = delete;
+      storage_arena& operator=(const storage_arena&) = delete;
+
+      template<class T>
+      T* allocate(size_t count)
+      {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        CHECK_AND_ASSERT_THROW_MES(count <= std::numeric_limits<size_t>::max() / sizeof(T), "arena allocation overflow");
+        T *p = static_cast<T*>(allocate_bytes(count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < count; ++i)
+          new (p + i) T();
+        return p;
+      }
+
+      // keeps the largest chunk, so a storage reused for similar payloads stops allocating
+      void clear()
+      {
+        if (m_chunks.size() > 1)
+        {
+          std::unique_ptr<uint8_t[]> last = std::move(m_chunks.back());
+          m_chunks.clear();
+          m_chunks.push_back(std::move(last));
+        }
+        m_ptr = m_chunks.empty() ? nullptr : m_chunks.back().get();
+        m_left = m_chunks.empty() ? 0 : m_chunk_size;
+      }
+
+    private:
+      void* allocate_bytes(size_t bytes, size_t align)
+      {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(m_ptr) % align) % align;
+        if (pad + bytes > m_left)
+        {
+          const size_t size = std::max(m_next_chunk_size, bytes + align);
+          m_chunks.emplace_back(new uint8_t[size]);
+          m_ptr = m_chunks.back().get();
+          m_left = size;
+          m_chunk_size = size;
+          m_next_chunk_size = size * 2;
+          pad = (align - reinterpret_cast<uintptr_t>(m_ptr) % align) % align;
+        }
+        uint8_t *p = m_ptr + pad;
+        m_ptr += pad + bytes;
+        m_left -= pad + bytes;
+        return p;
+      }
+
+      std::vector<std::unique_ptr<uint8_t[]>> m_chunks;
+      uint8_t *m_ptr;
+      size_t m_left;
+      size_t m_chunk_size;
+      size_t m_next_chunk_size;
+    };
+
+    struct flat_section;
+
+    struct flat_value
+    {
+      uint8_t type;         // SERIALIZE_TYPE_*, or'ed with SERIALIZE_FLAG_ARRAY for arrays
+      size_t size;          // string length, or array element count
+      mutable size_t next;  // array iteration cursor
+      union
+      {
+        const uint8_t *bytes;     // scalars, strings and arrays of scalars: in the source buffer
+        flat_value *values;       // arrays of strings
+        flat_section *sections;   // one object, or arrays of objects
+      };
+    };
+
+    struct flat_field
+    {
+      const char *name;
+      uint8_t name_size;
+      flat_value value;
+    };
+
+    // fields sorted by name, kept in the arena
+    struct flat_section
+    {
+      flat_field *fields;
+      size_t count;
+    };
+
+    /************************************************************************/
+    /* Read only portable_storage backend for binary payloads: the whole    */
+    /* tree lives in one arena and string values point into the source      */
+    /* buffer, which must outlive any load from this storage.               */
+    /************************************************************************/
+    class flat_portable_storage
+    {
+    public:
+      typedef flat_section* hsection;
+      typedef flat_value* harray;
+      typedef storage_entry meta_entry;
+
+      flat_portable_storage(): m_ptr(nullptr), m_count(0) { m_root.fields = nullptr; m_root.count = 0; }
+      flat_portable_storage(const flat_portable_storage&) = delete;
+      flat_portable_storage& operator=(const flat_portable_storage&) = delete;
+
+      bool load_from_binary(const epee::span<const uint8_t> source);
+      bool load_from_binary(const std::string& source) { return load_from_binary(epee::strspan<uint8_t>(source)); }
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool get_value(const std::string& value_name, t_value& val, hsection hparent_section);
+      bool get_value(const std::string& value_name, epee::span<const uint8_t>& val, hsection hparent_section);
+      template<class t_value>
+      harray get_first_value(const std::string& value_name, t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool get_next_value(harray hval_array, t_value& target);
+      harray get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section);
+      bool get_next_section(harray hsec_array, hsection& h_child_section);
+
+      // the store side of KV_SERIALIZE maps is compiled for every storage, but never works here
+      template<class t_value>
+      bool set_value(const std::string&, const t_value&, hsection) { return read_only(); }
+      template<class t_value>
+      harray insert_first_value(const std::string&, const t_value&, hsection) { read_only(); return nullptr; }
+      template<class t_value>
+      bool insert_next_value(harray, const t_value&) { return read_only(); }
+      harray insert_first_section(const std::string&, hsection&, hsection) { read_only(); return nullptr; }
+      bool insert_next_section(harray, hsection&) { return read_only(); }
+
+    private:
+      static bool read_only() { LOG_ERROR("flat_portable_storage is read only"); return false; }
+
+      const flat_value* find_value(const std::string& value_name, hsection hparent_section) const;
+      template<class t_value>
+      static void get_scalar(uint8_t type, const uint8_t *bytes, t_value& val);
+      template<class t_value>
+      static void get_string(const flat_value& v, t_value& val) { convert_t(std::string((const char*)v.bytes, v.size), val); }
+      static void get_string(const flat_value& v, std::string& val) { val.assign((const char*)v.bytes, v.size); }
+
+      const uint8_t* take(size_t count);
+      size_t read_varint();
+      void read_section(flat_section& sec, size_t depth);
+      void read_value(flat_value& v, uint8_t type, size_t depth);
+      void read_array(flat_value& v, uint8_t type, size_t depth);
+
+      storage_arena m_arena;
+      flat_section m_root;
+      const uint8_t *m_ptr;
+      size_t m_count;
+
+#pragma pack(push)
+#pragma pack(1)
+      struct storage_block_header
+      {
+        uint32_t m_signature_a;
+        uint32_t m_signature_b;
+        uint8_t  m_ver;
+      };
+#pragma pack(pop)
+    };
+
+    namespace detail
+    {
+      inline size_t scalar_size(uint8_t type)
+      {
+        switch (type)
+        {
+        case SERIALIZE_TYPE_INT64: case SERIALIZE_TYPE_UINT64: case SERIALIZE_TYPE_DUOBLE: return 8;
+        case SERIALIZE_TYPE_INT32: case SERIALIZE_TYPE_UINT32: return 4;
+        case SERIALIZE_TYPE_INT16: case SERIALIZE_TYPE_UINT16: return 2;
+        case SERIALIZE_TYPE_INT8: case SERIALIZE_TYPE_UINT8: case SERIALIZE_TYPE_BOOL: return 1;
+        default: return 0;
+        }
+      }
+
+      template<class T>
+      T load_scalar(const uint8_t *bytes)
+      {
+        T v;
+        memcpy(&v, bytes, sizeof(v));
+        return v;
+      }
+
+      inline int compare_name(const char *a, size_t a_size, const char *b, size_t b_size)
+      {
+        const int r = memcmp(a, b, std::min(a_size, b_size));
+        if (r)
+          return r;
+        return a_size < b_size ? -1 : a_size > b_size ? 1 : 0;
+      }
+    }
+
+    inline
+    bool flat_portable_storage::load_from_binary(const epee::span<const uint8_t> source)
+    {
+      m_arena.clear();
+      m_root.fields = nullptr;
+      m_root.count = 0;
+      if(source.size() < sizeof(storage_block_header))
+      {
+        LOG_ERROR("flat_portable_storage: wrong binary format, packet size = " << source.size() << " less than expected sizeof(storage_block_header)=" << sizeof(storage_block_header));
+        return false;
+      }
+      const storage_block_header* pbuff = (const storage_block_header*)source.data();
+      if(pbuff->m_signature_a != SWAP32LE(PORTABLE_STORAGE_SIGNATUREA) ||
+        pbuff->m_signature_b != SWAP32LE(PORTABLE_STORAGE_SIGNATUREB)
+        )
+      {
+        LOG_ERROR("flat_portable_storage: wrong binary format - signature mismatch");
+        return false;
+      }
+      if(pbuff->m_ver != PORTABLE_STORAGE_FORMAT_VER)
+      {
+        LOG_ERROR("flat_portable_storage: wrong binary format - unknown format ver = " << pbuff->m_ver);
+        return false;
+      }
+      TRY_ENTRY();
+      m_ptr = source.data() + sizeof(storage_block_header);
+      m_count = source.size() - sizeof(storage_block_header);
+      read_section(m_root, 0);
+      return true;
+      CATCH_ENTRY("flat_portable_storage::load_from_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const uint8_t* flat_portable_storage::take(size_t count)
+    {
+      CHECK_AND_ASSERT_THROW_MES(m_count >= count, " attempt to read " << count << " bytes from buffer with " << m_count << " bytes remained");
+      const uint8_t *p = m_ptr;
+      m_ptr += count;
+      m_count -= count;
+      return p;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t flat_portable_storage::read_varint()
+    {
+      CHECK_AND_ASSERT_THROW_MES(m_count >= 1, "empty buff, expected place for varint");
+      size_t v = 0;
+      switch (*m_ptr & PORTABLE_RAW_SIZE_MARK_MASK)
+      {
+      case PORTABLE_RAW_SIZE_MARK_BYTE: v = detail::load_scalar<uint8_t>(take(1)); break;
+      case PORTABLE_RAW_SIZE_MARK_WORD: v = detail::load_scalar<uint16_t>(take(2)); break;
+      case PORTABLE_RAW_SIZE_MARK_DWORD: v = detail::load_scalar<uint32_t>(take(4)); break;
+      case PORTABLE_RAW_SIZE_MARK_INT64: v = detail::load_scalar<uint64_t>(take(8)); break;
+      }
+      return v >> 2;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void flat_portable_storage::read_section(flat_section& sec, size_t depth)
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      const size_t count = read_varint();
+      // every field takes at least a name length and a type byte
+      CHECK_AND_ASSERT_THROW_MES(count <= m_count / 2, "section field count " << count << " goes out of remain storage len " << m_count);
+      sec.fields = m_arena.allocate<flat_field>(count);
+      sec.count = count;
+      for (size_t i = 0; i < count; ++i)
+      {
+        flat_field &f = sec.fields[i];
+        f.name_size = *take(1);
+        f.name = (const char*)take(f.name_size);
+        const uint8_t type = *take(1);
+        if (type & SERIALIZE_FLAG_ARRAY)
+          read_array(f.value, type, depth + 1);
+        else
+          read_value(f.value, type, depth + 1);
+      }
+
+      // payloads come out of std::map already sorted, anything else is sorted once; the sort is
+      // stable so the first of duplicate names wins, as with portable_storage
+      const auto less = [](const flat_field &a, const flat_field &b) { return detail::compare_name(a.name, a.name_size, b.name, b.name_size) < 0; };
+      if (!std::is_sorted(sec.fields, sec.fields + count, less))
+        std::stable_sort(sec.fields, sec.fields + count, less);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void flat_portable_storage::read_value(flat_value& v, uint8_t type, size_t depth)
+    {
+      v.type = type;
+      v.size = 0;
+      v.next = 0;
+      switch (type)
+      {
+      case SERIALIZE_TYPE_STRING:
+        v.size = read_varint();
+        CHECK_AND_ASSERT_THROW_MES(v.size < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << v.size);
+        v.bytes = take(v.size);
+        break;
+      case SERIALIZE_TYPE_OBJECT:
+        v.sections = m_arena.allocate<flat_section>(1);
+        read_section(*v.sections, depth);
+        break;
+      case SERIALIZE_TYPE_ARRAY:
+      {
+        const uint8_t array_type = *take(1);
+        CHECK_AND_ASSERT_THROW_MES(array_type & SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+        read_array(v, array_type, depth);
+        break;
+      }
+      default:
+        const size_t size = detail::scalar_size(type);
+        CHECK_AND_ASSERT_THROW_MES(size, "unknown entry_type code = " << (unsigned)type);
+        v.bytes = take(size);
+        break;
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void flat_portable_storage::read_array(flat_value& v, uint8_t type, size_t depth)
+    {
+      CHECK_AND_ASSERT_THROW_MES(depth < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      const uint8_t element_type = type & ~SERIALIZE_FLAG_ARRAY;
+      v.type = type;
+      v.next = 0;
+      v.size = read_varint();
+      // every element takes at least a byte, so a bogus count can't make us allocate
+      CHECK_AND_ASSERT_THROW_MES(v.size <= m_count, "array element count " << v.size << " goes out of remain storage len " << m_count);
+      switch (element_type)
+      {
+      case SERIALIZE_TYPE_STRING:
+        v.values = m_arena.allocate<flat_value>(v.size);
+        for (size_t i = 0; i < v.size; ++i)
+          read_value(v.values[i], element_type, depth);
+        break;
+      case SERIALIZE_TYPE_OBJECT:
+        v.sections = m_arena.allocate<flat_section>(v.size);
+        for (size_t i = 0; i < v.size; ++i)
+          read_section(v.sections[i], depth + 1);
+        break;
+      case SERIALIZE_TYPE_ARRAY:
+        CHECK_AND_ASSERT_THROW_MES(false, "Reading array entry is not supported");
+      default:
+        const size_t size = detail::scalar_size(element_type);
+        CHECK_AND_ASSERT_THROW_MES(size, "unknown entry_type code = " << (unsigned)element_type);
+        CHECK_AND_ASSERT_THROW_MES(v.size <= m_count / size, "array element count " << v.size << " goes out of remain storage len " << m_count);
+        v.bytes = take(v.size * size);
+        break;
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const flat_value* flat_portable_storage::find_value(const std::string& value_name, hsection hparent_section) const
+    {
+      const flat_section &sec = hparent_section ? *hparent_section : m_root;
+      const flat_field *begin = sec.fields, *end = sec.fields + sec.count;
+      const flat_field *it = std::lower_bound(begin, end, value_name, [](const flat_field &f, const std::string &name) {
+        return detail::compare_name(f.name, f.name_size, name.data(), name.size()) < 0;
+      });
+      if (it == end || detail::compare_name(it->name, it->name_size, value_name.data(), value_name.size()))
+        return nullptr;
+      return &it->value;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void flat_portable_storage::get_scalar(uint8_t type, const uint8_t *bytes, t_value& val)
+    {
+      switch (type)
+      {
+      case SERIALIZE_TYPE_INT64:  convert_t(detail::load_scalar<int64_t>(bytes), val); break;
+      case SERIALIZE_TYPE_INT32:  convert_t(detail::load_scalar<int32_t>(bytes), val); break;
+      case SERIALIZE_TYPE_INT16:  convert_t(detail::load_scalar<int16_t>(bytes), val); break;
+      case SERIALIZE_TYPE_INT8:   convert_t(detail::load_scalar<int8_t>(bytes), val); break;
+      case SERIALIZE_TYPE_UINT64: convert_t(detail::load_scalar<uint64_t>(bytes), val); break;
+      case SERIALIZE_TYPE_UINT32: convert_t(detail::load_scalar<uint32_t>(bytes), val); break;
+      case SERIALIZE_TYPE_UINT16: convert_t(detail::load_scalar<uint16_t>(bytes), val); break;
+      case SERIALIZE_TYPE_UINT8:  convert_t(detail::load_scalar<uint8_t>(bytes), val); break;
+      case SERIALIZE_TYPE_DUOBLE: convert_t(detail::load_scalar<double>(bytes), val); break;
+      case SERIALIZE_TYPE_BOOL:   convert_t(*bytes != 0, val); break;
+      default:
+        ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from entry type " << (unsigned)type << " to type " << typeid(val).name());
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_portable_storage::hsection flat_portable_storage::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      if (create_if_notexist)
+      {
+        read_only();
+        return nullptr;
+      }
+      const flat_value *v = find_value(section_name, hparent_section);
+      if (!v || v->type != SERIALIZE_TYPE_OBJECT)
+        return nullptr;
+      return v->sections;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool flat_portable_storage::get_value(const std::string& value_name, t_value& val, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      const flat_value *v = find_value(value_name, hparent_section);
+      if (!v)
+        return false;
+      if (v->type == SERIALIZE_TYPE_STRING)
+        get_string(*v, val);
+      else
+        get_scalar(v->type, v->bytes, val);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool flat_portable_storage::get_value(const std::string& value_name, epee::span<const uint8_t>& val, hsection hparent_section)
+    {
+      const flat_value *v = find_value(value_name, hparent_section);
+      if (!v)
+        return false;
+      CHECK_AND_ASSERT_THROW_MES(v->type == SERIALIZE_TYPE_STRING, "WRONG DATA CONVERSION: from entry type " << (unsigned)v->type << " to blob");
+      val = {v->bytes, v->size};
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    flat_portable_storage::harray flat_portable_storage::get_first_value(const std::string& value_name, t_value& target, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      const flat_value *v = find_value(value_name, hparent_section);
+      if (!v || !(v->type & SERIALIZE_FLAG_ARRAY))
+        return nullptr;
+      harray hval_array = const_cast<harray>(v);
+      hval_array->next = 0;
+      if (!get_next_value(hval_array, target))
+        return nullptr;
+      return hval_array;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool flat_portable_storage::get_next_value(harray hval_array, t_value& target)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      CHECK_AND_ASSERT(hval_array, false);
+      if (hval_array->next >= hval_array->size)
+        return false;
+      const size_t i = hval_array->next++;
+      const uint8_t element_type = hval_array->type & ~SERIALIZE_FLAG_ARRAY;
+      if (element_type == SERIALIZE_TYPE_STRING)
+        get_string(hval_array->values[i], target);
+      else if (element_type == SERIALIZE_TYPE_OBJECT)
+      {
+        ASSERT_MES_AND_THROW("WRONG DATA CONVERSION: from object array to type " << typeid(target).name());
+      }
+      else
+        get_scalar(element_type, hval_array->bytes + i * detail::scalar_size(element_type), target);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    flat_portable_storage::harray flat_portable_storage::get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section)
+    {
+      const flat_value *v = find_value(section_name, hparent_section);
+      if (!v || v->type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY) || !v->size)
+        return nullptr;
+      harray hsec_array = const_cast<harray>(v);
+      hsec_array->next = 1;
+      h_child_section = hsec_array->sections;
+      return hsec_array;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool flat_portable_storage::get_next_section(harray hsec_array, hsection& h_child_section)
+    {
+      CHECK_AND_ASSERT(hsec_array, false);
+      if (hsec_array->type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY) || hsec_array->next >= hsec_array->size)
+        return false;
+      h_child_section = &hsec_array->sections[hsec_array->next++];
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    // lets the blob overloads in keyvalue_serialization_overloads.h read in place
+    inline bool get_blob_value(flat_portable_storage& stg, flat_portable_storage::hsection hparent_section, const char* pname, std::string& /*buff*/, epee::span<const uint8_t>& blob)
+    {
+      return stg.get_value(pname, blob, hparent_section);
+    }
+  }
+}
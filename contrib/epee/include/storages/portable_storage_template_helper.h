@@ -30,6 +30,8 @@
 
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_flat.h"
+#include "portable_storage_writer.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -86,7 +88,7 @@ namespace epee
     template<class t_struct>
     bool load_t_from_binary(t_struct& out, const epee::span<const uint8_t> binary_buff)
     {
-      portable_storage ps;
+      flat_portable_storage ps;
       bool rs = ps.load_from_binary(binary_buff);
       if(!rs)
         return false;
@@ -113,6 +115,17 @@ namespace epee
     template<class t_struct>
     bool store_t_to_binary(t_struct& str_in, std::string& binary_buff, size_t indent = 0)
     {
+      try
+      {
+        portable_storage_writer writer;
+        str_in.store(writer);
+        return writer.store_to_binary(binary_buff);
+      }
+      catch (const std::exception &e)
+      {
+        // eg, a name stored twice, which only a tree can overwrite
+        MDEBUG("Streaming store failed, building a portable_storage: " << e.what());
+      }
       portable_storage ps;
       str_in.store(ps);
       return ps.store_to_binary(binary_buff);
@@ -0,0 +1,290 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/mpl/contains.hpp>
+#include <boost/mpl/push_front.hpp>
+
+#include "misc_log_ex.h"
+#include "int-util.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    template<class T> struct portable_type_id;
+    template<> struct portable_type_id<uint64_t> { static const uint8_t value = SERIALIZE_TYPE_UINT64; };
+    template<> struct portable_type_id<uint32_t> { static const uint8_t value = SERIALIZE_TYPE_UINT32; };
+    template<> struct portable_type_id<uint16_t> { static const uint8_t value = SERIALIZE_TYPE_UINT16; };
+    template<> struct portable_type_id<uint8_t> { static const uint8_t value = SERIALIZE_TYPE_UINT8; };
+    template<> struct portable_type_id<int64_t> { static const uint8_t value = SERIALIZE_TYPE_INT64; };
+    template<> struct portable_type_id<int32_t> { static const uint8_t value = SERIALIZE_TYPE_INT32; };
+    template<> struct portable_type_id<int16_t> { static const uint8_t value = SERIALIZE_TYPE_INT16; };
+    template<> struct portable_type_id<int8_t> { static const uint8_t value = SERIALIZE_TYPE_INT8; };
+    template<> struct portable_type_id<double> { static const uint8_t value = SERIALIZE_TYPE_DUOBLE; };
+    template<> struct portable_type_id<bool> { static const uint8_t value = SERIALIZE_TYPE_BOOL; };
+    template<> struct portable_type_id<std::string> { static const uint8_t value = SERIALIZE_TYPE_STRING; };
+
+    /************************************************************************/
+    /* Store only portable_storage backend writing the binary format        */
+    /* straight from KV_SERIALIZE maps, with no tree in between. Sections   */
+    /* and arrays must be written in nesting order, as the maps do, and     */
+    /* fields come out in declaration order rather than sorted by name,     */
+    /* which readers don't care about. A name stored twice in one section   */
+    /* throws, as there is no going back to replace the first value.        */
+    /************************************************************************/
+    // an open section, or an open array, of a portable_storage_writer
+    struct writer_frame
+    {
+      size_t depth;
+      uint8_t array_type;         // 0 for sections
+      size_t count_offset;        // where the field/element count goes once known
+      size_t count;
+      std::vector<size_t> names;  // name offsets, to catch duplicates
+    };
+
+    class portable_storage_writer
+    {
+    public:
+      typedef writer_frame frame;
+      typedef frame* hsection;
+      typedef frame* harray;
+      typedef storage_entry meta_entry;
+
+      explicit portable_storage_writer(size_t reserve = 4096);
+      portable_storage_writer(const portable_storage_writer&) = delete;
+      portable_storage_writer& operator=(const portable_storage_writer&) = delete;
+
+      // hands the bytes over, after which the writer is spent
+      bool store_to_binary(binarybuffer& target);
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& target);
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section);
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection);
+
+    private:
+      struct stream
+      {
+        std::string &m_buffer;
+        void write(const char *data, size_t size) { m_buffer.append(data, size); }
+      };
+
+      frame& enter(hsection hparent_section);
+      frame& push(uint8_t array_type);
+      void close_top();
+      void write_name(frame& sec, const std::string& name);
+      void write_type(uint8_t type) { m_buffer.push_back((char)type); }
+      template<class t_value>
+      void write_payload(const t_value& v) { m_buffer.append((const char*)&v, sizeof(v)); }
+      void write_payload(const std::string& v) { stream s{m_buffer}; put_string(s, v); }
+
+      std::string m_buffer;
+      std::deque<frame> m_frames; // never shrinks, so handles stay valid and name vectors get reused
+      size_t m_depth;             // frames in use
+      bool m_done;
+
+#pragma pack(push)
+#pragma pack(1)
+      struct storage_block_header
+      {
+        uint32_t m_signature_a;
+        uint32_t m_signature_b;
+        uint8_t  m_ver;
+      };
+#pragma pack(pop)
+    };
+
+    inline
+    portable_storage_writer::portable_storage_writer(size_t reserve): m_depth(0), m_done(false)
+    {
+      m_buffer.reserve(reserve);
+      storage_block_header sbh = AUTO_VAL_INIT(sbh);
+      sbh.m_signature_a = SWAP32LE(PORTABLE_STORAGE_SIGNATUREA);
+      sbh.m_signature_b = SWAP32LE(PORTABLE_STORAGE_SIGNATUREB);
+      sbh.m_ver = PORTABLE_STORAGE_FORMAT_VER;
+      m_buffer.append((const char*)&sbh, sizeof(storage_block_header));
+      push(0);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_writer::store_to_binary(binarybuffer& target)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT_MES(!m_done, false, "portable_storage_writer: already stored");
+      while (m_depth)
+        close_top();
+      m_done = true;
+      target.swap(m_buffer);
+      m_buffer.clear();
+      return true;
+      CATCH_ENTRY("portable_storage_writer::store_to_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_writer::frame& portable_storage_writer::push(uint8_t array_type)
+    {
+      if (m_depth == m_frames.size())
+        m_frames.emplace_back();
+      frame &f = m_frames[m_depth];
+      f.depth = m_depth++;
+      f.array_type = array_type;
+      f.count_offset = m_buffer.size();
+      f.count = 0;
+      f.names.clear();
+      m_buffer.push_back(0); // one byte count, widened on close if need be
+      return f;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_writer::close_top()
+    {
+      frame &f = m_frames[--m_depth];
+      if (f.count <= 63)
+      {
+        m_buffer[f.count_offset] = (char)(f.count << 2 | PORTABLE_RAW_SIZE_MARK_BYTE);
+      }
+      else
+      {
+        std::string count;
+        stream s{count};
+        pack_varint(s, f.count);
+        m_buffer.replace(f.count_offset, 1, count);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_writer::frame& portable_storage_writer::enter(hsection hparent_section)
+    {
+      CHECK_AND_ASSERT_THROW_MES(!m_done, "portable_storage_writer: already stored");
+      frame *f = hparent_section ? hparent_section : &m_frames[0];
+      CHECK_AND_ASSERT_THROW_MES(f->depth < m_depth && &m_frames[f->depth] == f, "portable_storage_writer: writing to a closed section");
+      while (m_depth > f->depth + 1)
+        close_top();
+      return *f;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_writer::write_name(frame& sec, const std::string& name)
+    {
+      CHECK_AND_ASSERT_THROW_MES(!sec.array_type, "portable_storage_writer: writing a field to an array");
+      CHECK_AND_ASSERT_THROW_MES(name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << name.size() << ", val: " << name);
+      // names are stored as a length byte and the name; sections are small enough for a linear scan
+      for (size_t offset: sec.names)
+        if ((uint8_t)m_buffer[offset] == name.size() && !m_buffer.compare(offset + 1, name.size(), name))
+          throw std::runtime_error("portable_storage_writer: " + name + " stored twice");
+      sec.names.push_back(m_buffer.size());
+      ++sec.count;
+      m_buffer.push_back((char)name.size());
+      m_buffer.append(name);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_writer::hsection portable_storage_writer::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      CHECK_AND_ASSERT_THROW_MES(create_if_notexist, "portable_storage_writer is write only");
+      write_name(enter(hparent_section), section_name);
+      write_type(SERIALIZE_TYPE_OBJECT);
+      return &push(0);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_writer::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<boost::mpl::push_front<storage_entry::types, storage_entry>::type, t_value> ));
+      write_name(enter(hparent_section), value_name);
+      stream s{m_buffer};
+      storage_entry_store_visitor<stream> visitor(s);
+      return visitor(v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<>
+    inline bool portable_storage_writer::set_value(const std::string& value_name, const storage_entry& v, hsection hparent_section)
+    {
+      write_name(enter(hparent_section), value_name);
+      stream s{m_buffer};
+      return pack_entry_to_buff(s, v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_storage_writer::harray portable_storage_writer::insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+    {
+      write_name(enter(hparent_section), value_name);
+      write_type(portable_type_id<t_value>::value | SERIALIZE_FLAG_ARRAY);
+      frame &arr = push(portable_type_id<t_value>::value);
+      write_payload(target);
+      ++arr.count;
+      return &arr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_writer::insert_next_value(harray hval_array, const t_value& target)
+    {
+      CHECK_AND_ASSERT_MES(hval_array, false, "portable_storage_writer: null array");
+      frame &arr = enter(hval_array);
+      CHECK_AND_ASSERT_MES(arr.array_type == portable_type_id<t_value>::value, false, "unexpected type in insert_next_value: " << typeid(t_value).name());
+      write_payload(target);
+      ++arr.count;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_writer::harray portable_storage_writer::insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      write_name(enter(hparent_section), section_name);
+      write_type(SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY);
+      frame &arr = push(SERIALIZE_TYPE_OBJECT);
+      ++arr.count;
+      hinserted_childsection = &push(0);
+      return &arr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_writer::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      CHECK_AND_ASSERT_MES(hsec_array, false, "portable_storage_writer: null array");
+      frame &arr = enter(hsec_array);
+      CHECK_AND_ASSERT_MES(arr.array_type == SERIALIZE_TYPE_OBJECT, false, "unexpected type(not 'section') in insert_next_section");
+      ++arr.count;
+      hinserted_childsection = &push(0);
+      return true;
+    }
+  }
+}
@@ -110,6 +110,34 @@ namespace epee
 namespace net_utils
 {
 
+// ================================================================================================
+// token_bucket
+// ================================================================================================
+
+token_bucket::token_bucket()
+	: m_rate(0), m_tokens(0), m_last_refill(-1)
+{
+}
+
+void token_bucket::set_rate(network_speed_bps rate)
+{
+	m_rate = rate;
+	m_tokens = std::min(m_tokens, m_rate);
+}
+
+network_time_seconds token_bucket::take(size_t bytes, network_time_seconds now)
+{
+	if (m_rate <= 0)
+		return 0;
+	if (m_last_refill < 0)
+		m_tokens = m_rate; // start full
+	else if (now > m_last_refill)
+		m_tokens = std::min(m_rate, m_tokens + (now - m_last_refill) * m_rate);
+	m_last_refill = std::max(m_last_refill, now);
+	m_tokens -= bytes;
+	return m_tokens >= 0 ? 0 : -m_tokens / m_rate;
+}
+
 // ================================================================================================
 // network_throttle
 // ================================================================================================
@@ -137,6 +165,8 @@ network_throttle::network_throttle(const std::string &nameshort, const std::stri
 	m_history.resize(m_window_size);
 	m_total_packets = 0;
 	m_total_bytes = 0;
+	m_bucket.set_rate(m_target_speed);
+	memset(m_zone_stats, 0, sizeof(m_zone_stats));
 }
 
 void network_throttle::set_name(const std::string &name)
@@ -147,6 +177,7 @@ void network_throttle::set_name(const std::string &name)
 void network_throttle::set_target_speed( network_speed_kbps target )
 {
     m_target_speed = target * 1024;
+	m_bucket.set_rate(m_target_speed);
 	MINFO("Setting LIMIT: " << target << " Kbps");
 }
 
@@ -360,6 +391,33 @@ void network_throttle::get_stats(uint64_t &total_packets, uint64_t &total_bytes)
 	total_bytes = m_total_bytes;
 }
 
+network_time_seconds network_throttle::handle_trafic_throttled(size_t packet_size, zone z) {
+	handle_trafic_exact(packet_size);
+	const network_time_seconds delay = m_bucket.take(packet_size, get_time_seconds());
+
+	const size_t index = static_cast<size_t>(z);
+	if (index < sizeof(m_zone_stats) / sizeof(m_zone_stats[0]))
+	{
+		zone_throttle_stats &stats = m_zone_stats[index];
+		++stats.packets;
+		stats.bytes += packet_size;
+		if (delay > 0)
+		{
+			++stats.deferrals;
+			stats.deferred_ms += delay * 1000;
+		}
+	}
+	return delay;
+}
+
+void network_throttle::get_stats(zone z, zone_throttle_stats &stats) const {
+	const size_t index = static_cast<size_t>(z);
+	if (index < sizeof(m_zone_stats) / sizeof(m_zone_stats[0]))
+		stats = m_zone_stats[index];
+	else
+		memset(&stats, 0, sizeof(stats));
+}
+
 
 } // namespace
 } // namespace
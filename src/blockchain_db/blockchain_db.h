@@ -1256,6 +1256,24 @@ public:
 
   virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const = 0;
 
+  /**
+   * @brief runs functions over blocks and their transactions, without copying them
+   *
+   * Takes the same limits as get_blocks_from. block_f is called for each
+   * block with its blob, its miner tx hash (if requested) and its number of
+   * non coinbase txes, then tx_f for each of those txes with their pruned
+   * and prunable blobs. The prunable blob is empty if pruned is true.
+   *
+   * The blobs point to the db's own memory, and remain valid only as long
+   * as the read transaction they were obtained in, so callers should hold
+   * one (eg, with db_rtxn_guard) if they keep them past the call.
+   *
+   * If either function returns false, the iteration stops.
+   *
+   * @return false if a function returned false, true otherwise
+   */
+  virtual bool for_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, bool pruned, bool skip_coinbase, bool get_miner_tx_hash, std::function<bool(const epee::span<const uint8_t>&, const crypto::hash&, size_t)> block_f, std::function<bool(const crypto::hash&, const epee::span<const uint8_t>&, const epee::span<const uint8_t>&)> tx_f) const = 0;
+
   /**
    * @brief fetches the prunable transaction blob with the given hash
    *
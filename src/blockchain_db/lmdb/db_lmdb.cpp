@@ -56,6 +56,8 @@ using namespace crypto;
 // Increase when the DB structure changes
 #define VERSION 4
 
+#define BLOCK_INFO_COLUMN_PAGE 1024
+
 namespace
 {
 
@@ -721,6 +723,8 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, uint64_t l
   mdb_txn_cursors *m_cursors = &m_wcursors;
   uint64_t m_height = height();
 
+  invalidate_block_info_columns(m_height);
+
   CURSOR(block_heights)
   blk_height bh = {blk_hash, m_height};
   MDB_val_set(val_h, bh);
@@ -801,6 +805,8 @@ void BlockchainLMDB::remove_block()
   if (m_height == 0)
     throw0(BLOCK_DNE ("Attempting to remove block from an empty blockchain"));
 
+  invalidate_block_info_columns(m_height - 1);
+
   mdb_txn_cursors *m_cursors = &m_wcursors;
   CURSOR(block_info)
   CURSOR(block_heights)
@@ -1259,6 +1265,8 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_block_info_columns_generation = 0;
+  m_block_info_columns_dirty_from = std::numeric_limits<uint64_t>::max();
 
   // reset may also need changing when initialize things here
 
@@ -1563,6 +1571,7 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_blocks: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_block_info, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_info: ", result).c_str()));
+  invalidate_block_info_columns(0);
   if (auto result = mdb_drop(txn, m_block_heights, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_heights: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_pruned, 0))
@@ -1596,6 +1605,7 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
   txn.commit();
+  settle_block_info_columns();
   m_cum_size = 0;
   m_cum_count = 0;
 }
@@ -2501,6 +2511,12 @@ std::vector<uint64_t> BlockchainLMDB::get_block_info_64bit_fields(uint64_t start
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  uint64_t generation;
+  {
+    boost::unique_lock<boost::mutex> lock(m_block_info_columns_lock);
+    generation = m_block_info_columns_generation;
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(block_info);
 
@@ -2509,48 +2525,120 @@ std::vector<uint64_t> BlockchainLMDB::get_block_info_64bit_fields(uint64_t start
     if (start_height >= h)
       throw0(DB_ERROR(("Height " + std::to_string(start_height) + " not in blockchain").c_str()));
 
+  // A read txn we did not start may be older than the cached pages, so only
+  // use them from a fresh read txn, or from the writer, whose own changes
+  // keep the pages they touch out of the cache until its txn ends
+  const bool use_columns = my_rtxn || m_cursors == &m_wcursors;
+
+  const uint64_t end_height = h == 0 ? start_height : h - start_height > count ? start_height + count : h;
   std::vector<uint64_t> ret;
-  ret.reserve(count);
+  ret.reserve(end_height - start_height);
 
-  MDB_val v;
-  uint64_t range_begin = 0, range_end = 0;
-  for (uint64_t height = start_height; height < h && count--; ++height)
-  {
-    if (height >= range_begin && height < range_end)
+  auto read_rows = [&](uint64_t first_height, uint64_t rows, std::vector<uint64_t> &out) {
+    MDB_val v;
+    uint64_t range_begin = 0, range_end = 0;
+    for (uint64_t height = first_height; height < first_height + rows; ++height)
     {
-      // nothing to do
+      if (height >= range_begin && height < range_end)
+      {
+        // nothing to do
+      }
+      else
+      {
+        int result = 0;
+        if (range_end > 0)
+        {
+          MDB_val k2;
+          result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT_MULTIPLE);
+          range_begin = ((const mdb_block_info*)v.mv_data)->bi_height;
+          range_end = range_begin + v.mv_size / sizeof(mdb_block_info); // whole records please
+          if (height < range_begin || height >= range_end)
+            throw0(DB_ERROR(("Height " + std::to_string(height) + " not included in multiple record range: " + std::to_string(range_begin) + "-" + std::to_string(range_end)).c_str()));
+        }
+        else
+        {
+          v.mv_size = sizeof(uint64_t);
+          v.mv_data = (void*)&height;
+          result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+          range_begin = height;
+          range_end = range_begin + 1;
+        }
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block_info from the db: ", result).c_str()));
+      }
+      const mdb_block_info *bi = ((const mdb_block_info *)v.mv_data) + (height - range_begin);
+      out.push_back(*(const uint64_t*)(((const char*)bi) + offset));
     }
-    else
+  };
+
+  for (uint64_t height = start_height; height < end_height; )
+  {
+    const size_t page_index = height / BLOCK_INFO_COLUMN_PAGE;
+    const uint64_t page_start = page_index * BLOCK_INFO_COLUMN_PAGE;
+    const uint64_t page_end = page_start + BLOCK_INFO_COLUMN_PAGE;
+    const uint64_t rows = std::min(end_height, page_end) - height;
+
+    std::shared_ptr<const std::vector<uint64_t>> page;
+    if (use_columns && page_end <= h)
     {
-      int result = 0;
-      if (range_end > 0)
       {
-        MDB_val k2;
-        result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT_MULTIPLE);
-        range_begin = ((const mdb_block_info*)v.mv_data)->bi_height;
-        range_end = range_begin + v.mv_size / sizeof(mdb_block_info); // whole records please
-        if (height < range_begin || height >= range_end)
-          throw0(DB_ERROR(("Height " + std::to_string(height) + " not included in multiple record range: " + std::to_string(range_begin) + "-" + std::to_string(range_end)).c_str()));
+        boost::unique_lock<boost::mutex> lock(m_block_info_columns_lock);
+        const block_info_column &column = m_block_info_columns[offset];
+        if (page_index < column.size())
+          page = column[page_index];
       }
-      else
+      if (!page)
       {
-        v.mv_size = sizeof(uint64_t);
-        v.mv_data = (void*)&height;
-        result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-        range_begin = height;
-        range_end = range_begin + 1;
+        std::shared_ptr<std::vector<uint64_t>> new_page = std::make_shared<std::vector<uint64_t>>();
+        new_page->reserve(BLOCK_INFO_COLUMN_PAGE);
+        read_rows(page_start, BLOCK_INFO_COLUMN_PAGE, *new_page);
+        page = new_page;
+
+        boost::unique_lock<boost::mutex> lock(m_block_info_columns_lock);
+        if (generation == m_block_info_columns_generation && page_end <= m_block_info_columns_dirty_from)
+        {
+          block_info_column &column = m_block_info_columns[offset];
+          if (column.size() <= page_index)
+            column.resize(page_index + 1);
+          column[page_index] = page;
+        }
       }
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block_info from the db: ", result).c_str()));
     }
-    const mdb_block_info *bi = ((const mdb_block_info *)v.mv_data) + (height - range_begin);
-    ret.push_back(*(const uint64_t*)(((const char*)bi) + offset));
+
+    if (page)
+      ret.insert(ret.end(), page->begin() + (height - page_start), page->begin() + (height - page_start + rows));
+    else
+      read_rows(height, rows, ret);
+    height += rows;
   }
 
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
+void BlockchainLMDB::invalidate_block_info_columns(uint64_t from_height)
+{
+  // called by the writer when it changes blocks from that height: drop the
+  // pages covering them, and keep them out of the cache until the txn ends
+  boost::unique_lock<boost::mutex> lock(m_block_info_columns_lock);
+  const size_t first_page = from_height / BLOCK_INFO_COLUMN_PAGE;
+  for (auto &column: m_block_info_columns)
+    if (column.second.size() > first_page)
+      column.second.resize(first_page);
+  m_block_info_columns_dirty_from = std::min(m_block_info_columns_dirty_from, from_height);
+  ++m_block_info_columns_generation;
+}
+
+void BlockchainLMDB::settle_block_info_columns()
+{
+  boost::unique_lock<boost::mutex> lock(m_block_info_columns_lock);
+  if (m_block_info_columns_dirty_from == std::numeric_limits<uint64_t>::max())
+    return;
+  // pages read during the write txn may predate its end
+  m_block_info_columns_dirty_from = std::numeric_limits<uint64_t>::max();
+  ++m_block_info_columns_generation;
+}
+
 uint64_t BlockchainLMDB::get_max_block_size()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3012,7 +3100,9 @@ bool BlockchainLMDB::get_pruned_tx_blobs_from(const crypto::hash& h, size_t coun
   return true;
 }
 
-bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const
+bool BlockchainLMDB::for_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, bool pruned, bool skip_coinbase, bool get_miner_tx_hash,
+    std::function<bool(const epee::span<const uint8_t>&, const crypto::hash&, size_t)> block_f,
+    std::function<bool(const crypto::hash&, const epee::span<const uint8_t>&, const epee::span<const uint8_t>&)> tx_f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
@@ -3026,15 +3116,16 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
     RCURSOR(txs_prunable);
   }
 
-  blocks.reserve(std::min<size_t>(max_block_count, 10000)); // guard against very large max count if only checking bytes
   const uint64_t blockchain_height = height();
   uint64_t size = 0;
+  size_t num_blocks = 0;
   size_t num_txes = 0;
   MDB_val_copy<uint64_t> key(start_height);
   MDB_val k, v, val_tx_id;
   uint64_t tx_id = ~0;
   MDB_cursor_op op = MDB_SET;
-  for (uint64_t h = start_height; h < blockchain_height && blocks.size() < max_block_count && (size < max_size || blocks.size() < min_block_count); ++h)
+  bool fret = true;
+  for (uint64_t h = start_height; h < blockchain_height && num_blocks < max_block_count && (size < max_size || num_blocks < min_block_count); ++h)
   {
     MDB_cursor_op op = h == start_height ? MDB_SET : MDB_NEXT;
     int result = mdb_cursor_get(m_cur_blocks, &key, &v, op);
@@ -3043,16 +3134,13 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
     else if (result)
       throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block from the db", result).c_str()));
 
-    blocks.resize(blocks.size() + 1);
-    auto &current_block = blocks.back();
-
-    current_block.first.first.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    const epee::span<const uint8_t> block_blob{(const uint8_t*)v.mv_data, v.mv_size};
     size += v.mv_size;
+    ++num_blocks;
 
     cryptonote::block b;
-    if (!parse_and_validate_block_from_blob(current_block.first.first, b))
+    if (!parse_and_validate_block_from_blob(cryptonote::blobdata_ref{(const char*)v.mv_data, v.mv_size}, b))
       throw0(DB_ERROR("Invalid block"));
-    current_block.first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
 
     // get the tx_id for the first tx (the first block's coinbase tx)
     if (h == start_height)
@@ -3069,6 +3157,12 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
       val_tx_id.mv_size = sizeof(tx_id);
     }
 
+    if (!block_f(block_blob, get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash, b.tx_hashes.size()))
+    {
+      fret = false;
+      break;
+    }
+
     if (skip_coinbase)
     {
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
@@ -3084,35 +3178,63 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_cou
 
     op = MDB_NEXT;
 
-    current_block.second.reserve(b.tx_hashes.size());
     num_txes += b.tx_hashes.size() + (skip_coinbase ? 0 : 1);
     for (const auto &tx_hash: b.tx_hashes)
     {
       // get pruned data
-      cryptonote::blobdata tx_blob;
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
       if (result)
         throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      tx_blob.assign((const char*)v.mv_data, v.mv_size);
+      const epee::span<const uint8_t> pruned_blob{(const uint8_t*)v.mv_data, v.mv_size};
+      size += v.mv_size;
 
+      epee::span<const uint8_t> prunable_blob;
       if (!pruned)
       {
         result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
         if (result)
           throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-        tx_blob.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+        prunable_blob = {(const uint8_t*)v.mv_data, v.mv_size};
+        size += v.mv_size;
+      }
+
+      if (!tx_f(tx_hash, pruned_blob, prunable_blob))
+      {
+        fret = false;
+        break;
       }
-      current_block.second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
-      size += current_block.second.back().second.size();
     }
 
-    if(blocks.size() >= min_block_count && num_txes >= max_tx_count)
+    if (!fret || (num_blocks >= min_block_count && num_txes >= max_tx_count))
       break;
   }
 
   TXN_POSTFIX_RDONLY();
 
-  return true;
+  return fret;
+}
+
+bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  blocks.reserve(std::min<size_t>(max_block_count, 10000)); // guard against very large max count if only checking bytes
+  return for_blocks_from(start_height, min_block_count, max_block_count, max_tx_count, max_size, pruned, skip_coinbase, get_miner_tx_hash,
+    [&blocks](const epee::span<const uint8_t> &blob, const crypto::hash &miner_tx_hash, size_t ntxes) {
+      blocks.resize(blocks.size() + 1);
+      blocks.back().first.first.assign((const char*)blob.data(), blob.size());
+      blocks.back().first.second = miner_tx_hash;
+      blocks.back().second.reserve(ntxes);
+      return true;
+    },
+    [&blocks](const crypto::hash &tx_hash, const epee::span<const uint8_t> &pruned_blob, const epee::span<const uint8_t> &prunable_blob) {
+      cryptonote::blobdata tx_blob;
+      tx_blob.reserve(pruned_blob.size() + prunable_blob.size());
+      tx_blob.append((const char*)pruned_blob.data(), pruned_blob.size());
+      tx_blob.append((const char*)prunable_blob.data(), prunable_blob.size());
+      blocks.back().second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
+      return true;
+    });
 }
 
 bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
@@ -3684,6 +3806,7 @@ void BlockchainLMDB::cleanup_batch()
   m_write_batch_txn = nullptr;
   m_batch_active = false;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  settle_block_info_columns();
 }
 
 void BlockchainLMDB::batch_stop()
@@ -3735,6 +3858,7 @@ void BlockchainLMDB::batch_abort()
   m_write_batch_txn = nullptr;
   m_batch_active = false;
   memset(&m_wcursors, 0, sizeof(m_wcursors));
+  settle_block_info_columns();
   LOG_PRINT_L3("batch transaction: aborted");
 }
 
@@ -3852,6 +3976,7 @@ void BlockchainLMDB::block_wtxn_stop()
       delete m_write_txn;
       m_write_txn = nullptr;
       memset(&m_wcursors, 0, sizeof(m_wcursors));
+      settle_block_info_columns();
     }
   }
 }
@@ -3869,6 +3994,7 @@ void BlockchainLMDB::block_wtxn_abort()
     delete m_write_txn;
     m_write_txn = nullptr;
     memset(&m_wcursors, 0, sizeof(m_wcursors));
+    settle_block_info_columns();
   }
 }
 
@@ -3974,7 +4100,20 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
 	  MDB_val_set(k, amount);
 	  MDB_val_set(v, offsets[i]);
 
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    int get_result = MDB_NOTFOUND;
+    // callers sorting their offsets often ask for runs of consecutive outputs,
+    // which are the next duplicates of the same key
+    if (i > 0 && amount == (amounts.size() == 1 ? amounts[0] : amounts[i - 1]) && offsets[i] == offsets[i - 1] + 1)
+    {
+      MDB_val k2, v2;
+      get_result = mdb_cursor_get(m_cur_output_amounts, &k2, &v2, MDB_NEXT_DUP);
+      if (get_result == 0 && ((const pre_rct_outkey *)v2.mv_data)->amount_index == offsets[i])
+        v = v2;
+      else
+        get_result = MDB_NOTFOUND;
+    }
+    if (get_result == MDB_NOTFOUND)
+      get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
     if (get_result == MDB_NOTFOUND)
     {
       if (allow_partial)
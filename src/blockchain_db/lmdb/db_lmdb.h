@@ -27,10 +27,13 @@
 #pragma once
 
 #include <atomic>
+#include <map>
+#include <memory>
 
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/tss.hpp>
 
 #include <lmdb.h>
@@ -256,6 +259,7 @@ public:
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_pruned_tx_blobs_from(const crypto::hash& h, size_t count, std::vector<cryptonote::blobdata> &bd) const;
   virtual bool get_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const;
+  virtual bool for_blocks_from(uint64_t start_height, size_t min_block_count, size_t max_block_count, size_t max_tx_count, size_t max_size, bool pruned, bool skip_coinbase, bool get_miner_tx_hash, std::function<bool(const epee::span<const uint8_t>&, const crypto::hash&, size_t)> block_f, std::function<bool(const crypto::hash&, const epee::span<const uint8_t>&, const epee::span<const uint8_t>&)> tx_f) const;
   virtual bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const;
 
@@ -415,6 +419,8 @@ private:
   virtual uint64_t get_database_size() const;
 
   std::vector<uint64_t> get_block_info_64bit_fields(uint64_t start_height, size_t count, off_t offset) const;
+  void invalidate_block_info_columns(uint64_t from_height);
+  void settle_block_info_columns();
 
   uint64_t get_max_block_size();
   void add_max_block_size(uint64_t sz);
@@ -481,6 +487,15 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  // In memory columns of 64 bit block_info fields, keyed by field offset, in
+  // pages of BLOCK_INFO_COLUMN_PAGE heights. Only pages holding committed
+  // blocks are kept, so bulk reads of those heights are plain copies.
+  typedef std::vector<std::shared_ptr<const std::vector<uint64_t>>> block_info_column;
+  mutable boost::mutex m_block_info_columns_lock;
+  mutable std::map<off_t, block_info_column> m_block_info_columns;
+  uint64_t m_block_info_columns_generation; //!< bumped whenever cached pages may have gone stale
+  uint64_t m_block_info_columns_dirty_from; //!< lowest height changed by the current write txn
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -100,6 +100,11 @@ unsigned int threadpool::get_max_concurrency() const
   return max;
 }
 
+bool threadpool::in_leaf_task()
+{
+  return is_leaf;
+}
+
 threadpool::waiter::~waiter()
 {
   try
@@ -75,6 +75,10 @@ class threadpool
 
   unsigned int get_max_concurrency() const;
 
+  // Whether the calling thread is running a leaf task,
+  // which may not submit tasks of its own.
+  static bool in_leaf_task();
+
   ~threadpool();
 
   private:
@@ -44,6 +44,7 @@
 #define CTHR_THREAD_RETURN	return
 #define CTHR_THREAD_CREATE(thr, func, arg)	thr = (HANDLE)_beginthread(func, 0, arg)
 #define CTHR_THREAD_JOIN(thr)			WaitForSingleObject(thr, INFINITE)
+#define CTHR_THREAD_DETACH(thr)			do {} while(0)
 #else
 #include <pthread.h>
 #define CTHR_MUTEX_TYPE pthread_mutex_t
@@ -55,4 +56,5 @@
 #define CTHR_THREAD_RETURN	return NULL
 #define CTHR_THREAD_CREATE(thr, func, arg)	pthread_create(&thr, NULL, func, arg)
 #define CTHR_THREAD_JOIN(thr)			pthread_join(thr, NULL)
+#define CTHR_THREAD_DETACH(thr)			pthread_detach(thr)
 #endif
@@ -1557,20 +1557,20 @@ static void ge_precomp_cmov(ge_precomp *t, const ge_precomp *u, unsigned char b)
   fe_cmov(t->xy2d, u->xy2d, b);
 }
 
-static void select(ge_precomp *t, int pos, signed char b) {
+static void select(ge_precomp *t, const ge_precomp row[8], signed char b) {
   ge_precomp minust;
   unsigned char bnegative = negative(b);
   unsigned char babs = b - (((-bnegative) & b) << 1);
 
   ge_precomp_0(t);
-  ge_precomp_cmov(t, &ge_base[pos][0], equal(babs, 1));
-  ge_precomp_cmov(t, &ge_base[pos][1], equal(babs, 2));
-  ge_precomp_cmov(t, &ge_base[pos][2], equal(babs, 3));
-  ge_precomp_cmov(t, &ge_base[pos][3], equal(babs, 4));
-  ge_precomp_cmov(t, &ge_base[pos][4], equal(babs, 5));
-  ge_precomp_cmov(t, &ge_base[pos][5], equal(babs, 6));
-  ge_precomp_cmov(t, &ge_base[pos][6], equal(babs, 7));
-  ge_precomp_cmov(t, &ge_base[pos][7], equal(babs, 8));
+  ge_precomp_cmov(t, &row[0], equal(babs, 1));
+  ge_precomp_cmov(t, &row[1], equal(babs, 2));
+  ge_precomp_cmov(t, &row[2], equal(babs, 3));
+  ge_precomp_cmov(t, &row[3], equal(babs, 4));
+  ge_precomp_cmov(t, &row[4], equal(babs, 5));
+  ge_precomp_cmov(t, &row[5], equal(babs, 6));
+  ge_precomp_cmov(t, &row[6], equal(babs, 7));
+  ge_precomp_cmov(t, &row[7], equal(babs, 8));
   fe_copy(minust.yplusx, t->yminusx);
   fe_copy(minust.yminusx, t->yplusx);
   fe_neg(minust.xy2d, t->xy2d);
@@ -1578,15 +1578,16 @@ static void select(ge_precomp *t, int pos, signed char b) {
 }
 
 /*
-h = a * B
+h = a * P
 where a = a[0]+256*a[1]+...+256^31 a[31]
-B is the Ed25519 base point (x,4/5) with x positive.
+and table[i][j] = (j+1)*256^i*P, as made by ge_fixed_base_precomp.
+Runs in constant time, like ge_scalarmult_base.
 
 Preconditions:
   a[31] <= 127
 */
 
-void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+void ge_scalarmult_fixed_base(ge_p3 *h, const unsigned char *a, const ge_fixed_base_table table) {
   signed char e[64];
   signed char carry;
   ge_p1p1 r;
@@ -1613,7 +1614,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
 
   ge_p3_0(h);
   for (i = 1; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 
@@ -1623,11 +1624,60 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   ge_p2_dbl(&r, &s); ge_p1p1_to_p3(h, &r);
 
   for (i = 0; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 }
 
+/*
+h = a * B
+where a = a[0]+256*a[1]+...+256^31 a[31]
+B is the Ed25519 base point (x,4/5) with x positive.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+  ge_scalarmult_fixed_base(h, a, ge_base);
+}
+
+/*
+Fills table with the affine multiples of p used by ge_scalarmult_fixed_base,
+in the layout of ge_base. Not constant time, p is meant to be public.
+*/
+
+void ge_fixed_base_precomp(ge_fixed_base_table table, const ge_p3 *p) {
+  ge_p3 row, multiple;
+  ge_cached row_cached;
+  ge_p1p1 t;
+  fe recip, x, y;
+  int i, j;
+
+  row = *p;
+  for (i = 0; i < 32; ++i) {
+    ge_p3_to_cached(&row_cached, &row);
+    multiple = row;
+    for (j = 0; j < 8; ++j) {
+      if (j > 0) {
+        ge_add(&t, &multiple, &row_cached);
+        ge_p1p1_to_p3(&multiple, &t);
+      }
+      fe_invert(recip, multiple.Z);
+      fe_mul(x, multiple.X, recip);
+      fe_mul(y, multiple.Y, recip);
+      fe_add(table[i][j].yplusx, y, x);
+      fe_sub(table[i][j].yminusx, y, x);
+      fe_mul(table[i][j].xy2d, x, y);
+      fe_mul(table[i][j].xy2d, table[i][j].xy2d, fe_d2);
+    }
+    for (j = 0; j < 8; ++j) {
+      ge_p3_dbl(&t, &row);
+      ge_p1p1_to_p3(&row, &t);
+    }
+  }
+}
+
 /* From ge_sub.c */
 
 /*
@@ -1663,6 +1713,42 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/*
+ * Encodes n points into s (32 bytes each), sharing one field inversion
+ * between all of them (Montgomery's trick). tmp must hold n elements.
+ */
+
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, size_t n, fe *tmp) {
+  fe recip;
+  fe t;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0)
+    return;
+
+  /* tmp[i] = Z_0 * ... * Z_i */
+  fe_copy(tmp[0], h[0].Z);
+  for (i = 1; i < n; ++i)
+    fe_mul(tmp[i], tmp[i - 1], h[i].Z);
+  fe_invert(recip, tmp[n - 1]);
+
+  for (i = n - 1; i > 0; --i) {
+    /* recip is 1 / (Z_0 * ... * Z_i) */
+    fe_mul(t, recip, tmp[i - 1]);
+    fe_mul(recip, recip, h[i].Z);
+    fe_mul(x, h[i].X, t);
+    fe_mul(y, h[i].Y, t);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+  }
+  fe_mul(x, h[0].X, recip);
+  fe_mul(y, h[0].Y, recip);
+  fe_tobytes(s, y);
+  s[31] ^= fe_isnegative(x) << 7;
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /* From fe.h */
 
 typedef int32_t fe[10];
@@ -117,9 +119,16 @@ void ge_p3_tobytes(unsigned char *, const ge_p3 *);
 extern const ge_precomp ge_base[32][8];
 void ge_scalarmult_base(ge_p3 *, const unsigned char *);
 
+/* Same comb as ge_scalarmult_base, for any fixed point */
+
+typedef ge_precomp ge_fixed_base_table[32][8];
+void ge_fixed_base_precomp(ge_fixed_base_table, const ge_p3 *);
+void ge_scalarmult_fixed_base(ge_p3 *, const unsigned char *, const ge_fixed_base_table);
+
 /* From ge_tobytes.c */
 
 void ge_tobytes(unsigned char *, const ge_p2 *);
+void ge_tobytes_batch(unsigned char *, const ge_p2 *, size_t, fe *);
 
 /* From sc_reduce.c */
 
@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -185,6 +186,40 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations(const public_key *keys, std::size_t count, const secret_key &key2, key_derivation *derivations, bool *valid) {
+    // Points are encoded a chunk at a time so one field inversion is shared by
+    // the whole chunk, instead of paying for one per derivation
+    static constexpr size_t chunk_size = 64;
+    ge_p2 points[chunk_size];
+    fe tmp[chunk_size];
+    key_derivation encoded[chunk_size];
+    size_t index[chunk_size];
+    bool all_valid = true;
+
+    assert(sc_check(&key2) == 0);
+    for (size_t start = 0; start < count; start += chunk_size) {
+      const size_t end = std::min(count, start + chunk_size);
+      size_t n = 0;
+      for (size_t i = start; i < end; ++i) {
+        ge_p3 point;
+        ge_p1p1 point3;
+        valid[i] = ge_frombytes_vartime(&point, &keys[i]) == 0;
+        if (!valid[i]) {
+          all_valid = false;
+          continue;
+        }
+        ge_scalarmult(&points[n], &unwrap(key2), &point);
+        ge_mul8(&point3, &points[n]);
+        ge_p1p1_to_p2(&points[n], &point3);
+        index[n++] = i;
+      }
+      ge_tobytes_batch(reinterpret_cast<unsigned char*>(encoded), points, n, tmp);
+      for (size_t i = 0; i < n; ++i)
+        derivations[index[i]] = encoded[i];
+    }
+    return all_valid;
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -118,6 +118,8 @@ namespace crypto {
     friend bool secret_key_to_public_key(const secret_key &, public_key &);
     static bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
     friend bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
+    static bool generate_key_derivations(const public_key *, std::size_t, const secret_key &, key_derivation *, bool *);
+    friend bool generate_key_derivations(const public_key *, std::size_t, const secret_key &, key_derivation *, bool *);
     static void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     friend void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     static bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
@@ -216,6 +218,12 @@ namespace crypto {
   inline bool generate_key_derivation(const public_key &key1, const secret_key &key2, key_derivation &derivation) {
     return crypto_ops::generate_key_derivation(key1, key2, derivation);
   }
+  /* Same as above for count keys sharing one secret key, which is what a wallet does when scanning.
+   * valid[i] is set to whether keys[i] could be used, the return value to whether all could.
+   */
+  inline bool generate_key_derivations(const public_key *keys, std::size_t count, const secret_key &key2, key_derivation *derivations, bool *valid) {
+    return crypto_ops::generate_key_derivations(keys, count, key2, derivations, valid);
+  }
   inline bool derive_public_key(const key_derivation &derivation, std::size_t output_index,
     const public_key &base, public_key &derived_key) {
     return crypto_ops::derive_public_key(derivation, output_index, base, derived_key);
@@ -96,3 +96,6 @@ uint64_t rx_seedheight(const uint64_t height);
 void rx_seedheights(const uint64_t height, uint64_t *seed_height, uint64_t *next_height);
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, char *hash, int miners, int is_alt);
 void rx_reorg(const uint64_t split_height);
+void rx_set_dataset_dir(const char *dir, int prepare);
+void rx_prepare_dataset(const uint64_t seedheight, const char *seedhash, int threads);
+void rx_set_numa_affinity(unsigned int thread_index);
@@ -26,6 +26,9 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* sched_getcpu, pthread_setaffinity_np */
+#endif
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -35,6 +38,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#endif
 
 #include "randomx.h"
 #include "c_threads.h"
@@ -45,26 +55,66 @@
 
 #if defined(_MSC_VER)
 #define THREADV __declspec(thread)
+#define RX_ATOMIC_ADD(x, v)	InterlockedExchangeAdd(&(x), (v))
+#define RX_ATOMIC_LOAD(x)	InterlockedCompareExchange(&(x), 0, 0)
+#define RX_ATOMIC_STORE(x, v)	InterlockedExchange(&(x), (v))
 #else
 #define THREADV __thread
+#define RX_ATOMIC_ADD(x, v)	__atomic_add_fetch(&(x), (v), __ATOMIC_SEQ_CST)
+#define RX_ATOMIC_LOAD(x)	__atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define RX_ATOMIC_STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#endif
+
+#ifdef _WIN32
+#define rx_yield()	SwitchToThread()
+#else
+#define rx_yield()	sched_yield()
 #endif
 
+typedef struct rx_rwlock {
+  long rw_readers;	/* hashers using the data without holding its mutex */
+  long rw_updating;	/* set while the mutex holder changes the data */
+} rx_rwlock;
+
 typedef struct rx_state {
   CTHR_MUTEX_TYPE rs_mutex;
   char rs_hash[HASH_SIZE];
   uint64_t  rs_height;
   randomx_cache *rs_cache;
+  rx_rwlock rs_rw;	/* guards rs_cache and the seed against hashers not holding rs_mutex */
 } rx_state;
 
 static CTHR_MUTEX_TYPE rx_mutex = CTHR_MUTEX_INIT;
 static CTHR_MUTEX_TYPE rx_dataset_mutex = CTHR_MUTEX_INIT;
 
-static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0},{CTHR_MUTEX_INIT,{0},0,0}};
+static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0,{0,0}},{CTHR_MUTEX_INIT,{0},0,0,{0,0}}};
 
 static randomx_dataset *rx_dataset;
 static int rx_dataset_nomem;
 static uint64_t rx_dataset_height;
+static char rx_dataset_hash[HASH_SIZE];
+static int rx_dataset_hash_valid;
+/* miners hash with rx_dataset without holding rx_dataset_mutex, which
+ * rebuilds and frees it only once they have drained */
+static rx_rwlock rx_dataset_rw;
+/* bumped whenever rx_dataset gets rebuilt, freed or invalidated */
+static long rx_dataset_gen;
 static THREADV randomx_vm *rx_vm = NULL;
+static THREADV int rx_vm_fullmem;
+/* the seed this thread's light VM was last set up for; slot caches get
+ * reseeded in place, so the cache pointer alone says nothing */
+static THREADV char rx_vm_hash[HASH_SIZE];
+static THREADV int rx_vm_hash_valid;
+/* for a full memory VM, the rx_dataset_gen it last hashed with */
+static THREADV long rx_vm_dataset_gen;
+
+/* on-disk dataset cache, shared across restarts and between processes */
+static CTHR_MUTEX_TYPE rx_file_mutex = CTHR_MUTEX_INIT;
+static char *rx_dataset_dir;
+static int rx_prepare_enabled;
+static int rx_prepare_running;
+static int rx_prepared_valid;
+static char rx_prepared_hash[HASH_SIZE];
 
 static void local_abort(const char *msg)
 {
@@ -113,6 +163,180 @@ static inline int enabled_flags(void) {
   return flags;
 }
 
+static size_t rx_dataset_bytes(void) {
+  return (size_t)randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE;
+}
+
+/* Mainchain hashers take a slot's seed, and miners the dataset, without
+ * any lock: they announce themselves in rw_readers, then back off if a
+ * change is under way. A change (made with the data's mutex held) announces
+ * itself in rw_updating, then waits for the readers to drain before
+ * touching the data. */
+static int rx_reader_enter(rx_rwlock *rw) {
+  RX_ATOMIC_ADD(rw->rw_readers, 1);
+  if (RX_ATOMIC_LOAD(rw->rw_updating)) {
+    RX_ATOMIC_ADD(rw->rw_readers, -1);
+    return 0;
+  }
+  return 1;
+}
+
+static void rx_reader_leave(rx_rwlock *rw) {
+  RX_ATOMIC_ADD(rw->rw_readers, -1);
+}
+
+static void rx_writer_enter(rx_rwlock *rw) {
+  RX_ATOMIC_STORE(rw->rw_updating, 1);
+  while (RX_ATOMIC_LOAD(rw->rw_readers) != 0)
+    rx_yield();
+}
+
+static void rx_writer_leave(rx_rwlock *rw) {
+  RX_ATOMIC_STORE(rw->rw_updating, 0);
+}
+
+#if defined(__linux__)
+#define RX_NUMA_NODES_MAX 16
+
+/* NUMA placement is opt-in: every node beyond the first gets its own copy
+ * of the 2GB dataset, and miner threads are pinned to the nodes in turn. */
+static int rx_numa_nodes = -1;
+static cpu_set_t rx_numa_cpus[RX_NUMA_NODES_MAX];
+static randomx_dataset *rx_numa_dataset[RX_NUMA_NODES_MAX];
+static int rx_dataset_node;
+
+static int rx_parse_cpulist(const char *list, cpu_set_t *set) {
+  int found = 0;
+  CPU_ZERO(set);
+  while (*list) {
+    char *end;
+    unsigned long first = strtoul(list, &end, 10), last;
+    if (end == list)
+      break;
+    last = first;
+    if (*end == '-')
+      last = strtoul(end + 1, &end, 10);
+    for (; first <= last && first < CPU_SETSIZE; first++) {
+      CPU_SET(first, set);
+      found = 1;
+    }
+    list = end;
+    if (*list == ',')
+      list++;
+    else
+      break;
+  }
+  return found;
+}
+
+static int rx_numa_init(void) {
+  static CTHR_MUTEX_TYPE rx_numa_mutex = CTHR_MUTEX_INIT;
+  const char *env;
+  int n;
+  CTHR_MUTEX_LOCK(rx_numa_mutex);
+  if (rx_numa_nodes >= 0) {
+    CTHR_MUTEX_UNLOCK(rx_numa_mutex);
+    return rx_numa_nodes;
+  }
+  n = 0;
+  env = getenv("WALLSTREETBETS_RANDOMX_NUMA");
+  if (env && atoi(env) > 0) {
+    for (; n < RX_NUMA_NODES_MAX; n++) {
+      char path[64], list[1024];
+      FILE *f;
+      size_t len;
+      snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+      f = fopen(path, "r");
+      if (f == NULL)
+        break;
+      len = fread(list, 1, sizeof(list) - 1, f);
+      fclose(f);
+      list[len] = 0;
+      if (!rx_parse_cpulist(list, &rx_numa_cpus[n]))
+        break;
+    }
+    if (n > 1)
+      minfo(RX_LOGCAT, "Using %d NUMA nodes for RandomX mining", n);
+    else
+      n = 0;
+  }
+  RX_ATOMIC_STORE(rx_numa_nodes, n);
+  CTHR_MUTEX_UNLOCK(rx_numa_mutex);
+  return n;
+}
+
+static int rx_numa_node(void) {
+  int cpu = sched_getcpu(), i;
+  if (cpu >= 0) {
+    for (i=0; i<rx_numa_nodes; i++)
+      if (CPU_ISSET(cpu, &rx_numa_cpus[i]))
+        return i;
+  }
+  return 0;
+}
+
+static CTHR_THREAD_RTYPE rx_numa_copythread(void *arg) {
+  const int node = (int)(intptr_t)arg;
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &rx_numa_cpus[node]);
+  /* large pages are populated on allocation, so the copy is local to this node */
+  if (rx_numa_dataset[node] == NULL)
+    rx_numa_dataset[node] = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+  if (rx_numa_dataset[node] == NULL)
+    rx_numa_dataset[node] = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+  if (rx_numa_dataset[node] != NULL)
+    memcpy(randomx_get_dataset_memory(rx_numa_dataset[node]), randomx_get_dataset_memory(rx_dataset), rx_dataset_bytes());
+  else
+    mwarning(RX_LOGCAT, "Couldn't allocate RandomX dataset for NUMA node %d", node);
+  CTHR_THREAD_RETURN;
+}
+
+/* Refreshes the per-node copies; the caller must hold rx_dataset_mutex */
+static void rx_numa_replicate(void) {
+  CTHR_THREAD_TYPE st[RX_NUMA_NODES_MAX];
+  int i;
+  if (rx_numa_nodes < 2)
+    return;
+  for (i=0; i<rx_numa_nodes; i++)
+    if (i != rx_dataset_node)
+      CTHR_THREAD_CREATE(st[i], rx_numa_copythread, (void*)(intptr_t)i);
+  for (i=0; i<rx_numa_nodes; i++)
+    if (i != rx_dataset_node)
+      CTHR_THREAD_JOIN(st[i]);
+}
+
+static void rx_numa_release(void) {
+  int i;
+  for (i=0; i<RX_NUMA_NODES_MAX; i++) {
+    if (rx_numa_dataset[i] != NULL) {
+      randomx_release_dataset(rx_numa_dataset[i]);
+      rx_numa_dataset[i] = NULL;
+    }
+  }
+}
+
+/* The dataset copy closest to the calling thread */
+static randomx_dataset *rx_local_dataset(void) {
+  if (rx_numa_nodes > 1) {
+    int node = rx_numa_node();
+    if (node != rx_dataset_node && rx_numa_dataset[node] != NULL)
+      return rx_numa_dataset[node];
+  }
+  return rx_dataset;
+}
+#else
+static randomx_dataset *rx_local_dataset(void) {
+  return rx_dataset;
+}
+#endif
+
+void rx_set_numa_affinity(unsigned int thread_index) {
+#if defined(__linux__)
+  int nodes = rx_numa_init();
+  if (nodes > 1 && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &rx_numa_cpus[thread_index % nodes]) != 0)
+    mwarning(RX_LOGCAT, "Couldn't pin RandomX miner thread to NUMA node %u", thread_index % nodes);
+#endif
+}
+
 #define SEEDHASH_EPOCH_BLOCKS 2048	/* Must be same as BLOCKS_SYNCHRONIZING_MAX_COUNT in cryptonote_config.h */
 #define SEEDHASH_EPOCH_LAG 64
 
@@ -121,9 +345,17 @@ void rx_reorg(const uint64_t split_height) {
   CTHR_MUTEX_LOCK(rx_mutex);
   for (i=0; i<2; i++) {
     if (split_height <= rx_s[i].rs_height) {
-      if (rx_s[i].rs_height == rx_dataset_height)
+      CTHR_MUTEX_LOCK(rx_s[i].rs_mutex);
+      rx_writer_enter(&rx_s[i].rs_rw);
+      CTHR_MUTEX_LOCK(rx_dataset_mutex);
+      if (rx_s[i].rs_height == rx_dataset_height) {
         rx_dataset_height = 1;
+        RX_ATOMIC_ADD(rx_dataset_gen, 1);
+      }
+      CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
       rx_s[i].rs_height = 1;	/* set to an invalid seed height */
+      rx_writer_leave(&rx_s[i].rs_rw);
+      CTHR_MUTEX_UNLOCK(rx_s[i].rs_mutex);
     }
   }
   CTHR_MUTEX_UNLOCK(rx_mutex);
@@ -141,6 +373,7 @@ void rx_seedheights(const uint64_t height, uint64_t *seedheight, uint64_t *nexth
 }
 
 typedef struct seedinfo {
+  randomx_dataset *si_dataset;
   randomx_cache *si_cache;
   unsigned long si_start;
   unsigned long si_count;
@@ -148,11 +381,11 @@ typedef struct seedinfo {
 
 static CTHR_THREAD_RTYPE rx_seedthread(void *arg) {
   seedinfo *si = arg;
-  randomx_init_dataset(rx_dataset, si->si_cache, si->si_start, si->si_count);
+  randomx_init_dataset(si->si_dataset, si->si_cache, si->si_start, si->si_count);
   CTHR_THREAD_RETURN;
 }
 
-static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_t seedheight) {
+static void rx_filldata(randomx_dataset *dataset, randomx_cache *rs_cache, const int miners) {
   if (miners > 1) {
     unsigned long delta = randomx_dataset_item_count() / miners;
     unsigned long start = 0;
@@ -168,27 +401,356 @@ static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_
       local_abort("Couldn't allocate RandomX mining threadlist");
     }
     for (i=0; i<miners-1; i++) {
+      si[i].si_dataset = dataset;
       si[i].si_cache = rs_cache;
       si[i].si_start = start;
       si[i].si_count = delta;
       start += delta;
     }
+    si[i].si_dataset = dataset;
     si[i].si_cache = rs_cache;
     si[i].si_start = start;
     si[i].si_count = randomx_dataset_item_count() - start;
     for (i=1; i<miners; i++) {
       CTHR_THREAD_CREATE(st[i], rx_seedthread, &si[i]);
     }
-    randomx_init_dataset(rx_dataset, rs_cache, 0, si[0].si_count);
+    randomx_init_dataset(dataset, rs_cache, 0, si[0].si_count);
     for (i=1; i<miners; i++) {
       CTHR_THREAD_JOIN(st[i]);
     }
     free(st);
     free(si);
   } else {
-    randomx_init_dataset(rx_dataset, rs_cache, 0, randomx_dataset_item_count());
+    randomx_init_dataset(dataset, rs_cache, 0, randomx_dataset_item_count());
   }
+}
+
+#ifndef _WIN32
+/* Dataset files are named after their seed hash and start with a header
+ * carrying that hash and a checksum of the data, which are checked before
+ * the file is used. They are written to a private temporary file first and
+ * renamed into place, so readers only ever see complete files. The caller
+ * must hold rx_file_mutex or own a copy of the directory name. */
+#define RX_DATASET_MAGIC	"RXDSET01"
+
+typedef struct rx_dataset_header {
+  char dh_magic[8];
+  uint64_t dh_size;
+  char dh_hash[HASH_SIZE];
+  uint64_t dh_checksum;
+  char dh_reserved[8];
+} rx_dataset_header;
+
+static int rx_dataset_path(char *path, size_t size, const char *dir, const char *seedhash, const char *suffix) {
+  static const char hexchars[] = "0123456789abcdef";
+  char hex[HASH_SIZE * 2 + 1];
+  int i, len;
+  for (i=0; i<HASH_SIZE; i++) {
+    hex[i*2] = hexchars[((const unsigned char*)seedhash)[i] >> 4];
+    hex[i*2+1] = hexchars[((const unsigned char*)seedhash)[i] & 0xf];
+  }
+  hex[HASH_SIZE * 2] = 0;
+  len = snprintf(path, size, "%s/randomx-%s.dat%s", dir, hex, suffix);
+  return len > 0 && (size_t)len < size;
+}
+
+/* FNV-1a over 64 bit words; catches truncated, torn or otherwise damaged
+ * files at memory speed. The dataset size is a multiple of 64 bytes. */
+static uint64_t rx_dataset_checksum(uint64_t sum, const void *data, size_t size) {
+  const unsigned char *p = data;
+  uint64_t w;
+  size_t i;
+  for (i=0; i<size; i+=sizeof(w)) {
+    memcpy(&w, p + i, sizeof(w));
+    sum = (sum ^ w) * 0x100000001b3ULL;
+  }
+  return sum;
+}
+
+#define RX_CHECKSUM_INIT	0xcbf29ce484222325ULL
+
+static int rx_dataset_header_ok(const rx_dataset_header *dh, const char *seedhash) {
+  return !memcmp(dh->dh_magic, RX_DATASET_MAGIC, sizeof(dh->dh_magic)) && dh->dh_size == rx_dataset_bytes() &&
+    !memcmp(dh->dh_hash, seedhash, HASH_SIZE);
+}
+
+static int rx_dataset_file_exists(const char *dir, const char *seedhash) {
+  char path[PATH_MAX];
+  struct stat st;
+  rx_dataset_header dh;
+  int fd, ok;
+  if (!rx_dataset_path(path, sizeof(path), dir, seedhash, ""))
+    return 0;
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  ok = fstat(fd, &st) == 0 && (size_t)st.st_size == sizeof(dh) + rx_dataset_bytes() &&
+    read(fd, &dh, sizeof(dh)) == (ssize_t)sizeof(dh) && rx_dataset_header_ok(&dh, seedhash);
+  close(fd);
+  return ok;
+}
+
+/* Recomputes a few items from the seed's cache and compares them with the
+ * loaded data, so a file that passed its checksum but was built from the
+ * wrong seed (or by a broken build) is still caught. */
+static int rx_dataset_spotcheck(randomx_dataset *dataset, randomx_cache *cache) {
+  unsigned char *mem = randomx_get_dataset_memory(dataset);
+  const unsigned long count = randomx_dataset_item_count();
+  unsigned char item[RANDOMX_DATASET_ITEM_SIZE];
+  unsigned long i, index;
+  int ok = 1;
+  for (i=0; i<8; i++) {
+    index = (unsigned long)(((uint64_t)count * (2*i+1)) / 16);
+    memcpy(item, mem + index * RANDOMX_DATASET_ITEM_SIZE, sizeof(item));
+    randomx_init_dataset(dataset, cache, index, 1);
+    if (memcmp(item, mem + index * RANDOMX_DATASET_ITEM_SIZE, sizeof(item)))
+      ok = 0;
+  }
+  return ok;
+}
+
+static int rx_dataset_load(randomx_dataset *dataset, randomx_cache *cache, const char *dir, const char *seedhash) {
+  char path[PATH_MAX];
+  struct stat st;
+  const size_t size = rx_dataset_bytes();
+  const size_t chunk = (size_t)1 << 24;
+  rx_dataset_header dh;
+  unsigned char *mem = randomx_get_dataset_memory(dataset);
+  const unsigned char *data;
+  uint64_t sum = RX_CHECKSUM_INIT;
+  size_t off, n;
+  void *map;
+  int fd;
+  if (!rx_dataset_path(path, sizeof(path), dir, seedhash, ""))
+    return 0;
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(dh) + size) {
+    close(fd);
+    goto bad;
+  }
+  map = mmap(NULL, sizeof(dh) + size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 0;
+  madvise(map, sizeof(dh) + size, MADV_SEQUENTIAL);
+  memcpy(&dh, map, sizeof(dh));
+  if (!rx_dataset_header_ok(&dh, seedhash)) {
+    munmap(map, sizeof(dh) + size);
+    goto bad;
+  }
+  /* checksum each chunk while it is still in cache from the copy */
+  data = (const unsigned char *)map + sizeof(dh);
+  for (off=0; off<size; off+=n) {
+    n = size - off < chunk ? size - off : chunk;
+    memcpy(mem + off, data + off, n);
+    sum = rx_dataset_checksum(sum, mem + off, n);
+  }
+  munmap(map, sizeof(dh) + size);
+  if (sum != dh.dh_checksum || !rx_dataset_spotcheck(dataset, cache))
+    goto bad;
+  minfo(RX_LOGCAT, "Loaded RandomX dataset from %s", path);
+  return 1;
+bad:
+  mwarning(RX_LOGCAT, "Ignoring invalid RandomX dataset file %s", path);
+  unlink(path);
+  return 0;
+}
+
+static void rx_dataset_save(randomx_dataset *dataset, const char *dir, const char *seedhash) {
+  char path[PATH_MAX], tmp_path[PATH_MAX];
+  const char *data = randomx_get_dataset_memory(dataset);
+  size_t left = rx_dataset_bytes();
+  rx_dataset_header dh;
+  int fd;
+  if (!rx_dataset_path(path, sizeof(path), dir, seedhash, "") || !rx_dataset_path(tmp_path, sizeof(tmp_path), dir, seedhash, ".XXXXXX"))
+    return;
+  /* a fresh file of our own, so concurrent writers never share one; the
+   * last complete rename wins and both contents are identical */
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    mwarning(RX_LOGCAT, "Couldn't create RandomX dataset file in %s", dir);
+    return;
+  }
+  memset(&dh, 0, sizeof(dh));
+  memcpy(dh.dh_magic, RX_DATASET_MAGIC, sizeof(dh.dh_magic));
+  dh.dh_size = left;
+  memcpy(dh.dh_hash, seedhash, HASH_SIZE);
+  dh.dh_checksum = rx_dataset_checksum(RX_CHECKSUM_INIT, data, left);
+  if (fchmod(fd, 0644) != 0 || write(fd, &dh, sizeof(dh)) != (ssize_t)sizeof(dh))
+    goto fail;
+  while (left > 0) {
+    ssize_t w = write(fd, data, left);
+    if (w <= 0)
+      goto fail;
+    data += w;
+    left -= w;
+  }
+  if (fsync(fd) != 0 || rename(tmp_path, path) != 0)
+    goto fail;
+  close(fd);
+  minfo(RX_LOGCAT, "Saved RandomX dataset to %s", path);
+  return;
+fail:
+  mwarning(RX_LOGCAT, "Couldn't write RandomX dataset file %s", tmp_path);
+  unlink(tmp_path);
+  close(fd);
+}
+
+static void rx_dataset_remove(const char *dir, const char *seedhash) {
+  char path[PATH_MAX];
+  if (rx_dataset_path(path, sizeof(path), dir, seedhash, ""))
+    unlink(path);
+}
+#endif
+
+static char *rx_get_dataset_dir(void) {
+  char *dir = NULL;
+  CTHR_MUTEX_LOCK(rx_file_mutex);
+  if (rx_dataset_dir != NULL)
+    dir = strdup(rx_dataset_dir);
+  CTHR_MUTEX_UNLOCK(rx_file_mutex);
+  return dir;
+}
+
+/* The caller must hold rx_dataset_mutex, and not be a reader of rx_dataset_rw */
+static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_t seedheight, const char *seedhash) {
+  char *dir = rx_get_dataset_dir();
+  int loaded = 0;
+  rx_writer_enter(&rx_dataset_rw);
+#ifndef _WIN32
+  if (dir != NULL)
+    loaded = rx_dataset_load(rx_dataset, rs_cache, dir, seedhash);
+#endif
+  if (!loaded)
+    rx_filldata(rx_dataset, rs_cache, miners);
+#ifndef _WIN32
+  if (dir != NULL) {
+    if (!loaded)
+      rx_dataset_save(rx_dataset, dir, seedhash);
+    /* the previous epoch's file is of no further use */
+    if (rx_dataset_hash_valid && memcmp(rx_dataset_hash, seedhash, HASH_SIZE))
+      rx_dataset_remove(dir, rx_dataset_hash);
+  }
+#endif
+  free(dir);
+#if defined(__linux__)
+  rx_numa_replicate();
+#endif
   rx_dataset_height = seedheight;
+  memcpy(rx_dataset_hash, seedhash, HASH_SIZE);
+  rx_dataset_hash_valid = 1;
+  RX_ATOMIC_ADD(rx_dataset_gen, 1);
+  rx_writer_leave(&rx_dataset_rw);
+}
+
+/* Whether rx_dataset is built for the given seed; the caller must hold rx_dataset_mutex */
+static int rx_dataset_current(const uint64_t seedheight, const char *seedhash) {
+  return rx_dataset_height == seedheight && rx_dataset_hash_valid && !memcmp(rx_dataset_hash, seedhash, HASH_SIZE);
+}
+
+/* Makes the calling thread's full memory VM a reader of rx_dataset until it
+ * calls rx_reader_leave; the caller must hold rx_dataset_mutex */
+static void rx_dataset_reader_locked(const char *seedhash) {
+  RX_ATOMIC_ADD(rx_dataset_rw.rw_readers, 1);
+  rx_vm_dataset_gen = RX_ATOMIC_LOAD(rx_dataset_gen);
+  memcpy(rx_vm_hash, seedhash, HASH_SIZE);
+  rx_vm_hash_valid = 1;
+}
+
+typedef struct prepareinfo {
+  char pi_hash[HASH_SIZE];
+  char *pi_dir;
+  int pi_threads;
+} prepareinfo;
+
+static CTHR_THREAD_RTYPE rx_preparethread(void *arg) {
+  prepareinfo *pi = arg;
+#ifndef _WIN32
+  randomx_flags flags = enabled_flags() & ~disabled_flags();
+  randomx_cache *cache;
+  randomx_dataset *dataset;
+  cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+  if (cache == NULL)
+    cache = randomx_alloc_cache(flags);
+  dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+  if (dataset == NULL)
+    dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+  if (cache != NULL && dataset != NULL) {
+    randomx_init_cache(cache, pi->pi_hash, HASH_SIZE);
+    rx_filldata(dataset, cache, pi->pi_threads);
+    rx_dataset_save(dataset, pi->pi_dir, pi->pi_hash);
+  } else {
+    mwarning(RX_LOGCAT, "Couldn't allocate memory to prepare the next RandomX dataset");
+  }
+  if (dataset != NULL)
+    randomx_release_dataset(dataset);
+  if (cache != NULL)
+    randomx_release_cache(cache);
+#endif
+  free(pi->pi_dir);
+  free(pi);
+  CTHR_MUTEX_LOCK(rx_file_mutex);
+  rx_prepare_running = 0;
+  CTHR_MUTEX_UNLOCK(rx_file_mutex);
+  CTHR_THREAD_RETURN;
+}
+
+void rx_set_dataset_dir(const char *dir, int prepare) {
+  CTHR_MUTEX_LOCK(rx_file_mutex);
+  free(rx_dataset_dir);
+  rx_dataset_dir = dir ? strdup(dir) : NULL;
+  rx_prepare_enabled = prepare;
+  rx_prepared_valid = 0;
+  CTHR_MUTEX_UNLOCK(rx_file_mutex);
+}
+
+/* Builds the dataset for an upcoming seed in the background, so that the
+ * epoch switch only has to load it from disk. The dataset in use can't be
+ * borrowed for this, so it costs a second full dataset's worth of memory
+ * while it runs, and is only done when asked for. */
+void rx_prepare_dataset(const uint64_t seedheight, const char *seedhash, int threads) {
+#ifndef _WIN32
+  prepareinfo *pi;
+  CTHR_THREAD_TYPE thread;
+  CTHR_MUTEX_LOCK(rx_file_mutex);
+  if (rx_dataset_dir == NULL || !rx_prepare_enabled || rx_prepare_running || (rx_prepared_valid && !memcmp(rx_prepared_hash, seedhash, HASH_SIZE))) {
+    CTHR_MUTEX_UNLOCK(rx_file_mutex);
+    return;
+  }
+  memcpy(rx_prepared_hash, seedhash, HASH_SIZE);
+  rx_prepared_valid = 1;
+  if (rx_dataset_file_exists(rx_dataset_dir, seedhash)) {
+    CTHR_MUTEX_UNLOCK(rx_file_mutex);
+    return;
+  }
+  pi = malloc(sizeof(prepareinfo));
+  if (pi == NULL) {
+    CTHR_MUTEX_UNLOCK(rx_file_mutex);
+    return;
+  }
+  memcpy(pi->pi_hash, seedhash, HASH_SIZE);
+  pi->pi_dir = strdup(rx_dataset_dir);
+  pi->pi_threads = threads > 0 ? threads : 1;
+  if (pi->pi_dir == NULL) {
+    free(pi);
+    CTHR_MUTEX_UNLOCK(rx_file_mutex);
+    return;
+  }
+  rx_prepare_running = 1;
+  CTHR_MUTEX_UNLOCK(rx_file_mutex);
+  minfo(RX_LOGCAT, "Preparing RandomX dataset for seed height %llu", (unsigned long long)seedheight);
+  if (CTHR_THREAD_CREATE(thread, rx_preparethread, pi) != 0) {
+    free(pi->pi_dir);
+    free(pi);
+    CTHR_MUTEX_LOCK(rx_file_mutex);
+    rx_prepare_running = 0;
+    CTHR_MUTEX_UNLOCK(rx_file_mutex);
+    return;
+  }
+  CTHR_THREAD_DETACH(thread);
+#endif
 }
 
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
@@ -198,6 +760,30 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   randomx_flags flags = enabled_flags() & ~disabled_flags();
   rx_state *rx_sp;
   randomx_cache *cache;
+  int dataset_reader = 0;
+
+  /* the usual case, a mainchain hash with a VM already set up for the
+   * current seed, doesn't need to take the seed locks */
+  if (!is_alt && s_height == seedheight && rx_vm != NULL && (miners != 0) == rx_vm_fullmem) {
+    rx_sp = &rx_s[toggle];
+    if (rx_reader_enter(&rx_sp->rs_rw)) {
+      if (rx_sp->rs_cache != NULL && rx_sp->rs_height == seedheight && !memcmp(rx_sp->rs_hash, seedhash, HASH_SIZE)) {
+        /* a full memory VM also needs the dataset it hashed with last to
+         * be there still, unchanged */
+        if (rx_vm_hash_valid && !memcmp(rx_vm_hash, seedhash, HASH_SIZE) && (!miners || rx_reader_enter(&rx_dataset_rw))) {
+          if (!miners || RX_ATOMIC_LOAD(rx_dataset_gen) == rx_vm_dataset_gen) {
+            randomx_calculate_hash(rx_vm, data, length, hash);
+            if (miners)
+              rx_reader_leave(&rx_dataset_rw);
+            rx_reader_leave(&rx_sp->rs_rw);
+            return;
+          }
+          rx_reader_leave(&rx_dataset_rw);
+        }
+      }
+      rx_reader_leave(&rx_sp->rs_rw);
+    }
+  }
 
   CTHR_MUTEX_LOCK(rx_mutex);
 
@@ -233,10 +819,12 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     }
   }
   if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, HASH_SIZE)) {
+    rx_writer_enter(&rx_sp->rs_rw);
     randomx_init_cache(cache, seedhash, HASH_SIZE);
     rx_sp->rs_cache = cache;
     rx_sp->rs_height = seedheight;
     memcpy(rx_sp->rs_hash, seedhash, HASH_SIZE);
+    rx_writer_leave(&rx_sp->rs_rw);
   }
   if (rx_vm == NULL) {
     if ((flags & RANDOMX_FLAG_JIT) && !miners) {
@@ -249,18 +837,24 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
       CTHR_MUTEX_LOCK(rx_dataset_mutex);
       if (!rx_dataset_nomem) {
         if (rx_dataset == NULL) {
+#if defined(__linux__)
+          if (rx_numa_init() > 1)
+            rx_dataset_node = rx_numa_node();
+#endif
           rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
           if (rx_dataset == NULL) {
             mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX dataset");
             rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
           }
-          if (rx_dataset != NULL)
-            rx_initdata(rx_sp->rs_cache, miners, seedheight);
         }
+        if (rx_dataset != NULL && !rx_dataset_current(seedheight, seedhash))
+          rx_initdata(rx_sp->rs_cache, miners, seedheight, seedhash);
       }
-      if (rx_dataset != NULL)
+      if (rx_dataset != NULL) {
         flags |= RANDOMX_FLAG_FULL_MEM;
-      else {
+        rx_dataset_reader_locked(seedhash);
+        dataset_reader = 1;
+      } else {
         miners = 0;
         if (!rx_dataset_nomem) {
           rx_dataset_nomem = 1;
@@ -269,37 +863,57 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
       }
       CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
     }
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
-    if(rx_vm == NULL) { //large pages failed
-      mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
-    }
-    if(rx_vm == NULL) {//fallback if everything fails
-      flags = RANDOMX_FLAG_DEFAULT | (miners ? RANDOMX_FLAG_FULL_MEM : 0);
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
+    {
+      randomx_dataset *dataset = miners ? rx_local_dataset() : rx_dataset;
+      rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, dataset);
+      if(rx_vm == NULL) { //large pages failed
+        mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
+        rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, dataset);
+      }
+      if(rx_vm == NULL) {//fallback if everything fails
+        flags = RANDOMX_FLAG_DEFAULT | (miners ? RANDOMX_FLAG_FULL_MEM : 0);
+        rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, dataset);
+      }
     }
     if (rx_vm == NULL)
       local_abort("Couldn't allocate RandomX VM");
+    rx_vm_fullmem = (flags & RANDOMX_FLAG_FULL_MEM) != 0;
+    memcpy(rx_vm_hash, seedhash, HASH_SIZE);
+    rx_vm_hash_valid = 1;
   } else if (miners) {
     CTHR_MUTEX_LOCK(rx_dataset_mutex);
-    if (rx_dataset != NULL && rx_dataset_height != seedheight)
-      rx_initdata(cache, miners, seedheight);
-    else if (rx_dataset == NULL) {
+    if (rx_dataset != NULL && rx_vm_fullmem) {
+      if (!rx_dataset_current(seedheight, seedhash))
+        rx_initdata(cache, miners, seedheight, seedhash);
+      rx_dataset_reader_locked(seedhash);
+      dataset_reader = 1;
+    } else {
       /* this is a no-op if the cache hasn't changed */
       randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
+      memcpy(rx_vm_hash, seedhash, HASH_SIZE);
+      rx_vm_hash_valid = 1;
     }
     CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
   } else {
     /* this is a no-op if the cache hasn't changed */
     randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
+    memcpy(rx_vm_hash, seedhash, HASH_SIZE);
+    rx_vm_hash_valid = 1;
   }
-  /* mainchain users can run in parallel */
-  if (!is_alt)
+  /* mainchain users can run in parallel, but keep the seed from
+   * changing under them until they're done */
+  if (!is_alt) {
+    RX_ATOMIC_ADD(rx_sp->rs_rw.rw_readers, 1);
     CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+  }
   randomx_calculate_hash(rx_vm, data, length, hash);
+  if (dataset_reader)
+    rx_reader_leave(&rx_dataset_rw);
   /* altchain slot users always get fully serialized */
   if (is_alt)
     CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+  else
+    rx_reader_leave(&rx_sp->rs_rw);
 }
 
 void rx_slow_hash_allocate_state(void) {
@@ -309,16 +923,24 @@ void rx_slow_hash_free_state(void) {
   if (rx_vm != NULL) {
     randomx_destroy_vm(rx_vm);
     rx_vm = NULL;
+    rx_vm_fullmem = 0;
+    rx_vm_hash_valid = 0;
   }
 }
 
 void rx_stop_mining(void) {
   CTHR_MUTEX_LOCK(rx_dataset_mutex);
+  rx_writer_enter(&rx_dataset_rw);
   if (rx_dataset != NULL) {
     randomx_dataset *rd = rx_dataset;
     rx_dataset = NULL;
     randomx_release_dataset(rd);
   }
+#if defined(__linux__)
+  rx_numa_release();
+#endif
   rx_dataset_nomem = 0;
+  RX_ATOMIC_ADD(rx_dataset_gen, 1);
+  rx_writer_leave(&rx_dataset_rw);
   CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
 }
@@ -1251,15 +1251,22 @@ namespace cryptonote
     return res;
   }
   //---------------------------------------------------------------
-  bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash)
+  bool parse_and_validate_block_from_blob(const blobdata_ref& b_blob, block& b)
   {
     std::stringstream ss;
-    ss << b_blob;
+    ss.write(b_blob.data(), b_blob.size());
     binary_archive<false> ba(ss);
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
     b.invalidate_hashes();
     b.miner_tx.invalidate_hashes();
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash)
+  {
+    if (!parse_and_validate_block_from_blob(blobdata_ref{b_blob.data(), b_blob.size()}, b))
+      return false;
     if(block_hash)
     {
       calculate_block_hash(b, *block_hash, &b_blob);
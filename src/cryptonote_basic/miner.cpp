@@ -326,6 +326,7 @@ namespace cryptonote
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 1);
   }
   extern "C" void rx_stop_mining(void);
+  extern "C" void rx_set_numa_affinity(unsigned int thread_index);
   //-----------------------------------------------------------------------------------------------------
   bool miner::stop()
   {
@@ -414,6 +415,7 @@ namespace cryptonote
     uint32_t th_local_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
     MLOG_SET_THREAD_NAME(std::string("[miner ") + std::to_string(th_local_index) + "]");
     MGINFO("Miner thread was started ["<< th_local_index << "]");
+    rx_set_numa_affinity(th_local_index);
     uint32_t nonce = m_starter_nonce + th_local_index;
     uint64_t height = 0;
     difficulty_type local_diff = 0;
@@ -140,7 +140,17 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               60         // 60 seconds
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                 0x02
+#define P2P_SUPPORT_FLAG_TX_RECONCILIATION              0x04
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_TX_RECONCILIATION)
+
+#define P2P_COMPACT_BLOCK_SHORT_ID_SIZE                 6
+#define P2P_COMPACT_BLOCK_MAX_PREFILL_HINTS             4096
+
+#define P2P_TX_RECONCILIATION_INTERVAL                  2          // seconds
+#define P2P_TX_RECONCILIATION_TIMEOUT                   30         // seconds
+#define P2P_TX_RECONCILIATION_MAX_CAPACITY              128
+#define P2P_TX_RECONCILIATION_MAX_SET_SIZE              1000
 
 #define ALLOW_DEBUG_COMMANDS
 
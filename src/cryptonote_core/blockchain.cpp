@@ -63,6 +63,10 @@
 
 #define FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE (100*1024*1024) // 100 MB
 
+#define OUTPUT_CACHE_SIZE 32768 // per generation, so up to twice that many outputs
+#define INPUT_CACHE_MAX_TXES 8192
+#define DIFFICULTY_WINDOW_FORK_DEPTH 128 // main chain blocks kept beyond the difficulty window, for alt chains forking off them
+
 using namespace crypto;
 
 //#include "serialization/json_archive.h"
@@ -129,14 +133,21 @@ static const struct {
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
   m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
   m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(10), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false),
-  m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
+  m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0),
+  m_difficulty_window(std::max<size_t>({DIFFICULTY_BLOCKS_COUNT, DIFFICULTY_BLOCKS_COUNT_V11, DIFFICULTY_BLOCKS_COUNT_V16}) + DIFFICULTY_WINDOW_FORK_DEPTH),
+  m_cancel(false),
   m_long_term_block_weights_window(CRYPTONOTE_LONG_TERM_BLOCK_WEIGHT_WINDOW_SIZE),
   m_long_term_effective_median_block_weight(0),
+  m_weight_windows_height(std::numeric_limits<uint64_t>::max()),
   m_difficulty_for_next_block_top_hash(crypto::null_hash),
   m_difficulty_for_next_block(1),
+  m_rct_distribution_top_hash(crypto::null_hash),
+  m_output_cache(OUTPUT_CACHE_SIZE),
   m_btc_valid(false),
   m_batch_success(true),
-  m_prepare_height(0)
+  m_prepare_height(0),
+  m_prepare_start_time(0),
+  m_prepare_ntxes(0)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -465,6 +476,7 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
 
   if (test_options && test_options->long_term_block_weight_window)
     m_long_term_block_weights_window = test_options->long_term_block_weight_window;
+  m_weight_windows_height = std::numeric_limits<uint64_t>::max();
 
   {
     db_txn_guard txn_guard(m_db, m_db->is_read_only());
@@ -627,7 +639,8 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
+  m_output_cache.clear();
+  m_input_cache.clear();
 
   block popped_block;
   std::vector<transaction> popped_txs;
@@ -637,6 +650,16 @@ block Blockchain::pop_block_from_blockchain()
   try
   {
     m_db->pop_block(popped_block, popped_txs);
+    pop_weight_windows();
+    if (m_timestamps_and_difficulties_height == m_db->height() + 1 && m_difficulty_window.size() > 0)
+    {
+      m_difficulty_window.pop_back();
+      --m_timestamps_and_difficulties_height;
+    }
+    else
+    {
+      m_timestamps_and_difficulties_height = 0;
+    }
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
@@ -651,6 +674,17 @@ block Blockchain::pop_block_from_blockchain()
     throw;
   }
 
+  {
+    CRITICAL_REGION_LOCAL(m_rct_distribution_lock);
+    const uint64_t new_height = m_db->height();
+    if (m_rct_distribution.size() > new_height)
+    {
+      m_rct_distribution.resize(new_height);
+      if (new_height > 0)
+        m_rct_distribution_top_hash = m_db->get_block_hash_from_height(new_height - 1);
+    }
+  }
+
   // return transactions from popped block to the tx_pool
   size_t pruned = 0;
   for (transaction& tx : popped_txs)
@@ -708,7 +742,10 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_timestamps_and_difficulties_height = 0;
+  m_weight_windows_height = std::numeric_limits<uint64_t>::max();
   invalidate_block_template_cache();
+  m_output_cache.clear();
+  m_input_cache.clear();
   m_db->reset();
   m_db->drop_alt_blocks();
   m_hardfork->init();
@@ -926,44 +963,10 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   uint8_t version = get_current_hard_fork_version();
   size_t difficulty_blocks_count = get_difficulty_blocks_count(version);
 
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && m_timestamps.size() >= difficulty_blocks_count)
-  {
-    uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > difficulty_blocks_count)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > difficulty_blocks_count)
-      m_difficulties.erase(m_difficulties.begin());
-
-    m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
-  }
-  else
-  {
-    uint64_t offset = height - std::min <uint64_t> (height, static_cast<uint64_t>(difficulty_blocks_count));
-    if (offset == 0)
-      ++offset;
-
-    timestamps.clear();
-    difficulties.clear();
-    if (height > offset)
-    {
-      timestamps.reserve(height - offset);
-      difficulties.reserve(height - offset);
-    }
-    for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
-
-    m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
-  }
+  // the last difficulty_blocks_count blocks, genesis excluded
+  const size_t count = std::min<uint64_t>(height - 1, difficulty_blocks_count);
+  sync_difficulty_window(height, count);
+  m_difficulty_window.copy(m_difficulty_window.size() - count, count, timestamps, difficulties);
 
   if(version >= 16)
   {
@@ -980,6 +983,26 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
 
 }
 //------------------------------------------------------------------
+void Blockchain::sync_difficulty_window(uint64_t height, size_t count)
+{
+  size_t wanted = count;
+  if (m_timestamps_and_difficulties_height != height)
+  {
+    // reload including the spare depth, so alternative chains are served from it too
+    m_difficulty_window.clear();
+    m_timestamps_and_difficulties_height = height;
+    wanted = m_difficulty_window.capacity();
+  }
+  wanted = height ? std::min<uint64_t>(wanted, height - 1) : 0;
+
+  // put back the blocks which were popped off the front, or never loaded
+  while (m_difficulty_window.size() < wanted)
+  {
+    const uint64_t block_height = height - m_difficulty_window.size() - 1;
+    m_difficulty_window.push_front(m_db->get_block_timestamp(block_height), m_db->get_block_cumulative_difficulty(block_height));
+  }
+}
+//------------------------------------------------------------------
 // This function removes blocks from the blockchain until it gets to the
 // position where the blockchain switch started and then re-adds the blocks
 // that had been removed.
@@ -994,8 +1017,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
   while (m_db->height() != rollback_height)
   {
@@ -1049,7 +1070,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<block_extended_info>
 
   uint8_t hf_version = get_current_hard_fork_version();
   uint64_t block_future_time_limit = hf_version >= 16 ? CRYPTONOTE_BLOCK_FUTURE_TIME_LIMIT_V16 : CRYPTONOTE_BLOCK_FUTURE_TIME_LIMIT_V11;
-  m_timestamps_and_difficulties_height = 0;
 
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
@@ -1208,6 +1228,10 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<block_extended_info>
     reorg_notify->notify("%s", std::to_string(split_height).c_str(), "%h", std::to_string(m_db->height()).c_str(),
         "%n", std::to_string(m_db->height() - split_height).c_str());
 
+  for (const auto &listener: m_reorg_listeners)
+    listener(split_height, m_db->height());
+  notify_miner_listeners();
+
   MGINFO_GREEN("REORGANIZE SUCCESS! on height: " << split_height << ", new blockchain size: " << m_db->height());
   return true;
 }
@@ -1242,11 +1266,21 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     if(!main_chain_start_offset)
       ++main_chain_start_offset; //skip genesis block
 
-    // get difficulties and timestamps from relevant main chain blocks
-    for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+    // get difficulties and timestamps from relevant main chain blocks, from
+    // the difficulty window when the fork point is recent enough
+    const uint64_t window_start = m_timestamps_and_difficulties_height - m_difficulty_window.size();
+    if (m_timestamps_and_difficulties_height && main_chain_start_offset >= window_start && main_chain_stop_offset <= m_timestamps_and_difficulties_height)
     {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      if (main_chain_start_offset < main_chain_stop_offset)
+        m_difficulty_window.copy(main_chain_start_offset - window_start, main_chain_stop_offset - main_chain_start_offset, timestamps, cumulative_difficulties);
+    }
+    else
+    {
+      for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+      {
+        timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
+        cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      }
     }
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
@@ -1326,9 +1360,9 @@ bool Blockchain::validate_miner_transaction(const block& b, size_t cumulative_bl
     money_in_use += o.amount;
   partial_block_reward = false;
 
-  std::vector<uint64_t> last_blocks_weights;
-  get_last_n_blocks_weights(last_blocks_weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-  if (!get_block_reward(epee::misc_utils::median(last_blocks_weights), cumulative_block_weight, already_generated_coins, fee, base_reward, hard_fork_version, height))
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  sync_weight_windows();
+  if (!get_block_reward(m_short_term_weights_window.median(), cumulative_block_weight, already_generated_coins, fee, base_reward, hard_fork_version, height))
   {
     MERROR_VER("block weight " << cumulative_block_weight << " is bigger than allowed for this blockchain");
     return false;
@@ -1410,6 +1444,64 @@ void Blockchain::get_long_term_block_weights(std::vector<uint64_t>& weights, uin
   weights = m_db->get_long_term_block_weights(start_height, count);
 }
 //------------------------------------------------------------------
+void Blockchain::sync_weight_windows() const
+{
+  const uint64_t db_height = m_db->height();
+  if (m_weight_windows_height == db_height)
+    return;
+
+  MDEBUG("Rebuilding block weight median windows at height " << db_height);
+  m_long_term_weights_window.clear();
+  m_short_term_weights_window.clear();
+  const uint64_t long_term_blocks = std::min<uint64_t>(m_long_term_block_weights_window, db_height);
+  if (long_term_blocks > 0)
+    for (uint64_t weight: m_db->get_long_term_block_weights(db_height - long_term_blocks, long_term_blocks))
+      m_long_term_weights_window.push_back(weight);
+  const uint64_t short_term_blocks = std::min<uint64_t>(CRYPTONOTE_REWARD_BLOCKS_WINDOW, db_height);
+  if (short_term_blocks > 0)
+    for (uint64_t weight: m_db->get_block_weights(db_height - short_term_blocks, short_term_blocks))
+      m_short_term_weights_window.push_back(weight);
+  m_weight_windows_height = db_height;
+}
+//------------------------------------------------------------------
+void Blockchain::push_weight_windows(uint64_t new_height, uint64_t block_weight, uint64_t long_term_block_weight)
+{
+  if (m_weight_windows_height + 1 != new_height)
+  {
+    // out of step, the next user rebuilds them
+    m_weight_windows_height = std::numeric_limits<uint64_t>::max();
+    return;
+  }
+
+  m_long_term_weights_window.push_back(long_term_block_weight);
+  if (m_long_term_weights_window.size() > m_long_term_block_weights_window)
+    m_long_term_weights_window.pop_front();
+  m_short_term_weights_window.push_back(block_weight);
+  if (m_short_term_weights_window.size() > CRYPTONOTE_REWARD_BLOCKS_WINDOW)
+    m_short_term_weights_window.pop_front();
+  m_weight_windows_height = new_height;
+}
+//------------------------------------------------------------------
+void Blockchain::pop_weight_windows()
+{
+  const uint64_t db_height = m_db->height();
+  if (m_weight_windows_height != db_height + 1 || m_long_term_weights_window.empty() || m_short_term_weights_window.empty())
+  {
+    m_weight_windows_height = std::numeric_limits<uint64_t>::max();
+    return;
+  }
+
+  // the popped block leaves at the back, and the block which slid out of
+  // the front when it was added comes back
+  m_long_term_weights_window.pop_back();
+  if (db_height >= m_long_term_block_weights_window)
+    m_long_term_weights_window.push_front(m_db->get_block_long_term_weight(db_height - m_long_term_block_weights_window));
+  m_short_term_weights_window.pop_back();
+  if (db_height >= CRYPTONOTE_REWARD_BLOCKS_WINDOW)
+    m_short_term_weights_window.push_front(m_db->get_block_weight(db_height - CRYPTONOTE_REWARD_BLOCKS_WINDOW));
+  m_weight_windows_height = db_height;
+}
+//------------------------------------------------------------------
 uint64_t Blockchain::get_current_cumulative_block_weight_limit() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -1557,6 +1649,9 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
       uint64_t next_height, seed_height;
       crypto::rx_seedheights(height, &seed_height, &next_height);
       seed_hash = get_block_id_by_height(seed_height);
+      // the next seed is known ahead of the switch, get its dataset ready
+      if (next_height != seed_height)
+        crypto::rx_prepare_dataset(next_height, get_block_id_by_height(next_height).data, 1);
     }
   }
 
@@ -1786,7 +1881,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -2126,34 +2220,83 @@ bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMA
   res.outs.clear();
   res.outs.reserve(req.outputs.size());
 
-  std::vector<cryptonote::output_data_t> data;
   try
   {
+    // look up each distinct output once, in db key order, so the cursor
+    // moves forward through output_amounts instead of jumping around
+    std::vector<size_t> order(req.outputs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [&req](size_t a, size_t b) {
+      const auto &oa = req.outputs[a], &ob = req.outputs[b];
+      return oa.amount < ob.amount || (oa.amount == ob.amount && oa.index < ob.index);
+    });
+
+    std::vector<size_t> slot(req.outputs.size()); // request position -> distinct output
+    std::vector<output_cache::entry> outputs;
+    std::vector<size_t> missing;
     std::vector<uint64_t> amounts, offsets;
-    amounts.reserve(req.outputs.size());
-    offsets.reserve(req.outputs.size());
-    for (const auto &i: req.outputs)
+    outputs.reserve(req.outputs.size());
+    for (size_t k = 0; k < order.size(); ++k)
     {
-      amounts.push_back(i.amount);
-      offsets.push_back(i.index);
+      const size_t i = order[k];
+      const auto &o = req.outputs[i];
+      if (k > 0 && req.outputs[order[k - 1]].amount == o.amount && req.outputs[order[k - 1]].index == o.index)
+      {
+        slot[i] = outputs.size() - 1;
+        continue;
+      }
+      slot[i] = outputs.size();
+      const output_cache::entry *e = m_output_cache.find(o.amount, o.index);
+      if (e)
+      {
+        outputs.push_back(*e);
+      }
+      else
+      {
+        outputs.push_back(output_cache::entry());
+        outputs.back().has_txid = false;
+        missing.push_back(outputs.size() - 1);
+        amounts.push_back(o.amount);
+        offsets.push_back(o.index);
+      }
     }
-    m_db->get_output_key(epee::span<const uint64_t>(amounts.data(), amounts.size()), offsets, data);
-    if(data.size() != req.outputs.size())
+
+    if (!missing.empty())
     {
-      MERROR("Unexpected output data size: expected " << req.outputs.size() << ", got " << data.size());
-      return false;
+      std::vector<cryptonote::output_data_t> data;
+      m_db->get_output_key(epee::span<const uint64_t>(amounts.data(), amounts.size()), offsets, data);
+      if (data.size() != missing.size())
+      {
+        MERROR("Unexpected output data size: expected " << missing.size() << ", got " << data.size());
+        return false;
+      }
+      for (size_t i = 0; i < missing.size(); ++i)
+      {
+        outputs[missing[i]].data = data[i];
+        m_output_cache.insert(amounts[i], offsets[i], data[i]);
+      }
     }
-    for(const auto &t: data)
-      res.outs.push_back({t.pubkey, t.commitment, is_tx_spendtime_unlocked(t.unlock_time), t.height, crypto::null_hash});
 
-    if(req.get_txid)
+    if (req.get_txid)
     {
-      for(size_t i = 0; i < req.outputs.size(); ++i)
+      for (size_t i: order)
       {
-        tx_out_index toi = m_db->get_output_tx_and_index(req.outputs[i].amount, req.outputs[i].index);
-        res.outs[i].txid = toi.first;
+        output_cache::entry &e = outputs[slot[i]];
+        if (e.has_txid)
+          continue;
+        const auto &o = req.outputs[i];
+        e.txid = m_db->get_output_tx_and_index(o.amount, o.index).first;
+        e.has_txid = true;
+        m_output_cache.insert(o.amount, o.index, e.data) = e;
       }
     }
+
+    for (size_t i = 0; i < req.outputs.size(); ++i)
+    {
+      const output_cache::entry &e = outputs[slot[i]];
+      res.outs.push_back({e.data.pubkey, e.data.commitment, is_tx_spendtime_unlocked(e.data.unlock_time), e.data.height, req.get_txid ? e.txid : crypto::null_hash});
+    }
   }
   catch (const std::exception &e)
   {
@@ -2194,17 +2337,12 @@ bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height,
     return false;
   if (amount == 0)
   {
-    std::vector<uint64_t> heights;
-    heights.reserve(to_height + 1 - start_height);
-    const uint64_t real_start_height = start_height > 0 ? start_height-1 : start_height;
-    for (uint64_t h = real_start_height; h <= to_height; ++h)
-      heights.push_back(h);
-    distribution = m_db->get_block_cumulative_rct_outputs(heights);
+    CRITICAL_REGION_LOCAL(m_rct_distribution_lock);
+    if (!update_rct_distribution_cache(to_height + 1))
+      return false;
     if (start_height > 0)
-    {
-      base = distribution[0];
-      distribution.erase(distribution.begin());
-    }
+      base = m_rct_distribution[start_height - 1];
+    distribution.assign(m_rct_distribution.begin() + start_height, m_rct_distribution.begin() + to_height + 1);
     return true;
   }
   else
@@ -2213,6 +2351,37 @@ bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height,
   }
 }
 //------------------------------------------------------------------
+bool Blockchain::update_rct_distribution_cache(uint64_t nblocks) const
+{
+  db_rtxn_guard rtxn_guard(m_db);
+  const uint64_t db_height = m_db->height();
+  if (nblocks > db_height)
+    return false;
+
+  // blocks are only popped through pop_block_from_blockchain, which trims
+  // the cache, but a different top hash means we can't trust any of it
+  if (!m_rct_distribution.empty())
+  {
+    const uint64_t top = m_rct_distribution.size() - 1;
+    if (top >= db_height || m_db->get_block_hash_from_height(top) != m_rct_distribution_top_hash)
+    {
+      MDEBUG("Chain changed under the rct output distribution cache, dropping it");
+      m_rct_distribution.clear();
+    }
+  }
+  if (m_rct_distribution.size() >= nblocks)
+    return true;
+
+  std::vector<uint64_t> heights;
+  heights.reserve(nblocks - m_rct_distribution.size());
+  for (uint64_t h = m_rct_distribution.size(); h < nblocks; ++h)
+    heights.push_back(h);
+  const std::vector<uint64_t> cumulative = m_db->get_block_cumulative_rct_outputs(heights);
+  m_rct_distribution.insert(m_rct_distribution.end(), cumulative.begin(), cumulative.end());
+  m_rct_distribution_top_hash = m_db->get_block_hash_from_height(nblocks - 1);
+  return true;
+}
+//------------------------------------------------------------------
 // This function takes a list of block hashes from another node
 // on the network to find where the split point is between us and them.
 // This is used to see what to send another node that needs to sync.
@@ -2562,11 +2731,8 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
 // find split point between ours and foreign blockchain (or start at
 // blockchain height <req_start_block>), and return up to max_count FULL
 // blocks by reference.
-bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const
+bool Blockchain::find_blockchain_supplement_start(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& start_height) const
 {
-  LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-
   // if a specific start height has been requested
   if(req_start_block > 0)
   {
@@ -2584,6 +2750,16 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
       return false;
     }
   }
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  if (!find_blockchain_supplement_start(req_start_block, qblock_ids, start_height))
+    return false;
 
   db_rtxn_guard rtxn_guard(m_db);
   blocks.reserve(std::min(std::min(max_block_count, (size_t)10000), (size_t)(total_height - start_height)));
@@ -2591,6 +2767,43 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<block_complete_entry, crypto::hash>>& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  if (!find_blockchain_supplement_start(req_start_block, qblock_ids, start_height))
+    return false;
+
+  // the blobs we get are views into this read txn, and get copied once
+  // into the entries we return
+  db_rtxn_guard rtxn_guard(m_db);
+  blocks.reserve(std::min(std::min(max_block_count, (size_t)10000), (size_t)(total_height - start_height)));
+  const bool r = m_db->for_blocks_from(start_height, 3, max_block_count, max_tx_count, FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE, pruned, true, get_miner_tx_hash,
+    [&blocks, pruned](const epee::span<const uint8_t> &blob, const crypto::hash &miner_tx_hash, size_t ntxes) {
+      blocks.resize(blocks.size() + 1);
+      block_complete_entry &entry = blocks.back().first;
+      entry.pruned = pruned;
+      entry.block.assign((const char*)blob.data(), blob.size());
+      entry.txs.reserve(ntxes);
+      blocks.back().second = miner_tx_hash;
+      return true;
+    },
+    [&blocks, get_miner_tx_hash](const crypto::hash &tx_hash, const epee::span<const uint8_t> &pruned_blob, const epee::span<const uint8_t> &prunable_blob) {
+      block_complete_entry &entry = blocks.back().first;
+      if (!get_miner_tx_hash && entry.txs.empty())
+        blocks.back().second = tx_hash;
+      entry.txs.push_back(tx_blob_entry());
+      blobdata &tx_blob = entry.txs.back().blob;
+      tx_blob.reserve(pruned_blob.size() + prunable_blob.size());
+      tx_blob.append((const char*)pruned_blob.data(), pruned_blob.size());
+      tx_blob.append((const char*)prunable_blob.data(), prunable_blob.size());
+      return true;
+    });
+  CHECK_AND_ASSERT_MES(r, false, "Error getting blocks");
+  return true;
+}
+//------------------------------------------------------------------
 bool Blockchain::add_block_as_invalid(const block& bl, const crypto::hash& h)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -3043,6 +3256,9 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         return false;
       }
 
+      // signatures already checked in parallel by prepare_handle_incoming_blocks
+      const bool prevalidated = !m_prevalidated_txs.empty() && m_prevalidated_txs.find(get_transaction_hash(tx)) != m_prevalidated_txs.end();
+
       const rct::rctSig &rv = tx.rct_signatures;
       switch (rv.type)
       {
@@ -3103,10 +3319,23 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
           }
         }
 
-        if (!rct::verRctNonSemanticsSimple(rv))
+        if (!prevalidated)
         {
-          MERROR_VER("Failed to check ringct signatures!");
-          return false;
+          // inputs already verified when the tx went through the pool are not checked again
+          const crypto::hash tx_hash = get_transaction_hash(tx);
+          auto cached = m_input_cache.find(tx_hash);
+          if (cached == m_input_cache.end())
+          {
+            if (m_input_cache.size() >= INPUT_CACHE_MAX_TXES)
+              m_input_cache.clear();
+            cached = m_input_cache.emplace(tx_hash, std::vector<bool>()).first;
+          }
+          size_t failed_input = 0;
+          if (!rct::verRctNonSemanticsSimple(rv, cached->second, &failed_input))
+          {
+            MERROR_VER("Failed to check ringct signatures! (input " << failed_input << ")");
+            return false;
+          }
         }
         break;
       }
@@ -3163,7 +3392,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
           }
         }
 
-        if (!rct::verRct(rv, false))
+        if (!prevalidated && !rct::verRct(rv, false))
         {
           MERROR_VER("Failed to check ringct signatures!");
           return false;
@@ -3280,13 +3509,18 @@ uint64_t Blockchain::get_dynamic_base_fee_estimate(uint64_t grace_blocks) const
     grace_blocks = CRYPTONOTE_REWARD_BLOCKS_WINDOW - 1;
 
   const uint64_t min_block_weight = get_min_block_weight(version);
-  std::vector<uint64_t> weights;
-  get_last_n_blocks_weights(weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW - grace_blocks);
-  weights.reserve(grace_blocks);
-  for (size_t i = 0; i < grace_blocks; ++i)
-    weights.push_back(min_block_weight);
 
-  uint64_t median = epee::misc_utils::median(weights);
+  // the last blocks, with the oldest replaced by grace_blocks minimal ones
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  sync_weight_windows();
+  const size_t kept = std::min<size_t>(m_short_term_weights_window.size(), CRYPTONOTE_REWARD_BLOCKS_WINDOW - grace_blocks);
+  std::vector<uint64_t> dropped;
+  dropped.reserve(m_short_term_weights_window.size() - kept);
+  for (size_t i = 0; i < m_short_term_weights_window.size() - kept; ++i)
+    dropped.push_back(m_short_term_weights_window[i]);
+  const std::vector<uint64_t> grace(grace_blocks, min_block_weight);
+
+  uint64_t median = m_short_term_weights_window.median_with(dropped, grace);
   if(median <= min_block_weight)
     median = min_block_weight;
 
@@ -3767,6 +4001,7 @@ leave:
         return_tx_to_pool(txs);
         goto leave;
       }
+      m_input_cache.erase(tx_id);
     }
 #if defined(PER_BLOCK_CHECKPOINT)
     else
@@ -3850,8 +4085,19 @@ leave:
     try
     {
       uint64_t long_term_block_weight = get_next_long_term_block_weight(block_weight);
+      const uint64_t block_timestamp = bl.timestamp;
       cryptonote::blobdata bd = cryptonote::block_to_blob(bl);
       new_height = m_db->add_block(std::make_pair(std::move(bl), std::move(bd)), block_weight, long_term_block_weight, cumulative_difficulty, already_generated_coins, txs);
+      push_weight_windows(new_height, block_weight, long_term_block_weight);
+      if (m_timestamps_and_difficulties_height && m_timestamps_and_difficulties_height + 1 == new_height)
+      {
+        m_difficulty_window.push_back(block_timestamp, cumulative_difficulty);
+        m_timestamps_and_difficulties_height = new_height;
+      }
+      else
+      {
+        m_timestamps_and_difficulties_height = 0;
+      }
     }
     catch (const KEY_IMAGE_EXISTS& e)
     {
@@ -3926,8 +4172,46 @@ leave:
   if (block_notify)
     block_notify->notify("%s", epee::string_tools::pod_to_hex(id).c_str(), NULL);
 
+  for (const auto &listener: m_block_listeners)
+    listener(new_height - 1, bl);
+  notify_miner_listeners();
+
   return true;
 }
+//------------------------------------------------------------------
+bool Blockchain::get_miner_data(miner_data &data)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t height = m_db->height();
+  if (height == 0)
+    return false;
+
+  data.major_version = m_hardfork->get_current_version();
+  data.height = height;
+  data.prev_id = get_tail_id();
+  data.seed_hash = crypto::null_hash;
+  if (data.major_version >= RX_BLOCK_VERSION)
+  {
+    uint64_t seed_height, next_height;
+    crypto::rx_seedheights(height, &seed_height, &next_height);
+    data.seed_hash = get_block_id_by_height(seed_height);
+  }
+  data.difficulty = get_difficulty_for_next_block();
+  data.median_weight = m_current_block_cumul_weight_limit / 2;
+  data.already_generated_coins = m_db->get_block_already_generated_coins(height - 1);
+  return true;
+}
+//------------------------------------------------------------------
+void Blockchain::notify_miner_listeners()
+{
+  if (m_miner_listeners.empty())
+    return;
+  miner_data data;
+  if (!get_miner_data(data))
+    return;
+  for (const auto &listener: m_miner_listeners)
+    listener(data);
+}
 
 extern "C" void message_buffer_cleanup(void*, void* hint) {
    delete reinterpret_cast<std::string*>(hint);
@@ -3972,16 +4256,13 @@ uint64_t Blockchain::get_next_long_term_block_weight(uint64_t block_weight) cons
 {
   PERF_TIMER(get_next_long_term_block_weight);
 
-  const uint64_t db_height = m_db->height();
-  const uint64_t nblocks = std::min<uint64_t>(m_long_term_block_weights_window, db_height);
-
   const uint8_t hf_version = get_current_hard_fork_version();
 
   uint64_t block_grant = hf_version >= 17 ? config::blockchain_settings::new_block_min_size : config::blockchain_settings::old_block_min_size;
 
-  std::vector<uint64_t> weights;
-  get_long_term_block_weights(weights, db_height - nblocks, nblocks);
-  uint64_t long_term_median = epee::misc_utils::median(weights);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  sync_weight_windows();
+  uint64_t long_term_median = m_long_term_weights_window.median();
   uint64_t long_term_effective_median_block_weight = std::max<uint64_t>(block_grant, long_term_median);
 
   uint64_t short_term_constraint = long_term_effective_median_block_weight + long_term_effective_median_block_weight * 2 / 5;
@@ -4004,7 +4285,13 @@ bool Blockchain::update_next_cumulative_weight_limit(uint64_t *long_term_effecti
 
   const uint64_t block_weight = m_db->get_block_weight(db_height - 1);
 
-  std::vector<uint64_t> weights, new_weights;
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  sync_weight_windows();
+
+  // the window ends at the top block, the medians below are taken over the
+  // one ending a block earlier: the top weight leaves it, and the weight
+  // which slid out of the front when the top block was added comes back
+  const std::vector<uint64_t> top_weight(1, m_long_term_weights_window.back());
   uint64_t long_term_median;
   if (db_height == 1)
   {
@@ -4012,12 +4299,10 @@ bool Blockchain::update_next_cumulative_weight_limit(uint64_t *long_term_effecti
   }
   else
   {
-    uint64_t nblocks = std::min<uint64_t>(m_long_term_block_weights_window, db_height);
-    if (nblocks == db_height)
-      --nblocks;
-    get_long_term_block_weights(weights, db_height - nblocks - 1, nblocks);
-    new_weights = weights;
-    long_term_median = epee::misc_utils::median(weights);
+    std::vector<uint64_t> slid_out;
+    if (db_height > m_long_term_block_weights_window)
+      slid_out.push_back(m_db->get_block_long_term_weight(db_height - m_long_term_block_weights_window - 1));
+    long_term_median = m_long_term_weights_window.median_with(top_weight, slid_out);
   }
 
   m_long_term_effective_median_block_weight = std::max<uint64_t>(block_grant, long_term_median);
@@ -4025,16 +4310,21 @@ bool Blockchain::update_next_cumulative_weight_limit(uint64_t *long_term_effecti
   uint64_t short_term_constraint = m_long_term_effective_median_block_weight + m_long_term_effective_median_block_weight * 2 / 5;
   uint64_t long_term_block_weight = std::min<uint64_t>(block_weight, short_term_constraint);
 
-  if (new_weights.empty())
-    new_weights.resize(1);
-  new_weights[0] = long_term_block_weight;
-  long_term_median = epee::misc_utils::median(new_weights);
+  // the top block's recomputed long term weight then replaces the oldest weight of that window
+  if (db_height == 1)
+  {
+    long_term_median = long_term_block_weight;
+  }
+  else
+  {
+    std::vector<uint64_t> replaced = top_weight;
+    if (db_height <= m_long_term_block_weights_window)
+      replaced.push_back(m_long_term_weights_window.front());
+    long_term_median = m_long_term_weights_window.median_with(replaced, std::vector<uint64_t>(1, long_term_block_weight));
+  }
   m_long_term_effective_median_block_weight = std::max<uint64_t>(block_grant, long_term_median);
 
-  weights.clear();
-  get_last_n_blocks_weights(weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-
-  uint64_t short_term_median = epee::misc_utils::median(weights);
+  uint64_t short_term_median = m_short_term_weights_window.median();
   uint64_t effective_median_block_weight = std::min<uint64_t>(std::max<uint64_t>(block_grant, short_term_median), CRYPTONOTE_SHORT_TERM_BLOCK_WEIGHT_SURGE_FACTOR * m_long_term_effective_median_block_weight);
 
   m_current_block_cumul_weight_median = effective_median_block_weight;
@@ -4183,6 +4473,70 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
   TIME_MEASURE_FINISH(t);
 }
 
+//------------------------------------------------------------------
+void Blockchain::tx_signatures_worker(const cryptonote::blobdata &tx_blob, transaction &tx, crypto::hash &tx_hash, bool &parsed, bool &valid)
+{
+  parsed = false;
+  valid = false;
+  if (m_cancel)
+    return;
+
+  try
+  {
+    if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash))
+      return;
+    parsed = true;
+    if (tx.version < 2 || tx.pruned)
+      return;
+
+    const crypto::hash tx_prefix_hash = get_transaction_prefix_hash(tx);
+    const auto its = m_scan_table.find(tx_prefix_hash);
+    if (its == m_scan_table.end())
+      return;
+
+    std::vector<std::vector<rct::ctkey>> pubkeys(tx.vin.size());
+    for (size_t n = 0; n < tx.vin.size(); ++n)
+    {
+      if (tx.vin[n].type() != typeid(txin_to_key))
+        return;
+      const txin_to_key &in_to_key = boost::get<txin_to_key>(tx.vin[n]);
+      const auto it = its->second.find(in_to_key.k_image);
+      // outputs created earlier in the same span are not in the scan table yet
+      if (it == its->second.end() || it->second.size() != in_to_key.key_offsets.size())
+        return;
+      pubkeys[n].reserve(it->second.size());
+      for (const output_data_t &output : it->second)
+        pubkeys[n].push_back(rct::ctkey({rct::pk2rct(output.pubkey), output.commitment}));
+    }
+
+    if (!expand_transaction_2(tx, tx_prefix_hash, pubkeys))
+      return;
+
+    const rct::rctSig &rv = tx.rct_signatures;
+    switch (rv.type)
+    {
+    case rct::RCTTypeSimple:
+    case rct::RCTTypeSimpleBulletproof:
+    case rct::RCTTypeBulletproof:
+      if (rv.p.MGs.size() != tx.vin.size())
+        return;
+      valid = rct::verRctNonSemanticsSimple(rv);
+      break;
+    case rct::RCTTypeFull:
+    case rct::RCTTypeFullBulletproof:
+      valid = rct::verRct(rv, false);
+      break;
+    default:
+      break;
+    }
+  }
+  catch (const std::exception &e)
+  {
+    MDEBUG("Failed to prevalidate tx signatures: " << e.what());
+    valid = false;
+  }
+}
+
 //------------------------------------------------------------------
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 {
@@ -4234,10 +4588,21 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   }
 
   TIME_MEASURE_FINISH(t1);
+  if (m_show_time_stats && m_prepare_start_time && m_prepare_nblocks > 0)
+  {
+    const uint64_t elapsed = std::max<uint64_t>(epee::misc_utils::get_tick_count() - m_prepare_start_time, 1);
+    MINFO("Span of " << m_prepare_nblocks << " blocks / " << m_prepare_ntxes << " txes processed in " << elapsed << " ms: "
+        << m_prepare_nblocks * 1000 / elapsed << " blocks/s, " << m_prepare_ntxes * 1000 / elapsed << " tx/s");
+  }
+  m_prepare_start_time = 0;
+  m_prepare_nblocks = 0;
+  m_prepare_ntxes = 0;
   m_blocks_longhash_table.clear();
   m_scan_table.clear();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
+  m_prevalidated_txs.clear();
+  m_prevalidated_semantics_txs.clear();
 
   // when we're well clear of the precomputed hashes, free the memory
   if (!m_blocks_hash_check.empty() && m_db->height() > m_blocks_hash_check.size() + 4096)
@@ -4409,10 +4774,14 @@ bool Blockchain::has_block_weights(uint64_t height, uint64_t nblocks) const
 //    vs [k_image, output_keys] (m_scan_table). This is faster because it takes advantage of bulk queries
 //    and is threaded if possible. The table (m_scan_table) will be used later when querying output
 //    keys.
+// 3. Verify the ring signatures of all txes in the span in parallel, using the keys from m_scan_table.
+//    The txes which pass are recorded in m_prevalidated_txs, and handle_block_to_main_chain then only
+//    has to do the cheap checks and the in-order commit to the db.
 bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks)
 {
   MTRACE("Blockchain::" << __func__);
   TIME_MEASURE_START(prepare);
+  m_prepare_start_time = prepare;
   bool stop_batch;
   uint64_t bytes = 0;
   size_t total_txs = 0;
@@ -4448,6 +4817,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     total_txs += entry.txs.size();
   }
   m_bytes_to_sync += bytes;
+  m_prepare_nblocks = blocks_entry.size();
+  m_prepare_ntxes = total_txs;
   while (!(stop_batch = m_db->batch_start(blocks_entry.size(), bytes))) {
     m_blockchain_lock.unlock();
     m_tx_pool.unlock();
@@ -4571,6 +4942,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
 
   m_scan_table.clear();
   m_check_txin_table.clear();
+  m_prevalidated_txs.clear();
+  m_prevalidated_semantics_txs.clear();
 
   TIME_MEASURE_FINISH(prepare);
   m_fake_pow_calc_time = prepare / blocks_entry.size();
@@ -4757,9 +5130,77 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       MDEBUG("Prepare scantable took: " << scantable << " ms");
   }
 
+  TIME_MEASURE_START(sigcheck);
+  std::vector<transaction> span_txes(total_txs);
+  std::vector<crypto::hash> tx_hashes(total_txs);
+  std::deque<bool> parsed(total_txs, false);
+  if (total_txs > 0)
+  {
+    std::deque<bool> valid(total_txs, false);
+    tools::threadpool::waiter waiter;
+    tx_index = 0;
+    for (const auto &entry : blocks_entry)
+    {
+      for (const auto &tx_blob : entry.txs)
+      {
+        tpool.submit(&waiter, boost::bind(&Blockchain::tx_signatures_worker, this, std::cref(tx_blob.blob), std::ref(span_txes[tx_index]), std::ref(tx_hashes[tx_index]), std::ref(parsed[tx_index]), std::ref(valid[tx_index])));
+        ++tx_index;
+      }
+    }
+    waiter.wait(&tpool);
+
+    if (m_cancel)
+      return false;
+
+    for (size_t i = 0; i < total_txs; ++i)
+      if (valid[i])
+        m_prevalidated_txs.insert(tx_hashes[i]);
+  }
+  TIME_MEASURE_FINISH(sigcheck);
+  if (total_txs > 0)
+  {
+    m_fake_scan_time += sigcheck / total_txs;
+    if(m_show_time_stats)
+      MDEBUG("Prepare signature checks took: " << sigcheck << " ms, " << m_prevalidated_txs.size() << "/" << total_txs << " txes prevalidated");
+  }
+
+  // batch all the range proofs in the span in a single multiexp, instead of the
+  // per block batches the txes would otherwise get in handle_incoming_txs
+  TIME_MEASURE_START(rangeproofs);
+  std::vector<const rct::rctSig*> rvv;
+  std::vector<size_t> rvv_tx_index;
+  for (size_t i = 0; i < total_txs; ++i)
+  {
+    if (!parsed[i] || span_txes[i].version < 2 || span_txes[i].pruned)
+      continue;
+    const rct::rctSig &rv = span_txes[i].rct_signatures;
+    if (rv.type != rct::RCTTypeBulletproof || rv.p.bulletproofs.size() != 1)
+      continue;
+    rvv.push_back(&rv);
+    rvv_tx_index.push_back(i);
+  }
+  if (!rvv.empty())
+  {
+    std::vector<bool> semantics_valid;
+    if (!rct::verRctSemanticsSimple(rvv, semantics_valid))
+      MDEBUG("Some txes in the span have bad range proofs, they will be rejected when handled");
+    for (size_t i = 0; i < rvv.size(); ++i)
+      if (semantics_valid[i])
+        m_prevalidated_semantics_txs.insert(tx_hashes[rvv_tx_index[i]]);
+  }
+  TIME_MEASURE_FINISH(rangeproofs);
+  if (!rvv.empty() && m_show_time_stats)
+    MDEBUG("Prepare range proofs took: " << rangeproofs << " ms for " << rvv.size() << " txes");
+
   return true;
 }
 
+bool Blockchain::is_tx_semantics_prevalidated(const crypto::hash &txid) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_prevalidated_semantics_txs.find(txid) != m_prevalidated_semantics_txs.end();
+}
+
 void Blockchain::add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata &blob, const txpool_tx_meta_t &meta)
 {
   m_db->add_txpool_tx(txid, blob, meta);
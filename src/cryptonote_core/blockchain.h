@@ -64,6 +64,10 @@
 #include "checkpoints/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "core_events.h"
+#include "output_cache.h"
+#include "median_window.h"
+#include "difficulty_window.h"
 
 namespace tools { class Notify; }
 
@@ -248,6 +252,15 @@ namespace cryptonote
      */
     bool cleanup_handle_incoming_blocks(bool force_sync = false);
 
+    /**
+     * @brief checks whether a tx's range proofs were batch verified by prepare_handle_incoming_blocks
+     *
+     * @param txid the transaction hash
+     *
+     * @return true if the tx is part of the current span and its rct semantics are known good
+     */
+    bool is_tx_semantics_prevalidated(const crypto::hash &txid) const;
+
     /**
      * @brief search the blockchain for a transaction by hash
      *
@@ -449,6 +462,20 @@ namespace cryptonote
      */
     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const;
 
+    /**
+     * @brief get recent blocks for a foreign chain, ready to be sent
+     *
+     * As above, but the blobs are copied once, straight from the database
+     * into the entries returned, without intermediate blobs.
+     *
+     * @param blocks return-by-reference the blocks and their transactions, each with
+     * the hash of its first returned transaction (the miner tx if get_miner_tx_hash is
+     * set, else the first other tx, if any)
+     *
+     * @return true if a block found in common or req_start_block specified, else false
+     */
+    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<block_complete_entry, crypto::hash>>& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const;
+
     /**
      * @brief retrieves a set of blocks and their transactions, and possibly other transactions
      *
@@ -763,6 +790,36 @@ namespace cryptonote
      */
     void set_reorg_notify(const std::shared_ptr<tools::Notify> &notify) { m_reorg_notify = notify; }
 
+    /**
+     * @brief adds a listener to call for every block added to the main chain
+     *
+     * @param listener the listener, see core_events.h
+     */
+    void add_block_listener(block_listener &&listener) { m_block_listeners.push_back(std::move(listener)); }
+
+    /**
+     * @brief adds a listener to call after every successful reorg
+     *
+     * @param listener the listener, see core_events.h
+     */
+    void add_reorg_listener(reorg_listener &&listener) { m_reorg_listeners.push_back(std::move(listener)); }
+
+    /**
+     * @brief adds a listener to call whenever the data needed to mine the next block changes
+     *
+     * @param listener the listener, see core_events.h
+     */
+    void add_miner_listener(miner_listener &&listener) { m_miner_listeners.push_back(std::move(listener)); }
+
+    /**
+     * @brief gets what a miner needs to start working on the next block
+     *
+     * @param data return-by-reference the data for the block on top of the chain
+     *
+     * @return false if the chain is empty, true otherwise
+     */
+    bool get_miner_data(miner_data &data);
+
     /**
      * @brief Put DB in safe sync mode
      */
@@ -965,6 +1022,22 @@ namespace cryptonote
      */
     void block_longhash_worker(uint64_t height, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const;
 
+    /**
+     * @brief verifies the ring signatures of a transaction from an incoming block span
+     *
+     * The ring members are taken from m_scan_table, so this can run in
+     * parallel for all transactions of a span before the blocks are added.
+     * Transactions spending outputs created within the same span cannot
+     * be checked here, and are left to check_tx_inputs.
+     *
+     * @param tx_blob the transaction blob
+     * @param tx return-by-reference the parsed transaction
+     * @param tx_hash return-by-reference the transaction hash
+     * @param parsed return-by-reference true if the transaction could be parsed
+     * @param valid return-by-reference true if the signatures were checked and are valid
+     */
+    void tx_signatures_worker(const cryptonote::blobdata &tx_blob, transaction &tx, crypto::hash &tx_hash, bool &parsed, bool &valid);
+
     /**
      * @brief returns a set of known alternate chains
      *
@@ -1037,6 +1110,11 @@ namespace cryptonote
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
+    // per input MG results of recently checked txes, by txid, so txes checked
+    // for the pool are not checked again when they come in a block
+    std::unordered_map<crypto::hash, std::vector<bool>> m_input_cache;
+    std::unordered_set<crypto::hash> m_prevalidated_txs;
+    std::unordered_set<crypto::hash> m_prevalidated_semantics_txs;
 
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<std::pair<crypto::hash, crypto::hash>> m_blocks_hash_of_hashes;
@@ -1054,16 +1132,32 @@ namespace cryptonote
     uint64_t m_fake_scan_time;
     uint64_t m_sync_counter;
     uint64_t m_bytes_to_sync;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
+    // timestamps and cumulative difficulties of the blocks below
+    // m_timestamps_and_difficulties_height (0 if not loaded), with some spare
+    // depth for alternative chains forking off recent blocks
+    difficulty_window m_difficulty_window;
     uint64_t m_timestamps_and_difficulties_height;
     uint64_t m_long_term_block_weights_window;
     uint64_t m_long_term_effective_median_block_weight;
 
+    // long and short term block weight median windows ending at the chain tip,
+    // moved along as blocks are added and popped
+    mutable median_window m_long_term_weights_window;
+    mutable median_window m_short_term_weights_window;
+    mutable uint64_t m_weight_windows_height;
+
     epee::critical_section m_difficulty_lock;
     crypto::hash m_difficulty_for_next_block_top_hash;
     difficulty_type m_difficulty_for_next_block;
 
+    // cumulative rct output counts by height, extended as requested
+    mutable epee::critical_section m_rct_distribution_lock;
+    mutable std::vector<uint64_t> m_rct_distribution;
+    mutable crypto::hash m_rct_distribution_top_hash;
+
+    // outputs recently returned by get_outs, protected by m_blockchain_lock
+    mutable output_cache m_output_cache;
+
     boost::asio::io_service m_async_service;
     boost::thread_group m_async_pool;
     std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
@@ -1105,6 +1199,10 @@ namespace cryptonote
     std::shared_ptr<tools::Notify> m_block_notify;
     std::shared_ptr<tools::Notify> m_reorg_notify;
 
+    std::vector<block_listener> m_block_listeners;
+    std::vector<reorg_listener> m_reorg_listeners;
+    std::vector<miner_listener> m_miner_listeners;
+
     zmq::context_t context;
     zmq::socket_t producer{context, ZMQ_DEALER};
     zmq::message_t create_message(std::string &&data);
@@ -1113,6 +1211,8 @@ namespace cryptonote
     uint64_t m_prepare_height;
     uint64_t m_prepare_nblocks;
     std::vector<block> *m_prepare_blocks;
+    uint64_t m_prepare_start_time;
+    uint64_t m_prepare_ntxes;
 
     /**
      * @brief collects the keys for all outputs being "spent" as an input
@@ -1333,6 +1433,39 @@ namespace cryptonote
      */
     void get_long_term_block_weights(std::vector<uint64_t>& weights, uint64_t start_height, size_t count) const;
 
+    /**
+     * @brief makes sure the block weight median windows match the chain tip
+     *
+     * Rebuilds them from the db if blocks were added or removed behind
+     * our back. The caller must hold m_blockchain_lock.
+     */
+    void sync_weight_windows() const;
+
+    /**
+     * @brief moves the block weight median windows forward over a new top block
+     *
+     * @param new_height the chain height after adding the block
+     * @param block_weight the weight of the new block
+     * @param long_term_block_weight the long term weight of the new block
+     */
+    void push_weight_windows(uint64_t new_height, uint64_t block_weight, uint64_t long_term_block_weight);
+
+    /**
+     * @brief moves the block weight median windows back after popping the top block
+     */
+    void pop_weight_windows();
+
+    /**
+     * @brief brings the difficulty window up to the given chain height
+     *
+     * Reuses what it already holds when the window ends at that height,
+     * reloads it from the db otherwise. The caller must hold m_blockchain_lock.
+     *
+     * @param height the chain height
+     * @param count the number of blocks the window must hold, genesis excluded
+     */
+    void sync_difficulty_window(uint64_t height, size_t count);
+
     /**
      * @brief checks if a transaction is unlocked (its outputs spendable)
      *
@@ -1502,6 +1635,34 @@ namespace cryptonote
      */
     void invalidate_block_template_cache();
 
+    /**
+     * @brief calls the miner listeners with the data for the current top of the chain
+     */
+    void notify_miner_listeners();
+
+    /**
+     * @brief finds the height to start a foreign chain's supplement from
+     *
+     * @param req_start_block if non-zero, specifies a start point (otherwise find most recent commonality)
+     * @param qblock_ids the foreign chain's "short history" (see get_short_chain_history)
+     * @param start_height return-by-reference the height of the first block to return
+     *
+     * @return true if a block found in common or req_start_block specified, else false
+     */
+    bool find_blockchain_supplement_start(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, uint64_t& start_height) const;
+
+    /**
+     * @brief makes sure the cached rct output distribution covers the given number of blocks
+     *
+     * The cache is dropped if the chain it was built from is no longer the
+     * main chain. The caller must hold m_rct_distribution_lock.
+     *
+     * @param nblocks the number of blocks, from genesis, to cover
+     *
+     * @return false if the chain is not that long, true otherwise
+     */
+    bool update_rct_distribution_cache(uint64_t nblocks) const;
+
      /**
      * @brief stores a new cached block template
      *
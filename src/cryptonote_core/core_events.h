@@ -0,0 +1,72 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "cryptonote_basic/blobdatatype.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/difficulty.h"
+
+namespace cryptonote
+{
+  //! a transaction which was just added to the pool
+  struct txpool_event
+  {
+    crypto::hash id;
+    const transaction *tx;
+    const blobdata *blob;
+    uint64_t weight;
+    uint64_t fee;
+  };
+
+  //! what a miner needs to start working on the next block
+  struct miner_data
+  {
+    uint8_t major_version;
+    uint64_t height;
+    crypto::hash prev_id;
+    crypto::hash seed_hash;
+    difficulty_type difficulty;
+    uint64_t median_weight;
+    uint64_t already_generated_coins;
+  };
+
+  /* Listeners are called synchronously, with core locks held, so they
+   * must hand the event off quickly and must not call back into the core.
+   * They have to be added before the core starts handling blocks and txes.
+   */
+  typedef std::function<void(uint64_t height, const block &b)> block_listener;
+  typedef std::function<void(uint64_t split_height, uint64_t new_height)> reorg_listener;
+  typedef std::function<void(const miner_data &data)> miner_listener;
+  typedef std::function<void(const std::vector<txpool_event> &txs)> txpool_listener;
+}
@@ -209,6 +209,17 @@ namespace cryptonote
   , "Keep Alternative Blocks on Restart"
   , false
   };
+  static const command_line::arg_descriptor<bool> arg_randomx_dataset_cache = {
+    "randomx-dataset-cache"
+  , "Keep the RandomX mining dataset in the data directory, so it is loaded rather than rebuilt on restart"
+  , false
+  };
+  static const command_line::arg_descriptor<bool> arg_randomx_dataset_prepare = {
+    "randomx-dataset-prepare"
+  , "With --randomx-dataset-cache, build the next epoch's dataset in the background ahead of the switch "
+    "(needs memory for a second dataset while it runs)"
+  , false
+  };
 
   //-----------------------------------------------------------------------------------------------
   core::core(i_cryptonote_protocol* pprotocol):
@@ -327,6 +338,8 @@ namespace cryptonote
     command_line::add_arg(desc, arg_prune_blockchain);
     command_line::add_arg(desc, arg_reorg_notify);
     command_line::add_arg(desc, arg_keep_alt_blocks);
+    command_line::add_arg(desc, arg_randomx_dataset_cache);
+    command_line::add_arg(desc, arg_randomx_dataset_prepare);
 
     miner::init_options(desc);
     BlockchainDB::init_options(desc);
@@ -460,6 +473,8 @@ namespace cryptonote
     size_t max_txpool_weight = command_line::get_arg(vm, arg_max_txpool_weight);
     bool prune_blockchain = command_line::get_arg(vm, arg_prune_blockchain);
     bool keep_alt_blocks = command_line::get_arg(vm, arg_keep_alt_blocks);
+    bool randomx_dataset_cache = command_line::get_arg(vm, arg_randomx_dataset_cache);
+    bool randomx_dataset_prepare = command_line::get_arg(vm, arg_randomx_dataset_prepare);
 
     boost::filesystem::path folder(m_config_folder);
     if (m_nettype == FAKECHAIN)
@@ -469,6 +484,9 @@ namespace cryptonote
     CHECK_AND_ASSERT_MES (boost::filesystem::exists(folder) || boost::filesystem::create_directories(folder), false,
       std::string("Failed to create directory ").append(folder.string()).c_str());
 
+    if (randomx_dataset_cache)
+      crypto::rx_set_dataset_dir(folder.string().c_str(), randomx_dataset_prepare);
+
     // check for blockchain.bin
     try
     {
@@ -941,6 +959,9 @@ namespace cryptonote
             tx_info[n].result = false;
             break;
           }
+          // already batch verified with the rest of its sync span
+          if (keeped_by_block && m_blockchain_storage.is_tx_semantics_prevalidated(tx_info[n].tx_hash))
+            break;
           rvv.push_back(&rv); // delayed batch verification
           break;
         default:
@@ -962,6 +983,8 @@ namespace cryptonote
           continue;
         if (tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproof)
           continue;
+        if (std::find(rvv.begin(), rvv.end(), &tx_info[n].tx->rct_signatures) == rvv.end())
+          continue;
         if (assumed_bad || !rct::verRctSemanticsSimple(tx_info[n].tx->rct_signatures))
         {
           set_semantics_failed(tx_info[n].tx_hash);
@@ -1001,9 +1024,8 @@ namespace cryptonote
       });
     }
     waiter.wait(&tpool);
-    it = tx_blobs.begin();
     std::vector<bool> already_have(tx_blobs.size(), false);
-    for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
+    for (size_t i = 0; i < tx_blobs.size(); i++) {
       if (!results[i].res)
         continue;
       if(m_mempool.have_tx(results[i].hash))
@@ -1016,22 +1038,48 @@ namespace cryptonote
         LOG_PRINT_L2("tx " << results[i].hash << " already have transaction in blockchain");
         already_have[i] = true;
       }
-      else
+    }
+
+    // double spends of the pool and the chain are turned away before their
+    // proofs get checked; txes from blocks are exempt, as in
+    // tx_memory_pool::add_tx. Txes of this batch spending the same key images
+    // are left to add_tx, so that an invalid one can't shut out a valid one
+    if (!keeped_by_block)
+    {
+      std::vector<const transaction*> candidates(tx_blobs.size(), NULL);
+      for (size_t i = 0; i < tx_blobs.size(); i++)
+        if (results[i].res && !already_have[i])
+          candidates[i] = &results[i].tx;
+      std::vector<bool> conflicts;
+      m_mempool.check_key_image_conflicts(candidates, conflicts);
+      for (size_t i = 0; i < tx_blobs.size(); i++)
       {
-        tpool.submit(&waiter, [&, i, it] {
-          try
-          {
-            results[i].res = handle_incoming_tx_post(*it, tvc[i], results[i].tx, results[i].hash, keeped_by_block, relayed, do_not_relay);
-          }
-          catch (const std::exception &e)
-          {
-            MERROR_VER("Exception in handle_incoming_tx_post: " << e.what());
-            tvc[i].m_verifivation_failed = true;
-            results[i].res = false;
-          }
-        });
+        if (!conflicts[i])
+          continue;
+        LOG_PRINT_L1("tx " << results[i].hash << " spends key images already spent, rejected");
+        tvc[i].m_verifivation_failed = true;
+        tvc[i].m_double_spend = true;
+        results[i].res = false;
       }
     }
+
+    it = tx_blobs.begin();
+    for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
+      if (!results[i].res || already_have[i])
+        continue;
+      tpool.submit(&waiter, [&, i, it] {
+        try
+        {
+          results[i].res = handle_incoming_tx_post(*it, tvc[i], results[i].tx, results[i].hash, keeped_by_block, relayed, do_not_relay);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR_VER("Exception in handle_incoming_tx_post: " << e.what());
+          tvc[i].m_verifivation_failed = true;
+          results[i].res = false;
+        }
+      });
+    }
     waiter.wait(&tpool);
 
     std::vector<tx_verification_batch_info> tx_info;
@@ -1045,6 +1093,23 @@ namespace cryptonote
       handle_incoming_tx_accumulated_batch(tx_info, keeped_by_block);
 
     bool ok = true;
+    std::vector<txpool_event> added;
+
+    // one pool lock and one db write txn for the whole batch, rather than one per tx
+    m_mempool.lock();
+    epee::misc_utils::auto_scope_leave_caller pool_unlocker = epee::misc_utils::create_scope_leave_handler([&](){m_mempool.unlock();});
+    CRITICAL_REGION_LOCAL1(m_blockchain_storage);
+    BlockchainDB &db = m_blockchain_storage.get_db();
+    const bool batch = db.batch_start();
+    // committed even on exceptions: the pool's in memory state already includes what was added
+    epee::misc_utils::auto_scope_leave_caller batch_stopper = epee::misc_utils::create_scope_leave_handler([&](){
+      if (batch)
+      {
+        try { db.batch_stop(); }
+        catch (const std::exception &e) { MERROR("Failed to commit tx pool batch: " << e.what()); }
+      }
+    });
+
     it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
       if (!results[i].res)
@@ -1065,8 +1130,15 @@ namespace cryptonote
       {MERROR_VER("Transaction verification impossible: " << results[i].hash);}
 
       if(tvc[i].m_added_to_pool)
+      {
         MDEBUG("tx added: " << results[i].hash);
+        if (!do_not_relay && !m_txpool_listeners.empty())
+          added.push_back({results[i].hash, &results[i].tx, &tx_blobs[i].blob, weight, get_tx_fee(results[i].tx)});
+      }
     }
+    if (!added.empty())
+      for (const auto &listener: m_txpool_listeners)
+        listener(added);
     return ok;
 
     CATCH_ENTRY_L0("core::handle_incoming_txs()", false);
@@ -1354,6 +1426,11 @@ namespace cryptonote
     return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, pruned, get_miner_tx_hash, max_block_count, max_tx_count);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<block_complete_entry, crypto::hash>>& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const
+  {
+    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, pruned, get_miner_tx_hash, max_block_count, max_tx_count);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
   {
     return m_blockchain_storage.get_outs(req, res);
@@ -404,6 +404,15 @@ namespace cryptonote
       */
      void set_cryptonote_protocol(i_cryptonote_protocol* pprotocol);
 
+     /**
+      * @brief adds a listener to call with the transactions added to the pool
+      *
+      * Transactions flagged do_not_relay are not passed on.
+      *
+      * @param listener the listener, see core_events.h
+      */
+     void add_txpool_listener(txpool_listener &&listener) { m_txpool_listeners.push_back(std::move(listener)); }
+
      /**
       * @copydoc Blockchain::set_checkpoints
       *
@@ -534,6 +543,13 @@ namespace cryptonote
       */
      bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const;
 
+     /**
+      * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<block_complete_entry, crypto::hash>>&, uint64_t&, uint64_t&, bool, bool, size_t, size_t) const
+      *
+      * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<block_complete_entry, crypto::hash>>&, uint64_t&, uint64_t&, bool, bool, size_t, size_t) const
+      */
+     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<block_complete_entry, crypto::hash>>& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_block_count, size_t max_tx_count) const;
+
      /**
       * @brief gets some stats about the daemon
       *
@@ -1003,6 +1019,8 @@ namespace cryptonote
 
      epee::critical_section m_incoming_tx_lock; //!< incoming transaction lock
 
+     std::vector<txpool_listener> m_txpool_listeners; //!< called with the txes added to the pool
+
      //m_miner and m_miner_addres are probably temporary here
      miner m_miner; //!< miner instance
 
@@ -0,0 +1,91 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "misc_log_ex.h"
+#include "difficulty_window.h"
+
+namespace cryptonote
+{
+
+difficulty_window::difficulty_window(size_t capacity):
+  m_entries(capacity ? capacity : 1),
+  m_first(0),
+  m_size(0)
+{
+}
+
+void difficulty_window::push_back(uint64_t timestamp, const difficulty_type &cumulative_difficulty)
+{
+  if (m_size == m_entries.size())
+  {
+    m_first = slot(1);
+    --m_size;
+  }
+  entry &e = m_entries[slot(m_size)];
+  e.timestamp = timestamp;
+  e.cumulative_difficulty = cumulative_difficulty;
+  ++m_size;
+}
+
+void difficulty_window::push_front(uint64_t timestamp, const difficulty_type &cumulative_difficulty)
+{
+  if (m_size == m_entries.size())
+    return;
+  m_first = slot(m_entries.size() - 1);
+  entry &e = m_entries[m_first];
+  e.timestamp = timestamp;
+  e.cumulative_difficulty = cumulative_difficulty;
+  ++m_size;
+}
+
+void difficulty_window::pop_back()
+{
+  CHECK_AND_ASSERT_THROW_MES(m_size > 0, "Popping from an empty difficulty window");
+  --m_size;
+}
+
+void difficulty_window::clear()
+{
+  m_first = 0;
+  m_size = 0;
+}
+
+void difficulty_window::copy(size_t first, size_t count, std::vector<uint64_t> &timestamps, std::vector<difficulty_type> &cumulative_difficulties) const
+{
+  CHECK_AND_ASSERT_THROW_MES(first + count <= m_size, "Difficulty window range out of bounds");
+  timestamps.reserve(timestamps.size() + count);
+  cumulative_difficulties.reserve(cumulative_difficulties.size() + count);
+  for (size_t i = first; i < first + count; ++i)
+  {
+    const entry &e = m_entries[slot(i)];
+    timestamps.push_back(e.timestamp);
+    cumulative_difficulties.push_back(e.cumulative_difficulty);
+  }
+}
+
+}
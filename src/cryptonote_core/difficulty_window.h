@@ -0,0 +1,81 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cryptonote_basic/difficulty.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief Ring buffer of the timestamps and cumulative difficulties of the
+   * most recent main chain blocks
+   *
+   * Blocks are pushed and popped at the back as the chain moves, and older
+   * blocks can be put back at the front after pops. Once full, pushing drops
+   * the oldest entry. Index 0 is the oldest entry.
+   *
+   * Not thread safe, the caller locks.
+   */
+  class difficulty_window
+  {
+  public:
+    explicit difficulty_window(size_t capacity);
+
+    void push_back(uint64_t timestamp, const difficulty_type &cumulative_difficulty);
+    //! no-op when full
+    void push_front(uint64_t timestamp, const difficulty_type &cumulative_difficulty);
+    void pop_back();
+    void clear();
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_entries.size(); }
+
+    uint64_t timestamp(size_t i) const { return m_entries[slot(i)].timestamp; }
+    const difficulty_type &cumulative_difficulty(size_t i) const { return m_entries[slot(i)].cumulative_difficulty; }
+
+    //! appends entries [first, first + count)
+    void copy(size_t first, size_t count, std::vector<uint64_t> &timestamps, std::vector<difficulty_type> &cumulative_difficulties) const;
+
+  private:
+    struct entry
+    {
+      uint64_t timestamp;
+      difficulty_type cumulative_difficulty;
+    };
+
+    size_t slot(size_t i) const { return (m_first + i) % m_entries.size(); }
+
+    std::vector<entry> m_entries;
+    size_t m_first;
+    size_t m_size;
+  };
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "misc_language.h"
+#include "median_window.h"
+
+namespace cryptonote
+{
+
+void median_window::push_back(uint64_t value)
+{
+  m_values.push_back(value);
+  insert(value);
+}
+
+void median_window::push_front(uint64_t value)
+{
+  m_values.push_front(value);
+  insert(value);
+}
+
+void median_window::pop_back()
+{
+  erase(m_values.back());
+  m_values.pop_back();
+}
+
+void median_window::pop_front()
+{
+  erase(m_values.front());
+  m_values.pop_front();
+}
+
+void median_window::clear()
+{
+  m_values.clear();
+  m_low.clear();
+  m_high.clear();
+}
+
+uint64_t median_window::median() const
+{
+  if (m_low.empty())
+    return 0;
+  if (m_low.size() > m_high.size())
+    return *m_low.rbegin();
+  return epee::misc_utils::get_mid<uint64_t>(*m_low.rbegin(), *m_high.begin());
+}
+
+uint64_t median_window::median_with(const std::vector<uint64_t> &remove, const std::vector<uint64_t> &add)
+{
+  for (uint64_t value: add)
+    insert(value);
+  for (uint64_t value: remove)
+    erase(value);
+  const uint64_t res = median();
+  for (uint64_t value: remove)
+    insert(value);
+  for (uint64_t value: add)
+    erase(value);
+  return res;
+}
+
+void median_window::insert(uint64_t value)
+{
+  if (m_low.empty() || value <= *m_low.rbegin())
+    m_low.insert(value);
+  else
+    m_high.insert(value);
+  rebalance();
+}
+
+void median_window::erase(uint64_t value)
+{
+  auto it = m_low.empty() || value > *m_low.rbegin() ? m_low.end() : m_low.find(value);
+  if (it != m_low.end())
+  {
+    m_low.erase(it);
+  }
+  else
+  {
+    it = m_high.find(value);
+    if (it == m_high.end())
+      return;
+    m_high.erase(it);
+  }
+  rebalance();
+}
+
+void median_window::rebalance()
+{
+  if (m_low.size() > m_high.size() + 1)
+  {
+    auto it = std::prev(m_low.end());
+    m_high.insert(*it);
+    m_low.erase(it);
+  }
+  else if (m_high.size() > m_low.size())
+  {
+    auto it = m_high.begin();
+    m_low.insert(*it);
+    m_high.erase(it);
+  }
+}
+
+}
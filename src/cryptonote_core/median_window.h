@@ -0,0 +1,84 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <vector>
+
+namespace cryptonote
+{
+  /**
+   * @brief Sliding window of values with an O(log n) median
+   *
+   * Values enter and leave at either end, so the window can follow the chain
+   * forwards as blocks are added and backwards as they are popped. The values
+   * are kept split into a lower and an upper half, the median is read off the
+   * boundary between them. For an even number of values it is the midpoint
+   * of the two middle ones, the same as epee::misc_utils::median.
+   *
+   * Not thread safe, the caller locks.
+   */
+  class median_window
+  {
+  public:
+    void push_back(uint64_t value);
+    void push_front(uint64_t value);
+    void pop_back();
+    void pop_front();
+    void clear();
+
+    uint64_t front() const { return m_values.front(); }
+    uint64_t back() const { return m_values.back(); }
+    uint64_t operator[](size_t i) const { return m_values[i]; }
+    size_t size() const { return m_values.size(); }
+    bool empty() const { return m_values.empty(); }
+
+    //! 0 if empty
+    uint64_t median() const;
+
+    /**
+     * @brief median of the window with some values taken out and others added
+     *
+     * The window is left unchanged. Every value in remove must be in the
+     * window (or in add).
+     */
+    uint64_t median_with(const std::vector<uint64_t> &remove, const std::vector<uint64_t> &add);
+
+  private:
+    void insert(uint64_t value);
+    void erase(uint64_t value);
+    void rebalance();
+
+    std::deque<uint64_t> m_values;
+    std::multiset<uint64_t> m_low; //!< holds the extra value when the size is odd
+    std::multiset<uint64_t> m_high;
+  };
+}
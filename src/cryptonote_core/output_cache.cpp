@@ -0,0 +1,91 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "output_cache.h"
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------------------------
+  output_cache::output_cache(size_t capacity):
+    m_capacity(capacity ? capacity : 1),
+    m_hits(0),
+    m_misses(0)
+  {
+  }
+  //---------------------------------------------------------------------------------
+  output_cache::entry *output_cache::find(uint64_t amount, uint64_t index)
+  {
+    const output_key key{amount, index};
+    auto i = m_current.find(key);
+    if (i != m_current.end())
+    {
+      ++m_hits;
+      return &i->second;
+    }
+    i = m_previous.find(key);
+    if (i == m_previous.end())
+    {
+      ++m_misses;
+      return NULL;
+    }
+    ++m_hits;
+    const entry e = i->second;
+    m_previous.erase(i);
+    make_room();
+    return &(m_current[key] = e);
+  }
+  //---------------------------------------------------------------------------------
+  output_cache::entry &output_cache::insert(uint64_t amount, uint64_t index, const output_data_t &data)
+  {
+    const output_key key{amount, index};
+    m_previous.erase(key);
+    auto i = m_current.find(key);
+    if (i == m_current.end())
+    {
+      make_room();
+      i = m_current.emplace(key, entry()).first;
+      i->second.has_txid = false;
+    }
+    i->second.data = data;
+    return i->second;
+  }
+  //---------------------------------------------------------------------------------
+  void output_cache::clear()
+  {
+    m_current.clear();
+    m_previous.clear();
+  }
+  //---------------------------------------------------------------------------------
+  void output_cache::make_room()
+  {
+    if (m_current.size() < m_capacity)
+      return;
+    m_previous = std::move(m_current);
+    m_current = generation();
+  }
+}
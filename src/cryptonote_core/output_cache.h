@@ -0,0 +1,92 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "crypto/hash.h"
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief Cache of recently requested outputs, keyed by amount and index
+   *
+   * Wallets keep picking the same recent outputs as decoys. Entries live in
+   * two generations: lookups hit either and move the entry to the current
+   * one, inserts go to the current one, and once that is full the older
+   * generation is dropped. Memory stays bounded without per-entry LRU
+   * bookkeeping.
+   *
+   * Not thread safe, the caller locks. Outputs never change while they are
+   * on the chain, so the cache only needs clearing when blocks are popped.
+   */
+  class output_cache
+  {
+  public:
+    struct entry
+    {
+      output_data_t data;
+      crypto::hash txid;
+      bool has_txid;
+    };
+
+    explicit output_cache(size_t capacity);
+
+    //! returns NULL on a miss; the pointer is valid until the next insert or find
+    entry *find(uint64_t amount, uint64_t index);
+    entry &insert(uint64_t amount, uint64_t index, const output_data_t &data);
+    void clear();
+
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+  private:
+    struct output_key
+    {
+      uint64_t amount;
+      uint64_t index;
+      bool operator==(const output_key &other) const { return amount == other.amount && index == other.index; }
+    };
+    struct output_key_hash
+    {
+      size_t operator()(const output_key &k) const { return std::hash<uint64_t>()(k.index) ^ (std::hash<uint64_t>()(k.amount) << 1); }
+    };
+    typedef std::unordered_map<output_key, entry, output_key_hash> generation;
+
+    void make_room();
+
+    size_t m_capacity; //!< per generation
+    generation m_current;
+    generation m_previous;
+    uint64_t m_hits;
+    uint64_t m_misses;
+  };
+}
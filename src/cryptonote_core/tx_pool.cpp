@@ -45,6 +45,7 @@
 #include "misc_language.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
+#include "profile_tools.h"
 #include "crypto/hash.h"
 
 #undef WALLSTREETBETS_DEFAULT_LOG_CATEGORY
@@ -65,7 +66,6 @@ namespace cryptonote
     //      will work correctly.
     time_t const MIN_RELAY_TIME = (60 * 5); // only start re-relaying transactions after that many seconds
     time_t const MAX_RELAY_TIME = (60 * 60 * 4); // at most that many seconds between resends
-    float const ACCEPT_THRESHOLD = 1.0f;
 
     // a kind of increasing backoff within min/max bounds
     uint64_t get_relay_delay(time_t now, time_t received)
@@ -76,11 +76,6 @@ namespace cryptonote
       return d;
     }
 
-    uint64_t template_accept_threshold(uint64_t amount)
-    {
-      return amount * ACCEPT_THRESHOLD;
-    }
-
     uint64_t get_transaction_weight_limit(uint8_t version)
     {
       if(version >= 17)
@@ -93,24 +88,29 @@ namespace cryptonote
     // If a batch exists, it can't be from another thread, since we can
     // only be called with the txpool lock taken, and it is held during
     // the whole prepare/handle/cleanup incoming block sequence.
+    // Changes staged in the pool index are published on commit, and
+    // dropped on abort by the LockedTXN which owns the batch; a nested
+    // abort must not throw away what the outer batch staged.
     class LockedTXN {
     public:
-      LockedTXN(Blockchain &b): m_blockchain(b), m_batch(false), m_active(false) {
+      LockedTXN(Blockchain &b, txpool_index &index): m_blockchain(b), m_index(index), m_batch(false), m_active(false) {
         m_batch = m_blockchain.get_db().batch_start();
         m_active = true;
       }
-      void commit() { try { if (m_batch && m_active) { m_blockchain.get_db().batch_stop(); m_active = false; } } catch (const std::exception& e) { MWARNING("LockedTXN::commit filtering exception: " << e.what()); } }
-      void abort() { try { if (m_batch && m_active) { m_blockchain.get_db().batch_abort(); m_active = false; } } catch (const std::exception& e) { MWARNING("LockedTXN::abort filtering exception: " << e.what()); } }
+      void commit() { try { if (m_active) { if (m_batch) m_blockchain.get_db().batch_stop(); m_index.publish(); m_active = false; } } catch (const std::exception& e) { MWARNING("LockedTXN::commit filtering exception: " << e.what()); } }
+      void abort() { try { if (m_active) { if (m_batch) { m_index.discard(); m_blockchain.get_db().batch_abort(); } m_active = false; } } catch (const std::exception& e) { MWARNING("LockedTXN::abort filtering exception: " << e.what()); } }
       ~LockedTXN() { abort(); }
     private:
       Blockchain &m_blockchain;
+      txpool_index &m_index;
       bool m_batch;
       bool m_active;
     };
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0),
+    m_block_template_requests(0), m_block_template_rebuilds(0), m_block_template_time_total(0), m_block_template_time_last(0)
   {
 
   }
@@ -222,11 +222,14 @@ namespace cryptonote
           if (kept_by_block)
             m_parsed_tx_cache.insert(std::make_pair(id, tx));
           CRITICAL_REGION_LOCAL1(m_blockchain);
-          LockedTXN lock(m_blockchain);
+          LockedTXN lock(m_blockchain, m_index);
           m_blockchain.add_txpool_tx(id, blob, meta);
+          m_index.add_tx(id, meta, blob);
           if (!insert_key_images(tx, id, kept_by_block))
             return false;
           m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+          // it will be rechecked from scratch, the chain is being reorganized anyway
+          m_block_template.invalidate();
           lock.commit();
         }
         catch (const std::exception& e)
@@ -267,12 +270,15 @@ namespace cryptonote
         if (kept_by_block)
           m_parsed_tx_cache.insert(std::make_pair(id, tx));
         CRITICAL_REGION_LOCAL1(m_blockchain);
-        LockedTXN lock(m_blockchain);
+        LockedTXN lock(m_blockchain, m_index);
         m_blockchain.remove_txpool_tx(id);
         m_blockchain.add_txpool_tx(id, blob, meta);
+        m_index.remove_tx(id);
+        m_index.add_tx(id, meta, blob);
         if (!insert_key_images(tx, id, kept_by_block))
           return false;
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+        add_to_block_template(id);
         lock.commit();
       }
       catch (const std::exception& e)
@@ -309,6 +315,36 @@ namespace cryptonote
     return add_tx(tx, h, bl, get_transaction_weight(tx, bl.size()), tvc, keeped_by_block, relayed, do_not_relay, version);
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::check_key_image_conflicts(const std::vector<const transaction*> &txs, std::vector<bool> &conflicts)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    find_key_image_conflicts(txs, [this](const crypto::key_image &k_image) {
+      return have_tx_keyimg_as_spent(k_image) || m_blockchain.have_tx_keyimg_as_spent(k_image);
+    }, conflicts);
+    for (size_t i = 0; i < txs.size(); ++i)
+      if (conflicts[i] && have_tx_keyimges_as_spent(*txs[i]))
+        mark_double_spend(*txs[i]);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::find_key_image_conflicts(const std::vector<const transaction*> &txs, const std::function<bool(const crypto::key_image&)> &spent, std::vector<bool> &conflicts)
+  {
+    conflicts.assign(txs.size(), false);
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+      if (!txs[i])
+        continue;
+      for (const auto &in: txs[i]->vin)
+      {
+        if (in.type() == typeid(txin_to_key) && spent(boost::get<txin_to_key>(in).k_image))
+        {
+          conflicts[i] = true;
+          break;
+        }
+      }
+    }
+  }
+  //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_txpool_weight() const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -327,7 +363,7 @@ namespace cryptonote
     if (bytes == 0)
       bytes = m_txpool_max_weight;
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    LockedTXN lock(m_blockchain);
+    LockedTXN lock(m_blockchain, m_index);
     bool changed = false;
 
     // this will never remove the first one, but we don't care
@@ -339,21 +375,21 @@ namespace cryptonote
       try
       {
         const crypto::hash &txid = it->second;
-        txpool_tx_meta_t meta;
-        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+        const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(txid);
+        if (!e)
         {
           MERROR("Failed to find tx in txpool");
           return;
         }
+        const txpool_tx_meta_t &meta = e->meta;
         // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
         if (meta.kept_by_block)
         {
           --it;
           continue;
         }
-        cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
         cryptonote::transaction_prefix tx;
-        if (!parse_and_validate_tx_prefix_from_blob(txblob, tx))
+        if (!parse_and_validate_tx_prefix_from_blob(*e->blob, tx))
         {
           MERROR("Failed to parse tx from txpool");
           return;
@@ -361,8 +397,10 @@ namespace cryptonote
         // remove first, in case this throws, so key images aren't removed
         MINFO("Pruning tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
         m_blockchain.remove_txpool_tx(txid);
+        m_index.remove_tx(txid);
         m_txpool_weight -= meta.weight;
         remove_transaction_keyimages(tx, txid);
+        m_block_template.remove(txid, tx);
         MINFO("Pruned tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
         m_txs_by_fee_and_receive_time.erase(it--);
         changed = true;
@@ -391,6 +429,7 @@ namespace cryptonote
                                           << "tx_id= " << id );
       auto ins_res = kei_image_set.insert(id);
       CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
+      m_index.add_key_image(txin.k_image, id);
     }
     ++m_cookie;
     return true;
@@ -418,6 +457,7 @@ namespace cryptonote
       CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << txin.k_image << ENDL
         << "transaction id = " << actual_hash);
       key_image_set.erase(it_in_set);
+      m_index.remove_key_image(txin.k_image, actual_hash);
       if(!key_image_set.size())
       {
         //it is now empty hash container for this key_image
@@ -439,14 +479,15 @@ namespace cryptonote
 
     try
     {
-      LockedTXN lock(m_blockchain);
-      txpool_tx_meta_t meta;
-      if(!m_blockchain.get_txpool_tx_meta(id, meta))
+      LockedTXN lock(m_blockchain, m_index);
+      const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(id);
+      if(!e)
       {
         MERROR("Failed to find tx in txpool");
         return false;
       }
-      txblob = m_blockchain.get_txpool_tx_blob(id);
+      const txpool_tx_meta_t &meta = e->meta;
+      txblob = *e->blob;
       auto ci = m_parsed_tx_cache.find(id);
       if(ci != m_parsed_tx_cache.end())
       {
@@ -470,8 +511,10 @@ namespace cryptonote
 
       // remove first, in case this throws, so key images aren't removed
       m_blockchain.remove_txpool_tx(id);
+      m_index.remove_tx(id);
       m_txpool_weight -= tx_weight;
       remove_transaction_keyimages(tx, id);
+      m_block_template.remove(id, tx);
       lock.commit();
     }
     catch (const std::exception& e)
@@ -504,7 +547,8 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     std::list<std::pair<crypto::hash, uint64_t>> remove;
-    m_blockchain.for_all_txpool_txes([this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *) {
+    m_index.current().for_each([this, &remove](const crypto::hash &txid, const txpool_index::entry &e) {
+      const txpool_tx_meta_t &meta = e.meta;
       uint64_t tx_age = time(nullptr) - meta.receive_time;
 
       if((tx_age > CRYPTONOTE_MEMPOOL_TX_LIVETIME && !meta.kept_by_block) ||
@@ -524,19 +568,19 @@ namespace cryptonote
         remove.push_back(std::make_pair(txid, meta.weight));
       }
       return true;
-    }, false);
+    });
 
     if (!remove.empty())
     {
-      LockedTXN lock(m_blockchain);
+      LockedTXN lock(m_blockchain, m_index);
       for (const std::pair<crypto::hash, uint64_t> &entry: remove)
       {
         const crypto::hash &txid = entry.first;
         try
         {
-          cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
+          const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(txid);
           cryptonote::transaction_prefix tx;
-          if (!parse_and_validate_tx_prefix_from_blob(bd, tx))
+          if (!e || !parse_and_validate_tx_prefix_from_blob(*e->blob, tx))
           {
             MERROR("Failed to parse tx from txpool");
             // continue
@@ -545,8 +589,10 @@ namespace cryptonote
           {
             // remove first, so we only remove key images if the tx removal succeeds
             m_blockchain.remove_txpool_tx(txid);
+            m_index.remove_tx(txid);
             m_txpool_weight -= entry.second;
             remove_transaction_keyimages(tx, txid);
+            m_block_template.remove(txid, tx);
           }
         }
         catch (const std::exception& e)
@@ -564,11 +610,11 @@ namespace cryptonote
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_relayable_transactions(std::vector<std::pair<crypto::hash, cryptonote::blobdata>> &txs) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
     const uint64_t now = time(NULL);
-    txs.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *){
+    txs.reserve(pool->count());
+    pool->for_each([now, &txs](const crypto::hash &txid, const txpool_index::entry &e){
+      const txpool_tx_meta_t &meta = e.meta;
       // 0 fee transactions are never relayed
       if(!meta.pruned && meta.fee > 0 && !meta.do_not_relay && now - meta.last_relayed_time > get_relay_delay(now, meta.receive_time))
       {
@@ -577,21 +623,10 @@ namespace cryptonote
         // flushed txes to be re-added when received from a node which was just about to flush it
         uint64_t max_age = meta.kept_by_block ? CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME : CRYPTONOTE_MEMPOOL_TX_LIVETIME;
         if (now - meta.receive_time <= max_age / 2)
-        {
-          try
-          {
-            cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
-            txs.push_back(std::make_pair(txid, bd));
-          }
-          catch (const std::exception& e)
-          {
-            MERROR("Failed to get transaction blob from db");
-            // ignore error
-          }
-        }
+          txs.push_back(std::make_pair(txid, *e.blob));
       }
       return true;
-    }, false);
+    });
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -600,17 +635,19 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     const time_t now = time(NULL);
-    LockedTXN lock(m_blockchain);
+    LockedTXN lock(m_blockchain, m_index);
     for (auto it = txs.begin(); it != txs.end(); ++it)
     {
       try
       {
-        txpool_tx_meta_t meta;
-        if (m_blockchain.get_txpool_tx_meta(it->first, meta))
+        const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(it->first);
+        if (e)
         {
+          txpool_tx_meta_t meta = e->meta;
           meta.relayed = true;
           meta.last_relayed_time = now;
           m_blockchain.update_txpool_tx(it->first, meta);
+          m_index.update_tx(it->first, meta);
         }
       }
       catch (const std::exception& e)
@@ -624,19 +661,16 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count(bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    return m_index.get_snapshot()->count(include_unrelayed_txes);
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
+    txs.reserve(pool->count(include_unrelayed_txes));
+    pool->for_each([&txs](const crypto::hash&, const txpool_index::entry &e){
       transaction tx;
-      if(!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, tx) : parse_and_validate_tx_from_blob(*bd, tx)))
+      if(!(e.meta.pruned ? parse_and_validate_tx_base_from_blob(*e.blob, tx) : parse_and_validate_tx_from_blob(*e.blob, tx)))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -644,42 +678,40 @@ namespace cryptonote
       }
       txs.push_back(tx);
       return true;
-    }, true, include_unrelayed_txes);
+    }, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
+    txs.reserve(pool->count(include_unrelayed_txes));
+    pool->for_each([&txs](const crypto::hash &txid, const txpool_index::entry&){
       txs.push_back(txid);
       return true;
-    }, false, include_unrelayed_txes);
+    }, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
     const uint64_t now = time(NULL);
-    backlog.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      backlog.push_back({meta.weight, meta.fee, meta.receive_time - now});
+    backlog.reserve(pool->count(include_unrelayed_txes));
+    pool->for_each([&backlog, now](const crypto::hash&, const txpool_index::entry &e){
+      backlog.push_back({e.meta.weight, e.meta.fee, e.meta.receive_time - now});
       return true;
-    }, false, include_unrelayed_txes);
+    }, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
     const uint64_t now = time(NULL);
     std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    stats.txs_total = pool->count(include_unrelayed_txes);
     std::vector<uint32_t> weights;
     weights.reserve(stats.txs_total);
-    m_blockchain.for_all_txpool_txes([&stats, &weights, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    pool->for_each([&stats, &weights, now, &agebytes](const crypto::hash&, const txpool_index::entry &e){
+      const txpool_tx_meta_t &meta = e.meta;
       weights.push_back(meta.weight);
       stats.bytes_total += meta.weight;
       if (!stats.bytes_min || meta.weight < stats.bytes_min)
@@ -701,7 +733,12 @@ namespace cryptonote
       if (meta.double_spend_seen)
         ++stats.num_double_spends;
       return true;
-      }, false, include_unrelayed_txes);
+      }, include_unrelayed_txes);
+
+    stats.template_requests = m_block_template_requests;
+    stats.template_rebuilds = m_block_template_rebuilds;
+    stats.template_time_avg = stats.template_requests ? m_block_template_time_total / stats.template_requests : 0;
+    stats.template_time_last = m_block_template_time_last;
     stats.bytes_med = epee::misc_utils::median(weights);
     if (stats.txs_total > 1)
     {
@@ -750,11 +787,12 @@ namespace cryptonote
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info>& tx_infos, std::vector<spent_key_image_info>& key_image_infos, bool include_sensitive_data) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    tx_infos.reserve(m_blockchain.get_txpool_tx_count());
-    key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
+    tx_infos.reserve(pool->count());
+    key_image_infos.reserve(pool->count());
+    pool->for_each([&tx_infos, include_sensitive_data](const crypto::hash &txid, const txpool_index::entry &e){
+      const txpool_tx_meta_t &meta = e.meta;
+      const cryptonote::blobdata *bd = e.blob.get();
       tx_info txi;
       txi.id_hash = epee::string_tools::pod_to_hex(txid);
       txi.tx_blob = *bd;
@@ -784,51 +822,42 @@ namespace cryptonote
       txi.double_spend_seen = meta.double_spend_seen;
       tx_infos.push_back(txi);
       return true;
-    }, true, include_sensitive_data);
+    }, include_sensitive_data);
 
-    txpool_tx_meta_t meta;
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
-      const crypto::key_image& k_image = kee.first;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
+    return pool->for_each([&pool, &key_image_infos, include_sensitive_data](const crypto::key_image &k_image, const std::vector<crypto::hash> &txids){
       spent_key_image_info ki;
       ki.id_hash = epee::string_tools::pod_to_hex(k_image);
-      for (const crypto::hash& tx_id_hash : kei_image_set)
+      for (const crypto::hash& tx_id_hash : txids)
       {
         if (!include_sensitive_data)
         {
-          try
+          const std::shared_ptr<const txpool_index::entry> e = pool->find(tx_id_hash);
+          if (!e)
           {
-            if (!m_blockchain.get_txpool_tx_meta(tx_id_hash, meta))
-            {
-              MERROR("Failed to get tx meta from txpool");
-              return false;
-            }
-            if (!meta.relayed)
-              // Do not include that transaction if in restricted mode and it's not relayed
-              continue;
-          }
-          catch (const std::exception& e)
-          {
-            MERROR("Failed to get tx meta from txpool: " << e.what());
+            MERROR("Failed to get tx meta from txpool");
             return false;
           }
+          if (!e->meta.relayed)
+            // Do not include that transaction if in restricted mode and it's not relayed
+            continue;
         }
         ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
       }
       // Only return key images for which we have at least one tx that we can show for them
       if (!ki.txs_hashes.empty())
         key_image_infos.push_back(ki);
-    }
-    return true;
+      return true;
+    });
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool>& tx_infos, cryptonote::rpc::key_images_with_tx_hashes& key_image_infos) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    tx_infos.reserve(m_blockchain.get_txpool_tx_count());
-    key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
+    tx_infos.reserve(pool->count());
+    key_image_infos.reserve(pool->count());
+    pool->for_each([&tx_infos](const crypto::hash &txid, const txpool_index::entry &e){
+      const txpool_tx_meta_t &meta = e.meta;
+      const cryptonote::blobdata *bd = e.blob.get();
       cryptonote::rpc::tx_in_pool txi;
       txi.tx_hash = txid;
       if(!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, txi.tx) : parse_and_validate_tx_from_blob(*bd, txi.tx)))
@@ -853,32 +882,23 @@ namespace cryptonote
       txi.double_spend_seen = meta.double_spend_seen;
       tx_infos.push_back(txi);
       return true;
-    }, true, false);
-
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
-      std::vector<crypto::hash> tx_hashes;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
-      for (const crypto::hash& tx_id_hash : kei_image_set)
-      {
-        tx_hashes.push_back(tx_id_hash);
-      }
+    }, false);
 
-      const crypto::key_image& k_image = kee.first;
-      key_image_infos[k_image] = tx_hashes;
-    }
-    return true;
+    return pool->for_each([&key_image_infos](const crypto::key_image &k_image, const std::vector<crypto::hash> &txids){
+      key_image_infos[k_image] = txids;
+      return true;
+    });
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const txpool_index::snapshot> pool = m_index.get_snapshot();
 
     spent.clear();
 
     for (const auto& image : key_images)
     {
-      spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      spent.push_back(pool->find(image) != nullptr);
     }
 
     return true;
@@ -886,16 +906,11 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction(const crypto::hash& id, cryptonote::blobdata& txblob) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    try
-    {
-      return m_blockchain.get_txpool_tx_blob(id, txblob);
-    }
-    catch (const std::exception& e)
-    {
+    const std::shared_ptr<const txpool_index::entry> e = m_index.get_snapshot()->find(id);
+    if (!e)
       return false;
-    }
+    txblob = *e->blob;
+    return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
@@ -903,6 +918,7 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_input_cache.clear();
     m_parsed_tx_cache.clear();
+    m_block_template.invalidate();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -911,14 +927,13 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_input_cache.clear();
     m_parsed_tx_cache.clear();
+    m_block_template.invalidate();
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_db().txpool_has_tx(id);
+    return m_index.get_snapshot()->find(id) != nullptr;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx) const
@@ -1036,34 +1051,12 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::have_key_images(const std::unordered_set<crypto::key_image>& k_images, const transaction_prefix& tx)
-  {
-    for(size_t i = 0; i!= tx.vin.size(); i++)
-    {
-      CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, false);
-      if(k_images.count(itk.k_image))
-        return true;
-    }
-    return false;
-  }
-  //---------------------------------------------------------------------------------
-  bool tx_memory_pool::append_key_images(std::unordered_set<crypto::key_image>& k_images, const transaction_prefix& tx)
-  {
-    for(size_t i = 0; i!= tx.vin.size(); i++)
-    {
-      CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, false);
-      auto i_res = k_images.insert(itk.k_image);
-      CHECK_AND_ASSERT_MES(i_res.second, false, "internal error: key images pool cache - inserted duplicate image in set: " << itk.k_image);
-    }
-    return true;
-  }
-  //---------------------------------------------------------------------------------
   void tx_memory_pool::mark_double_spend(const transaction &tx)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     bool changed = false;
-    LockedTXN lock(m_blockchain);
+    LockedTXN lock(m_blockchain, m_index);
     for(size_t i = 0; i!= tx.vin.size(); i++)
     {
       CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, void());
@@ -1072,13 +1065,14 @@ namespace cryptonote
       {
         for (const crypto::hash &txid: it->second)
         {
-          txpool_tx_meta_t meta;
-          if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+          const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(txid);
+          if (!e)
           {
             MERROR("Failed to find tx meta in txpool");
             // continue, not fatal
             continue;
           }
+          txpool_tx_meta_t meta = e->meta;
           if (!meta.double_spend_seen)
           {
             MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
@@ -1087,6 +1081,7 @@ namespace cryptonote
             try
             {
               m_blockchain.update_txpool_tx(txid, meta);
+              m_index.update_tx(txid, meta);
             }
             catch (const std::exception& e)
             {
@@ -1105,9 +1100,9 @@ namespace cryptonote
   std::string tx_memory_pool::print_pool(bool short_format) const
   {
     std::stringstream ss;
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
+    m_index.get_snapshot()->for_each([&ss, short_format](const crypto::hash &txid, const txpool_index::entry &e) {
+      const txpool_tx_meta_t &meta = e.meta;
+      const cryptonote::blobdata *txblob = e.blob.get();
       ss << "id: " << txid << std::endl;
       if (!short_format) {
         cryptonote::transaction tx;
@@ -1128,7 +1123,7 @@ namespace cryptonote
         << "last_failed_height: " << meta.last_failed_height << std::endl
         << "last_failed_id: " << meta.last_failed_id << std::endl;
       return true;
-    }, !short_format);
+    });
 
     return ss.str();
   }
@@ -1139,115 +1134,88 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    uint64_t best_coinbase = 0, coinbase = 0;
-    uint64_t height = m_blockchain.get_current_blockchain_height() - 1;
-    total_weight = 0;
-    fee = 0;
-
-    //baseline empty block
-    get_block_reward(median_weight, total_weight, already_generated_coins, fee, best_coinbase, version, height);
-
-
-    size_t max_total_weight = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    std::unordered_set<crypto::key_image> k_images;
-
-    LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+    TIME_MEASURE_NS_START(fill_time);
 
-    LockedTXN lock(m_blockchain);
-
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    const txpool_block_template &bt = m_block_template;
+    if (!bt.matches(m_blockchain.get_tail_id(), median_weight, already_generated_coins, version))
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
-      {
-        MERROR("  failed to find tx meta");
-        continue;
-      }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
-
-      if(meta.pruned)
-      {
-        LOG_PRINT_L2(" tx is pruned");
-        continue;
-      }
-
-      // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
-      {
-        LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
-      }
-
-      // If we're getting lower coinbase tx,
-      // stop including more tx
-      uint64_t block_reward;
-      if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, fee, block_reward, version, height))
-      {
-        LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
-      }
-      coinbase = block_reward + meta.fee;
-      if (coinbase < template_accept_threshold(best_coinbase))
-      {
-        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
-        continue;
-      }
+      build_block_template(median_weight, already_generated_coins, version);
+      ++m_block_template_rebuilds;
+    }
+    else
+    {
+      LOG_PRINT_L2("Reusing block template with " << bt.tx_hashes().size() << " txes");
+    }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
+    bl.tx_hashes.insert(bl.tx_hashes.end(), bt.tx_hashes().begin(), bt.tx_hashes().end());
+    total_weight = bt.total_weight();
+    fee = bt.fee();
+    expected_reward = bt.coinbase();
 
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
+    TIME_MEASURE_NS_FINISH(fill_time);
+    ++m_block_template_requests;
+    m_block_template_time_total += fill_time / 1000;
+    m_block_template_time_last = fill_time / 1000;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_ready_for_block_template(const crypto::hash &txid, transaction &tx)
+  {
+    const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(txid);
+    if (!e)
+      return false;
+    txpool_tx_meta_t meta = e->meta;
+    const cryptonote::txpool_tx_meta_t original_meta = meta;
+    const bool ready = is_transaction_ready_to_go(meta, txid, *e->blob, tx);
+    if (memcmp(&original_meta, &meta, sizeof(meta)))
+    {
       try
       {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
+        m_blockchain.update_txpool_tx(txid, meta);
+        m_index.update_tx(txid, meta);
       }
       catch (const std::exception& e)
       {
-        MERROR("Failed to check transaction readiness: " << e.what());
+        MERROR("Failed to update tx meta: " << e.what());
         // continue, not fatal
       }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
-      {
-        try
-        {
-          m_blockchain.update_txpool_tx(sorted_it->second, meta);
-        }
-        catch (const std::exception& e)
-        {
-          MERROR("Failed to update tx meta: " << e.what());
-          // continue, not fatal
-        }
-      }
-      if (!ready)
+    }
+    return ready;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::build_block_template(size_t median_weight, uint64_t already_generated_coins, uint8_t version)
+  {
+    std::vector<txpool_block_template::tx_info> txs;
+    txs.reserve(m_txs_by_fee_and_receive_time.size());
+    const txpool_index::snapshot &snapshot = m_index.current();
+    for (const auto &sorted: m_txs_by_fee_and_receive_time)
+    {
+      const std::shared_ptr<const txpool_index::entry> e = snapshot.find(sorted.second);
+      if (!e)
       {
-        LOG_PRINT_L2("  not ready to go");
+        MERROR("  failed to find tx meta");
         continue;
       }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
+      if (e->meta.pruned)
         continue;
-      }
-
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+      txs.push_back({sorted.second, e->meta.weight, e->meta.fee});
     }
-    lock.commit();
 
-    expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
-        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
-        << " (including " << print_money(fee) << " in fees)");
-    return true;
+    LockedTXN lock(m_blockchain, m_index);
+    m_block_template.build(m_blockchain.get_tail_id(), m_blockchain.get_current_blockchain_height() - 1, median_weight, already_generated_coins, version,
+        txs, [this](const crypto::hash &txid, transaction &tx) { return is_ready_for_block_template(txid, tx); });
+    lock.commit();
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_to_block_template(const crypto::hash &txid)
+  {
+    if (!m_block_template.valid())
+      return;
+    const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(txid);
+    if (!e || e->meta.pruned)
+      return;
+    m_block_template.add(m_blockchain.get_tail_id(), {txid, e->meta.weight, e->meta.fee},
+        [this](const crypto::hash &txid, transaction &tx) { return is_ready_for_block_template(txid, tx); });
   }
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::validate(uint8_t version)
@@ -1258,7 +1226,8 @@ namespace cryptonote
     std::unordered_set<crypto::hash> remove;
 
     m_txpool_weight = 0;
-    m_blockchain.for_all_txpool_txes([this, &remove, tx_weight_limit](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+    m_index.current().for_each([this, &remove, tx_weight_limit](const crypto::hash &txid, const txpool_index::entry &e) {
+      const txpool_tx_meta_t &meta = e.meta;
       m_txpool_weight += meta.weight;
       if (meta.weight > tx_weight_limit) {
         LOG_PRINT_L1("Transaction " << txid << " is too big (" << meta.weight << " bytes), removing it from pool");
@@ -1269,27 +1238,29 @@ namespace cryptonote
         remove.insert(txid);
       }
       return true;
-    }, false);
+    });
 
     size_t n_removed = 0;
     if (!remove.empty())
     {
-      LockedTXN lock(m_blockchain);
+      LockedTXN lock(m_blockchain, m_index);
       for (const crypto::hash &txid: remove)
       {
         try
         {
-          cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
+          const std::shared_ptr<const txpool_index::entry> e = m_index.current().find(txid);
           cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!e || !parse_and_validate_tx_from_blob(*e->blob, tx))
           {
             MERROR("Failed to parse tx from txpool");
             continue;
           }
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
-          m_txpool_weight -= get_transaction_weight(tx, txblob.size());
+          m_index.remove_tx(txid);
+          m_txpool_weight -= get_transaction_weight(tx, e->blob->size());
           remove_transaction_keyimages(tx, txid);
+          m_block_template.remove(txid, tx);
           auto sorted_it = find_tx_in_sorted_container(txid);
           if (sorted_it == m_txs_by_fee_and_receive_time.end())
           {
@@ -1322,6 +1293,8 @@ namespace cryptonote
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
     m_spent_key_images.clear();
+    m_index.clear();
+    m_block_template.invalidate();
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
 
@@ -1340,6 +1313,7 @@ namespace cryptonote
           remove.push_back(txid);
           return true;
         }
+        m_index.add_tx(txid, meta, *bd);
         if(!insert_key_images(tx, txid, meta.kept_by_block))
         {
           MFATAL("Failed to insert key images from txpool tx");
@@ -1350,11 +1324,15 @@ namespace cryptonote
         return true;
       }, true);
       if(!r)
+      {
+        m_index.discard();
         return false;
+      }
     }
+    m_index.publish();
     if(!remove.empty())
     {
-      LockedTXN lock(m_blockchain);
+      LockedTXN lock(m_blockchain, m_index);
       for(const auto &txid: remove)
       {
         try
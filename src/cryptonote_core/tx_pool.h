@@ -32,6 +32,7 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <functional>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
@@ -48,6 +49,8 @@
 #include "crypto/hash.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
+#include "txpool_index.h"
+#include "txpool_block_template.h"
 
 namespace cryptonote
 {
@@ -129,6 +132,32 @@ namespace cryptonote
      */
     bool add_tx(transaction &tx, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version);
 
+    /**
+     * @brief finds the txes of an incoming batch which spend key images already
+     * spent in the pool or in the chain
+     *
+     * Meant to run before the expensive checks, so those are not wasted on
+     * double spends. Pool txes spending the same key images are flagged, as
+     * add_tx would do. Txes of the batch spending the same key images are not
+     * conflicts here: which of them is valid is only known after their checks,
+     * and add_tx settles it when they go into the pool.
+     *
+     * @param txs the incoming txes, NULL entries are skipped
+     * @param conflicts return-by-reference, true for the txes which conflict
+     */
+    void check_key_image_conflicts(const std::vector<const transaction*> &txs, std::vector<bool> &conflicts);
+
+    /**
+     * @brief finds the txes which spend a key image already spent
+     *
+     * The txes are not checked against each other, only against spent.
+     *
+     * @param txs the txes, NULL entries are skipped
+     * @param spent tells whether a key image is already spent
+     * @param conflicts return-by-reference, true for the txes spending such a key image
+     */
+    static void find_key_image_conflicts(const std::vector<const transaction*> &txs, const std::function<bool(const crypto::key_image&)> &spent, std::vector<bool> &conflicts);
+
     /**
      * @brief takes a transaction with the given hash from the pool
      *
@@ -486,26 +515,6 @@ namespace cryptonote
      */
     bool remove_transaction_keyimages(const transaction_prefix& tx, const crypto::hash &txid);
 
-    /**
-     * @brief check if any of a transaction's spent key images are present in a given set
-     *
-     * @param kic the set of key images to check against
-     * @param tx the transaction to check
-     *
-     * @return true if any key images present in the set, otherwise false
-     */
-    static bool have_key_images(const std::unordered_set<crypto::key_image>& kic, const transaction_prefix& tx);
-
-    /**
-     * @brief append the key images from a transaction to the given set
-     *
-     * @param kic the set of key images to append to
-     * @param tx the transaction
-     *
-     * @return false if any append fails, otherwise true
-     */
-    static bool append_key_images(std::unordered_set<crypto::key_image>& kic, const transaction_prefix& tx);
-
     /**
      * @brief check if a transaction is a valid candidate for inclusion in a block
      *
@@ -523,6 +532,30 @@ namespace cryptonote
      */
     void mark_double_spend(const transaction &tx);
 
+    /**
+     * @brief block template readiness check, also saves what it learnt in the tx meta
+     */
+    bool is_ready_for_block_template(const crypto::hash &txid, transaction &tx);
+
+    /**
+     * @brief picks the transactions for the next block from scratch
+     *
+     * The result is kept in m_block_template, which is then updated as
+     * transactions enter and leave the pool until the chain changes.
+     *
+     * @param median_weight the current median block weight
+     * @param already_generated_coins the current total number of coins "minted"
+     * @param version hard fork version to use for consensus rules
+     */
+    void build_block_template(size_t median_weight, uint64_t already_generated_coins, uint8_t version);
+
+    /**
+     * @brief adds a newly accepted transaction to the cached block template
+     *
+     * @param txid the hash of the transaction
+     */
+    void add_to_block_template(const crypto::hash &txid);
+
     /**
      * @brief prune lowest fee/byte txes till we're not above bytes
      *
@@ -552,6 +585,9 @@ private:
     //! container for spent key images from the transactions in the pool
     key_images_container m_spent_key_images;
 
+    //! in-memory copy of the pool, readers work on its snapshots without taking the pool lock
+    txpool_index m_index;
+
     //TODO: this time should be a named constant somewhere, not hard-coded
     //! interval on which to check for stale/"stuck" transactions
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
@@ -562,6 +598,14 @@ private:
 
     std::atomic<uint64_t> m_cookie; //!< incremented at each change
 
+    //! the transactions picked for the next block
+    txpool_block_template m_block_template;
+
+    std::atomic<uint64_t> m_block_template_requests; //!< number of fill_block_template calls
+    std::atomic<uint64_t> m_block_template_rebuilds; //!< number of those which had to start from scratch
+    std::atomic<uint64_t> m_block_template_time_total; //!< time spent in fill_block_template, in microseconds
+    std::atomic<uint64_t> m_block_template_time_last; //!< time spent in the last fill_block_template, in microseconds
+
     /**
      * @brief get an iterator to a transaction in the sorted container
      *
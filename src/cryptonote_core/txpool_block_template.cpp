@@ -0,0 +1,263 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_config.h"
+#include "misc_log_ex.h"
+#include "txpool_block_template.h"
+
+#undef WALLSTREETBETS_DEFAULT_LOG_CATEGORY
+#define WALLSTREETBETS_DEFAULT_LOG_CATEGORY "txpool"
+
+namespace cryptonote
+{
+  namespace
+  {
+    float const ACCEPT_THRESHOLD = 1.0f;
+
+    uint64_t template_accept_threshold(uint64_t amount)
+    {
+      return amount * ACCEPT_THRESHOLD;
+    }
+
+    bool have_key_images(const std::unordered_set<crypto::key_image>& k_images, const transaction_prefix& tx)
+    {
+      for(size_t i = 0; i!= tx.vin.size(); i++)
+      {
+        CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, false);
+        if(k_images.count(itk.k_image))
+          return true;
+      }
+      return false;
+    }
+
+    bool append_key_images(std::unordered_set<crypto::key_image>& k_images, const transaction_prefix& tx)
+    {
+      for(size_t i = 0; i!= tx.vin.size(); i++)
+      {
+        CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, false);
+        auto i_res = k_images.insert(itk.k_image);
+        CHECK_AND_ASSERT_MES(i_res.second, false, "internal error: key images pool cache - inserted duplicate image in set: " << itk.k_image);
+      }
+      return true;
+    }
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_block_template::matches(const crypto::hash &prev_id, size_t median_weight, uint64_t already_generated_coins, uint8_t version) const
+  {
+    return m_valid && m_prev_id == prev_id && m_median_weight == median_weight && m_already_generated_coins == already_generated_coins && m_version == version;
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_block_template::build(const crypto::hash &prev_id, uint64_t height, size_t median_weight, uint64_t already_generated_coins, uint8_t version,
+      const std::vector<tx_info> &txs, const ready_callback &ready)
+  {
+    m_valid = false;
+    m_complete = true;
+    m_prev_id = prev_id;
+    m_height = height;
+    m_median_weight = median_weight;
+    m_already_generated_coins = already_generated_coins;
+    m_version = version;
+    m_tx_hashes.clear();
+    m_txs.clear();
+    m_k_images.clear();
+
+    uint64_t best_coinbase = 0, coinbase = 0;
+    size_t total_weight = 0;
+    uint64_t fee = 0;
+
+    //baseline empty block
+    get_block_reward(median_weight, total_weight, already_generated_coins, fee, best_coinbase, version, height);
+
+
+    size_t max_total_weight = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+
+    LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << txs.size() << " txes in the pool");
+
+    for (const tx_info &info: txs)
+    {
+      LOG_PRINT_L2("Considering " << info.txid << ", weight " << info.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
+
+      // Can not exceed maximum block weight
+      if (max_total_weight < total_weight + info.weight)
+      {
+        LOG_PRINT_L2("  would exceed maximum block weight");
+        m_complete = false;
+        continue;
+      }
+
+      // If we're getting lower coinbase tx,
+      // stop including more tx
+      uint64_t block_reward;
+      if(!get_block_reward(median_weight, total_weight + info.weight, already_generated_coins, fee, block_reward, version, height))
+      {
+        LOG_PRINT_L2("  would exceed maximum block weight");
+        m_complete = false;
+        continue;
+      }
+      coinbase = block_reward + info.fee;
+      if (coinbase < template_accept_threshold(best_coinbase))
+      {
+        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+        m_complete = false;
+        continue;
+      }
+
+      // Skip transactions that are not ready to be
+      // included into the blockchain or that are
+      // missing key images
+      cryptonote::transaction tx;
+      bool is_ready = false;
+      try
+      {
+        is_ready = ready(info.txid, tx);
+      }
+      catch (const std::exception& e)
+      {
+        MERROR("Failed to check transaction readiness: " << e.what());
+        // continue, not fatal
+      }
+      if (!is_ready)
+      {
+        LOG_PRINT_L2("  not ready to go");
+        continue;
+      }
+      if (have_key_images(m_k_images, tx))
+      {
+        LOG_PRINT_L2("  key images already seen");
+        m_complete = false;
+        continue;
+      }
+
+      m_tx_hashes.push_back(info.txid);
+      m_txs[info.txid] = std::make_pair(info.weight, info.fee);
+      total_weight += info.weight;
+      fee += info.fee;
+      best_coinbase = coinbase;
+      append_key_images(m_k_images, tx);
+      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+    }
+
+    // past the median, which txes get in depends on their order, so any
+    // change to the pool will need a full rebuild
+    if (total_weight > std::max<size_t>(median_weight, get_min_block_weight(version)))
+      m_complete = false;
+
+    m_total_weight = total_weight;
+    m_fee = fee;
+    m_coinbase = best_coinbase;
+    m_valid = true;
+    LOG_PRINT_L2("Block template filled with " << m_tx_hashes.size() << " txes, weight "
+        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
+        << " (including " << print_money(fee) << " in fees)");
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_block_template::add(const crypto::hash &prev_id, const tx_info &info, const ready_callback &ready)
+  {
+    if (!m_valid)
+      return;
+    if (!m_complete || m_prev_id != prev_id)
+    {
+      m_valid = false;
+      return;
+    }
+
+    cryptonote::transaction tx;
+    bool is_ready = false;
+    try
+    {
+      is_ready = ready(info.txid, tx);
+    }
+    catch (const std::exception& e)
+    {
+      MERROR("Failed to check transaction readiness: " << e.what());
+      m_valid = false;
+      return;
+    }
+    if (!is_ready)
+      return;
+
+    // a full rebuild might pick another tx, or a different set
+    if (have_key_images(m_k_images, tx) || m_total_weight + info.weight > std::max<size_t>(m_median_weight, get_min_block_weight(m_version)))
+    {
+      m_valid = false;
+      return;
+    }
+
+    uint64_t coinbase;
+    if (!get_block_reward(m_median_weight, m_total_weight + info.weight, m_already_generated_coins, m_fee + info.fee, coinbase, m_version, m_height))
+    {
+      m_valid = false;
+      return;
+    }
+
+    m_tx_hashes.push_back(info.txid);
+    m_txs[info.txid] = std::make_pair(info.weight, info.fee);
+    append_key_images(m_k_images, tx);
+    m_total_weight += info.weight;
+    m_fee += info.fee;
+    m_coinbase = coinbase;
+    LOG_PRINT_L2("Added " << info.txid << " to block template, new block weight " << m_total_weight << ", coinbase " << print_money(m_coinbase));
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_block_template::remove(const crypto::hash &txid, const transaction_prefix &tx)
+  {
+    if (!m_valid)
+      return;
+    if (!m_complete)
+    {
+      // some tx may have been left out for this one
+      m_valid = false;
+      return;
+    }
+
+    const auto i = m_txs.find(txid);
+    if (i == m_txs.end())
+      return;
+
+    uint64_t coinbase;
+    if (!get_block_reward(m_median_weight, m_total_weight - i->second.first, m_already_generated_coins, m_fee - i->second.second, coinbase, m_version, m_height))
+    {
+      m_valid = false;
+      return;
+    }
+
+    for (const txin_v &in: tx.vin)
+      if (in.type() == typeid(txin_to_key))
+        m_k_images.erase(boost::get<txin_to_key>(in).k_image);
+    m_tx_hashes.erase(std::find(m_tx_hashes.begin(), m_tx_hashes.end(), txid));
+    m_total_weight -= i->second.first;
+    m_fee -= i->second.second;
+    m_coinbase = coinbase;
+    m_txs.erase(i);
+    LOG_PRINT_L2("Removed " << txid << " from block template, new block weight " << m_total_weight << ", coinbase " << print_money(m_coinbase));
+  }
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief The transactions picked from the pool for the next block
+   *
+   * build() picks them from scratch, add() and remove() then keep the pick
+   * up to date as transactions enter and leave the pool, for as long as the
+   * result is what a rebuild would give. When it might not be, the template
+   * invalidates itself, and the pool rebuilds it on the next request.
+   *
+   * Not thread safe, the pool keeps it under its own lock.
+   */
+  class txpool_block_template
+  {
+  public:
+    //! a pool transaction, as far as picking it goes
+    struct tx_info
+    {
+      crypto::hash txid;
+      size_t weight;
+      uint64_t fee;
+    };
+
+    //! whether a transaction can go in the next block, and if so, the parsed transaction
+    typedef std::function<bool(const crypto::hash&, transaction&)> ready_callback;
+
+    txpool_block_template(): m_valid(false) {}
+
+    //! whether the template is still good for a block on top of prev_id with these parameters
+    bool matches(const crypto::hash &prev_id, size_t median_weight, uint64_t already_generated_coins, uint8_t version) const;
+
+    //! the chain changed, the next request rebuilds
+    void invalidate() { m_valid = false; }
+    bool valid() const { return m_valid; }
+
+    /**
+     * @brief picks the transactions for the next block from scratch
+     *
+     * @param prev_id the top block id
+     * @param height the top block height
+     * @param median_weight the current median block weight
+     * @param already_generated_coins the current total number of coins "minted"
+     * @param version hard fork version to use for consensus rules
+     * @param txs the unpruned pool transactions, highest fee per byte first
+     * @param ready checks whether a transaction can go in the next block
+     */
+    void build(const crypto::hash &prev_id, uint64_t height, size_t median_weight, uint64_t already_generated_coins, uint8_t version,
+        const std::vector<tx_info> &txs, const ready_callback &ready);
+
+    /**
+     * @brief adds a transaction newly accepted in the pool
+     *
+     * Invalidates the template instead if the result could differ from
+     * a full rebuild (key image conflict, penalty zone).
+     *
+     * @param prev_id the top block id
+     * @param tx the transaction, which must not be pruned
+     * @param ready checks whether the transaction can go in the next block
+     */
+    void add(const crypto::hash &prev_id, const tx_info &tx, const ready_callback &ready);
+
+    /**
+     * @brief removes a transaction leaving the pool
+     *
+     * @param txid the hash of the transaction
+     * @param tx the transaction
+     */
+    void remove(const crypto::hash &txid, const transaction_prefix &tx);
+
+    const std::vector<crypto::hash> &tx_hashes() const { return m_tx_hashes; }
+    size_t total_weight() const { return m_total_weight; }
+    uint64_t fee() const { return m_fee; }
+    uint64_t coinbase() const { return m_coinbase; }
+
+  private:
+    bool m_valid;
+    bool m_complete; //!< every ready tx is in, none was left out for weight, reward or a key image conflict
+    crypto::hash m_prev_id;
+    uint64_t m_height;
+    size_t m_median_weight;
+    uint64_t m_already_generated_coins;
+    uint8_t m_version;
+    std::vector<crypto::hash> m_tx_hashes;
+    std::unordered_map<crypto::hash, std::pair<size_t, uint64_t>> m_txs; //!< weight and fee of the picked txes
+    std::unordered_set<crypto::key_image> m_k_images;
+    size_t m_total_weight;
+    uint64_t m_fee;
+    uint64_t m_coinbase;
+  };
+}
@@ -0,0 +1,222 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+
+#include "txpool_index.h"
+
+namespace cryptonote
+{
+  namespace
+  {
+    template<typename T>
+    size_t shard_of(const T &key)
+    {
+      // hashes and key images are uniformly distributed already
+      uint64_t v;
+      static_assert(sizeof(key.data) >= sizeof(v), "Key too small");
+      memcpy(&v, key.data, sizeof(v));
+      return v % txpool_index::shard_count;
+    }
+  }
+  //---------------------------------------------------------------------------------
+  txpool_index::snapshot::snapshot(): m_count(0), m_do_not_relay_count(0), m_weight(0)
+  {
+    for (size_t i = 0; i < shard_count; ++i)
+    {
+      m_txs[i] = std::make_shared<const tx_shard>();
+      m_key_images[i] = std::make_shared<const key_image_shard>();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  std::shared_ptr<const txpool_index::entry> txpool_index::snapshot::find(const crypto::hash &txid) const
+  {
+    const tx_shard &shard = *m_txs[shard_of(txid)];
+    const auto i = shard.find(txid);
+    return i == shard.end() ? nullptr : i->second;
+  }
+  //---------------------------------------------------------------------------------
+  const std::vector<crypto::hash> *txpool_index::snapshot::find(const crypto::key_image &key_image) const
+  {
+    const key_image_shard &shard = *m_key_images[shard_of(key_image)];
+    const auto i = shard.find(key_image);
+    return i == shard.end() ? nullptr : &i->second;
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_index::snapshot::for_each(const std::function<bool(const crypto::hash&, const entry&)> &f, bool include_unrelayed_txes) const
+  {
+    for (const auto &shard: m_txs)
+    {
+      for (const auto &e: *shard)
+      {
+        if (!include_unrelayed_txes && e.second->meta.do_not_relay)
+          continue;
+        if (!f(e.first, *e.second))
+          return false;
+      }
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_index::snapshot::for_each(const std::function<bool(const crypto::key_image&, const std::vector<crypto::hash>&)> &f) const
+  {
+    for (const auto &shard: m_key_images)
+      for (const auto &e: *shard)
+        if (!f(e.first, e.second))
+          return false;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  txpool_index::txpool_index(): m_published(std::make_shared<const snapshot>())
+  {
+  }
+  //---------------------------------------------------------------------------------
+  txpool_index::snapshot &txpool_index::stage()
+  {
+    // shards are shared with the published snapshot until first written to
+    if (!m_staged)
+    {
+      m_staged = std::make_shared<snapshot>(*m_published);
+      m_staged_txs.reset();
+      m_staged_key_images.reset();
+    }
+    return *m_staged;
+  }
+  //---------------------------------------------------------------------------------
+  txpool_index::tx_shard &txpool_index::stage_txs(const crypto::hash &txid)
+  {
+    snapshot &s = stage();
+    const size_t n = shard_of(txid);
+    if (!m_staged_txs[n])
+    {
+      s.m_txs[n] = std::make_shared<tx_shard>(*s.m_txs[n]);
+      m_staged_txs[n] = true;
+    }
+    return const_cast<tx_shard&>(*s.m_txs[n]);
+  }
+  //---------------------------------------------------------------------------------
+  txpool_index::key_image_shard &txpool_index::stage_key_images(const crypto::key_image &key_image)
+  {
+    snapshot &s = stage();
+    const size_t n = shard_of(key_image);
+    if (!m_staged_key_images[n])
+    {
+      s.m_key_images[n] = std::make_shared<key_image_shard>(*s.m_key_images[n]);
+      m_staged_key_images[n] = true;
+    }
+    return const_cast<key_image_shard&>(*s.m_key_images[n]);
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_index::add_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata &blob)
+  {
+    std::shared_ptr<entry> e = std::make_shared<entry>();
+    e->meta = meta;
+    e->blob = std::make_shared<const cryptonote::blobdata>(blob);
+    if (!stage_txs(txid).emplace(txid, std::move(e)).second)
+      return false;
+    snapshot &s = *m_staged;
+    ++s.m_count;
+    if (meta.do_not_relay)
+      ++s.m_do_not_relay_count;
+    s.m_weight += meta.weight;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_index::update_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+  {
+    tx_shard &shard = stage_txs(txid);
+    const auto i = shard.find(txid);
+    if (i == shard.end())
+      return false;
+    // the blob is shared with the previous version of the entry
+    std::shared_ptr<entry> e = std::make_shared<entry>(*i->second);
+    snapshot &s = *m_staged;
+    s.m_do_not_relay_count += !!meta.do_not_relay - !!e->meta.do_not_relay;
+    s.m_weight += meta.weight - e->meta.weight;
+    e->meta = meta;
+    i->second = std::move(e);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_index::remove_tx(const crypto::hash &txid)
+  {
+    tx_shard &shard = stage_txs(txid);
+    const auto i = shard.find(txid);
+    if (i == shard.end())
+      return false;
+    snapshot &s = *m_staged;
+    --s.m_count;
+    if (i->second->meta.do_not_relay)
+      --s.m_do_not_relay_count;
+    s.m_weight -= i->second->meta.weight;
+    shard.erase(i);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_index::add_key_image(const crypto::key_image &key_image, const crypto::hash &txid)
+  {
+    stage_key_images(key_image)[key_image].push_back(txid);
+  }
+  //---------------------------------------------------------------------------------
+  bool txpool_index::remove_key_image(const crypto::key_image &key_image, const crypto::hash &txid)
+  {
+    key_image_shard &shard = stage_key_images(key_image);
+    const auto i = shard.find(key_image);
+    if (i == shard.end())
+      return false;
+    auto j = std::find(i->second.begin(), i->second.end(), txid);
+    if (j == i->second.end())
+      return false;
+    i->second.erase(j);
+    if (i->second.empty())
+      shard.erase(i);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_index::clear()
+  {
+    m_staged = std::make_shared<snapshot>();
+    m_staged_txs.set();
+    m_staged_key_images.set();
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_index::publish()
+  {
+    if (!m_staged)
+      return;
+    std::shared_ptr<const snapshot> s = std::move(m_staged);
+    std::atomic_store(&m_published, s);
+    m_staged.reset();
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_index::discard()
+  {
+    m_staged.reset();
+  }
+}
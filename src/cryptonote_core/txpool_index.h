@@ -0,0 +1,117 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "cryptonote_basic/blobdatatype.h"
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief In-memory index of the transaction pool, sharded by tx hash and key image
+   *
+   * Readers work on a snapshot, which never changes once taken, so they do not
+   * need the pool lock. Writers must be serialized by the caller (the pool lock
+   * does that); their changes only touch copies of the shards involved, and
+   * become visible to new snapshots all at once on publish().
+   */
+  class txpool_index
+  {
+  public:
+    static constexpr size_t shard_count = 256;
+
+    struct entry
+    {
+      txpool_tx_meta_t meta;
+      std::shared_ptr<const cryptonote::blobdata> blob;
+    };
+
+    typedef std::unordered_map<crypto::hash, std::shared_ptr<const entry>> tx_shard;
+    typedef std::unordered_map<crypto::key_image, std::vector<crypto::hash>> key_image_shard;
+
+    class snapshot
+    {
+    public:
+      snapshot();
+
+      std::shared_ptr<const entry> find(const crypto::hash &txid) const;
+      const std::vector<crypto::hash> *find(const crypto::key_image &key_image) const;
+      size_t count(bool include_unrelayed_txes = true) const { return include_unrelayed_txes ? m_count : m_count - m_do_not_relay_count; }
+      uint64_t weight() const { return m_weight; }
+
+      bool for_each(const std::function<bool(const crypto::hash&, const entry&)> &f, bool include_unrelayed_txes = true) const;
+      bool for_each(const std::function<bool(const crypto::key_image&, const std::vector<crypto::hash>&)> &f) const;
+
+    private:
+      friend class txpool_index;
+
+      std::array<std::shared_ptr<const tx_shard>, shard_count> m_txs;
+      std::array<std::shared_ptr<const key_image_shard>, shard_count> m_key_images;
+      size_t m_count;
+      size_t m_do_not_relay_count;
+      uint64_t m_weight;
+    };
+
+    txpool_index();
+
+    //! the last published state, for readers
+    std::shared_ptr<const snapshot> get_snapshot() const { return std::atomic_load(&m_published); }
+    //! the state including unpublished changes, for the writer
+    const snapshot &current() const { return m_staged ? *m_staged : *m_published; }
+
+    bool add_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata &blob);
+    bool update_tx(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+    bool remove_tx(const crypto::hash &txid);
+    void add_key_image(const crypto::key_image &key_image, const crypto::hash &txid);
+    bool remove_key_image(const crypto::key_image &key_image, const crypto::hash &txid);
+    void clear();
+
+    void publish();
+    void discard();
+
+  private:
+    snapshot &stage();
+    tx_shard &stage_txs(const crypto::hash &txid);
+    key_image_shard &stage_key_images(const crypto::key_image &key_image);
+
+    std::shared_ptr<const snapshot> m_published;
+    std::shared_ptr<snapshot> m_staged;
+    std::bitset<shard_count> m_staged_txs;
+    std::bitset<shard_count> m_staged_key_images;
+  };
+}
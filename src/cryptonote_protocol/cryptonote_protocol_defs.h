@@ -84,6 +84,11 @@ namespace cryptonote
 
     uint32_t pruning_seed;
 
+    uint64_t tx_relay_bytes_in;
+    uint64_t tx_relay_bytes_out;
+    uint64_t tx_reconciliation_bytes_in;
+    uint64_t tx_reconciliation_bytes_out;
+
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(incoming)
       KV_SERIALIZE(localhost)
@@ -109,6 +114,10 @@ namespace cryptonote
       KV_SERIALIZE(connection_id)
       KV_SERIALIZE(height)
       KV_SERIALIZE(pruning_seed)
+      KV_SERIALIZE_OPT(tx_relay_bytes_in, (uint64_t)0)
+      KV_SERIALIZE_OPT(tx_relay_bytes_out, (uint64_t)0)
+      KV_SERIALIZE_OPT(tx_reconciliation_bytes_in, (uint64_t)0)
+      KV_SERIALIZE_OPT(tx_reconciliation_bytes_out, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -143,16 +152,22 @@ namespace cryptonote
       }
       else
       {
-        std::vector<blobdata> txs;
         if(is_store)
         {
-          txs.reserve(this_ref.txs.size());
-          for(const auto &e: this_ref.txs)
-            txs.push_back(e.blob);
+          // stored as a plain array of blobs, straight from the entries
+          if(!this_ref.txs.empty())
+          {
+            auto it = this_ref.txs.begin();
+            auto hval_array = stg.insert_first_value("txs", it->blob, hparent_section);
+            CHECK_AND_ASSERT_MES(hval_array, false, "failed to insert first value to storage");
+            for(++it; it != this_ref.txs.end(); ++it)
+              stg.insert_next_value(hval_array, it->blob);
+          }
         }
-        epee::serialization::selector<is_store>::serialize(txs, stg, hparent_section, "txs");
-        if(!is_store)
+        else
         {
+          std::vector<blobdata> txs;
+          epee::serialization::selector<is_store>::serialize(txs, stg, hparent_section, "txs");
           block_complete_entry &self = const_cast<block_complete_entry&>(this_ref);
           self.txs.clear();
           self.txs.reserve(txs.size());
@@ -347,5 +362,102 @@ namespace cryptonote
     };
     typedef epee::misc_utils::struct_init<request_t> request;
   }; 
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct prefilled_tx
+    {
+      uint64_t index;
+      blobdata blob;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(index)
+        KV_SERIALIZE(blob)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request_t
+    {
+      crypto::hash block_hash;
+      blobdata block; // without its tx hashes
+      uint64_t salt;
+      std::string short_ids; // P2P_COMPACT_BLOCK_SHORT_ID_SIZE bytes per tx, in block order
+      std::vector<prefilled_tx> prefilled_txs;
+      uint64_t current_blockchain_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(block)
+        KV_SERIALIZE(salt)
+        KV_SERIALIZE(short_ids)
+        KV_SERIALIZE(prefilled_txs)
+        KV_SERIALIZE(current_blockchain_height)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TX_RECONCILIATION
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request_t
+    {
+      uint64_t salt;
+      uint64_t set_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(salt)
+        KV_SERIALIZE(set_size)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_TX_RECONCILIATION_SKETCH
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request_t
+    {
+      std::string sketch; // empty if the sets are too far apart, the txes are then flooded
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(sketch)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_TX_RECONCILIATION_DIFF
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 13;
+
+    struct request_t
+    {
+      bool success; // if not, both sides flood their set
+      std::string missing_ids; // 4 bytes per short id
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(success)
+        KV_SERIALIZE(missing_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
     
 }
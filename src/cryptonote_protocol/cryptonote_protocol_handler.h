@@ -37,6 +37,9 @@
 
 #include <boost/program_options/variables_map.hpp>
 #include <string>
+#include <unordered_set>
+#include <unordered_map>
+#include <map>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -92,6 +95,10 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TX_RECONCILIATION, &cryptonote_protocol_handler::handle_request_tx_reconciliation)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_RECONCILIATION_SKETCH, &cryptonote_protocol_handler::handle_tx_reconciliation_sketch)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_RECONCILIATION_DIFF, &cryptonote_protocol_handler::handle_tx_reconciliation_diff)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -125,6 +132,10 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_request_tx_reconciliation(int command, NOTIFY_REQUEST_TX_RECONCILIATION::request& arg, cryptonote_connection_context& context);
+    int handle_tx_reconciliation_sketch(int command, NOTIFY_TX_RECONCILIATION_SKETCH::request& arg, cryptonote_connection_context& context);
+    int handle_tx_reconciliation_diff(int command, NOTIFY_TX_RECONCILIATION_DIFF::request& arg, cryptonote_connection_context& context);
 
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -144,6 +155,17 @@ namespace cryptonote
     int try_add_next_blocks(cryptonote_connection_context &context);
     void notify_new_stripe(cryptonote_connection_context &context, uint32_t stripe);
     void skip_unneeded_hashes(cryptonote_connection_context& context, bool check_block_queue) const;
+    bool make_compact_block(const NOTIFY_NEW_BLOCK::request& arg, NOTIFY_NEW_COMPACT_BLOCK::request& compact_arg);
+    void add_compact_prefill_hint(const crypto::hash &tx_hash);
+    static crypto::hash get_compact_block_key(const crypto::hash &block_hash, uint64_t salt);
+    static uint64_t get_compact_short_id(const crypto::hash &key, const crypto::hash &tx_hash);
+    static uint64_t read_compact_short_id(const std::string &short_ids, size_t index);
+    bool reconcile_transactions();
+    bool uses_tx_reconciliation(const cryptonote_connection_context &context, uint32_t support_flags) const;
+    std::vector<uint32_t> start_tx_reconciliation_round(const boost::uuids::uuid &connection_id, uint64_t salt);
+    std::vector<crypto::hash> finish_tx_reconciliation_round(const boost::uuids::uuid &connection_id, const std::vector<uint32_t> *ids);
+    void add_tx_relay_bytes(const boost::uuids::uuid &connection_id, uint64_t reconciliation_bytes_in, uint64_t reconciliation_bytes_out, uint64_t tx_bytes_out);
+    void send_pool_transactions(const std::vector<crypto::hash> &txids, cryptonote_connection_context &context);
 
     t_core& m_core;
 
@@ -157,6 +179,7 @@ namespace cryptonote
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
     epee::math_helper::once_a_time_milliseconds<100> m_standby_checker;
     epee::math_helper::once_a_time_seconds<101> m_sync_search_checker;
+    epee::math_helper::once_a_time_seconds<P2P_TX_RECONCILIATION_INTERVAL> m_tx_reconciliation_checker;
     std::atomic<unsigned int> m_max_out_peers;
     tools::PerformanceTimer m_sync_timer, m_add_timer;
     uint64_t m_last_add_end_time;
@@ -165,6 +188,23 @@ namespace cryptonote
     size_t m_block_download_max_size;
     bool m_sync_pruned_blocks;
 
+    boost::mutex m_compact_prefill_lock;
+    std::unordered_set<crypto::hash> m_compact_prefill; // txes we had to fetch, so our peers might lack them too
+
+    struct tx_relay_state
+    {
+      std::unordered_set<crypto::hash> pending; // to announce at the next reconciliation round
+      std::unordered_map<uint32_t, crypto::hash> in_flight; // sketched in the current round, by short id
+      uint64_t salt = 0;
+      time_t round_start = 0; // 0 if no round in progress
+      uint64_t tx_bytes_in = 0;
+      uint64_t tx_bytes_out = 0;
+      uint64_t reconciliation_bytes_in = 0;
+      uint64_t reconciliation_bytes_out = 0;
+    };
+    boost::mutex m_tx_relay_lock;
+    std::map<boost::uuids::uuid, tx_relay_state> m_tx_relay;
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
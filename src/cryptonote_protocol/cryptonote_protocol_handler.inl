@@ -44,6 +44,7 @@
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 #include "common/pruning.h"
+#include "tx_sketch.h"
 
 #undef WALLSTREETBETS_DEFAULT_LOG_CATEGORY
 #define WALLSTREETBETS_DEFAULT_LOG_CATEGORY "net.cn"
@@ -286,6 +287,19 @@ namespace cryptonote
       cnx.height = cntxt.m_remote_blockchain_height;
       cnx.pruning_seed = cntxt.m_pruning_seed;
 
+      cnx.tx_relay_bytes_in = cnx.tx_relay_bytes_out = cnx.tx_reconciliation_bytes_in = cnx.tx_reconciliation_bytes_out = 0;
+      {
+        boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+        const auto i = m_tx_relay.find(cntxt.m_connection_id);
+        if (i != m_tx_relay.end())
+        {
+          cnx.tx_relay_bytes_in = i->second.tx_bytes_in;
+          cnx.tx_relay_bytes_out = i->second.tx_bytes_out;
+          cnx.tx_reconciliation_bytes_in = i->second.reconciliation_bytes_in;
+          cnx.tx_reconciliation_bytes_out = i->second.reconciliation_bytes_out;
+        }
+      }
+
       connections.push_back(cnx);
 
       return true;
@@ -605,6 +619,9 @@ namespace cryptonote
             context.m_requested_objects.erase(req_tx_it);
           }
 
+          // we did not have it, so our own peers might not either
+          add_compact_prefill_hint(tx_hash);
+
           // we might already have the tx that the peer
           // sent in our pool, so don't verify again..
           if(!m_core.pool_has_tx(tx_hash))
@@ -859,6 +876,186 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK (height " << arg.current_blockchain_height << ", " << arg.short_ids.size() / P2P_COMPACT_BLOCK_SHORT_ID_SIZE << " txes, " << arg.prefilled_txs.size() << " prefilled)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized()) // can happen if a peer connection goes to normal but another thread still hasn't finished adding queued blocks
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+
+    block b;
+    if(arg.short_ids.size() % P2P_COMPACT_BLOCK_SHORT_ID_SIZE || !parse_and_validate_block_from_blob(arg.block, b) || !b.tx_hashes.empty())
+    {
+      LOG_ERROR_CCONTEXT("sent wrong compact block: failed to parse and validate block, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    const size_t ntxes = arg.short_ids.size() / P2P_COMPACT_BLOCK_SHORT_ID_SIZE;
+    const crypto::hash key = get_compact_block_key(arg.block_hash, arg.salt);
+    b.tx_hashes.resize(ntxes, crypto::null_hash);
+
+    // the sender expected us to miss those
+    for(const auto &ptx: arg.prefilled_txs)
+    {
+      transaction tx;
+      crypto::hash tx_hash;
+      if(ptx.index >= ntxes || !parse_and_validate_tx_from_blob(ptx.blob, tx, tx_hash) || get_compact_short_id(key, tx_hash) != read_compact_short_id(arg.short_ids, ptx.index))
+      {
+        LOG_ERROR_CCONTEXT("sent wrong compact block: bad prefilled transaction, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      if(!m_core.pool_has_tx(tx_hash))
+      {
+        cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+        if(!m_core.handle_incoming_tx(ptx.blob, tvc, true, true, false) || tvc.m_verifivation_failed)
+        {
+          LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
+          drop_connection(context, false, false);
+          return 1;
+        }
+        add_compact_prefill_hint(tx_hash);
+      }
+      b.tx_hashes[ptx.index] = tx_hash;
+    }
+
+    // match the others against our pool, ids shared by several txes can't be resolved
+    std::vector<crypto::hash> pool_tx_hashes;
+    m_core.get_pool_transaction_hashes(pool_tx_hashes, true);
+    std::unordered_map<uint64_t, crypto::hash> pool_short_ids;
+    pool_short_ids.reserve(pool_tx_hashes.size());
+    for(const auto &tx_hash: pool_tx_hashes)
+    {
+      auto i = pool_short_ids.emplace(get_compact_short_id(key, tx_hash), tx_hash);
+      if(!i.second)
+        i.first->second = crypto::null_hash;
+    }
+
+    std::vector<uint64_t> need_tx_indices;
+    for(size_t n = 0; n < ntxes; ++n)
+    {
+      if(b.tx_hashes[n] != crypto::null_hash)
+        continue;
+      const auto i = pool_short_ids.find(read_compact_short_id(arg.short_ids, n));
+      if(i == pool_short_ids.end() || i->second == crypto::null_hash)
+        need_tx_indices.push_back(n);
+      else
+        b.tx_hashes[n] = i->second;
+    }
+
+    // a short id matching the wrong tx shows up as a different block hash
+    if(need_tx_indices.empty() && get_block_hash(b) != arg.block_hash)
+    {
+      MDEBUG("Compact block " << arg.block_hash << " did not match our txes, requesting all of them");
+      for(size_t n = 0; n < ntxes; ++n)
+        need_tx_indices.push_back(n);
+    }
+
+    if(!need_tx_indices.empty())
+    {
+      // the reply is a fluffy block with the txes we lack
+      MDEBUG("We are missing " << need_tx_indices.size() << " txes for this compact block");
+      NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+      missing_tx_req.block_hash = arg.block_hash;
+      missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+      missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+      MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_FLUFFY_MISSING_TX: missing_tx_indices.size()=" << missing_tx_req.missing_tx_indices.size() );
+      post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+      return 1;
+    }
+
+    // all txes are now in our pool, so this is a fluffy block with nothing to fetch
+    MDEBUG("We have all needed txes for this compact block");
+    NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+    fluffy_arg.b.block = t_serializable_object_to_blob(b);
+    fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+    return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  crypto::hash t_cryptonote_protocol_handler<t_core>::get_compact_block_key(const crypto::hash &block_hash, uint64_t salt)
+  {
+    char data[sizeof(crypto::hash) + sizeof(uint64_t)];
+    memcpy(data, &block_hash, sizeof(crypto::hash));
+    salt = SWAP64LE(salt);
+    memcpy(data + sizeof(crypto::hash), &salt, sizeof(uint64_t));
+    return crypto::cn_fast_hash(data, sizeof(data));
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  uint64_t t_cryptonote_protocol_handler<t_core>::get_compact_short_id(const crypto::hash &key, const crypto::hash &tx_hash)
+  {
+    crypto::hash data[2] = {key, tx_hash};
+    const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+    uint64_t id = 0;
+    for(size_t n = 0; n < P2P_COMPACT_BLOCK_SHORT_ID_SIZE; ++n)
+      id |= ((uint64_t)(uint8_t)h.data[n]) << (8 * n);
+    return id;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  uint64_t t_cryptonote_protocol_handler<t_core>::read_compact_short_id(const std::string &short_ids, size_t index)
+  {
+    uint64_t id = 0;
+    for(size_t n = 0; n < P2P_COMPACT_BLOCK_SHORT_ID_SIZE; ++n)
+      id |= ((uint64_t)(uint8_t)short_ids[index * P2P_COMPACT_BLOCK_SHORT_ID_SIZE + n]) << (8 * n);
+    return id;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_compact_prefill_hint(const crypto::hash &tx_hash)
+  {
+    boost::unique_lock<boost::mutex> lock(m_compact_prefill_lock);
+    if(m_compact_prefill.size() >= P2P_COMPACT_BLOCK_MAX_PREFILL_HINTS)
+      m_compact_prefill.clear();
+    m_compact_prefill.insert(tx_hash);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::make_compact_block(const NOTIFY_NEW_BLOCK::request& arg, NOTIFY_NEW_COMPACT_BLOCK::request& compact_arg)
+  {
+    block b;
+    if(!parse_and_validate_block_from_blob(arg.b.block, b))
+      return false;
+
+    compact_arg.block_hash = get_block_hash(b);
+    compact_arg.salt = crypto::rand<uint64_t>();
+    compact_arg.current_blockchain_height = arg.current_blockchain_height;
+    const crypto::hash key = get_compact_block_key(compact_arg.block_hash, compact_arg.salt);
+    compact_arg.short_ids.reserve(b.tx_hashes.size() * P2P_COMPACT_BLOCK_SHORT_ID_SIZE);
+    for(const auto &tx_hash: b.tx_hashes)
+    {
+      const uint64_t id = get_compact_short_id(key, tx_hash);
+      for(size_t n = 0; n < P2P_COMPACT_BLOCK_SHORT_ID_SIZE; ++n)
+        compact_arg.short_ids.push_back((char)(id >> (8 * n)));
+    }
+
+    // send along the txes we had to fetch ourselves
+    if(arg.b.txs.size() == b.tx_hashes.size())
+    {
+      boost::unique_lock<boost::mutex> lock(m_compact_prefill_lock);
+      for(size_t n = 0; n < b.tx_hashes.size(); ++n)
+      {
+        if(m_compact_prefill.erase(b.tx_hashes[n]) == 0)
+          continue;
+        transaction tx;
+        crypto::hash tx_hash;
+        if(parse_and_validate_tx_from_blob(arg.b.txs[n].blob, tx, tx_hash) && tx_hash == b.tx_hashes[n])
+          compact_arg.prefilled_txs.push_back({n, arg.b.txs[n].blob});
+      }
+    }
+
+    b.tx_hashes.clear();
+    compact_arg.block = t_serializable_object_to_blob(b);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
@@ -874,20 +1071,35 @@ namespace cryptonote
       return 1;
     }
 
+    uint64_t bytes = 0;
+    for (const auto &blob: arg.txs)
+      bytes += blob.size();
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      m_tx_relay[context.m_connection_id].tx_bytes_in += bytes;
+    }
+
+    // the whole message goes to the core at once, so it is parsed and checked
+    // in parallel and added to the pool in a single db transaction
+    std::vector<cryptonote::tx_blob_entry> tx_blobs;
+    tx_blobs.reserve(arg.txs.size());
+    for (auto &blob: arg.txs)
+      tx_blobs.push_back({std::move(blob), crypto::null_hash});
+    std::vector<cryptonote::tx_verification_context> tvc;
+    m_core.handle_incoming_txs(tx_blobs, tvc, false, true, false);
+
     std::vector<cryptonote::blobdata> newtxs;
-    newtxs.reserve(arg.txs.size());
-    for (size_t i = 0; i < arg.txs.size(); ++i)
+    newtxs.reserve(tx_blobs.size());
+    for (size_t i = 0; i < tx_blobs.size(); ++i)
     {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx({arg.txs[i], crypto::null_hash}, tvc, false, true, false);
-      if(tvc.m_verifivation_failed)
+      if(tvc[i].m_verifivation_failed)
       {
         LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
         drop_connection(context, false, false);
         return 1;
       }
-      if(tvc.m_should_be_relayed)
-        newtxs.push_back(std::move(arg.txs[i]));
+      if(tvc[i].m_should_be_relayed)
+        newtxs.push_back(std::move(tx_blobs[i].blob));
     }
     arg.txs = std::move(newtxs);
 
@@ -1463,6 +1675,7 @@ skip:
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
     m_standby_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::check_standby_peers, this));
     m_sync_search_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::update_sync_search, this));
+    m_tx_reconciliation_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::reconcile_transactions, this));
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -2253,13 +2466,18 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
-    // sort peers between fluffy ones and others
-    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact, fluffy ones and others
+    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id && context.m_remote_address.get_zone() == epee::net_utils::zone::public_)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING SHORT TX IDS");
+          compactConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
@@ -2273,7 +2491,23 @@ skip:
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    // send compact ones first, they are the smallest
+    if (!compactConnections.empty())
+    {
+      NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+      if (make_compact_block(arg, compact_arg))
+      {
+        std::string compactBlob;
+        epee::serialization::store_t_to_binary(compact_arg, compactBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, epee::strspan<uint8_t>(compactBlob), std::move(compactConnections));
+      }
+      else
+      {
+        MERROR("Failed to make compact block, relaying fluffy block instead");
+        fluffyConnections.insert(fluffyConnections.end(), compactConnections.begin(), compactConnections.end());
+      }
+    }
+    // then fluffy ones, we want to encourage people to run that
     if (!fluffyConnections.empty())
     {
       std::string fluffyBlob;
@@ -2284,7 +2518,7 @@ skip:
     {
       std::string fullBlob;
       epee::serialization::store_t_to_binary(arg, fullBlob);
-      m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, epee::strspan<uint8_t>(fullBlob), std::move(fluffyConnections));
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, epee::strspan<uint8_t>(fullBlob), std::move(fullConnections));
     }
 
     return true;
@@ -2331,19 +2565,63 @@ skip:
         arg._.resize(arg._.size() - remove);
       // if the size of _ moved enough, we might lose byte in size encoding, we don't care
     }
+
+    // peers we reconcile with only get the tx hashes queued for the next round
+    std::vector<crypto::hash> txids;
+    uint64_t tx_bytes = 0;
+    for (const auto &blob: arg.txs)
+    {
+      transaction tx;
+      crypto::hash txid;
+      if (!pad_transactions && parse_and_validate_tx_from_blob(blob, tx, txid))
+        txids.push_back(txid);
+      tx_bytes += blob.size();
+    }
+
+    const bool can_reconcile = !txids.empty() && txids.size() == arg.txs.size();
+
     std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections;
-    m_p2p->for_each_connection([hide_tx_broadcast, &exclude_context, &connections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    size_t reconciling = 0;
+    m_p2p->for_each_connection([this, hide_tx_broadcast, can_reconcile, &exclude_context, &connections, &txids, tx_bytes, &reconciling](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       const epee::net_utils::zone current_zone = context.m_remote_address.get_zone();
       const bool broadcast_to_peer = peer_id && (hide_tx_broadcast != bool(current_zone == epee::net_utils::zone::public_)) && exclude_context.m_connection_id != context.m_connection_id;
 
-      if (broadcast_to_peer)
-        connections.push_back({current_zone, context.m_connection_id});
+      if (!broadcast_to_peer)
+        return true;
 
+      if (can_reconcile && uses_tx_reconciliation(context, support_flags))
+      {
+        ++reconciling;
+        std::vector<crypto::hash> overflow;
+        {
+          boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+          auto &pending = m_tx_relay[context.m_connection_id].pending;
+          pending.insert(txids.begin(), txids.end());
+          if (pending.size() > P2P_TX_RECONCILIATION_MAX_SET_SIZE)
+          {
+            overflow.assign(pending.begin(), pending.end());
+            pending.clear();
+          }
+        }
+        if (!overflow.empty())
+        {
+          // the peer isn't keeping up with reconciliation rounds, flood to it instead
+          MDEBUG("Reconciliation set overflow for " << epee::net_utils::print_connection_context_short(context) << ", flooding " << overflow.size() << " txes");
+          send_pool_transactions(overflow, context);
+        }
+        return true;
+      }
+
+      connections.push_back({current_zone, context.m_connection_id});
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      m_tx_relay[context.m_connection_id].tx_bytes_out += tx_bytes;
       return true;
     });
 
-    if (connections.empty())
+    if (connections.empty() && reconciling)
+      MDEBUG("Transaction queued for reconciliation with " << reconciling << " peers");
+    else if (connections.empty())
       MERROR("Transaction not relayed - no" << (hide_tx_broadcast ? " privacy": "") << " peers available");
     else
     {
@@ -2355,6 +2633,243 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::uses_tx_reconciliation(const cryptonote_connection_context &context, uint32_t support_flags) const
+  {
+    // padding is there to hide tx sizes, which reconciliation would give away
+    return (support_flags & P2P_SUPPORT_FLAG_TX_RECONCILIATION) && context.m_remote_address.get_zone() == epee::net_utils::zone::public_ && !m_core.pad_transactions();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  std::vector<uint32_t> t_cryptonote_protocol_handler<t_core>::start_tx_reconciliation_round(const boost::uuids::uuid &connection_id, uint64_t salt)
+  {
+    std::vector<uint32_t> ids;
+    boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+    tx_relay_state &state = m_tx_relay[connection_id];
+
+    // anything left from an unfinished round goes in again
+    for (const auto &e: state.in_flight)
+      state.pending.insert(e.second);
+    state.in_flight.clear();
+
+    state.salt = salt;
+    state.round_start = time(NULL);
+    ids.reserve(state.pending.size());
+    for (auto i = state.pending.begin(); i != state.pending.end(); )
+    {
+      const uint32_t id = get_tx_reconciliation_short_id(salt, *i);
+      // a colliding tx waits for the next round, which has another salt
+      if (!state.in_flight.emplace(id, *i).second)
+      {
+        ++i;
+        continue;
+      }
+      ids.push_back(id);
+      i = state.pending.erase(i);
+    }
+    return ids;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  std::vector<crypto::hash> t_cryptonote_protocol_handler<t_core>::finish_tx_reconciliation_round(const boost::uuids::uuid &connection_id, const std::vector<uint32_t> *ids)
+  {
+    std::vector<crypto::hash> txids;
+    boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+    const auto i = m_tx_relay.find(connection_id);
+    if (i == m_tx_relay.end())
+      return txids;
+    tx_relay_state &state = i->second;
+    if (ids)
+    {
+      for (uint32_t id: *ids)
+      {
+        const auto j = state.in_flight.find(id);
+        if (j != state.in_flight.end())
+          txids.push_back(j->second);
+      }
+    }
+    else
+    {
+      for (const auto &e: state.in_flight)
+        txids.push_back(e.second);
+    }
+    state.in_flight.clear();
+    state.round_start = 0;
+    return txids;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_tx_relay_bytes(const boost::uuids::uuid &connection_id, uint64_t reconciliation_bytes_in, uint64_t reconciliation_bytes_out, uint64_t tx_bytes_out)
+  {
+    boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+    tx_relay_state &state = m_tx_relay[connection_id];
+    state.reconciliation_bytes_in += reconciliation_bytes_in;
+    state.reconciliation_bytes_out += reconciliation_bytes_out;
+    state.tx_bytes_out += tx_bytes_out;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::send_pool_transactions(const std::vector<crypto::hash> &txids, cryptonote_connection_context &context)
+  {
+    NOTIFY_NEW_TRANSACTIONS::request arg = AUTO_VAL_INIT(arg);
+    uint64_t bytes = 0;
+    for (const auto &txid: txids)
+    {
+      // it might have been mined since
+      cryptonote::blobdata blob;
+      if (!m_core.get_pool_transaction(txid, blob))
+        continue;
+      bytes += blob.size();
+      arg.txs.push_back(std::move(blob));
+    }
+    if (arg.txs.empty())
+      return;
+    add_tx_relay_bytes(context.m_connection_id, 0, 0, bytes);
+    post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::reconcile_transactions()
+  {
+    // outgoing connections start the rounds
+    std::set<boost::uuids::uuid> live_connections;
+    const time_t now = time(NULL);
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      live_connections.insert(context.m_connection_id);
+      if (context.m_state != cryptonote_connection_context::state_normal || context.m_is_income || !uses_tx_reconciliation(context, support_flags) || !is_synchronized())
+        return true;
+      {
+        boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+        const auto i = m_tx_relay.find(context.m_connection_id);
+        if (i != m_tx_relay.end() && i->second.round_start && now - i->second.round_start < P2P_TX_RECONCILIATION_TIMEOUT)
+          return true;
+      }
+
+      NOTIFY_REQUEST_TX_RECONCILIATION::request arg = AUTO_VAL_INIT(arg);
+      arg.salt = crypto::rand<uint64_t>();
+      arg.set_size = start_tx_reconciliation_round(context.m_connection_id, arg.salt).size();
+      add_tx_relay_bytes(context.m_connection_id, 0, sizeof(arg.salt) + sizeof(arg.set_size), 0);
+      post_notify<NOTIFY_REQUEST_TX_RECONCILIATION>(arg, context);
+      return true;
+    });
+
+    boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+    for (auto i = m_tx_relay.begin(); i != m_tx_relay.end(); )
+    {
+      if (live_connections.find(i->first) == live_connections.end())
+        i = m_tx_relay.erase(i);
+      else
+        ++i;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_tx_reconciliation(int command, NOTIFY_REQUEST_TX_RECONCILIATION::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TX_RECONCILIATION (" << arg.set_size << " txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!context.m_is_income || context.m_remote_address.get_zone() != epee::net_utils::zone::public_)
+    {
+      LOG_ERROR_CCONTEXT("Peer sent unexpected NOTIFY_REQUEST_TX_RECONCILIATION, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    const std::vector<uint32_t> ids = start_tx_reconciliation_round(context.m_connection_id, arg.salt);
+    const size_t capacity = tx_sketch::estimate_capacity(ids.size(), arg.set_size);
+    NOTIFY_TX_RECONCILIATION_SKETCH::request sketch_arg = AUTO_VAL_INIT(sketch_arg);
+    sketch_arg.sketch = make_tx_reconciliation_sketch(ids, arg.set_size);
+    add_tx_relay_bytes(context.m_connection_id, sizeof(arg.salt) + sizeof(arg.set_size), sketch_arg.sketch.size(), 0);
+    MLOG_P2P_MESSAGE("-->>NOTIFY_TX_RECONCILIATION_SKETCH: capacity=" << capacity << ", local set size=" << ids.size());
+    post_notify<NOTIFY_TX_RECONCILIATION_SKETCH>(sketch_arg, context);
+
+    if(sketch_arg.sketch.empty())
+    {
+      // too far apart for a sketch to be worth it, both sides flood
+      MDEBUG("Reconciliation capacity " << capacity << " too large, flooding " << ids.size() << " txes");
+      send_pool_transactions(finish_tx_reconciliation_round(context.m_connection_id, NULL), context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_tx_reconciliation_sketch(int command, NOTIFY_TX_RECONCILIATION_SKETCH::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TX_RECONCILIATION_SKETCH (" << arg.sketch.size() << " bytes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    tx_sketch sketch;
+    if(context.m_is_income || !sketch.deserialize(arg.sketch))
+    {
+      LOG_ERROR_CCONTEXT("Peer sent unexpected or invalid NOTIFY_TX_RECONCILIATION_SKETCH, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    add_tx_relay_bytes(context.m_connection_id, arg.sketch.size(), 0, 0);
+
+    std::unordered_set<uint32_t> local_ids;
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      const auto i = m_tx_relay.find(context.m_connection_id);
+      if(i == m_tx_relay.end() || !i->second.round_start)
+      {
+        MDEBUG("Got a reconciliation sketch with no round in progress, ignoring");
+        return 1;
+      }
+      for(const auto &e: i->second.in_flight)
+        local_ids.insert(e.first);
+    }
+
+    NOTIFY_TX_RECONCILIATION_DIFF::request diff_arg = AUTO_VAL_INIT(diff_arg);
+    std::vector<uint32_t> peer_missing_ids, missing_ids;
+    diff_arg.success = decode_tx_reconciliation_sketch(sketch, local_ids, peer_missing_ids, missing_ids);
+    if(diff_arg.success)
+    {
+      for(uint32_t id: missing_ids)
+      {
+        id = SWAP32LE(id);
+        diff_arg.missing_ids.append((const char*)&id, sizeof(id));
+      }
+    }
+    else
+    {
+      MDEBUG("Failed to reconcile " << local_ids.size() << " txes with a sketch of capacity " << sketch.capacity() << ", flooding them");
+    }
+
+    add_tx_relay_bytes(context.m_connection_id, 0, 1 + diff_arg.missing_ids.size(), 0);
+    MLOG_P2P_MESSAGE("-->>NOTIFY_TX_RECONCILIATION_DIFF: success=" << diff_arg.success << ", missing=" << diff_arg.missing_ids.size() / sizeof(uint32_t) << ", sending " << peer_missing_ids.size());
+    post_notify<NOTIFY_TX_RECONCILIATION_DIFF>(diff_arg, context);
+    send_pool_transactions(finish_tx_reconciliation_round(context.m_connection_id, diff_arg.success ? &peer_missing_ids : NULL), context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_tx_reconciliation_diff(int command, NOTIFY_TX_RECONCILIATION_DIFF::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_TX_RECONCILIATION_DIFF (success " << arg.success << ", " << arg.missing_ids.size() / sizeof(uint32_t) << " missing)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!context.m_is_income || arg.missing_ids.size() % sizeof(uint32_t) || arg.missing_ids.size() / sizeof(uint32_t) >= P2P_TX_RECONCILIATION_MAX_CAPACITY)
+    {
+      LOG_ERROR_CCONTEXT("Peer sent unexpected or invalid NOTIFY_TX_RECONCILIATION_DIFF, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    add_tx_relay_bytes(context.m_connection_id, 1 + arg.missing_ids.size(), 0, 0);
+
+    std::vector<uint32_t> ids(arg.missing_ids.size() / sizeof(uint32_t));
+    for(size_t n = 0; n < ids.size(); ++n)
+    {
+      memcpy(&ids[n], arg.missing_ids.data() + n * sizeof(uint32_t), sizeof(uint32_t));
+      ids[n] = SWAP32LE(ids[n]);
+    }
+    send_pool_transactions(finish_tx_reconciliation_round(context.m_connection_id, arg.success ? &ids : NULL), context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   std::string t_cryptonote_protocol_handler<t_core>::get_peers_overview() const
   {
     std::stringstream ss;
@@ -2460,6 +2975,10 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      m_tx_relay.erase(context.m_connection_id);
+    }
     MLOG_PEER_STATE("closed");
   }
 
@@ -0,0 +1,355 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include "int-util.h"
+#include "cryptonote_config.h"
+#include "tx_sketch.h"
+
+// Elements live in GF(2^32) = GF(2)[x] / (x^32 + x^7 + x^3 + x^2 + 1), and
+// polynomials over it are coefficient vectors, lowest degree first, with no
+// trailing zeros.
+namespace
+{
+  typedef std::vector<uint32_t> poly;
+
+  uint32_t gf_mul(uint32_t a, uint32_t b)
+  {
+    // four bits of b at a time, then fold the high half back twice
+    uint64_t t[16];
+    t[0] = 0;
+    for (int i = 1; i < 16; ++i)
+      t[i] = (i & 1) ? t[i - 1] ^ a : t[i / 2] << 1;
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4)
+      r = (r << 4) ^ t[(b >> i) & 0xf];
+    for (int n = 0; n < 2; ++n)
+    {
+      const uint64_t h = r >> 32;
+      r = (r & 0xffffffff) ^ (h << 7) ^ (h << 3) ^ (h << 2) ^ h;
+    }
+    return (uint32_t)r;
+  }
+
+  uint32_t gf_inv(uint32_t a)
+  {
+    // a^(2^32-2)
+    uint32_t r = 1;
+    for (int i = 0; i < 31; ++i)
+    {
+      a = gf_mul(a, a);
+      r = gf_mul(r, a);
+    }
+    return r;
+  }
+
+  void poly_trim(poly &p)
+  {
+    while (!p.empty() && p.back() == 0)
+      p.pop_back();
+  }
+
+  // a mod f, f monic
+  void poly_mod(poly &a, const poly &f)
+  {
+    const size_t df = f.size() - 1;
+    while (a.size() > df)
+    {
+      const uint32_t c = a.back();
+      const size_t shift = a.size() - 1 - df;
+      for (size_t i = 0; i < df; ++i)
+        a[shift + i] ^= gf_mul(c, f[i]);
+      a.pop_back();
+      poly_trim(a);
+    }
+  }
+
+  // squaring is linear in characteristic 2
+  poly poly_sqrmod(const poly &a, const poly &f)
+  {
+    if (a.empty())
+      return poly();
+    poly r(2 * a.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); ++i)
+      r[2 * i] = gf_mul(a[i], a[i]);
+    poly_mod(r, f);
+    return r;
+  }
+
+  void poly_monic(poly &p)
+  {
+    const uint32_t inv = gf_inv(p.back());
+    for (uint32_t &c: p)
+      c = gf_mul(c, inv);
+  }
+
+  poly poly_gcd(poly a, poly b)
+  {
+    while (!b.empty())
+    {
+      poly_monic(b);
+      poly_mod(a, b);
+      std::swap(a, b);
+    }
+    if (!a.empty())
+      poly_monic(a);
+    return a;
+  }
+
+  // exact division by a monic divisor
+  poly poly_div(poly a, const poly &f)
+  {
+    const size_t df = f.size() - 1;
+    poly q(a.size() - df, 0);
+    while (a.size() > df)
+    {
+      const uint32_t c = a.back();
+      const size_t shift = a.size() - 1 - df;
+      q[shift] = c;
+      for (size_t i = 0; i < df; ++i)
+        a[shift + i] ^= gf_mul(c, f[i]);
+      a.pop_back();
+    }
+    return q;
+  }
+
+  // Berlekamp trace algorithm: Tr(b.x) mod f splits the roots of f in two
+  // by the trace of b.root, and the trace functionals of the 32 basis
+  // elements together tell any two distinct roots apart
+  bool find_roots(const poly &f, unsigned basis, std::vector<uint32_t> &roots)
+  {
+    if (f.size() == 2)
+    {
+      roots.push_back(f[0]);
+      return true;
+    }
+    for (; basis < 32; ++basis)
+    {
+      poly t = {0, (uint32_t)1 << basis};
+      poly_mod(t, f);
+      poly tr = t;
+      for (int i = 1; i < 32; ++i)
+      {
+        t = poly_sqrmod(t, f);
+        tr.resize(std::max(tr.size(), t.size()), 0);
+        for (size_t j = 0; j < t.size(); ++j)
+          tr[j] ^= t[j];
+      }
+      poly_trim(tr);
+      const poly g = poly_gcd(f, tr);
+      if (g.size() > 1 && g.size() < f.size())
+        return find_roots(g, basis + 1, roots) && find_roots(poly_div(f, g), basis + 1, roots);
+    }
+    return false;
+  }
+}
+
+namespace cryptonote
+{
+  tx_sketch::tx_sketch(size_t capacity): m_syndromes(capacity, 0)
+  {
+  }
+
+  bool tx_sketch::empty() const
+  {
+    return std::all_of(m_syndromes.begin(), m_syndromes.end(), [](uint32_t s) { return s == 0; });
+  }
+
+  void tx_sketch::add(uint32_t id)
+  {
+    const uint32_t sq = gf_mul(id, id);
+    for (uint32_t &s: m_syndromes)
+    {
+      s ^= id;
+      id = gf_mul(id, sq);
+    }
+  }
+
+  void tx_sketch::merge(const tx_sketch &other)
+  {
+    // a smaller sketch is a prefix of a larger one
+    m_syndromes.resize(std::min(m_syndromes.size(), other.m_syndromes.size()));
+    for (size_t i = 0; i < m_syndromes.size(); ++i)
+      m_syndromes[i] ^= other.m_syndromes[i];
+  }
+
+  bool tx_sketch::decode(std::vector<uint32_t> &ids) const
+  {
+    ids.clear();
+    const size_t capacity = m_syndromes.size();
+    if (empty())
+      return true;
+
+    // power sums S_1..S_2c, the even ones being squares since S_2k = S_k^2
+    std::vector<uint32_t> s(2 * capacity);
+    for (size_t i = 0; i < capacity; ++i)
+      s[2 * i] = m_syndromes[i];
+    for (size_t i = 1; i < 2 * capacity; i += 2)
+      s[i] = gf_mul(s[i / 2], s[i / 2]);
+
+    // Berlekamp-Massey yields the locator polynomial prod(1 - id.z)
+    poly c = {1}, b = {1};
+    size_t l = 0, m = 1;
+    uint32_t bd = 1;
+    for (size_t n = 0; n < s.size(); ++n)
+    {
+      uint32_t d = s[n];
+      for (size_t i = 1; i <= l && i <= n && i < c.size(); ++i)
+        d ^= gf_mul(c[i], s[n - i]);
+      if (d == 0)
+      {
+        ++m;
+        continue;
+      }
+      const uint32_t coef = gf_mul(d, gf_inv(bd));
+      poly t = c;
+      c.resize(std::max(c.size(), b.size() + m), 0);
+      for (size_t i = 0; i < b.size(); ++i)
+        c[i + m] ^= gf_mul(coef, b[i]);
+      if (2 * l <= n)
+      {
+        l = n + 1 - l;
+        b = std::move(t);
+        bd = d;
+        m = 1;
+      }
+      else
+        ++m;
+    }
+    c.resize(l + 1, 0);
+    if (l >= capacity || c[l] == 0)
+      return false;
+
+    // its reverse has the ids themselves as roots, which must all be distinct
+    // and in the field, ie x^(2^32) = x mod f
+    poly f(c.rbegin(), c.rend());
+    poly x = {0, 1};
+    poly_mod(x, f);
+    poly xq = x;
+    for (int i = 0; i < 32; ++i)
+      xq = poly_sqrmod(xq, f);
+    if (xq != x)
+      return false;
+
+    if (!find_roots(f, 0, ids) || ids.size() != l)
+    {
+      ids.clear();
+      return false;
+    }
+
+    // an overloaded sketch can decode to garbage, so we only decode up to
+    // capacity - 1 ids and use the last power sum as a check
+    tx_sketch check(capacity);
+    for (uint32_t id: ids)
+      check.add(id);
+    if (check.m_syndromes != m_syndromes)
+    {
+      ids.clear();
+      return false;
+    }
+    return true;
+  }
+
+  std::string tx_sketch::serialize() const
+  {
+    std::string blob(m_syndromes.size() * sizeof(uint32_t), '\0');
+    for (size_t i = 0; i < m_syndromes.size(); ++i)
+    {
+      const uint32_t s = SWAP32LE(m_syndromes[i]);
+      memcpy(&blob[i * sizeof(uint32_t)], &s, sizeof(uint32_t));
+    }
+    return blob;
+  }
+
+  bool tx_sketch::deserialize(const std::string &blob)
+  {
+    if (blob.size() % sizeof(uint32_t) || blob.size() / sizeof(uint32_t) > P2P_TX_RECONCILIATION_MAX_CAPACITY)
+      return false;
+    m_syndromes.resize(blob.size() / sizeof(uint32_t));
+    for (size_t i = 0; i < m_syndromes.size(); ++i)
+    {
+      uint32_t s;
+      memcpy(&s, &blob[i * sizeof(uint32_t)], sizeof(uint32_t));
+      m_syndromes[i] = SWAP32LE(s);
+    }
+    return true;
+  }
+
+  size_t tx_sketch::estimate_capacity(size_t local_size, size_t remote_size)
+  {
+    // the difference is at least the size difference, plus whatever both
+    // sides learnt from elsewhere since the last round
+    const size_t diff = local_size > remote_size ? local_size - remote_size : remote_size - local_size;
+    return diff + std::min(local_size, remote_size) / 8 + 3;
+  }
+
+  uint32_t get_tx_reconciliation_short_id(uint64_t salt, const crypto::hash &tx_hash)
+  {
+    char data[sizeof(uint64_t) + sizeof(crypto::hash)];
+    salt = SWAP64LE(salt);
+    memcpy(data, &salt, sizeof(uint64_t));
+    memcpy(data + sizeof(uint64_t), &tx_hash, sizeof(crypto::hash));
+    const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+    uint32_t id;
+    memcpy(&id, &h, sizeof(id));
+    id = SWAP32LE(id);
+    return id ? id : 1; // zero can't go in a sketch
+  }
+
+  std::string make_tx_reconciliation_sketch(const std::vector<uint32_t> &ids, size_t remote_size)
+  {
+    const size_t capacity = tx_sketch::estimate_capacity(ids.size(), remote_size);
+    if (capacity > P2P_TX_RECONCILIATION_MAX_CAPACITY)
+      return std::string();
+    tx_sketch sketch(capacity);
+    for (uint32_t id: ids)
+      sketch.add(id);
+    return sketch.serialize();
+  }
+
+  bool decode_tx_reconciliation_sketch(const tx_sketch &remote, const std::unordered_set<uint32_t> &local_ids,
+      std::vector<uint32_t> &peer_missing_ids, std::vector<uint32_t> &local_missing_ids)
+  {
+    peer_missing_ids.clear();
+    local_missing_ids.clear();
+    if (remote.capacity() == 0)
+      return false;
+    tx_sketch sketch(remote.capacity());
+    for (uint32_t id: local_ids)
+      sketch.add(id);
+    sketch.merge(remote);
+    std::vector<uint32_t> ids;
+    if (!sketch.decode(ids))
+      return false;
+    // of the ids in the difference, the ones we have are the ones the peer lacks
+    for (uint32_t id: ids)
+      (local_ids.find(id) != local_ids.end() ? peer_missing_ids : local_missing_ids).push_back(id);
+    return true;
+  }
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  // A PinSketch style set sketch of 32 bit nonzero short ids: the odd power
+  // sums of the set elements over GF(2^32). Combining the sketches of two sets
+  // yields the sketch of their symmetric difference, which can be decoded back
+  // into the differing ids as long as there are fewer than capacity of them:
+  // a difference of capacity or more ids is reported as a failure.
+  class tx_sketch
+  {
+  public:
+    explicit tx_sketch(size_t capacity = 0);
+
+    size_t capacity() const { return m_syndromes.size(); }
+    bool empty() const;
+
+    void add(uint32_t id);
+    void merge(const tx_sketch &other);
+    bool decode(std::vector<uint32_t> &ids) const;
+
+    std::string serialize() const;
+    bool deserialize(const std::string &blob);
+
+    static size_t estimate_capacity(size_t local_size, size_t remote_size);
+
+  private:
+    std::vector<uint32_t> m_syndromes;
+  };
+
+  // The steps of a reconciliation round, shared by the protocol handler and the relay simulation.
+
+  //! the short id a tx goes by in a round with the given salt, never zero
+  uint32_t get_tx_reconciliation_short_id(uint64_t salt, const crypto::hash &tx_hash);
+  //! the responder's serialized sketch of its round ids, empty when the sets are too far apart for one
+  std::string make_tx_reconciliation_sketch(const std::vector<uint32_t> &ids, size_t remote_size);
+  //! the initiator's side: splits the difference between its ids and the peer's sketch into the ids
+  //! the peer lacks and the ones we lack, false if it can't be decoded
+  bool decode_tx_reconciliation_sketch(const tx_sketch &remote, const std::unordered_set<uint32_t> &local_ids,
+      std::vector<uint32_t> &peer_missing_ids, std::vector<uint32_t> &local_missing_ids);
+}
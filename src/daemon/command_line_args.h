@@ -141,6 +141,18 @@ namespace daemon_args
     }
   };
 
+  const command_line::arg_descriptor<std::string> arg_zmq_pub = {
+    "zmq-pub"
+  , "Address for the ZMQ event publisher to bind on, eg tcp://127.0.0.1:18083 (disabled if empty)"
+  , ""
+  };
+
+  const command_line::arg_descriptor<int> arg_zmq_pub_queue = {
+    "zmq-pub-queue"
+  , "Maximum number of ZMQ events queued for each subscriber before events are dropped"
+  , 1000
+  };
+
 }  // namespace daemon_args
 
 #endif // DAEMON_COMMAND_LINE_ARGS_H
\ No newline at end of file
@@ -48,6 +48,7 @@
 #include "net/net_ssl.h"
 #include "version.h"
 #include "wallstreetbets_mq/wallstreetbetsMQ.h"
+#include "wallstreetbets_mq/zmq_pub.h"
 
 using namespace epee;
 
@@ -59,6 +60,8 @@ using namespace epee;
 namespace daemonize {
 
 struct t_internals {
+  // declared first so it outlives the core, which holds its listeners
+  std::unique_ptr<wallstreetbetsMQ::ZmqPub> zmq_pub;
 private:
   t_protocol protocol;
 public:
@@ -155,6 +158,22 @@ bool t_daemon::run(bool interactive)
     if (!mp_internals->core.run())
       return false;
 
+    const std::string zmq_pub_address = command_line::get_arg(m_vm, daemon_args::arg_zmq_pub);
+    if (!zmq_pub_address.empty())
+    {
+      mp_internals->zmq_pub.reset(new wallstreetbetsMQ::ZmqPub());
+      wallstreetbetsMQ::ZmqPub &pub = *mp_internals->zmq_pub;
+      if (!pub.init(zmq_pub_address, command_line::get_arg(m_vm, daemon_args::arg_zmq_pub_queue)))
+        return false;
+      cryptonote::Blockchain &blockchain = mp_internals->core.get().get_blockchain_storage();
+      blockchain.add_block_listener([&pub](uint64_t height, const cryptonote::block &b) { pub.on_block(height, b); });
+      blockchain.add_reorg_listener([&pub](uint64_t split_height, uint64_t new_height) { pub.on_reorg(split_height, new_height); });
+      blockchain.add_miner_listener([&pub](const cryptonote::miner_data &data) { pub.on_miner_data(data); });
+      mp_internals->core.get().add_txpool_listener([&pub](const std::vector<cryptonote::txpool_event> &txs) { pub.on_txpool_add(txs); });
+      pub.run();
+      MGINFO_GREEN("ZMQ publisher started at " << zmq_pub_address);
+    }
+
     for(auto& rpc: mp_internals->rpcs)
       rpc->run();
 
@@ -218,6 +237,9 @@ bool t_daemon::run(bool interactive)
 	    wallstreetbetsNotifier.stop();
 	}
 
+    if (mp_internals->zmq_pub)
+      mp_internals->zmq_pub->stop();
+
     for(auto& rpc : mp_internals->rpcs)
       rpc->stop();
     mp_internals->core.get().get_miner().stop();
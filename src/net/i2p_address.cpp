@@ -39,6 +39,8 @@
 #include "net/error.h"
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage.h"
+#include "storages/portable_storage_flat.h"
+#include "storages/portable_storage_writer.h"
 #include "string_tools.h"
 
 namespace net
@@ -121,7 +123,8 @@ namespace net
         return i2p_address{host, porti};
     }
 
-    bool i2p_address::_load(epee::serialization::portable_storage& src, epee::serialization::section* hparent)
+    template<typename T, typename H>
+    bool i2p_address::load_from(T& src, H* hparent)
     {
         i2p_serialized in{};
         if (in._load(src, hparent) && in.host.size() < sizeof(host_) && (in.host == unknown_host || !host_check(in.host).has_error()))
@@ -137,12 +140,33 @@ namespace net
         return false;
     }
 
-    bool i2p_address::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+    template<typename T, typename H>
+    bool i2p_address::store_to(T& dest, H* hparent) const
     {
         const i2p_serialized out{std::string{host_}, port_};
         return out.store(dest, hparent);
     }
 
+    bool i2p_address::_load(epee::serialization::portable_storage& src, epee::serialization::section* hparent)
+    {
+        return load_from(src, hparent);
+    }
+
+    bool i2p_address::_load(epee::serialization::flat_portable_storage& src, epee::serialization::flat_section* hparent)
+    {
+        return load_from(src, hparent);
+    }
+
+    bool i2p_address::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+    {
+        return store_to(dest, hparent);
+    }
+
+    bool i2p_address::store(epee::serialization::portable_storage_writer& dest, epee::serialization::writer_frame* hparent) const
+    {
+        return store_to(dest, hparent);
+    }
+
     i2p_address::i2p_address(const i2p_address& rhs) noexcept
       : port_(rhs.port_)
     {
@@ -43,6 +43,10 @@ namespace serialization
 {
     class portable_storage;
     struct section;
+    class flat_portable_storage;
+    struct flat_section;
+    class portable_storage_writer;
+    struct writer_frame;
 }
 }
 
@@ -57,6 +61,11 @@ namespace net
         //! Keep in private, `host.size()` has no runtime check
         i2p_address(boost::string_ref host, std::uint16_t port) noexcept;
 
+        template<typename T, typename H>
+        bool load_from(T& src, H* hparent);
+        template<typename T, typename H>
+        bool store_to(T& dest, H* hparent) const;
+
     public:
         //! \return Size of internal buffer for host.
         static constexpr std::size_t buffer_size() noexcept { return sizeof(host_); }
@@ -79,9 +88,11 @@ namespace net
 
         //! Load from epee p2p format, and \return false if not valid tor address
         bool _load(epee::serialization::portable_storage& src, epee::serialization::section* hparent);
+        bool _load(epee::serialization::flat_portable_storage& src, epee::serialization::flat_section* hparent);
 
         //! Store in epee p2p format
         bool store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const;
+        bool store(epee::serialization::portable_storage_writer& dest, epee::serialization::writer_frame* hparent) const;
 
         // Moves and copies are currently identical
 
@@ -39,6 +39,8 @@
 #include "net/error.h"
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage.h"
+#include "storages/portable_storage_flat.h"
+#include "storages/portable_storage_writer.h"
 #include "string_tools.h"
 
 namespace net
@@ -123,7 +125,8 @@ namespace net
         return tor_address{host, porti};
     }
 
-    bool tor_address::_load(epee::serialization::portable_storage& src, epee::serialization::section* hparent)
+    template<typename T, typename H>
+    bool tor_address::load_from(T& src, H* hparent)
     {
         tor_serialized in{};
         if (in._load(src, hparent) && in.host.size() < sizeof(host_) && (in.host == unknown_host || !host_check(in.host).has_error()))
@@ -139,12 +142,33 @@ namespace net
         return false;
     }
 
-    bool tor_address::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+    template<typename T, typename H>
+    bool tor_address::store_to(T& dest, H* hparent) const
     {
         const tor_serialized out{std::string{host_}, port_};
         return out.store(dest, hparent);
     }
 
+    bool tor_address::_load(epee::serialization::portable_storage& src, epee::serialization::section* hparent)
+    {
+        return load_from(src, hparent);
+    }
+
+    bool tor_address::_load(epee::serialization::flat_portable_storage& src, epee::serialization::flat_section* hparent)
+    {
+        return load_from(src, hparent);
+    }
+
+    bool tor_address::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+    {
+        return store_to(dest, hparent);
+    }
+
+    bool tor_address::store(epee::serialization::portable_storage_writer& dest, epee::serialization::writer_frame* hparent) const
+    {
+        return store_to(dest, hparent);
+    }
+
     tor_address::tor_address(const tor_address& rhs) noexcept
       : port_(rhs.port_)
     {
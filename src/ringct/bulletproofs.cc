@@ -254,16 +254,20 @@ static void hadamard_fold(std::vector<ge_p3> &v, const rct::keyV *scale, const r
 {
   CHECK_AND_ASSERT_THROW_MES((v.size() & 1) == 0, "Vector size should be even");
   const size_t sz = v.size() / 2;
-  for (size_t n = 0; n < sz; ++n)
+  // each element is a double scalarmult of its own, so chunks can be small
+  run_parallel_chunks(sz, get_parallel_chunks(sz, 8), [&](size_t, size_t begin, size_t end)
   {
-    ge_dsmp c[2];
-    ge_dsm_precomp(c[0], &v[n]);
-    ge_dsm_precomp(c[1], &v[sz + n]);
-    rct::key sa, sb;
-    if (scale) sc_mul(sa.bytes, a.bytes, (*scale)[n].bytes); else sa = a;
-    if (scale) sc_mul(sb.bytes, b.bytes, (*scale)[sz + n].bytes); else sb = b;
-    ge_double_scalarmult_precomp_vartime2_p3(&v[n], sa.bytes, c[0], sb.bytes, c[1]);
-  }
+    for (size_t n = begin; n < end; ++n)
+    {
+      ge_dsmp c[2];
+      ge_dsm_precomp(c[0], &v[n]);
+      ge_dsm_precomp(c[1], &v[sz + n]);
+      rct::key sa, sb;
+      if (scale) sc_mul(sa.bytes, a.bytes, (*scale)[n].bytes); else sa = a;
+      if (scale) sc_mul(sb.bytes, b.bytes, (*scale)[sz + n].bytes); else sb = b;
+      ge_double_scalarmult_precomp_vartime2_p3(&v[n], sa.bytes, c[0], sb.bytes, c[1]);
+    }
+  });
   v.resize(sz);
 }
 
@@ -499,7 +503,7 @@ Bulletproof bulletproof_PROVE(const rct::keyV &sv, const rct::keyV &gamma)
     rct::key gamma8, sv8;
     sc_mul(gamma8.bytes, gamma[i].bytes, INV_EIGHT.bytes);
     sc_mul(sv8.bytes, sv[i].bytes, INV_EIGHT.bytes);
-    rct::addKeys2(V[i], gamma8, sv8, rct::H);
+    rct::addKeys2H(V[i], gamma8, sv8);
   }
   PERF_TIMER_STOP_BP(PROVE_v);
 
@@ -620,15 +624,12 @@ try_again:
   rct::key tau1 = rct::skGen(), tau2 = rct::skGen();
 
   rct::key T1, T2;
-  ge_p3 p3;
   sc_mul(tmp.bytes, t1.bytes, INV_EIGHT.bytes);
   sc_mul(tmp2.bytes, tau1.bytes, INV_EIGHT.bytes);
-  ge_double_scalarmult_base_vartime_p3(&p3, tmp.bytes, &ge_p3_H, tmp2.bytes);
-  ge_p3_tobytes(T1.bytes, &p3);
+  rct::addKeys2H(T1, tmp2, tmp);
   sc_mul(tmp.bytes, t2.bytes, INV_EIGHT.bytes);
   sc_mul(tmp2.bytes, tau2.bytes, INV_EIGHT.bytes);
-  ge_double_scalarmult_base_vartime_p3(&p3, tmp.bytes, &ge_p3_H, tmp2.bytes);
-  ge_p3_tobytes(T2.bytes, &p3);
+  rct::addKeys2H(T2, tmp2, tmp);
 
   // PAPER LINES 49-51
   rct::key x = hash_cache_mash(hash_cache, z, T1, T2);
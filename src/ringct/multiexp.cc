@@ -29,8 +29,13 @@
 //
 // Adapted from Python code by Sarang Noether
 
+#include <atomic>
+#include <exception>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
 #include "misc_log_ex.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 extern "C"
 {
 #include "crypto/crypto-ops.h"
@@ -99,9 +104,75 @@ extern "C"
 //     Cached Straus/Pippenger cross at 232
 //
 
+// below this, splitting over threads costs more than it saves; pippenger
+// splits by window, straus by whole bands of STEP points so the doublings
+// aren't repeated any more than they are serially
+#define PIPPENGER_THREAD_MIN_POINTS 64
+
 namespace rct
 {
 
+static std::atomic<bool> multiexp_threading(true);
+
+void set_multiexp_threading(bool enabled)
+{
+  multiexp_threading = enabled;
+}
+
+bool get_multiexp_threading()
+{
+  return multiexp_threading;
+}
+
+size_t get_parallel_chunks(size_t size, size_t min_chunk)
+{
+  if (!multiexp_threading || min_chunk == 0 || tools::threadpool::in_leaf_task())
+    return 1;
+  const size_t threads = tools::threadpool::getInstance().get_max_concurrency();
+  return std::max<size_t>(1, std::min<size_t>(threads, size / min_chunk));
+}
+
+void run_parallel_chunks(size_t size, size_t chunks, const std::function<void(size_t, size_t, size_t)> &f)
+{
+  CHECK_AND_ASSERT_THROW_MES(chunks > 0, "No chunks to run");
+  if (chunks == 1)
+  {
+    f(0, 0, size);
+    return;
+  }
+  if (tools::threadpool::in_leaf_task())
+  {
+    // a leaf task can't submit, and has no pool thread to spare anyway
+    for (size_t chunk = 0; chunk < chunks; ++chunk)
+      f(chunk, size * chunk / chunks, size * (chunk + 1) / chunks);
+    return;
+  }
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  boost::mutex error_mutex;
+  std::exception_ptr error;
+  for (size_t chunk = 0; chunk < chunks; ++chunk)
+  {
+    const size_t begin = size * chunk / chunks, end = size * (chunk + 1) / chunks;
+    tpool.submit(&waiter, [&, chunk, begin, end] {
+      try
+      {
+        f(chunk, begin, end);
+      }
+      catch (...)
+      {
+        boost::lock_guard<boost::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+      }
+    }, true);
+  }
+  waiter.wait(&tpool);
+  if (error)
+    std::rethrow_exception(error);
+}
+
 static inline bool operator<(const rct::key &k0, const rct::key&k1)
 {
   for (int n = 31; n >= 0; --n)
@@ -453,9 +524,6 @@ rct::key straus(const std::vector<MultiexpData> &data, const std::shared_ptr<str
   MULTIEXP_PERF(PERF_TIMER_START_UNIT(setup, 1000000));
   static constexpr unsigned int mask = (1<<STRAUS_C)-1;
   std::shared_ptr<straus_cached_data> local_cache = cache == NULL ? straus_init_cache(data) : cache;
-  ge_cached cached;
-  ge_p1p1 p1;
-  ge_p3 p3;
 
 #ifdef TRACK_STRAUS_ZERO_IDENTITY
   MULTIEXP_PERF(PERF_TIMER_START_UNIT(skip, 1000000));
@@ -508,53 +576,67 @@ rct::key straus(const std::vector<MultiexpData> &data, const std::shared_ptr<str
     start_i += STRAUS_C;
   MULTIEXP_PERF(PERF_TIMER_STOP(setup));
 
-  ge_p3 res_p3 = ge_p3_identity;
-
-  for (size_t start_offset = 0; start_offset < data.size(); start_offset += STEP)
+  // each chunk sums its own run of bands
+  const size_t bands = (data.size() + STEP - 1) / STEP;
+  const size_t chunks = get_parallel_chunks(bands, 1);
+  std::vector<ge_p3> chunk_p3(chunks, ge_p3_identity);
+  run_parallel_chunks(bands, chunks, [&](size_t chunk, size_t begin, size_t end)
   {
-    const size_t num_points = std::min(data.size() - start_offset, STEP);
+    ge_cached cached;
+    ge_p1p1 p1;
+    ge_p3 &res_p3 = chunk_p3[chunk];
 
-    ge_p3 band_p3 = ge_p3_identity;
-    size_t i = start_i;
-    if (!(i < STRAUS_C))
-      goto skipfirst;
-    while (!(i < STRAUS_C))
+    for (size_t band = begin; band < end; ++band)
     {
-      ge_p2 p2;
-      ge_p3_to_p2(&p2, &band_p3);
-      for (size_t j = 0; j < STRAUS_C; ++j)
+      const size_t start_offset = band * STEP;
+      const size_t num_points = std::min(data.size() - start_offset, STEP);
+
+      ge_p3 band_p3 = ge_p3_identity;
+      size_t i = start_i;
+      if (!(i < STRAUS_C))
+        goto skipfirst;
+      while (!(i < STRAUS_C))
       {
-        ge_p2_dbl(&p1, &p2);
-        if (j == STRAUS_C - 1)
-          ge_p1p1_to_p3(&band_p3, &p1);
-        else
-          ge_p1p1_to_p2(&p2, &p1);
-      }
+        ge_p2 p2;
+        ge_p3_to_p2(&p2, &band_p3);
+        for (size_t j = 0; j < STRAUS_C; ++j)
+        {
+          ge_p2_dbl(&p1, &p2);
+          if (j == STRAUS_C - 1)
+            ge_p1p1_to_p3(&band_p3, &p1);
+          else
+            ge_p1p1_to_p2(&p2, &p1);
+        }
 skipfirst:
-      i -= STRAUS_C;
-      for (size_t j = start_offset; j < start_offset + num_points; ++j)
-      {
+        i -= STRAUS_C;
+        for (size_t j = start_offset; j < start_offset + num_points; ++j)
+        {
 #ifdef TRACK_STRAUS_ZERO_IDENTITY
-        if (skip[j])
-          continue;
+          if (skip[j])
+            continue;
 #endif
 #if STRAUS_C==4
-        const uint8_t digit = digits[j*64+i/4];
+          const uint8_t digit = digits[j*64+i/4];
 #else
-        const uint8_t digit = digits[j*256+i];
+          const uint8_t digit = digits[j*256+i];
 #endif
-        if (digit)
-        {
-          ge_add(&p1, &band_p3, &CACHE_OFFSET(local_cache, j, digit));
-          ge_p1p1_to_p3(&band_p3, &p1);
+          if (digit)
+          {
+            ge_add(&p1, &band_p3, &CACHE_OFFSET(local_cache, j, digit));
+            ge_p1p1_to_p3(&band_p3, &p1);
+          }
         }
       }
+
+      ge_p3_to_cached(&cached, &band_p3);
+      ge_add(&p1, &res_p3, &cached);
+      ge_p1p1_to_p3(&res_p3, &p1);
     }
+  });
 
-    ge_p3_to_cached(&cached, &band_p3);
-    ge_add(&p1, &res_p3, &cached);
-    ge_p1p1_to_p3(&res_p3, &p1);
-  }
+  ge_p3 res_p3 = chunk_p3[0];
+  for (size_t chunk = 1; chunk < chunks; ++chunk)
+    add(res_p3, chunk_p3[chunk]);
 
   rct::key res;
   ge_p3_tobytes(res.bytes, &res_p3);
@@ -617,8 +699,6 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
 
   ge_p3 result = ge_p3_identity;
   bool result_init = false;
-  std::unique_ptr<ge_p3[]> buckets{new ge_p3[1<<c]};
-  bool buckets_init[1<<9];
   std::shared_ptr<pippenger_cached_data> local_cache = cache == NULL ? pippenger_init_cache(data) : cache;
   std::shared_ptr<pippenger_cached_data> local_cache_2 = data.size() > cache_size ? pippenger_init_cache(data, cache_size) : NULL;
 
@@ -633,6 +713,75 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
     ++groups;
   groups = (groups + c - 1) / c;
 
+  // windows sum their buckets independently, and are then combined high to low
+  std::vector<ge_p3> windows(groups);
+  std::vector<uint8_t> windows_init(groups, 0);
+  const size_t chunks = data.size() < PIPPENGER_THREAD_MIN_POINTS ? 1 : get_parallel_chunks(groups, 1);
+  run_parallel_chunks(groups, chunks, [&](size_t, size_t begin, size_t end)
+  {
+    std::unique_ptr<ge_p3[]> buckets{new ge_p3[1<<c]};
+    bool buckets_init[1<<9];
+
+    for (size_t k = begin; k < end; ++k)
+    {
+      memset(buckets_init, 0, 1u<<c);
+
+      // partition scalars into buckets
+      for (size_t i = 0; i < data.size(); ++i)
+      {
+        unsigned int bucket = 0;
+        for (size_t j = 0; j < c; ++j)
+          if (test(data[i].scalar, k*c+j))
+            bucket |= 1<<j;
+        if (bucket == 0)
+          continue;
+        CHECK_AND_ASSERT_THROW_MES(bucket < (1u<<c), "bucket overflow");
+        if (buckets_init[bucket])
+        {
+          if (i < cache_size)
+            add(buckets[bucket], local_cache->cached[i]);
+          else
+            add(buckets[bucket], local_cache_2->cached[i - cache_size]);
+        }
+        else
+        {
+          buckets[bucket] = data[i].point;
+          buckets_init[bucket] = true;
+        }
+      }
+
+      // sum the buckets
+      ge_p3 &window = windows[k];
+      bool window_init = false;
+      ge_p3 pail;
+      bool pail_init = false;
+      for (size_t i = (1<<c)-1; i > 0; --i)
+      {
+        if (buckets_init[i])
+        {
+          if (pail_init)
+            add(pail, buckets[i]);
+          else
+          {
+            pail = buckets[i];
+            pail_init = true;
+          }
+        }
+        if (pail_init)
+        {
+          if (window_init)
+            add(window, pail);
+          else
+          {
+            window = pail;
+            window_init = true;
+          }
+        }
+      }
+      windows_init[k] = window_init;
+    }
+  });
+
   for (size_t k = groups; k-- > 0; )
   {
     if (result_init)
@@ -649,56 +798,14 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
           ge_p1p1_to_p2(&p2, &p1);
       }
     }
-    memset(buckets_init, 0, 1u<<c);
-
-    // partition scalars into buckets
-    for (size_t i = 0; i < data.size(); ++i)
+    if (windows_init[k])
     {
-      unsigned int bucket = 0;
-      for (size_t j = 0; j < c; ++j)
-        if (test(data[i].scalar, k*c+j))
-          bucket |= 1<<j;
-      if (bucket == 0)
-        continue;
-      CHECK_AND_ASSERT_THROW_MES(bucket < (1u<<c), "bucket overflow");
-      if (buckets_init[bucket])
-      {
-        if (i < cache_size)
-          add(buckets[bucket], local_cache->cached[i]);
-        else
-          add(buckets[bucket], local_cache_2->cached[i - cache_size]);
-      }
+      if (result_init)
+        add(result, windows[k]);
       else
       {
-        buckets[bucket] = data[i].point;
-        buckets_init[bucket] = true;
-      }
-    }
-
-    // sum the buckets
-    ge_p3 pail;
-    bool pail_init = false;
-    for (size_t i = (1<<c)-1; i > 0; --i)
-    {
-      if (buckets_init[i])
-      {
-        if (pail_init)
-          add(pail, buckets[i]);
-        else
-        {
-          pail = buckets[i];
-          pail_init = true;
-        }
-      }
-      if (pail_init)
-      {
-        if (result_init)
-          add(result, pail);
-        else
-        {
-          result = pail;
-          result_init = true;
-        }
+        result = windows[k];
+        result_init = true;
       }
     }
   }
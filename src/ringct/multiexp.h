@@ -34,6 +34,7 @@
 #ifndef MULTIEXP_H
 #define MULTIEXP_H
 
+#include <functional>
 #include <vector>
 #include "crypto/crypto.h"
 #include "rctTypes.h"
@@ -67,6 +68,21 @@ size_t pippenger_get_cache_size(const std::shared_ptr<pippenger_cached_data> &ca
 size_t get_pippenger_c(size_t N);
 rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache = NULL, size_t cache_size = 0, size_t c = 0);
 
+// Large multiexps and prover loops are split over tools::threadpool. The sums
+// come out the same either way, turning it off keeps all the work on the
+// calling thread, in a fixed order
+void set_multiexp_threading(bool enabled);
+bool get_multiexp_threading();
+// number of chunks worth running [0, size) in, at most one per thread and
+// none smaller than min_chunk, or 1 if threading is off or the caller is
+// itself a threadpool leaf task
+size_t get_parallel_chunks(size_t size, size_t min_chunk);
+// runs f(chunk, begin, end) over [0, size) in the given number of chunks,
+// and rethrows the first exception any of them threw. The chunks are leaf
+// tasks, so f must not use the threadpool; called from a leaf task, all the
+// chunks run in turn on the calling thread
+void run_parallel_chunks(size_t size, size_t chunks, const std::function<void(size_t, size_t, size_t)> &f);
+
 }
 
 #endif
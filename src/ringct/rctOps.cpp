@@ -218,6 +218,31 @@ static const zero_commitment zero_commitments[] = {
   { (uint64_t)10000000000000000000ull, {{0x65, 0x8d, 0x1, 0x37, 0x6d, 0x18, 0x63, 0xe7, 0x7b, 0x9, 0x6f, 0x98, 0xe6, 0xe5, 0x13, 0xc2, 0x4, 0x10, 0xf5, 0xc7, 0xfb, 0x18, 0xa6, 0xe5, 0x9a, 0x52, 0x66, 0x84, 0x5c, 0xd9, 0xb1, 0xe3}} },
 };
 
+namespace
+{
+  struct fixed_base
+  {
+    ge_fixed_base_table table;
+    explicit fixed_base(const ge_p3 &point) { ge_fixed_base_precomp(table, &point); }
+  };
+
+  // built on first use, 30 kB
+  const ge_fixed_base_table &H_table()
+  {
+    static const fixed_base H(ge_p3_H);
+    return H.table;
+  }
+
+  // G and H are in the prime order subgroup, so reducing changes nothing but
+  // keeps the comb's a[31] <= 127 precondition
+  void scalarmult_fixed_base(ge_p3 &r, const rct::key &a, const ge_fixed_base_table &table)
+  {
+    rct::key reduced;
+    sc_reduce32copy(reduced.bytes, a.bytes);
+    ge_scalarmult_fixed_base(&r, reduced.bytes, table);
+  }
+}
+
 namespace rct {
 
     //Various key initialization functions
@@ -296,7 +321,7 @@ namespace rct {
 
     //generates C =aG + bH from b, a is given..
     void genC(key & C, const key & a, xmr_amount amount) {
-        addKeys2(C, a, d2h(amount), rct::H);;
+        addKeys2H(C, a, d2h(amount));
     }
 
     //generates a <secret , public> / Pedersen commitment to the amount
@@ -388,10 +413,10 @@ namespace rct {
 
     //Computes aH where H= toPoint(cn_fast_hash(G)), G the basepoint
     key scalarmultH(const key & a) {
-        ge_p2 R;
-        ge_scalarmult(&R, a.bytes, &ge_p3_H);
+        ge_p3 R;
+        scalarmult_fixed_base(R, a, H_table());
         key aP;
-        ge_tobytes(aP.bytes, &R);
+        ge_p3_tobytes(aP.bytes, &R);
         return aP;
     }
 
@@ -465,6 +490,11 @@ namespace rct {
     //addKeys2
     //aGbB = aG + bB where a, b are scalars, G is the basepoint and B is a point
     void addKeys2(key &aGbB, const key &a, const key &b, const key & B) {
+        if (B == rct::H)
+        {
+            addKeys2H(aGbB, a, b);
+            return;
+        }
         ge_p2 rv;
         ge_p3 B2;
         CHECK_AND_ASSERT_THROW_MES_L1(ge_frombytes_vartime(&B2, B.bytes) == 0, "ge_frombytes_vartime failed at "+boost::lexical_cast<std::string>(__LINE__));
@@ -472,6 +502,21 @@ namespace rct {
         ge_tobytes(aGbB.bytes, &rv);
     }
 
+    //addKeys2H
+    //aGbH = aG + bH where a, b are scalars, G is the basepoint and H the commitment base
+    //both sides come from precomputed tables, in constant time
+    void addKeys2H(key &aGbH, const key &a, const key &b) {
+        ge_p3 aG, bH, rv;
+        ge_cached cached;
+        ge_p1p1 p1;
+        scalarmult_fixed_base(aG, a, ge_base);
+        scalarmult_fixed_base(bH, b, H_table());
+        ge_p3_to_cached(&cached, &bH);
+        ge_add(&p1, &aG, &cached);
+        ge_p1p1_to_p3(&rv, &p1);
+        ge_p3_tobytes(aGbH.bytes, &rv);
+    }
+
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key & B) {
@@ -29,6 +29,8 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <atomic>
+#include <limits>
 #include "misc_log_ex.h"
 #include "common/perf_timer.h"
 #include "common/threadpool.h"
@@ -1343,9 +1345,45 @@ namespace rct {
       return verRctSemanticsSimple(std::vector<const rctSig*>(1, &rv));
     }
 
+    //bisects a failed batch until the bad rctSigs are isolated
+    //if known_bad is set, the range is already known to contain a bad rctSig
+    static bool verRctSemanticsSimpleBisect(const std::vector<const rctSig*> & rvv, size_t begin, size_t end, bool known_bad, std::vector<bool> &valid)
+    {
+      if (!known_bad && verRctSemanticsSimple(std::vector<const rctSig*>(rvv.begin() + begin, rvv.begin() + end)))
+      {
+        std::fill(valid.begin() + begin, valid.begin() + end, true);
+        return true;
+      }
+      if (end - begin == 1)
+      {
+        valid[begin] = false;
+        return false;
+      }
+      const size_t middle = begin + (end - begin) / 2;
+      const bool left = verRctSemanticsSimpleBisect(rvv, begin, middle, false, valid);
+      // if the left half is fine, the bad one(s) must be on the right
+      verRctSemanticsSimpleBisect(rvv, middle, end, left, valid);
+      return false;
+    }
+
+    //ver RingCT simple, batched over all rctSigs (and thus all their bulletproofs)
+    //valid is set to whether each rctSig passed, bisecting the batch if it fails
+    bool verRctSemanticsSimple(const std::vector<const rctSig*> & rvv, std::vector<bool> &valid)
+    {
+      valid.assign(rvv.size(), false);
+      if (rvv.empty())
+        return true;
+      return verRctSemanticsSimpleBisect(rvv, 0, rvv.size(), false, valid);
+    }
+
     //ver RingCT simple
     //assumes only post-rct style inputs (at least for max anonymity)
     bool verRctNonSemanticsSimple(const rctSig & rv) {
+      std::vector<bool> verified;
+      return verRctNonSemanticsSimple(rv, verified, NULL);
+    }
+
+    bool verRctNonSemanticsSimple(const rctSig & rv, std::vector<bool> &verified, size_t *failed_input) {
       try
       {
         PERF_TIMER(verRctNonSemanticsSimple);
@@ -1357,10 +1395,10 @@ namespace rct {
           CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
         else
           CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
+        CHECK_AND_ASSERT_MES(verified.empty() || verified.size() == rv.mixRing.size(), false, "Mismatched sizes of verified and mixRing");
 
-        const size_t threads = std::max(rv.outPk.size(), rv.mixRing.size());
-
-        std::deque<bool> results(threads);
+        verified.resize(rv.mixRing.size(), false);
+        std::deque<bool> results(verified.begin(), verified.end());
         tools::threadpool& tpool = tools::threadpool::getInstance();
         tools::threadpool::waiter waiter;
 
@@ -1368,20 +1406,31 @@ namespace rct {
 
         const key message = get_pre_mlsag_hash(rv, hw::get_device("default"));
 
-        results.clear();
-        results.resize(rv.mixRing.size());
+        // once an input fails, the ones not started yet are not worth checking
+        static const size_t none = std::numeric_limits<size_t>::max();
+        std::atomic<size_t> failed(none);
         for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
+          if (verified[i])
+            continue;
           tpool.submit(&waiter, [&, i] {
+              if (failed.load(std::memory_order_relaxed) != none)
+                return;
               results[i] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+              size_t expected = none;
+              if (!results[i])
+                failed.compare_exchange_strong(expected, i);
           });
         }
         waiter.wait(&tpool);
 
-        for (size_t i = 0; i < results.size(); ++i) {
-          if(!results[i]) {
-            LOG_PRINT_L1("verRctMGSimple failed for input " << i);
-            return false;
-          }
+        for (size_t i = 0; i < results.size(); ++i)
+          verified[i] = results[i];
+
+        if (failed != none) {
+          LOG_PRINT_L1("verRctMGSimple failed for input " << failed);
+          if (failed_input)
+            *failed_input = failed;
+          return false;
         }
 
         return true;
@@ -130,9 +130,13 @@ namespace rct {
     static inline bool verRct(const rctSig & rv) { return verRct(rv, true) && verRct(rv, false); }
     bool verRctSemanticsSimple(const rctSig & rv);
     bool verRctSemanticsSimple(const std::vector<const rctSig*> & rv);
+    bool verRctSemanticsSimple(const std::vector<const rctSig*> & rv, std::vector<bool> &valid);
     bool verRctSemanticsSimple_old(const rctSig & rv);
     bool verRctSemanticsSimple_old(const std::vector<const rctSig*> & rv);
     bool verRctNonSemanticsSimple(const rctSig & rv);
+    //verifies the MGs of the inputs not already marked in verified, in parallel, marking those
+    //found valid. Stops early on the first failure, whose input goes in failed_input if given
+    bool verRctNonSemanticsSimple(const rctSig & rv, std::vector<bool> &verified, size_t *failed_input);
     static inline bool verRctSimple(const rctSig & rv) { return verRctSemanticsSimple(rv) && verRctNonSemanticsSimple(rv); }
     xmr_amount decodeRct(const rctSig & rv, const key & sk, unsigned int i, key & mask, hw::device &hwdev);
     xmr_amount decodeRct(const rctSig & rv, const key & sk, unsigned int i, hw::device &hwdev);
@@ -65,12 +65,20 @@ using namespace epee;
 
 #define OUTPUT_HISTOGRAM_RECENT_CUTOFF_RESTRICTION (3 * 86400) // 3 days max, the wallet requests 1.8 days
 
+// how long an expensive call over the limit waits for a slot before it is answered busy
+#define EXPENSIVE_RPC_QUEUE_TIMEOUT_MS 30000
+
 #define DEFAULT_PAYMENT_DIFFICULTY 1000
 #define DEFAULT_PAYMENT_CREDITS_PER_HASH 10
 
-#define RPC_TRACKER(rpc) \
+#define RPC_TRACKER_CLASS(rpc, rpc_class) \
   PERF_TIMER(rpc); \
-  RPCTracker tracker(#rpc, PERF_TIMER_NAME(rpc))
+  RPCTracker tracker(#rpc, PERF_TIMER_NAME(rpc)); \
+  do { if (ctx && !tracker.enter(m_limiter, rpc_class)) return rpc_busy(res); } while(0)
+#define RPC_TRACKER(rpc) RPC_TRACKER_CLASS(rpc, rpc_limiter::rpc_class_cheap)
+#define RPC_TRACKER_EXPENSIVE(rpc) RPC_TRACKER_CLASS(rpc, rpc_limiter::rpc_class_expensive)
+
+#define RPC_LATENCY_BUCKETS 17
 
 namespace
 {
@@ -82,15 +90,40 @@ namespace
       uint64_t count;
       uint64_t time;
       uint64_t credits;
+      uint64_t rejected;
+      // bucket 0 counts calls under 1 ms, bucket n calls from 2^(n-1) ms to 2^n ms, the last one everything slower
+      uint64_t latency[RPC_LATENCY_BUCKETS];
     };
 
-    RPCTracker(const char *rpc, tools::LoggingPerformanceTimer &timer): rpc(rpc), timer(timer) {
+    RPCTracker(const char *rpc, tools::LoggingPerformanceTimer &timer): rpc(rpc), timer(timer), limiter(NULL), rejected(false) {
     }
     ~RPCTracker() {
+      if (limiter)
+        limiter->leave(rpc, rpc_class);
       boost::unique_lock<boost::mutex> lock(mutex);
       auto &e = tracker[rpc];
+      if (rejected)
+      {
+        ++e.rejected;
+        return;
+      }
+      const uint64_t t = timer.value();
       ++e.count;
-      e.time += timer.value();
+      e.time += t;
+      size_t bucket = 0;
+      for (uint64_t ms = t / 1000000; ms && bucket < RPC_LATENCY_BUCKETS - 1; ms >>= 1)
+        ++bucket;
+      ++e.latency[bucket];
+    }
+    bool enter(cryptonote::rpc_limiter &l, cryptonote::rpc_limiter::rpc_class c) {
+      if (!l.enter(rpc, c))
+      {
+        rejected = true;
+        return false;
+      }
+      limiter = &l;
+      rpc_class = c;
+      return true;
     }
     void pay(uint64_t amount) {
       boost::unique_lock<boost::mutex> lock(mutex);
@@ -103,12 +136,28 @@ namespace
   private:
     std::string rpc;
     tools::LoggingPerformanceTimer &timer;
+    cryptonote::rpc_limiter *limiter;
+    cryptonote::rpc_limiter::rpc_class rpc_class;
+    bool rejected;
     static boost::mutex mutex;
     static std::unordered_map<std::string, entry_t> tracker;
   };
   boost::mutex RPCTracker::mutex;
   std::unordered_map<std::string, RPCTracker::entry_t> RPCTracker::tracker;
 
+  template<typename T>
+  bool rpc_busy(T &res)
+  {
+    res.status = CORE_RPC_STATUS_BUSY;
+    return true;
+  }
+
+  bool rpc_busy(std::string &)
+  {
+    // no status field to report it in, fail the call instead
+    return false;
+  }
+
   void add_reason(std::string &reasons, const char *reason)
   {
     if (!reasons.empty())
@@ -132,6 +181,9 @@ namespace cryptonote
     command_line::add_arg(desc, arg_rpc_payment_address);
     command_line::add_arg(desc, arg_rpc_payment_difficulty);
     command_line::add_arg(desc, arg_rpc_payment_credits);
+    command_line::add_arg(desc, arg_rpc_threads);
+    command_line::add_arg(desc, arg_rpc_expensive_threads);
+    command_line::add_arg(desc, arg_rpc_method_limit);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(
@@ -140,6 +192,8 @@ namespace cryptonote
     )
     : m_core(cr)
     , m_p2p(p2p)
+    , m_threads(0)
+    , m_expensive_threads(0)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::~core_rpc_server()
@@ -161,6 +215,18 @@ namespace cryptonote
     if (!rpc_config)
       return false;
 
+    m_threads = command_line::get_arg(vm, arg_rpc_threads);
+    m_expensive_threads = command_line::get_arg(vm, arg_rpc_expensive_threads);
+    if (m_threads == 0 || m_expensive_threads == 0)
+    {
+      MERROR("RPC thread counts must be at least 1");
+      return false;
+    }
+    m_limiter.set_class_limit(rpc_limiter::rpc_class_expensive, m_expensive_threads);
+    m_limiter.set_class_queue(rpc_limiter::rpc_class_expensive, m_expensive_threads, EXPENSIVE_RPC_QUEUE_TIMEOUT_MS);
+    if (!m_limiter.set_method_limits(command_line::get_arg(vm, arg_rpc_method_limit)))
+      return false;
+
     std::string address = command_line::get_arg(vm, arg_rpc_payment_address);
     if (!address.empty())
     {
@@ -377,6 +443,21 @@ namespace cryptonote
       CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_out);
       epee::net_utils::network_throttle_manager::get_global_throttle_out().get_stats(res.total_packets_out, res.total_bytes_out);
     }
+    for (const epee::net_utils::zone z: {epee::net_utils::zone::public_, epee::net_utils::zone::tor, epee::net_utils::zone::i2p})
+    {
+      epee::net_utils::zone_throttle_stats in, out;
+      {
+        CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_in);
+        epee::net_utils::network_throttle_manager::get_global_throttle_in().get_stats(z, in);
+      }
+      {
+        CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_out);
+        epee::net_utils::network_throttle_manager::get_global_throttle_out().get_stats(z, out);
+      }
+      if (in.packets == 0 && out.packets == 0)
+        continue;
+      res.zones.push_back({epee::net_utils::zone_to_string(z), in.packets, in.bytes, in.deferrals, in.deferred_ms, out.packets, out.bytes, out.deferrals, out.deferred_ms});
+    }
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -393,7 +474,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_blocks);
+    RPC_TRACKER_EXPENSIVE(get_blocks);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_FAST>(invoke_http_mode::BIN, "/getblocks.bin", req, res, r))
       return r;
@@ -425,8 +506,11 @@ namespace cryptonote
         return false;
       }
     }
+    if (req.max_block_count > 0 && req.max_block_count < max_blocks)
+      max_blocks = req.max_block_count;
 
-    std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> bs;
+    // entries come straight from the db, we only move them into the response
+    std::vector<std::pair<block_complete_entry, crypto::hash>> bs;
     if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, max_blocks, COMMAND_RPC_GET_BLOCKS_FAST_MAX_TX_COUNT))
     {
       res.status = "Failed";
@@ -435,36 +519,27 @@ namespace cryptonote
 
     CHECK_PAYMENT_SAME_TS(req, res, bs.size() * COST_PER_BLOCK);
 
-    size_t pruned_size = 0, unpruned_size = 0, ntxes = 0;
+    size_t size = 0, ntxes = 0;
     res.blocks.reserve(bs.size());
     res.output_indices.reserve(bs.size());
     for(auto& bd: bs)
     {
-      res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().pruned = req.prune;
-      res.blocks.back().block = bd.first.first;
-      pruned_size += bd.first.first.size();
-      unpruned_size += bd.first.first.size();
+      const size_t block_ntxes = bd.first.txs.size();
+      size += bd.first.block.size();
+      for (const auto &tx: bd.first.txs)
+        size += tx.blob.size();
+      ntxes += block_ntxes;
+      res.blocks.push_back(std::move(bd.first));
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
-      ntxes += bd.second.size();
-      res.output_indices.back().indices.reserve(1 + bd.second.size());
+      res.output_indices.back().indices.reserve(1 + block_ntxes);
       if (req.no_miner_tx)
         res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-      res.blocks.back().txs.reserve(bd.second.size());
-      for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
-      {
-        unpruned_size += i->second.size();
-        res.blocks.back().txs.push_back({std::move(i->second), crypto::null_hash});
-        i->second.clear();
-        i->second.shrink_to_fit();
-        pruned_size += res.blocks.back().txs.back().blob.size();
-      }
 
-      const size_t n_txes_to_lookup = bd.second.size() + (req.no_miner_tx ? 0 : 1);
+      const size_t n_txes_to_lookup = block_ntxes + (req.no_miner_tx ? 0 : 1);
       if (n_txes_to_lookup > 0)
       {
         std::vector<std::vector<uint64_t>> indices;
-        bool r = m_core.get_tx_outputs_gindexs(req.no_miner_tx ? bd.second.front().first : bd.first.second, n_txes_to_lookup, indices);
+        bool r = m_core.get_tx_outputs_gindexs(bd.second, n_txes_to_lookup, indices);
         if (!r)
         {
           res.status = "Failed";
@@ -480,13 +555,13 @@ namespace cryptonote
       }
     }
 
-    MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", unpruned size " << unpruned_size);
+    MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, " << (req.prune ? "pruned" : "unpruned") << " size " << size);
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
     bool core_rpc_server::on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res, const connection_context *ctx)
     {
-      RPC_TRACKER(get_alt_blocks_hashes);
+      RPC_TRACKER_EXPENSIVE(get_alt_blocks_hashes);
       bool r;
       if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_ALT_BLOCKS_HASHES>(invoke_http_mode::JON, "/get_alt_blocks_hashes", req, res, r))
         return r;
@@ -513,7 +588,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks_by_height(const COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_blocks_by_height);
+    RPC_TRACKER_EXPENSIVE(get_blocks_by_height);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_BY_HEIGHT>(invoke_http_mode::BIN, "/getblocks_by_height.bin", req, res, r))
       return r;
@@ -548,7 +623,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_hashes);
+    RPC_TRACKER_EXPENSIVE(get_hashes);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_HASHES_FAST>(invoke_http_mode::BIN, "/gethashes.bin", req, res, r))
       return r;
@@ -570,7 +645,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_outs_bin(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_outs_bin);
+    RPC_TRACKER_EXPENSIVE(get_outs_bin);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUTS_BIN>(invoke_http_mode::BIN, "/get_outs.bin", req, res, r))
       return r;
@@ -600,7 +675,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_outs(const COMMAND_RPC_GET_OUTPUTS::request& req, COMMAND_RPC_GET_OUTPUTS::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_outs);
+    RPC_TRACKER_EXPENSIVE(get_outs);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUTS>(invoke_http_mode::JON, "/get_outs", req, res, r))
       return r;
@@ -666,7 +741,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_transactions(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_transactions);
+    RPC_TRACKER_EXPENSIVE(get_transactions);
     bool ok;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTIONS>(invoke_http_mode::JON, "/gettransactions", req, res, ok))
       return ok;
@@ -890,7 +965,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_is_key_image_spent(const COMMAND_RPC_IS_KEY_IMAGE_SPENT::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(is_key_image_spent);
+    RPC_TRACKER_EXPENSIVE(is_key_image_spent);
     bool ok;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_IS_KEY_IMAGE_SPENT>(invoke_http_mode::JON, "/is_key_image_spent", req, res, ok))
       return ok;
@@ -1245,7 +1320,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request& req, COMMAND_RPC_GET_TRANSACTION_POOL::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_transaction_pool);
+    RPC_TRACKER_EXPENSIVE(get_transaction_pool);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTION_POOL>(invoke_http_mode::JON, "/get_transaction_pool", req, res, r))
       return r;
@@ -1880,7 +1955,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_block_headers_range(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_block_headers_range);
+    RPC_TRACKER_EXPENSIVE(get_block_headers_range);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCK_HEADERS_RANGE>(invoke_http_mode::JON_RPC, "getblockheadersrange", req, res, r))
       return r;
@@ -1934,7 +2009,7 @@ namespace cryptonote
   using std::endl;
   bool core_rpc_server::on_get_blocks_range(const COMMAND_RPC_GET_BLOCKS_RANGE::request& req, COMMAND_RPC_GET_BLOCKS_RANGE::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_blocks_range);
+    RPC_TRACKER_EXPENSIVE(get_blocks_range);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_RANGE>(invoke_http_mode::JON_RPC, "getblocksrange", req, res, r))
       return r;
@@ -2273,7 +2348,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_output_histogram(const COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request& req, COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_output_histogram);
+    RPC_TRACKER_EXPENSIVE(get_output_histogram);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_HISTOGRAM>(invoke_http_mode::JON_RPC, "get_output_histogram", req, res, r))
       return r;
@@ -2333,7 +2408,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_coinbase_tx_sum(const COMMAND_RPC_GET_COINBASE_TX_SUM::request& req, COMMAND_RPC_GET_COINBASE_TX_SUM::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_coinbase_tx_sum);
+    RPC_TRACKER_EXPENSIVE(get_coinbase_tx_sum);
     const uint64_t bc_height = m_core.get_current_blockchain_height();
     if (req.height >= bc_height || req.count > bc_height)
     {
@@ -2364,7 +2439,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_alternate_chains(const COMMAND_RPC_GET_ALTERNATE_CHAINS::request& req, COMMAND_RPC_GET_ALTERNATE_CHAINS::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_alternate_chains);
+    RPC_TRACKER_EXPENSIVE(get_alternate_chains);
     try
     {
       std::vector<std::pair<Blockchain::block_extended_info, std::vector<crypto::hash>>> chains = m_core.get_blockchain_storage().get_alternative_chains();
@@ -2668,7 +2743,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_txpool_backlog(const COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_txpool_backlog);
+    RPC_TRACKER_EXPENSIVE(get_txpool_backlog);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG>(invoke_http_mode::JON_RPC, "get_txpool_backlog", req, res, r))
       return r;
@@ -2688,7 +2763,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_output_distribution(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
-    RPC_TRACKER(get_output_distribution);
+    RPC_TRACKER_EXPENSIVE(get_output_distribution);
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_DISTRIBUTION>(invoke_http_mode::JON_RPC, "get_output_distribution", req, res, r))
       return r;
@@ -2728,7 +2803,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_output_distribution_bin(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, const connection_context *ctx)
   {
-    RPC_TRACKER(get_output_distribution_bin);
+    RPC_TRACKER_EXPENSIVE(get_output_distribution_bin);
 
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_DISTRIBUTION>(invoke_http_mode::BIN, "/get_output_distribution.bin", req, res, r))
@@ -2963,6 +3038,8 @@ namespace cryptonote
       res.data.back().count = d.second.count;
       res.data.back().time = d.second.time;
       res.data.back().credits = d.second.credits;
+      res.data.back().rejected = d.second.rejected;
+      res.data.back().latency_histogram.assign(d.second.latency, d.second.latency + RPC_LATENCY_BUCKETS);
     }
 
     res.status = CORE_RPC_STATUS_OK;
@@ -3081,4 +3158,22 @@ namespace cryptonote
     , "Restrict RPC to clients sending micropayment, yields that many credits per payment"
     , DEFAULT_PAYMENT_CREDITS_PER_HASH
     };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_threads = {
+      "rpc-threads"
+    , "Number of RPC threads reserved for cheap calls"
+    , 2
+    };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_expensive_threads = {
+      "rpc-expensive-threads"
+    , "Maximum number of concurrent expensive calls (eg get_blocks, get_outs, get_output_distribution); as many more may "
+      "wait for a slot, and the server runs twice this many RPC threads on top of the cheap ones for them"
+    , 2
+    };
+
+  const command_line::arg_descriptor<std::vector<std::string>> core_rpc_server::arg_rpc_method_limit = {
+      "rpc-method-limit"
+    , "Limit the number of concurrent calls to an RPC, as method:limit (eg get_output_distribution:1)"
+    };
 }  // namespace cryptonote
@@ -41,6 +41,7 @@
 #include "p2p/net_node.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
 #include "rpc_payment.h"
+#include "rpc_limiter.h"
 
 // yes, epee doesn't properly use its full namespace when calling its
 // functions from macros.  *sigh*
@@ -70,6 +71,9 @@ namespace cryptonote
     static const command_line::arg_descriptor<std::string> arg_rpc_payment_address;
     static const command_line::arg_descriptor<uint64_t> arg_rpc_payment_difficulty;
     static const command_line::arg_descriptor<uint64_t> arg_rpc_payment_credits;
+    static const command_line::arg_descriptor<unsigned> arg_rpc_threads;
+    static const command_line::arg_descriptor<unsigned> arg_rpc_expensive_threads;
+    static const command_line::arg_descriptor<std::vector<std::string>> arg_rpc_method_limit;
 
     typedef epee::net_utils::connection_context_base connection_context;
 
@@ -86,6 +90,8 @@ namespace cryptonote
         const std::string& port
       );
     network_type nettype() const { return m_core.get_nettype(); }
+    //! io threads to run: the ones reserved for cheap calls, plus the ones expensive calls run or wait for a slot on
+    size_t get_threads() const { return m_threads + 2 * m_expensive_threads; }
 
     CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
 
@@ -276,6 +282,9 @@ private:
     bool m_was_bootstrap_ever_used;
     bool m_restricted;
     std::unique_ptr<rpc_payment> m_rpc_payment;
+    rpc_limiter m_limiter;
+    unsigned m_threads;
+    unsigned m_expensive_threads;
   };
 }
 
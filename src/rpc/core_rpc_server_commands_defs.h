@@ -89,7 +89,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 4
-#define CORE_RPC_VERSION_MINOR 2
+#define CORE_RPC_VERSION_MINOR 6
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -168,6 +168,7 @@ namespace cryptonote
       uint64_t    start_height;
       bool        prune;
       bool        no_miner_tx;
+      uint64_t    max_block_count; // 0 for the daemon's default
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_request_base)
@@ -175,6 +176,7 @@ namespace cryptonote
         KV_SERIALIZE(start_height)
         KV_SERIALIZE(prune)
         KV_SERIALIZE_OPT(no_miner_tx, false)
+        KV_SERIALIZE_OPT(max_block_count, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -763,6 +765,31 @@ namespace cryptonote
 
 
   //-----------------------------------------------
+  struct net_zone_stats
+  {
+    std::string zone;
+    uint64_t packets_in;
+    uint64_t bytes_in;
+    uint64_t deferrals_in;
+    uint64_t deferred_ms_in;
+    uint64_t packets_out;
+    uint64_t bytes_out;
+    uint64_t deferrals_out;
+    uint64_t deferred_ms_out;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(zone)
+      KV_SERIALIZE(packets_in)
+      KV_SERIALIZE(bytes_in)
+      KV_SERIALIZE(deferrals_in)
+      KV_SERIALIZE(deferred_ms_in)
+      KV_SERIALIZE(packets_out)
+      KV_SERIALIZE(bytes_out)
+      KV_SERIALIZE(deferrals_out)
+      KV_SERIALIZE(deferred_ms_out)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct COMMAND_RPC_GET_NET_STATS
   {
     struct request_t: public rpc_request_base
@@ -781,6 +808,7 @@ namespace cryptonote
       uint64_t total_bytes_in;
       uint64_t total_packets_out;
       uint64_t total_bytes_out;
+      std::vector<net_zone_stats> zones;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_response_base)
@@ -789,6 +817,7 @@ namespace cryptonote
         KV_SERIALIZE(total_bytes_in)
         KV_SERIALIZE(total_packets_out)
         KV_SERIALIZE(total_bytes_out)
+        KV_SERIALIZE_OPT(zones, std::vector<net_zone_stats>())
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<response_t> response;
@@ -1499,8 +1528,12 @@ namespace cryptonote
     uint64_t histo_98pc;
     std::vector<txpool_histo> histo;
     uint32_t num_double_spends;
+    uint64_t template_requests;
+    uint64_t template_rebuilds;
+    uint64_t template_time_avg;
+    uint64_t template_time_last;
 
-    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0) {}
+    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0), template_requests(0), template_rebuilds(0), template_time_avg(0), template_time_last(0) {}
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(bytes_total)
@@ -1516,6 +1549,10 @@ namespace cryptonote
       KV_SERIALIZE(histo_98pc)
       KV_SERIALIZE_CONTAINER_POD_AS_BLOB(histo)
       KV_SERIALIZE(num_double_spends)
+      KV_SERIALIZE_OPT(template_requests, (uint64_t)0)
+      KV_SERIALIZE_OPT(template_rebuilds, (uint64_t)0)
+      KV_SERIALIZE_OPT(template_time_avg, (uint64_t)0)
+      KV_SERIALIZE_OPT(template_time_last, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -2440,12 +2477,16 @@ struct request_t: public rpc_access_request_base
       uint64_t count;
       uint64_t time;
       uint64_t credits;
+      uint64_t rejected;
+      std::vector<uint64_t> latency_histogram;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(rpc)
         KV_SERIALIZE(count)
         KV_SERIALIZE(time)
         KV_SERIALIZE(credits)
+        KV_SERIALIZE_OPT(rejected, (uint64_t)0)
+        KV_SERIALIZE(latency_histogram)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1,7 +1,5 @@
 
 #include <algorithm>
-#include <boost/thread/locks.hpp>
-#include <boost/thread/mutex.hpp>
 
 #include "cryptonote_core/cryptonote_core.h"
 
@@ -28,19 +26,8 @@ namespace rpc
   boost::optional<output_distribution_data>
     RpcHandler::get_output_distribution(const std::function<bool(uint64_t, uint64_t, uint64_t, uint64_t&, std::vector<uint64_t>&, uint64_t&)> &f, uint64_t amount, uint64_t from_height, uint64_t to_height, bool cumulative)
   {
-      static struct D
-      {
-        boost::mutex mutex;
-        std::vector<std::uint64_t> cached_distribution;
-        std::uint64_t cached_from, cached_to, cached_start_height, cached_base;
-        bool cached;
-        D(): cached_from(0), cached_to(0), cached_start_height(0), cached_base(0), cached(false) {}
-      } d;
-      const boost::unique_lock<boost::mutex> lock(d.mutex);
-
-      if (d.cached && amount == 0 && d.cached_from == from_height && d.cached_to == to_height)
-        return process_distribution(cumulative, d.cached_start_height, d.cached_distribution, d.cached_base);
-
+      // rct distributions are served from the blockchain's own cache,
+      // which follows reorgs
       std::vector<std::uint64_t> distribution;
       std::uint64_t start_height, base;
       if (!f(amount, from_height, to_height, start_height, distribution, base))
@@ -53,16 +40,6 @@ namespace rpc
           distribution.resize(to_height - offset + 1);
       }
 
-      if (amount == 0)
-      {
-        d.cached_from = from_height;
-        d.cached_to = to_height;
-        d.cached_distribution = distribution;
-        d.cached_start_height = start_height;
-        d.cached_base = base;
-        d.cached = true;
-      }
-
       return process_distribution(cumulative, start_height, std::move(distribution), base);
   }
 } // rpc
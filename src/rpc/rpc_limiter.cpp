@@ -0,0 +1,148 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "rpc_limiter.h"
+
+#include <boost/lexical_cast.hpp>
+#include "misc_log_ex.h"
+
+#undef WALLSTREETBETS_DEFAULT_LOG_CATEGORY
+#define WALLSTREETBETS_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+namespace cryptonote
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_limiter::rpc_limiter()
+  {
+    for (class_stats &s: m_classes)
+      s = {0, 0, 0, 0, 0, 0, 0};
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_limiter::set_class_limit(rpc_class c, unsigned limit)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_classes[c].limit = limit;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_limiter::set_class_queue(rpc_class c, unsigned max_waiting, unsigned timeout_ms)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_classes[c].queue_limit = max_waiting;
+    m_classes[c].queue_timeout_ms = timeout_ms;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_limiter::set_method_limit(const std::string &method, unsigned limit)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_methods[method].limit = limit;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_limiter::set_method_limits(const std::vector<std::string> &limits)
+  {
+    for (const std::string &s: limits)
+    {
+      const size_t pos = s.find(':');
+      unsigned limit;
+      if (pos == std::string::npos || pos == 0 || !boost::conversion::try_lexical_convert(s.substr(pos + 1), limit))
+      {
+        MERROR("Invalid RPC method limit, expected method:limit: " << s);
+        return false;
+      }
+      set_method_limit(s.substr(0, pos), limit);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_limiter::has_room(const std::string &method, rpc_class c) const
+  {
+    const class_stats &cs = m_classes[c];
+    if (cs.limit && cs.in_flight >= cs.limit)
+      return false;
+    if (!m_methods.empty())
+    {
+      auto i = m_methods.find(method);
+      if (i != m_methods.end() && i->second.limit && i->second.in_flight >= i->second.limit)
+        return false;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool rpc_limiter::enter(const std::string &method, rpc_class c)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    class_stats &cs = m_classes[c];
+    if (!has_room(method, c))
+    {
+      if (cs.waiting >= cs.queue_limit || cs.queue_timeout_ms == 0)
+      {
+        ++cs.rejected;
+        return false;
+      }
+      ++cs.waiting;
+      ++cs.queued;
+      const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(cs.queue_timeout_ms);
+      bool ready = true;
+      while (ready && !has_room(method, c))
+        ready = m_slot_freed.wait_until(lock, deadline) == boost::cv_status::no_timeout || has_room(method, c);
+      --cs.waiting;
+      if (!ready)
+      {
+        ++cs.rejected;
+        return false;
+      }
+    }
+    if (!m_methods.empty())
+    {
+      auto i = m_methods.find(method);
+      if (i != m_methods.end())
+        ++i->second.in_flight;
+    }
+    ++cs.in_flight;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void rpc_limiter::leave(const std::string &method, rpc_class c)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    --m_classes[c].in_flight;
+    if (!m_methods.empty())
+    {
+      auto i = m_methods.find(method);
+      if (i != m_methods.end())
+        --i->second.in_flight;
+    }
+    if (m_classes[c].waiting)
+      m_slot_freed.notify_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  rpc_limiter::class_stats rpc_limiter::get_class_stats(rpc_class c) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_classes[c];
+  }
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace cryptonote
+{
+  /**
+   * @brief Caps how many RPCs of each class, and of each method, run at once
+   *
+   * The RPC server handles calls synchronously on its io threads, so a few
+   * slow calls can occupy every thread and stall cheap ones. Expensive calls
+   * are limited to fewer concurrent calls than there are threads, which keeps
+   * the remaining threads free for cheap calls. Calls over a limit may wait
+   * for a slot in a short, bounded queue (each waiter holds an io thread, so
+   * the server runs that many more), and are refused once the queue is full
+   * or their wait times out.
+   */
+  class rpc_limiter
+  {
+  public:
+    enum rpc_class
+    {
+      rpc_class_cheap,
+      rpc_class_expensive,
+      rpc_class_count
+    };
+
+    struct class_stats
+    {
+      unsigned limit;
+      unsigned in_flight;
+      uint64_t rejected;
+      unsigned queue_limit;
+      unsigned queue_timeout_ms;
+      unsigned waiting;
+      uint64_t queued;
+    };
+
+    rpc_limiter();
+
+    //! 0 means no limit
+    void set_class_limit(rpc_class c, unsigned limit);
+    //! lets up to max_waiting calls over a limit of this class wait up to timeout_ms for a slot, 0 refuses them at once
+    void set_class_queue(rpc_class c, unsigned max_waiting, unsigned timeout_ms);
+    void set_method_limit(const std::string &method, unsigned limit);
+    //! parses "method:limit" entries, as given on the command line
+    bool set_method_limits(const std::vector<std::string> &limits);
+
+    //! returns false if the call would exceed a limit and could not wait for a slot, true if it may run and must be matched by leave
+    bool enter(const std::string &method, rpc_class c);
+    void leave(const std::string &method, rpc_class c);
+
+    class_stats get_class_stats(rpc_class c) const;
+
+  private:
+    struct method_state
+    {
+      unsigned limit;
+      unsigned in_flight;
+    };
+
+    bool has_room(const std::string &method, rpc_class c) const;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_slot_freed;
+    class_stats m_classes[rpc_class_count];
+    std::unordered_map<std::string, method_state> m_methods;
+  };
+}
@@ -2512,6 +2512,23 @@ bool simple_wallet::set_credits_target(const std::vector<std::string> &args/* =
   return true;
 }
 
+bool simple_wallet::set_refresh_memory_budget(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  const auto pwd_container = get_and_verify_password();
+  if (pwd_container)
+  {
+    uint64_t budget;
+    if (!epee::string_tools::get_xtype_from_string(budget, args[1]) || budget == 0)
+    {
+      fail_msg_writer() << tr("Invalid memory budget");
+      return true;
+    }
+    m_wallet->refresh_memory_budget(budget);
+    m_wallet->rewrite(m_wallet_file, pwd_container->password());
+  }
+  return true;
+}
+
 bool simple_wallet::set_key_reuse_mitigation2(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
 {
   const auto pwd_container = get_and_verify_password();
@@ -2768,7 +2785,9 @@ simple_wallet::simple_wallet()
                                   "auto-mine-for-rpc-payment-threshold <float>\n "
                                   "  Whether to automatically start mining for RPC payment if the daemon requires it.\n"
                                   "credits-target <unsigned int>\n"
-                                  "  The RPC payment credits balance to target."));
+                                  "  The RPC payment credits balance to target.\n"
+                                  "refresh-memory-budget <unsigned int>\n"
+                                  "  How many megabytes of fetched blocks refresh may hold while waiting to scan them."));
   m_cmd_binder.set_handler("encrypted_seed",
                            boost::bind(&simple_wallet::encrypted_seed, this, boost::placeholders::_1),
                            tr("Display the encrypted Electrum-style mnemonic seed."));
@@ -3047,6 +3066,7 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     success_msg_writer() << "persistent-rpc-client-id = " << m_wallet->persistent_rpc_client_id();
     success_msg_writer() << "auto-mine-for-rpc-payment-threshold = " << m_wallet->auto_mine_for_rpc_payment_threshold();
     success_msg_writer() << "credits-target = " << m_wallet->credits_target();
+    success_msg_writer() << "refresh-memory-budget = " << m_wallet->refresh_memory_budget();
     return true;
   }
   else
@@ -3105,6 +3125,7 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     CHECK_SIMPLE_VARIABLE("persistent-rpc-client-id", set_persistent_rpc_client_id, tr("0 or 1"));
     CHECK_SIMPLE_VARIABLE("auto-mine-for-rpc-payment-threshold", set_auto_mine_for_rpc_payment_threshold, tr("floating point >= 0"));
     CHECK_SIMPLE_VARIABLE("credits-target", set_credits_target, tr("unsigned integer"));
+    CHECK_SIMPLE_VARIABLE("refresh-memory-budget", set_refresh_memory_budget, tr("unsigned integer > 0"));
   }
   fail_msg_writer() << tr("set: unrecognized argument(s)");
   return true;
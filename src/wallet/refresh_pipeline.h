@@ -0,0 +1,158 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+
+namespace tools
+{
+  // Keeps track of a refresh fetched by height over several connections: which ranges
+  // are still to be fetched, the batches waiting for the commit stage, and where the
+  // daemon's chain ends as far as we know, which can move down while we fetch.
+  // Not thread safe, the caller keeps it under its own lock.
+  template<typename T>
+  class refresh_pipeline
+  {
+  public:
+    refresh_pipeline(uint64_t commit_height, uint64_t end_height, uint64_t blocks_per_fetch, size_t budget):
+      m_commit_height(commit_height), m_next_height(commit_height), m_end_height(end_height),
+      m_blocks_per_fetch(blocks_per_fetch), m_budget(budget), m_ready_size(0), m_in_flight(0) {}
+
+    uint64_t commit_height() const { return m_commit_height; }
+    uint64_t end_height() const { return m_end_height; }
+    size_t ready_size() const { return m_ready_size; }
+
+    // nothing left to fetch and no fetch still running
+    bool finished() const { return !more() && m_in_flight == 0; }
+
+    // hands out the next range to fetch, if any is to be fetched now: over budget,
+    // only what the commit stage is waiting on goes out
+    bool start_fetch(uint64_t &height, uint64_t &count)
+    {
+      if (!more())
+        return false;
+      const uint64_t h = m_refetch.empty() ? m_next_height : m_refetch.begin()->first;
+      if (m_ready_size >= m_budget && h != m_commit_height)
+        return false;
+      if (!m_refetch.empty())
+      {
+        height = m_refetch.begin()->first;
+        count = m_refetch.begin()->second;
+        m_refetch.erase(m_refetch.begin());
+      }
+      else
+      {
+        height = m_next_height;
+        count = std::min(m_blocks_per_fetch, m_end_height - m_next_height);
+        m_next_height += count;
+      }
+      ++m_in_flight;
+      return true;
+    }
+
+    // a fetch started with start_fetch is over, followed by one of the calls below
+    // unless it failed for good
+    void end_fetch() { --m_in_flight; }
+
+    // the range could not be fetched just now, it goes out again later
+    void requeue(uint64_t height, uint64_t count)
+    {
+      if (height < m_end_height)
+        m_refetch[height] = std::min(count, m_end_height - height);
+    }
+
+    // blocks fetched from height for a range of count blocks, the daemon may send fewer
+    void add(uint64_t height, uint64_t count, T batch, uint64_t nblocks, size_t size)
+    {
+      if (nblocks == 0)
+      {
+        // no blocks where the daemon said there would be means its chain got shorter
+        truncate(height);
+        return;
+      }
+      if (height >= m_end_height)
+        return;
+      if (nblocks < count && height + nblocks < m_end_height)
+        m_refetch[height + nblocks] = std::min(count, m_end_height - height) - nblocks;
+      m_ready_size += size;
+      m_ready.emplace(height, entry{std::move(batch), size});
+    }
+
+    // the daemon's chain now ends at height: what is below still gets committed,
+    // what we have past it is dropped and not fetched anymore
+    void truncate(uint64_t height)
+    {
+      if (height >= m_end_height)
+        return;
+      m_end_height = height;
+      m_next_height = std::min(m_next_height, m_end_height);
+      m_refetch.erase(m_refetch.lower_bound(m_end_height), m_refetch.end());
+      for (auto it = m_ready.lower_bound(m_end_height); it != m_ready.end(); it = m_ready.erase(it))
+        m_ready_size -= it->second.size;
+    }
+
+    // whether the commit stage has anything more to wait for
+    bool waiting() const { return m_commit_height < m_end_height; }
+
+    // the batch starting at the commit height, if it came in already
+    bool take(T &batch)
+    {
+      auto it = m_ready.find(m_commit_height);
+      if (it == m_ready.end())
+        return false;
+      batch = std::move(it->second.batch);
+      m_ready_size -= it->second.size;
+      m_ready.erase(it);
+      return true;
+    }
+
+    void committed(uint64_t nblocks) { m_commit_height += nblocks; }
+
+  private:
+    bool more() const { return !m_refetch.empty() || m_next_height < m_end_height; }
+
+    struct entry
+    {
+      T batch;
+      size_t size;
+    };
+
+    uint64_t m_commit_height;
+    uint64_t m_next_height;
+    uint64_t m_end_height;
+    const uint64_t m_blocks_per_fetch;
+    const size_t m_budget;
+    size_t m_ready_size;
+    size_t m_in_flight;
+    std::map<uint64_t, entry> m_ready;
+    std::map<uint64_t, uint64_t> m_refetch;
+  };
+}
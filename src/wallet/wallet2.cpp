@@ -80,6 +80,7 @@ using namespace epee;
 #include "common/perf_timer.h"
 #include "ringct/rctSigs.h"
 #include "ringdb.h"
+#include "refresh_pipeline.h"
 #include "net/socks_connect.h"
 
 extern "C"
@@ -133,6 +134,13 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY 1024
 
+#define REFRESH_PIPELINE_FETCHERS 4
+#define REFRESH_PIPELINE_BLOCKS_PER_FETCH 100
+#define REFRESH_PIPELINE_BUSY_RETRIES 8
+#define REFRESH_PIPELINE_BUSY_BACKOFF_MS 250
+#define DEFAULT_REFRESH_MEMORY_BUDGET 256 // MB
+#define KEY_DERIVATION_BATCH_SIZE 64
+
 #define GAMMA_SHAPE 19.28
 #define GAMMA_SCALE (1/1.61)
 
@@ -1011,6 +1019,7 @@ wallet_keys_unlocker::~wallet_keys_unlocker()
 wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_multisig_rescan_info(NULL),
   m_multisig_rescan_k(NULL),
+  m_daemon_ssl_options(epee::net_utils::ssl_support_t::e_ssl_support_autodetect),
   m_upper_transaction_weight_limit(0),
   m_run(true),
   m_callback(0),
@@ -1065,7 +1074,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_encrypt_keys_after_refresh(boost::none),
   m_unattended(unattended),
   m_offline(false),
-  m_credits_target(0)
+  m_credits_target(0),
+  m_refresh_memory_budget(DEFAULT_REFRESH_MEMORY_BUDGET)
 {
   set_rpc_client_secret_key(rct::rct2sk(rct::skGen()));
 }
@@ -1175,6 +1185,8 @@ bool wallet2::set_daemon(std::string daemon_address, boost::optional<epee::net_u
     m_node_rpc_proxy.invalidate();
   }
 
+  m_daemon_ssl_options = ssl_options;
+
   MINFO("setting daemon to " << get_daemon_address());
   return m_http_client.set_server(get_daemon_address(), get_daemon_login(), std::move(ssl_options));
 }
@@ -1184,6 +1196,7 @@ bool wallet2::init(std::string daemon_address, boost::optional<epee::net_utils::
   m_checkpoints.init_default_checkpoints(m_nettype);
   m_is_initialized = true;
   m_upper_transaction_weight_limit = upper_transaction_weight_limit;
+  m_daemon_proxy = proxy;
   if (proxy != boost::asio::ip::tcp::endpoint{})
     m_http_client.set_connector(net::socks::connector{std::move(proxy)});
   return set_daemon(daemon_address, daemon_login, trusted_daemon, std::move(ssl_options));
@@ -2251,7 +2264,7 @@ void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::bl
   error = !cryptonote::parse_and_validate_block_from_blob(blob, bl, bl_id);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t &current_height)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
@@ -2274,6 +2287,46 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
   }
 
   blocks_start_height = res.start_height;
+  current_height = res.current_height;
+  blocks = std::move(res.blocks);
+  o_indices = std::move(res.output_indices);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_blocks(epee::net_utils::http::http_simple_client &http_client, uint64_t start_height, uint64_t count, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+{
+  cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+  cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+
+  req.prune = true;
+  req.start_height = start_height;
+  req.max_block_count = count;
+  req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
+  req.client = get_client_signature();
+
+  // the request goes out on the caller's own connection, only the payment bookkeeping is shared
+  uint64_t pre_call_credits;
+  {
+    const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
+    pre_call_credits = m_rpc_payment_state.credits;
+  }
+  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, http_client, rpc_timeout);
+  {
+    const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
+    THROW_ON_RPC_RESPONSE_ERROR(r, {}, res, "getblocks.bin", error::get_blocks_error, get_rpc_status(res.status));
+    THROW_WALLET_EXCEPTION_IF(res.blocks.size() != res.output_indices.size(), error::wallet_internal_error,
+        "mismatched blocks (" + boost::lexical_cast<std::string>(res.blocks.size()) + ") and output_indices (" +
+        boost::lexical_cast<std::string>(res.output_indices.size()) + ") sizes from daemon");
+    check_rpc_cost("/getblocks.bin", res.credits, pre_call_credits, 1 + res.blocks.size() * COST_PER_BLOCK);
+  }
+  THROW_WALLET_EXCEPTION_IF(!res.blocks.empty() && res.start_height != start_height, error::wallet_internal_error,
+      "Daemon returned blocks from height " + std::to_string(res.start_height) + ", expected " + std::to_string(start_height));
+
+  // daemons which don't know about max_block_count send their usual batch size
+  if (res.blocks.size() > count)
+  {
+    res.blocks.resize(count);
+    res.output_indices.resize(count);
+  }
   blocks = std::move(res.blocks);
   o_indices = std::move(res.output_indices);
 }
@@ -2337,22 +2390,46 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   hwdev.set_mode(hw::device::TRANSACTION_PARSE);
   const cryptonote::account_keys &keys = m_account.get_keys();
 
-  auto gender = [&](wallet2::is_out_data &iod) {
-    boost::unique_lock<hw::device> hwdev_lock(hwdev);
-    if (!hwdev.generate_key_derivation(iod.pkey, keys.m_view_secret_key, iod.derivation))
+  // derivations all use the view key, so they go to the device in batches
+  std::vector<wallet2::is_out_data*> iods;
+  for (auto &slot: tx_cache_data)
+  {
+    for (auto &iod: slot.primary)
+      iods.push_back(&iod);
+    for (auto &iod: slot.additional)
+      iods.push_back(&iod);
+  }
+
+  auto gender = [&](size_t start, size_t end) {
+    std::vector<crypto::public_key> pkeys(end - start);
+    std::vector<crypto::key_derivation> derivations(end - start);
+    std::unique_ptr<bool[]> valid(new bool[end - start]);
+    for (size_t i = start; i < end; ++i)
+      pkeys[i - start] = iods[i]->pkey;
     {
-      MWARNING("Failed to generate key derivation from tx pubkey, skipping");
-      static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
-      memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
+      boost::unique_lock<hw::device> hwdev_lock(hwdev);
+      hwdev.generate_key_derivations(pkeys.data(), pkeys.size(), keys.m_view_secret_key, derivations.data(), valid.get());
+    }
+    for (size_t i = start; i < end; ++i)
+    {
+      wallet2::is_out_data &iod = *iods[i];
+      if (valid[i - start])
+      {
+        iod.derivation = derivations[i - start];
+      }
+      else
+      {
+        MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+        static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+        memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
+      }
     }
   };
 
-  for (auto &slot: tx_cache_data)
+  for (size_t start = 0; start < iods.size(); start += KEY_DERIVATION_BATCH_SIZE)
   {
-    for (auto &iod: slot.primary)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
-    for (auto &iod: slot.additional)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+    const size_t end = std::min<size_t>(iods.size(), start + KEY_DERIVATION_BATCH_SIZE);
+    tpool.submit(&waiter, [&gender, start, end]() { gender(start, end); }, true);
   }
   waiter.wait(&tpool);
 
@@ -2441,72 +2518,318 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   refresh(trusted_daemon, start_height, blocks_fetched, received_money);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error, std::exception_ptr &exception)
+void wallet2::parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error)
 {
   error = false;
-  exception = NULL;
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
 
-  try
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  parsed_blocks.resize(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
   {
-    drop_from_short_history(short_chain_history, 3);
-
-    THROW_WALLET_EXCEPTION_IF(prev_blocks.size() != prev_parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+    tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
+      std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+  }
+  waiter.wait(&tpool);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (parsed_blocks[i].error)
+    {
+      error = true;
+      break;
+    }
+    parsed_blocks[i].o_indices = std::move(o_indices[i]);
+  }
 
-    // prepend the last 3 blocks, should be enough to guard against a block or two's reorg
-    auto s = std::next(prev_parsed_blocks.rbegin(), std::min((size_t)3, prev_parsed_blocks.size())).base();
-    for (; s != prev_parsed_blocks.end(); ++s)
+  boost::mutex error_lock;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    parsed_blocks[i].txes.resize(blocks[i].txs.size());
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
     {
-      short_chain_history.push_front(s->hash);
+      tpool.submit(&waiter, [&, i, j](){
+        if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j].blob, parsed_blocks[i].txes[j]))
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          error = true;
+        }
+      }, true);
     }
+  }
+  waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, uint64_t &current_height, bool &error, std::exception_ptr &exception)
+{
+  error = false;
+  exception = NULL;
+
+  try
+  {
+    // leave out the last few blocks, should be enough to guard against a block or two's reorg
+    drop_from_short_history(short_chain_history, 3);
 
     // pull the new blocks
     std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
-    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
-    THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices, current_height);
+    parse_blocks(blocks, o_indices, parsed_blocks, error);
+  }
+  catch(...)
+  {
+    error = true;
+    exception = std::current_exception();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+std::unique_ptr<epee::net_utils::http::http_simple_client> wallet2::make_daemon_http_client()
+{
+  const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
+  std::unique_ptr<epee::net_utils::http::http_simple_client> http_client(new epee::net_utils::http::http_simple_client());
+  if (m_daemon_proxy != boost::asio::ip::tcp::endpoint{})
+    http_client->set_connector(net::socks::connector{m_daemon_proxy});
+  http_client->set_server(get_daemon_address(), get_daemon_login(), m_daemon_ssl_options);
+  return http_client;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_blocks_pipelined(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t daemon_height, uint64_t &blocks_added)
+{
+  struct refresh_batch
+  {
+    std::vector<cryptonote::block_complete_entry> blocks;
+    std::vector<parsed_block> parsed_blocks;
+    size_t size;
+  };
 
-    tools::threadpool& tpool = tools::threadpool::getInstance();
-    tools::threadpool::waiter waiter;
-    parsed_blocks.resize(blocks.size());
-    for (size_t i = 0; i < blocks.size(); ++i)
+  blocks_added = 0;
+  uint64_t added = 0;
+  const uint64_t commit_height = start_height + blocks.size();
+  if (commit_height >= daemon_height)
+  {
+    process_parsed_blocks(start_height, blocks, parsed_blocks, added);
+    blocks_added += added;
+    return;
+  }
+
+  // Blocks past the first batch are fetched by height on several connections at once, parsed
+  // as they come in, and handed to this thread which scans and commits them in chain order.
+  // A paying daemon gets a single connection so that credit accounting stays sequential.
+  const size_t budget = m_refresh_memory_budget * 1024 * 1024;
+  size_t n_fetchers = REFRESH_PIPELINE_FETCHERS;
+  {
+    const boost::lock_guard<boost::recursive_mutex> lock{m_daemon_rpc_mutex};
+    if (m_rpc_payment_state.credits > 0)
+      n_fetchers = 1;
+  }
+
+  // parsed transactions take several times the room of their blobs, and a batch keeps both
+  auto batch_size = [](const refresh_batch &batch) {
+    size_t size = 0;
+    for (const auto &b: batch.blocks)
     {
-      tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
-        std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+      size += b.block.size();
+      for (const auto &tx: b.txs)
+        size += tx.blob.size();
     }
-    waiter.wait(&tpool);
-    for (size_t i = 0; i < blocks.size(); ++i)
+    for (const auto &pb: batch.parsed_blocks)
     {
-      if (parsed_blocks[i].error)
+      size += sizeof(pb) + pb.block.miner_tx.extra.size() + pb.block.tx_hashes.size() * sizeof(crypto::hash);
+      for (const auto &tx: pb.txes)
       {
-        error = true;
-        break;
+        size += sizeof(tx) + tx.extra.size() + tx.vin.size() * sizeof(cryptonote::txin_v) + tx.vout.size() * sizeof(cryptonote::tx_out);
+        for (const auto &in: tx.vin)
+          if (in.type() == typeid(cryptonote::txin_to_key))
+            size += boost::get<cryptonote::txin_to_key>(in).key_offsets.size() * sizeof(uint64_t);
+        for (const auto &s: tx.signatures)
+          size += s.size() * sizeof(crypto::signature);
+        const rct::rctSig &rv = tx.rct_signatures;
+        size += rv.pseudoOuts.size() * sizeof(rct::key) + rv.ecdhInfo.size() * sizeof(rct::ecdhTuple) + rv.outPk.size() * sizeof(rct::ctkey);
       }
-      parsed_blocks[i].o_indices = std::move(o_indices[i]);
+      for (const auto &i: pb.o_indices.indices)
+        size += sizeof(i) + i.indices.size() * sizeof(uint64_t);
     }
+    return size;
+  };
+
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  tools::refresh_pipeline<refresh_batch> pipeline(commit_height, daemon_height, REFRESH_PIPELINE_BLOCKS_PER_FETCH, budget);
+  bool stop = false;
+  std::exception_ptr exception;
+
+  // daemons refuse a start height past the end of their chain, so a failed fetch may
+  // just mean the chain got shorter since we started
+  auto chain_ends_before = [](epee::net_utils::http::http_simple_client &http_client, uint64_t height, uint64_t &chain_height) {
+    try
+    {
+      cryptonote::COMMAND_RPC_GET_HEIGHT::request req = AUTO_VAL_INIT(req);
+      cryptonote::COMMAND_RPC_GET_HEIGHT::response res = AUTO_VAL_INIT(res);
+      if (!net_utils::invoke_http_json("/getheight", req, res, http_client, rpc_timeout) || res.status != CORE_RPC_STATUS_OK)
+        return false;
+      chain_height = res.height;
+      return chain_height <= height;
+    }
+    catch (...)
+    {
+      return false;
+    }
+  };
 
-    boost::mutex error_lock;
-    for (size_t i = 0; i < blocks.size(); ++i)
+  auto fetcher = [&](epee::net_utils::http::http_simple_client &http_client) {
+    unsigned busy_retries = 0;
+    while (true)
     {
-      parsed_blocks[i].txes.resize(blocks[i].txs.size());
-      for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+      uint64_t height, count;
       {
-        tpool.submit(&waiter, [&, i, j](){
-          if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j].blob, parsed_blocks[i].txes[j]))
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true)
+        {
+          if (stop || !m_run.load(std::memory_order_relaxed))
+            return;
+          if (pipeline.finished())
           {
-            boost::unique_lock<boost::mutex> lock(error_lock);
-            error = true;
+            cond.notify_all();
+            return;
           }
-        }, true);
+          if (pipeline.start_fetch(height, count))
+            break;
+          cond.wait(lock);
+        }
+      }
+
+      refresh_batch batch;
+      bool error = false, busy = false, refused = false;
+      std::exception_ptr e;
+      try
+      {
+        std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+        pull_blocks(http_client, height, count, batch.blocks, o_indices);
+        parse_blocks(batch.blocks, o_indices, batch.parsed_blocks, error);
       }
+      catch (const error::daemon_busy &)
+      {
+        busy = true;
+        e = std::current_exception();
+      }
+      catch (const error::get_blocks_error &)
+      {
+        refused = true;
+        e = std::current_exception();
+      }
+      catch (...)
+      {
+        error = true;
+        e = std::current_exception();
+      }
+      uint64_t chain_height = 0;
+      if (refused && !chain_ends_before(http_client, height, chain_height))
+        error = true;
+      if (!busy && !error && !refused)
+        batch.size = batch_size(batch);
+
+      boost::unique_lock<boost::mutex> lock(mutex);
+      pipeline.end_fetch();
+      cond.notify_all();
+      if (busy)
+      {
+        // the daemon is at its limit for expensive calls, give the range back and try again later
+        if (++busy_retries > REFRESH_PIPELINE_BUSY_RETRIES)
+        {
+          if (!exception)
+            exception = e;
+          stop = true;
+          return;
+        }
+        pipeline.requeue(height, count);
+        const boost::chrono::steady_clock::time_point until = boost::chrono::steady_clock::now() +
+            boost::chrono::milliseconds(REFRESH_PIPELINE_BUSY_BACKOFF_MS << std::min(busy_retries - 1, 5u));
+        while (!stop && m_run.load(std::memory_order_relaxed) && cond.wait_until(lock, until) == boost::cv_status::no_timeout);
+        continue;
+      }
+      busy_retries = 0;
+      if (error)
+      {
+        if (!exception)
+          exception = e ? e : std::make_exception_ptr(std::runtime_error("proxy exception in refresh thread"));
+        stop = true;
+        return;
+      }
+      if (refused)
+      {
+        // what is below still gets committed, then refresh starts again from the chain history
+        MDEBUG("Daemon chain now ends at height " << chain_height << ", not fetching from " << height << " on");
+        pipeline.truncate(chain_height);
+        continue;
+      }
+      const uint64_t nblocks = batch.blocks.size();
+      const size_t size = batch.size;
+      pipeline.add(height, count, std::move(batch), nblocks, size);
+    }
+  };
+
+  std::vector<std::unique_ptr<epee::net_utils::http::http_simple_client>> http_clients;
+  std::vector<boost::thread> threads;
+  auto joiner = epee::misc_utils::create_scope_leave_handler([&]() {
+    {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      stop = true;
+      cond.notify_all();
     }
-    waiter.wait(&tpool);
+    for (auto &t: threads)
+      t.join();
+  });
+  for (size_t i = 0; i < n_fetchers; ++i)
+  {
+    http_clients.push_back(make_daemon_http_client());
+    epee::net_utils::http::http_simple_client &http_client = *http_clients.back();
+    threads.push_back(boost::thread([&fetcher, &http_client]() { fetcher(http_client); }));
   }
-  catch(...)
+
+  // the fetchers are already busy with what comes next while we go through the first batch
+  process_parsed_blocks(start_height, blocks, parsed_blocks, added);
+  blocks_added += added;
+
+  // the commit height is only moved here, under the lock, as the fetchers read it
+  while (m_run.load(std::memory_order_relaxed))
   {
-    error = true;
-    exception = std::current_exception();
+    refresh_batch batch;
+    uint64_t height;
+    {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      bool found = pipeline.take(batch);
+      while (!found && pipeline.waiting() && !stop && m_run.load(std::memory_order_relaxed))
+      {
+        cond.wait_for(lock, boost::chrono::milliseconds(100));
+        found = pipeline.take(batch);
+      }
+      if (!found)
+      {
+        if (exception)
+          std::rethrow_exception(exception);
+        break;
+      }
+      height = pipeline.commit_height();
+      cond.notify_all();
+    }
+
+    // batches are fetched by height, make sure they still link up with what we have
+    bool linked = m_blockchain.size() == height && batch.parsed_blocks[0].block.prev_id == m_blockchain[height - 1];
+    for (size_t i = 1; linked && i < batch.parsed_blocks.size(); ++i)
+      linked = batch.parsed_blocks[i].block.prev_id == batch.parsed_blocks[i - 1].hash;
+    if (!linked)
+    {
+      MDEBUG("Daemon chain changed during refresh at height " << height << ", restarting from chain history");
+      break;
+    }
+
+    process_parsed_blocks(height, batch.blocks, batch.parsed_blocks, added);
+    blocks_added += added;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    pipeline.committed(batch.blocks.size());
+    cond.notify_all();
   }
 }
-
+//----------------------------------------------------------------------------------------------------
 void wallet2::remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashes)
 {
   // remove pool txes to us that aren't in the pool anymore
@@ -2904,8 +3227,6 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   size_t try_count = 0;
   crypto::hash last_tx_hash_id = m_transfers.size() ? m_transfers.back().m_txid : null_hash;
   std::list<crypto::hash> short_chain_history;
-  tools::threadpool& tpool = tools::threadpool::getInstance();
-  tools::threadpool::waiter waiter;
   uint64_t blocks_start_height;
   std::vector<cryptonote::block_complete_entry> blocks;
   std::vector<parsed_block> parsed_blocks;
@@ -2941,104 +3262,88 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     }
   });
 
-  bool first = true;
   while(m_run.load(std::memory_order_relaxed))
   {
-    uint64_t next_blocks_start_height;
-    std::vector<cryptonote::block_complete_entry> next_blocks;
-    std::vector<parsed_block> next_parsed_blocks;
+    uint64_t daemon_height = 0;
     bool error;
     std::exception_ptr exception;
     try
     {
-      error = false;
-      exception = NULL;
-      next_blocks.clear();
-      next_parsed_blocks.clear();
       added_blocks = 0;
-      if (!first && blocks.empty())
+
+      // the first batch is located through our short chain history, so it picks up any reorg;
+      // the rest, up to the daemon's height, is then fetched by height through the pipeline
+      pull_and_parse_next_blocks(start_height, blocks_start_height, short_chain_history, blocks, parsed_blocks, daemon_height, error, exception);
+      if (error)
+      {
+        if (exception)
+          std::rethrow_exception(exception);
+        else
+          throw std::runtime_error("proxy exception in refresh thread");
+      }
+      if (blocks.empty())
       {
         m_node_rpc_proxy.set_height(m_blockchain.size());
         refreshed = true;
         break;
       }
-      tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error, exception);});
 
-      if (!first)
+      try
       {
-        try
-        {
-          process_parsed_blocks(blocks_start_height, blocks, parsed_blocks, added_blocks);
-        }
-        catch (const tools::error::out_of_hashchain_bounds_error&)
-        {
-          MINFO("Daemon claims next refresh block is out of hash chain bounds, resetting hash chain");
-          uint64_t stop_height = m_blockchain.offset();
-          std::vector<crypto::hash> tip(m_blockchain.size() - m_blockchain.offset());
-          for (size_t i = m_blockchain.offset(); i < m_blockchain.size(); ++i)
-            tip[i - m_blockchain.offset()] = m_blockchain[i];
-          cryptonote::block b;
-          generate_genesis(b);
-          m_blockchain.clear();
-          m_blockchain.push_back(get_block_hash(b));
-          short_chain_history.clear();
-          get_short_chain_history(short_chain_history);
-          fast_refresh(stop_height, blocks_start_height, short_chain_history, true);
-          THROW_WALLET_EXCEPTION_IF(m_blockchain.size() != stop_height, error::wallet_internal_error, "Unexpected hashchain size");
-          THROW_WALLET_EXCEPTION_IF(m_blockchain.offset() != 0, error::wallet_internal_error, "Unexpected hashchain offset");
-          for (const auto &h: tip)
-            m_blockchain.push_back(h);
-          short_chain_history.clear();
-          get_short_chain_history(short_chain_history);
-          start_height = stop_height;
-          throw std::runtime_error(""); // loop again
-        }
-        blocks_fetched += added_blocks;
+        process_blocks_pipelined(blocks_start_height, blocks, parsed_blocks, daemon_height, added_blocks);
+      }
+      catch (const tools::error::out_of_hashchain_bounds_error&)
+      {
+        MINFO("Daemon claims next refresh block is out of hash chain bounds, resetting hash chain");
+        uint64_t stop_height = m_blockchain.offset();
+        std::vector<crypto::hash> tip(m_blockchain.size() - m_blockchain.offset());
+        for (size_t i = m_blockchain.offset(); i < m_blockchain.size(); ++i)
+          tip[i - m_blockchain.offset()] = m_blockchain[i];
+        cryptonote::block b;
+        generate_genesis(b);
+        m_blockchain.clear();
+        m_blockchain.push_back(get_block_hash(b));
+        short_chain_history.clear();
+        get_short_chain_history(short_chain_history);
+        fast_refresh(stop_height, blocks_start_height, short_chain_history, true);
+        THROW_WALLET_EXCEPTION_IF(m_blockchain.size() != stop_height, error::wallet_internal_error, "Unexpected hashchain size");
+        THROW_WALLET_EXCEPTION_IF(m_blockchain.offset() != 0, error::wallet_internal_error, "Unexpected hashchain offset");
+        for (const auto &h: tip)
+          m_blockchain.push_back(h);
+        short_chain_history.clear();
+        get_short_chain_history(short_chain_history);
+        start_height = stop_height;
+        throw std::runtime_error(""); // loop again
       }
-      waiter.wait(&tpool);
-      if(!first && blocks_start_height == next_blocks_start_height)
+      blocks_fetched += added_blocks;
+      if (added_blocks == 0)
       {
         m_node_rpc_proxy.set_height(m_blockchain.size());
         refreshed = true;
         break;
       }
 
-      first = false;
-
-      // handle error from async fetching thread
-      if (error)
-      {
-        if (exception)
-          std::rethrow_exception(exception);
-        else
-          throw std::runtime_error("proxy exception in refresh thread");
-      }
-
-      // switch to the new blocks from the daemon
-      blocks_start_height = next_blocks_start_height;
-      blocks = std::move(next_blocks);
-      parsed_blocks = std::move(next_parsed_blocks);
+      // the pipeline stops early if the chain changed under it, so ask again from what we have now
+      short_chain_history.clear();
+      get_short_chain_history(short_chain_history);
+      start_height = 0;
     }
     catch (const tools::error::password_needed&)
     {
       blocks_fetched += added_blocks;
-      waiter.wait(&tpool);
       throw;
     }
     catch (const error::payment_required&)
     {
       // no point in trying again, it'd just eat up credits
-      waiter.wait(&tpool);
       throw;
     }
     catch (const std::exception&)
     {
       blocks_fetched += added_blocks;
-      waiter.wait(&tpool);
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
-        first = true;
         ++try_count;
       }
       else
@@ -3429,6 +3734,9 @@ bool wallet2::store_keys(const std::string& keys_file_name, const epee::wipeable
   value2.SetUint64(m_credits_target);
   json.AddMember("credits_target", value2, json.GetAllocator());
 
+  value2.SetUint64(m_refresh_memory_budget);
+  json.AddMember("refresh_memory_budget", value2, json.GetAllocator());
+
   // Serialize the JSON object
   rapidjson::StringBuffer buffer;
   rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
@@ -3547,6 +3855,7 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
     m_persistent_rpc_client_id = false;
     m_auto_mine_for_rpc_payment_threshold = -1.0f;
     m_credits_target = 0;
+    m_refresh_memory_budget = DEFAULT_REFRESH_MEMORY_BUDGET;
   }
   else if(json.IsObject())
   {
@@ -3713,6 +4022,8 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
     m_auto_mine_for_rpc_payment_threshold = field_auto_mine_for_rpc_payment;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, credits_target, uint64_t, Uint64, false, 0);
     m_credits_target = field_credits_target;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, refresh_memory_budget, uint64_t, Uint64, false, DEFAULT_REFRESH_MEMORY_BUDGET);
+    m_refresh_memory_budget = field_refresh_memory_budget;
 
   }
   else
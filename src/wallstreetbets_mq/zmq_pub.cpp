@@ -0,0 +1,335 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "zmq_pub.h"
+
+#include <cstring>
+
+#include "misc_log_ex.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "serialization/json_object.h"
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#undef WALLSTREETBETS_DEFAULT_LOG_CATEGORY
+#define WALLSTREETBETS_DEFAULT_LOG_CATEGORY "daemon.zmq.pub"
+
+namespace
+{
+  const char relay_address[] = "inproc://zmq_pub";
+  const char quit_message[] = "QUIT";
+
+  const char *const topic_names[] =
+  {
+    "json-full-chain_main",
+    "json-minimal-chain_main",
+    "bin-full-chain_main",
+    "json-full-txpool_add",
+    "json-minimal-txpool_add",
+    "json-minimal-chain_reorg",
+    "json-full-miner_data",
+  };
+  static_assert(sizeof(topic_names) / sizeof(topic_names[0]) == wallstreetbetsMQ::ZmqPub::topic_count, "topic names out of sync");
+
+  std::string to_json(const rapidjson::Document &doc)
+  {
+    rapidjson::StringBuffer buf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+    doc.Accept(writer);
+    return std::string(buf.GetString(), buf.GetSize());
+  }
+
+  template<typename T>
+  void add_member(rapidjson::Document &doc, rapidjson::Value &obj, const char *key, const T &source)
+  {
+    rapidjson::Value val;
+    cryptonote::json::toJsonValue(doc, source, val);
+    obj.AddMember(rapidjson::StringRef(key), val, doc.GetAllocator());
+  }
+}
+
+namespace wallstreetbetsMQ
+{
+  ZmqPub::ZmqPub(): m_subscribed(0), m_dropped(0)
+  {
+  }
+
+  ZmqPub::~ZmqPub()
+  {
+    stop();
+  }
+
+  const char *ZmqPub::topic_name(topic t)
+  {
+    return t < topic_count ? topic_names[t] : "";
+  }
+
+  uint32_t ZmqPub::topic_mask(const std::set<std::string> &prefixes)
+  {
+    uint32_t mask = 0;
+    for (const std::string &s: prefixes)
+    {
+      for (size_t t = 0; t < topic_count; ++t)
+      {
+        if (strncmp(topic_names[t], s.data(), s.size()) == 0)
+          mask |= 1u << t;
+      }
+    }
+    return mask;
+  }
+
+  bool ZmqPub::init(const std::string &address, int queue_size)
+  {
+    try
+    {
+      m_pub.setsockopt<int>(ZMQ_SNDHWM, queue_size);
+      m_pub.setsockopt<int>(ZMQ_LINGER, 0);
+      m_pub.bind(address);
+
+      // each event is two messages on the relay, which must not be the bottleneck
+      m_relay_out.setsockopt<int>(ZMQ_RCVHWM, 2 * queue_size);
+      m_relay_out.bind(relay_address);
+      m_relay_in.setsockopt<int>(ZMQ_SNDHWM, 2 * queue_size);
+      m_relay_in.setsockopt<int>(ZMQ_LINGER, 0);
+      m_relay_in.connect(relay_address);
+    }
+    catch (const zmq::error_t &e)
+    {
+      MERROR("Failed to set up ZMQ publisher on " << address << ": " << e.what());
+      return false;
+    }
+    MINFO("Publishing ZMQ events on " << endpoint());
+    return true;
+  }
+
+  std::string ZmqPub::endpoint() const
+  {
+    char buf[256];
+    size_t size = sizeof(buf);
+    try
+    {
+      m_pub.getsockopt(ZMQ_LAST_ENDPOINT, buf, &size);
+    }
+    catch (const zmq::error_t &)
+    {
+      return "";
+    }
+    return std::string(buf, size ? size - 1 : 0);
+  }
+
+  void ZmqPub::run()
+  {
+    m_thread = std::thread([this]() { relay_loop(); });
+  }
+
+  void ZmqPub::stop()
+  {
+    if (!m_thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(m_relay_lock);
+      m_relay_in.send(quit_message, sizeof(quit_message) - 1, 0);
+    }
+    m_thread.join();
+    if (m_dropped)
+      MINFO("ZMQ publisher dropped " << m_dropped << " events");
+  }
+
+  void ZmqPub::publish(topic t, std::string &&payload)
+  {
+    const char *name = topic_names[t];
+    std::lock_guard<std::mutex> lock(m_relay_lock);
+    try
+    {
+      if (m_relay_in.send(name, strlen(name), ZMQ_SNDMORE | ZMQ_DONTWAIT) &&
+          m_relay_in.send(payload.data(), payload.size(), ZMQ_DONTWAIT))
+        return;
+    }
+    catch (const zmq::error_t &e)
+    {
+      MERROR("Failed to queue ZMQ event " << name << ": " << e.what());
+    }
+    ++m_dropped;
+  }
+
+  void ZmqPub::update_subscriptions(const zmq::message_t &msg)
+  {
+    // XPUB hands us "\x01prefix" on the first subscription to a prefix, and
+    // "\x00prefix" once nobody is subscribed to it anymore
+    if (msg.size() == 0)
+      return;
+    const char *data = msg.data<char>();
+    std::string prefix(data + 1, msg.size() - 1);
+    if (data[0] == 1)
+      m_subscriptions.insert(prefix);
+    else if (data[0] == 0)
+      m_subscriptions.erase(prefix);
+    else
+      return;
+
+    const uint32_t mask = topic_mask(m_subscriptions);
+    m_subscribed = mask;
+    MDEBUG("ZMQ subscriptions changed, topic mask now " << mask);
+  }
+
+  void ZmqPub::relay_loop()
+  {
+    zmq::pollitem_t items[2];
+    items[0].socket = (void*)m_relay_out;
+    items[0].fd = 0;
+    items[0].events = ZMQ_POLLIN;
+    items[1].socket = (void*)m_pub;
+    items[1].fd = 0;
+    items[1].events = ZMQ_POLLIN;
+
+    try
+    {
+      while (true)
+      {
+        zmq::poll(items, 2, -1);
+
+        if (items[1].revents & ZMQ_POLLIN)
+        {
+          zmq::message_t msg;
+          while (m_pub.recv(&msg, ZMQ_DONTWAIT))
+            update_subscriptions(msg);
+        }
+
+        if (items[0].revents & ZMQ_POLLIN)
+        {
+          zmq::message_t topic_msg, payload_msg;
+          while (m_relay_out.recv(&topic_msg, ZMQ_DONTWAIT))
+          {
+            if (!topic_msg.more())
+              return; // QUIT
+            m_relay_out.recv(&payload_msg, 0);
+            // a full subscriber queue makes XPUB drop for that subscriber only
+            m_pub.send(topic_msg, ZMQ_SNDMORE | ZMQ_DONTWAIT);
+            m_pub.send(payload_msg, ZMQ_DONTWAIT);
+          }
+        }
+      }
+    }
+    catch (const zmq::error_t &e)
+    {
+      MERROR("ZMQ publisher stopped: " << e.what());
+    }
+  }
+
+  void ZmqPub::on_block(uint64_t height, const cryptonote::block &b)
+  {
+    if (wanted(json_full_chain_main))
+    {
+      rapidjson::Document doc;
+      doc.SetArray();
+      rapidjson::Value val;
+      cryptonote::json::toJsonValue(doc, b, val);
+      doc.PushBack(val, doc.GetAllocator());
+      publish(json_full_chain_main, to_json(doc));
+    }
+
+    if (wanted(json_minimal_chain_main))
+    {
+      rapidjson::Document doc;
+      doc.SetObject();
+      add_member(doc, doc, "first_height", height);
+      add_member(doc, doc, "first_prev_id", b.prev_id);
+      const std::vector<crypto::hash> ids{cryptonote::get_block_hash(b)};
+      add_member(doc, doc, "ids", ids);
+      publish(json_minimal_chain_main, to_json(doc));
+    }
+
+    if (wanted(bin_full_chain_main))
+      publish(bin_full_chain_main, cryptonote::block_to_blob(b));
+  }
+
+  void ZmqPub::on_reorg(uint64_t split_height, uint64_t new_height)
+  {
+    if (!wanted(json_minimal_chain_reorg))
+      return;
+    rapidjson::Document doc;
+    doc.SetObject();
+    add_member(doc, doc, "split_height", split_height);
+    add_member(doc, doc, "new_height", new_height);
+    publish(json_minimal_chain_reorg, to_json(doc));
+  }
+
+  void ZmqPub::on_miner_data(const cryptonote::miner_data &data)
+  {
+    if (!wanted(json_full_miner_data))
+      return;
+    rapidjson::Document doc;
+    doc.SetObject();
+    add_member(doc, doc, "major_version", data.major_version);
+    add_member(doc, doc, "height", data.height);
+    add_member(doc, doc, "prev_id", data.prev_id);
+    add_member(doc, doc, "seed_hash", data.seed_hash);
+    add_member(doc, doc, "difficulty", data.difficulty);
+    add_member(doc, doc, "median_weight", data.median_weight);
+    add_member(doc, doc, "already_generated_coins", data.already_generated_coins);
+    publish(json_full_miner_data, to_json(doc));
+  }
+
+  void ZmqPub::on_txpool_add(const std::vector<cryptonote::txpool_event> &txs)
+  {
+    if (txs.empty())
+      return;
+
+    if (wanted(json_full_txpool_add))
+    {
+      rapidjson::Document doc;
+      doc.SetArray();
+      for (const cryptonote::txpool_event &e: txs)
+      {
+        if (!e.tx)
+          continue;
+        rapidjson::Value val;
+        cryptonote::json::toJsonValue(doc, *e.tx, val);
+        doc.PushBack(val, doc.GetAllocator());
+      }
+      publish(json_full_txpool_add, to_json(doc));
+    }
+
+    if (wanted(json_minimal_txpool_add))
+    {
+      rapidjson::Document doc;
+      doc.SetArray();
+      for (const cryptonote::txpool_event &e: txs)
+      {
+        rapidjson::Value obj(rapidjson::kObjectType);
+        add_member(doc, obj, "id", e.id);
+        add_member(doc, obj, "blob_size", static_cast<uint64_t>(e.blob ? e.blob->size() : 0));
+        add_member(doc, obj, "weight", e.weight);
+        add_member(doc, obj, "fee", e.fee);
+        doc.PushBack(obj, doc.GetAllocator());
+      }
+      publish(json_minimal_txpool_add, to_json(doc));
+    }
+  }
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zmq.hpp"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_core/core_events.h"
+
+namespace wallstreetbetsMQ
+{
+  /**
+   * @brief Publishes chain and pool events on a ZMQ XPUB socket
+   *
+   * Every message has two frames, the topic and then the payload, so
+   * subscribers pick what they get with ordinary ZMQ prefix subscriptions
+   * (eg "json-minimal-" for all the small JSON events). Events nobody is
+   * subscribed to are not serialized at all.
+   *
+   * Each subscriber gets its own queue of at most queue_size messages on
+   * the socket. Once a slow subscriber fills it, further messages are
+   * dropped for that subscriber only.
+   */
+  class ZmqPub
+  {
+  public:
+    enum topic
+    {
+      json_full_chain_main,
+      json_minimal_chain_main,
+      bin_full_chain_main,
+      json_full_txpool_add,
+      json_minimal_txpool_add,
+      json_minimal_chain_reorg,
+      json_full_miner_data,
+      topic_count
+    };
+
+    ZmqPub();
+    ~ZmqPub();
+    ZmqPub(const ZmqPub&) = delete;
+    ZmqPub& operator=(const ZmqPub&) = delete;
+
+    static const char *topic_name(topic t);
+
+    //! bit mask of the topics matched by any of these subscription prefixes
+    static uint32_t topic_mask(const std::set<std::string> &prefixes);
+
+    bool init(const std::string &address, int queue_size);
+
+    //! the address the socket is bound to, with the actual port if a wildcard was given
+    std::string endpoint() const;
+
+    void run();
+    void stop();
+
+    void on_block(uint64_t height, const cryptonote::block &b);
+    void on_reorg(uint64_t split_height, uint64_t new_height);
+    void on_miner_data(const cryptonote::miner_data &data);
+    void on_txpool_add(const std::vector<cryptonote::txpool_event> &txs);
+
+    //! number of messages dropped because the publisher thread fell behind
+    uint64_t dropped() const { return m_dropped; }
+
+  private:
+    bool wanted(topic t) const { return m_subscribed & (1u << t); }
+    void publish(topic t, std::string &&payload);
+    void update_subscriptions(const zmq::message_t &msg);
+    void relay_loop();
+
+    zmq::context_t m_context;
+    zmq::socket_t m_pub{m_context, ZMQ_XPUB};
+    zmq::socket_t m_relay_in{m_context, ZMQ_PAIR}; //!< written to by the core threads, under m_relay_lock
+    zmq::socket_t m_relay_out{m_context, ZMQ_PAIR}; //!< read from by the publisher thread
+    std::mutex m_relay_lock;
+    std::thread m_thread;
+
+    std::set<std::string> m_subscriptions; //!< prefixes subscribed to, publisher thread only
+    std::atomic<uint32_t> m_subscribed; //!< bit mask of the topics with subscribers
+    std::atomic<uint64_t> m_dropped;
+  };
+}
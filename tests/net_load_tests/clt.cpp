@@ -28,10 +28,15 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <map>
 #include <numeric>
+#include <random>
+#include <set>
+#include <unordered_set>
 #include <boost/thread/thread.hpp>
 #include <vector>
 
@@ -41,6 +46,10 @@
 #include "misc_language.h"
 #include "misc_log_ex.h"
 #include "storages/levin_abstract_invoke2.h"
+#include "crypto/hash.h"
+#include "cryptonote_config.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "cryptonote_protocol/tx_sketch.h"
 
 #include "net_load_tests.h"
 
@@ -626,6 +635,212 @@ TEST_F(net_load_test_clt, permament_open_and_close_and_connections_closed_by_ser
   ASSERT_EQ(RESERVED_CONN_CNT, m_tcp_server.get_config_object().get_connections_count());
 }
 
+namespace
+{
+  // In process model of a network relaying txes, counting the bytes each
+  // relay scheme puts on the wire for the same graph and the same txes
+  class tx_relay_simulation
+  {
+  public:
+    tx_relay_simulation(size_t node_count, size_t out_peers, size_t tx_count, size_t tx_size)
+      : m_rng(42)
+      , m_peers(node_count)
+      , m_tx_count(tx_count)
+    {
+      for (size_t a = 0; a < node_count; ++a)
+      {
+        std::set<size_t> out;
+        while (out.size() < out_peers)
+        {
+          const size_t b = m_rng() % node_count;
+          if (b != a && !m_peers[a].count(b) && !m_peers[b].count(a))
+            out.insert(b);
+        }
+        for (size_t b: out)
+        {
+          m_edges.push_back({a, b});
+          m_peers[a].insert(b);
+          m_peers[b].insert(a);
+        }
+      }
+      for (size_t n = 0; n < tx_count; ++n)
+      {
+        m_txids.push_back(crypto::cn_fast_hash(&n, sizeof(n)));
+        m_blobs.push_back(std::string(tx_size, (char)n));
+        m_origins.push_back(m_rng() % node_count);
+      }
+    }
+
+    uint64_t flood()
+    {
+      uint64_t bytes = 0;
+      for (size_t n = 0; n < m_tx_count; ++n)
+      {
+        std::vector<bool> known(m_peers.size(), false);
+        std::vector<std::pair<size_t, size_t>> queue{{m_origins[n], m_peers.size()}};
+        known[m_origins[n]] = true;
+        for (size_t q = 0; q < queue.size(); ++q)
+        {
+          for (size_t peer: m_peers[queue[q].first])
+          {
+            if (peer == queue[q].second)
+              continue;
+            bytes += txes_message_size({n});
+            if (!known[peer])
+            {
+              known[peer] = true;
+              queue.push_back({peer, queue[q].first});
+            }
+          }
+        }
+      }
+      return bytes;
+    }
+
+    uint64_t reconcile(size_t txes_per_round, size_t &rounds, size_t &failures)
+    {
+      std::vector<std::vector<bool>> known(m_peers.size(), std::vector<bool>(m_tx_count, false));
+      std::map<std::pair<size_t, size_t>, std::set<size_t>> pending;
+      uint64_t bytes = 0;
+      size_t next_tx = 0;
+      rounds = failures = 0;
+
+      auto learn = [&](size_t node, size_t tx, size_t from) {
+        if (known[node][tx])
+          return;
+        known[node][tx] = true;
+        for (size_t peer: m_peers[node])
+          if (peer != from)
+            pending[{node, peer}].insert(tx);
+      };
+
+      while (next_tx < m_tx_count || std::any_of(pending.begin(), pending.end(), [](const std::pair<const std::pair<size_t, size_t>, std::set<size_t>> &e) { return !e.second.empty(); }))
+      {
+        ++rounds;
+        for (size_t n = 0; n < txes_per_round && next_tx < m_tx_count; ++n, ++next_tx)
+          learn(m_origins[next_tx], next_tx, m_peers.size());
+
+        for (const auto &edge: m_edges)
+        {
+          const size_t a = edge.first, b = edge.second;
+          const std::set<size_t> a_set = std::move(pending[{a, b}]), b_set = std::move(pending[{b, a}]);
+          pending[{a, b}].clear();
+          pending[{b, a}].clear();
+
+          // the ids, sketches and difference come from the same functions the protocol handler uses
+          const uint64_t salt = m_rng();
+          std::map<uint32_t, size_t> a_ids, b_ids;
+          for (size_t tx: a_set)
+            a_ids[cryptonote::get_tx_reconciliation_short_id(salt, m_txids[tx])] = tx;
+          for (size_t tx: b_set)
+            b_ids[cryptonote::get_tx_reconciliation_short_id(salt, m_txids[tx])] = tx;
+
+          cryptonote::NOTIFY_REQUEST_TX_RECONCILIATION::request req = AUTO_VAL_INIT(req);
+          req.salt = salt;
+          req.set_size = a_ids.size();
+          bytes += message_size(req);
+
+          std::vector<uint32_t> b_id_list;
+          for (const auto &e: b_ids)
+            b_id_list.push_back(e.first);
+          cryptonote::NOTIFY_TX_RECONCILIATION_SKETCH::request sketch_arg = AUTO_VAL_INIT(sketch_arg);
+          sketch_arg.sketch = cryptonote::make_tx_reconciliation_sketch(b_id_list, req.set_size);
+          bytes += message_size(sketch_arg);
+
+          std::vector<uint32_t> b_missing, a_missing;
+          cryptonote::tx_sketch b_sketch;
+          bool success = !sketch_arg.sketch.empty() && b_sketch.deserialize(sketch_arg.sketch);
+          if (success)
+          {
+            std::unordered_set<uint32_t> a_id_set;
+            for (const auto &e: a_ids)
+              a_id_set.insert(e.first);
+            success = cryptonote::decode_tx_reconciliation_sketch(b_sketch, a_id_set, b_missing, a_missing);
+          }
+
+          std::vector<size_t> to_b, to_a;
+          cryptonote::NOTIFY_TX_RECONCILIATION_DIFF::request diff_arg = AUTO_VAL_INIT(diff_arg);
+          diff_arg.success = success;
+          if (success)
+          {
+            for (uint32_t id: b_missing)
+              to_b.push_back(a_ids[id]);
+            for (uint32_t id: a_missing)
+            {
+              const auto i = b_ids.find(id);
+              if (i != b_ids.end())
+                to_a.push_back(i->second);
+              diff_arg.missing_ids.append((const char*)&id, sizeof(id));
+            }
+          }
+          else
+          {
+            ++failures;
+            to_b.assign(a_set.begin(), a_set.end());
+            to_a.assign(b_set.begin(), b_set.end());
+          }
+          if (!sketch_arg.sketch.empty())
+            bytes += message_size(diff_arg);
+
+          if (!to_b.empty())
+            bytes += txes_message_size(to_b);
+          if (!to_a.empty())
+            bytes += txes_message_size(to_a);
+          for (size_t tx: to_b)
+            learn(b, tx, a);
+          for (size_t tx: to_a)
+            learn(a, tx, b);
+        }
+      }
+
+      for (const auto &k: known)
+        if (std::count(k.begin(), k.end(), true) != (ptrdiff_t)m_tx_count)
+          return 0;
+      return bytes;
+    }
+
+  private:
+    template<typename t_request>
+    static uint64_t message_size(const t_request &arg)
+    {
+      std::string blob;
+      epee::serialization::store_t_to_binary(const_cast<t_request&>(arg), blob);
+      return sizeof(epee::levin::bucket_head2) + blob.size();
+    }
+
+    uint64_t txes_message_size(const std::vector<size_t> &txes) const
+    {
+      cryptonote::NOTIFY_NEW_TRANSACTIONS::request arg = AUTO_VAL_INIT(arg);
+      for (size_t tx: txes)
+        arg.txs.push_back(m_blobs[tx]);
+      return message_size(arg);
+    }
+
+    std::mt19937_64 m_rng;
+    std::vector<std::set<size_t>> m_peers;
+    std::vector<std::pair<size_t, size_t>> m_edges; // outgoing side first
+    size_t m_tx_count;
+    std::vector<crypto::hash> m_txids;
+    std::vector<std::string> m_blobs;
+    std::vector<size_t> m_origins;
+  };
+}
+
+TEST(net_load_test_tx_relay, reconciliation_uses_less_bandwidth_than_flooding)
+{
+  const size_t tx_count = 300;
+  tx_relay_simulation simulation(60, 8, tx_count, 1500);
+
+  const uint64_t flood_bytes = simulation.flood();
+  size_t rounds, failures;
+  const uint64_t reconcile_bytes = simulation.reconcile(4, rounds, failures);
+  ASSERT_NE(reconcile_bytes, 0); // every node got every tx
+
+  LOG_PRINT_L0("bytes/tx: flooding " << flood_bytes / tx_count << ", reconciliation " << reconcile_bytes / tx_count <<
+    " (" << rounds << " rounds, " << failures << " failed reconciliations)");
+  ASSERT_LT(reconcile_bytes, flood_bytes);
+}
+
 int main(int argc, char** argv)
 {
   tools::on_startup();
@@ -0,0 +1,74 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "ringct/rctOps.h"
+#include "ringct/bulletproofs.h"
+#include "ringct/multiexp.h"
+
+template<bool a_verify, size_t n_amounts, bool a_threaded>
+class test_bulletproof
+{
+public:
+  static const size_t loop_count = 50 / n_amounts + 1;
+
+  test_bulletproof(): m_threading(rct::get_multiexp_threading()) {}
+
+  bool init()
+  {
+    rct::set_multiexp_threading(a_threaded);
+    for (size_t i = 0; i < n_amounts; ++i)
+    {
+      m_amounts.push_back(crypto::rand<uint64_t>());
+      m_gamma.push_back(rct::skGen());
+    }
+    if (a_verify)
+      m_proof = rct::bulletproof_PROVE(m_amounts, m_gamma);
+    return true;
+  }
+
+  ~test_bulletproof()
+  {
+    rct::set_multiexp_threading(m_threading);
+  }
+
+  bool test()
+  {
+    if (a_verify)
+      return rct::bulletproof_VERIFY(m_proof);
+    rct::bulletproof_PROVE(m_amounts, m_gamma);
+    return true;
+  }
+
+private:
+  std::vector<uint64_t> m_amounts;
+  rct::keyV m_gamma;
+  rct::Bulletproof m_proof;
+  bool m_threading;
+};
@@ -0,0 +1,74 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "crypto/crypto.h"
+
+template<size_t a_count, bool a_batched>
+class test_generate_key_derivations
+{
+public:
+  static const size_t loop_count = 100000 / a_count;
+  static const size_t ops_per_call = a_count;
+
+  bool init()
+  {
+    crypto::public_key pub;
+    crypto::generate_keys(pub, m_view_secret_key);
+
+    m_tx_pub_keys.resize(a_count);
+    for (auto &tx_pub_key: m_tx_pub_keys)
+    {
+      crypto::secret_key sec;
+      crypto::generate_keys(tx_pub_key, sec);
+    }
+    m_derivations.resize(a_count);
+    m_valid.reset(new bool[a_count]);
+    return true;
+  }
+
+  bool test()
+  {
+    if (a_batched)
+      return crypto::generate_key_derivations(m_tx_pub_keys.data(), a_count, m_view_secret_key, m_derivations.data(), m_valid.get());
+    for (size_t i = 0; i < a_count; ++i)
+      if (!crypto::generate_key_derivation(m_tx_pub_keys[i], m_view_secret_key, m_derivations[i]))
+        return false;
+    return true;
+  }
+
+private:
+  crypto::secret_key m_view_secret_key;
+  std::vector<crypto::public_key> m_tx_pub_keys;
+  std::vector<crypto::key_derivation> m_derivations;
+  std::unique_ptr<bool[]> m_valid;
+};
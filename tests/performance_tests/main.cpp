@@ -39,18 +39,25 @@
 #include "construct_tx.h"
 #include "check_tx_signature.h"
 #include "cn_slow_hash.h"
+#include "rx_slow_hash.h"
 #include "derive_public_key.h"
 #include "derive_secret_key.h"
 #include "ge_frombytes_vartime.h"
 #include "generate_key_derivation.h"
+#include "generate_key_derivations.h"
 #include "generate_key_image.h"
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
 #include "is_out_to_acc.h"
 #include "subaddress_expand.h"
+#include "txpool_index.h"
+#include "portable_storage_load.h"
+#include "portable_storage_store.h"
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
 #include "rct_mlsag.h"
+#include "rct_commit.h"
+#include "bulletproof.h"
 
 namespace po = boost::program_options;
 
@@ -148,16 +155,48 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE0(filter, test_is_out_to_acc_precomp);
   TEST_PERFORMANCE0(filter, test_generate_key_image_helper);
   TEST_PERFORMANCE0(filter, test_generate_key_derivation);
+  TEST_PERFORMANCE2(filter, test_generate_key_derivations, 64, false);
+  TEST_PERFORMANCE2(filter, test_generate_key_derivations, 64, true);
+  TEST_PERFORMANCE2(filter, test_generate_key_derivations, 1024, false);
+  TEST_PERFORMANCE2(filter, test_generate_key_derivations, 1024, true);
   TEST_PERFORMANCE0(filter, test_generate_key_image);
   TEST_PERFORMANCE0(filter, test_derive_public_key);
   TEST_PERFORMANCE0(filter, test_derive_secret_key);
   TEST_PERFORMANCE0(filter, test_ge_frombytes_vartime);
+
+  TEST_PERFORMANCE1(filter, test_txpool_index_insert, 0);
+  TEST_PERFORMANCE1(filter, test_txpool_index_insert, 4);
+  TEST_PERFORMANCE1(filter, test_txpool_index_template, 0);
+  TEST_PERFORMANCE1(filter, test_txpool_index_template, 4);
+  TEST_PERFORMANCE1(filter, test_portable_storage_load, false);
+  TEST_PERFORMANCE1(filter, test_portable_storage_load, true);
+  TEST_PERFORMANCE1(filter, test_portable_storage_store, false);
+  TEST_PERFORMANCE1(filter, test_portable_storage_store, true);
   TEST_PERFORMANCE0(filter, test_generate_keypair);
   TEST_PERFORMANCE0(filter, test_sc_reduce32);
+  TEST_PERFORMANCE1(filter, test_rct_commit, false);
+  TEST_PERFORMANCE1(filter, test_rct_commit, true);
+
+  TEST_PERFORMANCE3(filter, test_bulletproof, false, 1, false);
+  TEST_PERFORMANCE3(filter, test_bulletproof, false, 1, true);
+  TEST_PERFORMANCE3(filter, test_bulletproof, false, 2, false);
+  TEST_PERFORMANCE3(filter, test_bulletproof, false, 2, true);
+  TEST_PERFORMANCE3(filter, test_bulletproof, false, 16, false);
+  TEST_PERFORMANCE3(filter, test_bulletproof, false, 16, true);
+  TEST_PERFORMANCE3(filter, test_bulletproof, true, 1, false);
+  TEST_PERFORMANCE3(filter, test_bulletproof, true, 1, true);
+  TEST_PERFORMANCE3(filter, test_bulletproof, true, 2, false);
+  TEST_PERFORMANCE3(filter, test_bulletproof, true, 2, true);
+  TEST_PERFORMANCE3(filter, test_bulletproof, true, 16, false);
+  TEST_PERFORMANCE3(filter, test_bulletproof, true, 16, true);
 
   TEST_PERFORMANCE2(filter, test_wallet2_expand_subaddresses, 50, 200);
 
   TEST_PERFORMANCE0(filter, test_cn_slow_hash);
+  TEST_PERFORMANCE1(filter, test_rx_slow_hash, 1);
+  TEST_PERFORMANCE1(filter, test_rx_slow_hash, 2);
+  TEST_PERFORMANCE1(filter, test_rx_slow_hash, 4);
+  TEST_PERFORMANCE1(filter, test_rx_slow_hash, 8);
   TEST_PERFORMANCE1(filter, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, test_cn_fast_hash, 16384);
 
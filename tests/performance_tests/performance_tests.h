@@ -122,6 +122,12 @@ private:
   int m_elapsed;
 };
 
+// tests doing several operations per call can say how many in ops_per_call
+template <typename T>
+auto ops_per_call(int) -> decltype(T::ops_per_call, size_t()) { return T::ops_per_call; }
+template <typename T>
+size_t ops_per_call(...) { return 0; }
+
 template <typename T>
 void run_test(const std::string &filter, const char* test_name)
 {
@@ -145,7 +151,11 @@ void run_test(const std::string &filter, const char* test_name)
      unit = "µs";
 #endif
     }
-    std::cout << "  time per call: " << time_per_call << " " << unit << "/call\n" << std::endl;
+    std::cout << "  time per call: " << time_per_call << " " << unit << "/call\n";
+    const size_t ops = ops_per_call<T>(0);
+    if (ops > 0 && runner.elapsed_time() > 0)
+      std::cout << "  rate:          " << ops * T::loop_count * 1000 / runner.elapsed_time() << " ops/s\n";
+    std::cout << std::endl;
   }
   else
   {
@@ -0,0 +1,84 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// deserializes a 100 block NOTIFY_RESPONSE_GET_OBJECTS, as a syncing node gets it,
+// with either the map based portable_storage or the arena backed flat one
+template<bool a_flat>
+class test_portable_storage_load
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t blocks = 100;
+  static const size_t txes_per_block = 10;
+
+  bool init()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+    for (size_t n = 0; n < blocks; ++n)
+    {
+      cryptonote::block_complete_entry e;
+      e.pruned = false;
+      e.block = std::string(300, 'b');
+      e.block_weight = 0;
+      for (size_t t = 0; t < txes_per_block; ++t)
+        e.txs.push_back({std::string(1500 + 100 * t, 't'), crypto::null_hash});
+      r.blocks.push_back(std::move(e));
+    }
+    r.current_blockchain_height = 2000000;
+    return epee::serialization::store_t_to_binary(r, m_buffer);
+  }
+
+  bool test()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+    if (a_flat)
+    {
+      epee::serialization::flat_portable_storage ps;
+      if (!ps.load_from_binary(m_buffer) || !r.load(ps))
+        return false;
+    }
+    else
+    {
+      epee::serialization::portable_storage ps;
+      if (!ps.load_from_binary(m_buffer) || !r.load(ps))
+        return false;
+    }
+    return r.blocks.size() == blocks && r.blocks.back().txs.size() == txes_per_block;
+  }
+
+private:
+  std::string m_buffer;
+};
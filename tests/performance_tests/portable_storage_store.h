@@ -0,0 +1,85 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// serializes a 100 block NOTIFY_RESPONSE_GET_OBJECTS, as a node serving a sync does,
+// through a portable_storage tree or straight to bytes
+template<bool a_streaming>
+class test_portable_storage_store
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t blocks = 100;
+  static const size_t txes_per_block = 10;
+
+  bool init()
+  {
+    for (size_t n = 0; n < blocks; ++n)
+    {
+      cryptonote::block_complete_entry e;
+      e.pruned = false;
+      e.block = std::string(300, 'b');
+      e.block_weight = 0;
+      for (size_t t = 0; t < txes_per_block; ++t)
+        e.txs.push_back({std::string(1500 + 100 * t, 't'), crypto::null_hash});
+      m_request.blocks.push_back(std::move(e));
+    }
+    m_request.current_blockchain_height = 2000000;
+    return true;
+  }
+
+  bool test()
+  {
+    std::string buffer;
+    if (a_streaming)
+    {
+      epee::serialization::portable_storage_writer writer;
+      m_request.store(writer);
+      if (!writer.store_to_binary(buffer))
+        return false;
+    }
+    else
+    {
+      epee::serialization::portable_storage ps;
+      m_request.store(ps);
+      if (!ps.store_to_binary(buffer))
+        return false;
+    }
+    return buffer.size() > blocks * txes_per_block * 1500;
+  }
+
+private:
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request m_request;
+};
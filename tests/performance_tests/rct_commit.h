@@ -0,0 +1,66 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "ringct/rctOps.h"
+
+template<bool a_fixed_base>
+class test_rct_commit
+{
+public:
+  static const size_t loop_count = 10000;
+
+  bool init()
+  {
+    m_mask = rct::skGen();
+    m_amount = rct::d2h(crypto::rand<uint64_t>());
+    return ge_frombytes_vartime(&m_H, rct::H.bytes) == 0;
+  }
+
+  bool test()
+  {
+    rct::key C;
+    if (a_fixed_base)
+    {
+      rct::addKeys2H(C, m_mask, m_amount);
+    }
+    else
+    {
+      ge_p2 p2;
+      ge_double_scalarmult_base_vartime(&p2, m_amount.bytes, &m_H, m_mask.bytes);
+      ge_tobytes(C.bytes, &p2);
+    }
+    return true;
+  }
+
+private:
+  rct::key m_mask;
+  rct::key m_amount;
+  ge_p3 m_H;
+};
@@ -0,0 +1,79 @@
+// Copyright (c) 2019-2020, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+
+#pragma once
+
+#include <memory>
+#include "common/threadpool.h"
+#include "crypto/hash.h"
+
+// Each call hashes hashes_per_thread blobs on every thread, using light
+// mode VMs on a mainchain seed, so hashes/s is threads * hashes_per_thread
+// divided by the time per call.
+template<unsigned int threads>
+class test_rx_slow_hash
+{
+public:
+  static const size_t loop_count = 10;
+  static const size_t hashes_per_thread = 4;
+
+  bool init()
+  {
+    memset(m_seed.data, 0, sizeof(m_seed.data));
+    m_tpool.reset(tools::threadpool::getNewForUnitTests(threads));
+    // sets up the seed cache, which is shared by all threads
+    crypto::hash h;
+    crypto::rx_slow_hash(0, 0, m_seed.data, &m_seed, sizeof(m_seed), h.data, 0, 0);
+    return true;
+  }
+
+  bool test()
+  {
+    tools::threadpool::waiter waiter;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+      m_tpool->submit(&waiter, [this, t]() {
+        crypto::hash h;
+        for (size_t i = 0; i < hashes_per_thread; ++i)
+        {
+          const uint64_t blob = t * hashes_per_thread + i;
+          crypto::rx_slow_hash(0, 0, m_seed.data, &blob, sizeof(blob), h.data, 0, 0);
+        }
+      });
+    }
+    waiter.wait(m_tpool.get());
+    return true;
+  }
+
+private:
+  crypto::hash m_seed;
+  std::unique_ptr<tools::threadpool> m_tpool;
+};
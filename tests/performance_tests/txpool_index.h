@@ -0,0 +1,155 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/txpool_index.h"
+
+// a pool with a few thousand txes, with a_readers threads taking snapshots
+// and walking them the way RPC pool queries do while the test runs
+template<size_t a_readers>
+class txpool_index_test_base
+{
+public:
+  static const size_t pool_size = 5000;
+  static const size_t batch_size = 100;
+
+  ~txpool_index_test_base()
+  {
+    m_stop = true;
+    for (auto &t: m_readers)
+      t.join();
+  }
+
+  bool init()
+  {
+    m_blob.assign(2000, 'x');
+    for (size_t i = 0; i < pool_size; ++i)
+      add(crypto::rand<crypto::hash>());
+    m_index.publish();
+
+    m_stop = false;
+    m_reader_weight = 0;
+    for (size_t i = 0; i < a_readers; ++i)
+    {
+      m_readers.emplace_back([this]() {
+        while (!m_stop)
+        {
+          uint64_t weight = 0;
+          m_index.get_snapshot()->for_each([&weight](const crypto::hash&, const cryptonote::txpool_index::entry &e) { weight += e.meta.weight; return true; });
+          m_reader_weight += weight;
+        }
+      });
+    }
+    return true;
+  }
+
+protected:
+  void add(const crypto::hash &txid)
+  {
+    cryptonote::txpool_tx_meta_t meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.weight = 1000 + crypto::rand<uint16_t>() % 10000;
+    meta.fee = meta.weight * (1 + crypto::rand<uint16_t>() % 100);
+    m_index.add_tx(txid, meta, m_blob);
+    for (int n = 0; n < 2; ++n)
+      m_index.add_key_image(crypto::rand<crypto::key_image>(), txid);
+  }
+
+  cryptonote::txpool_index m_index;
+  cryptonote::blobdata m_blob;
+  std::vector<std::thread> m_readers;
+  std::atomic<bool> m_stop;
+  std::atomic<uint64_t> m_reader_weight;
+};
+
+// adds and publishes a batch of txes, then removes them again
+template<size_t a_readers>
+class test_txpool_index_insert: public txpool_index_test_base<a_readers>
+{
+public:
+  typedef txpool_index_test_base<a_readers> base_class;
+  static const size_t loop_count = 200;
+  static const size_t ops_per_call = base_class::batch_size;
+
+  bool test()
+  {
+    std::vector<crypto::hash> txids(base_class::batch_size);
+    for (auto &txid: txids)
+    {
+      txid = crypto::rand<crypto::hash>();
+      this->add(txid);
+      this->m_index.publish();
+    }
+    for (const auto &txid: txids)
+      if (!this->m_index.remove_tx(txid))
+        return false;
+    this->m_index.publish();
+    return true;
+  }
+};
+
+// picks txes by fee per byte from a snapshot, as fill_block_template does
+template<size_t a_readers>
+class test_txpool_index_template: public txpool_index_test_base<a_readers>
+{
+public:
+  typedef txpool_index_test_base<a_readers> base_class;
+  static const size_t loop_count = 200;
+
+  bool test()
+  {
+    const auto snap = this->m_index.get_snapshot();
+    std::vector<std::pair<double, crypto::hash>> sorted;
+    sorted.reserve(snap->count());
+    snap->for_each([&sorted](const crypto::hash &txid, const cryptonote::txpool_index::entry &e) {
+      sorted.emplace_back(e.meta.fee / (double)e.meta.weight, txid);
+      return true;
+    });
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<double, crypto::hash> &a, const std::pair<double, crypto::hash> &b) { return a.first > b.first; });
+
+    const uint64_t max_weight = 600000;
+    uint64_t weight = 0;
+    for (const auto &e: sorted)
+    {
+      const auto tx = snap->find(e.second);
+      if (!tx)
+        return false;
+      if (weight + tx->meta.weight <= max_weight)
+        weight += tx->meta.weight;
+    }
+    return weight > 0;
+  }
+};
@@ -0,0 +1,195 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/hardfork.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  // more than two pages of the block info columns
+  static const uint64_t NUM_BLOCKS = 2100;
+
+  class BlockInfoColumns : public testing::Test
+  {
+  protected:
+    BlockInfoColumns(): m_hardfork(m_db, 1, 0)
+    {
+      m_path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      m_db.open(m_path.string());
+      m_db.set_batch_transactions(true);
+      m_hardfork.init();
+      m_db.set_hard_fork(&m_hardfork);
+    }
+
+    ~BlockInfoColumns()
+    {
+      m_db.close();
+      boost::filesystem::remove_all(m_path);
+    }
+
+    // a different salt gives a different block, with different weights
+    void add_block(uint64_t salt = 0)
+    {
+      const uint64_t height = m_db.height();
+      block b;
+      b.major_version = 1;
+      b.minor_version = 0;
+      b.timestamp = 1000000 + height;
+      b.prev_id = height ? m_db.top_block_hash() : crypto::null_hash;
+      b.nonce = salt;
+      b.miner_tx.version = 1;
+      b.miner_tx.unlock_time = height + salt;
+      txin_gen in;
+      in.height = height;
+      b.miner_tx.vin.push_back(in);
+      db_wtxn_guard wtxn_guard(&m_db);
+      m_db.add_block(std::make_pair(b, block_to_blob(b)), height * 7 + salt + 1, height * 3 + salt + 2, height + 1, 0, {});
+    }
+
+    void pop_blocks(uint64_t n)
+    {
+      block b;
+      std::vector<transaction> txs;
+      while (n--)
+        m_db.pop_block(b, txs);
+    }
+
+    // the column reads, over several ranges, and twice so the second one can
+    // come from the cached pages, must match what the rows say
+    void check()
+    {
+      const uint64_t height = m_db.height();
+      std::vector<uint64_t> weights, long_term_weights;
+      for (uint64_t h = 0; h < height; ++h)
+      {
+        weights.push_back(m_db.get_block_weight(h));
+        long_term_weights.push_back(m_db.get_block_long_term_weight(h));
+      }
+      for (int pass = 0; pass < 2; ++pass)
+      {
+        ASSERT_EQ(m_db.get_block_weights(0, height), weights);
+        ASSERT_EQ(m_db.get_long_term_block_weights(0, height), long_term_weights);
+        for (uint64_t start: {(uint64_t)1, (uint64_t)1000, (uint64_t)1023, (uint64_t)1024, (uint64_t)2040, height - 1})
+        {
+          if (start >= height)
+            continue;
+          const uint64_t count = std::min<uint64_t>(600, height - start);
+          ASSERT_EQ(m_db.get_block_weights(start, count), std::vector<uint64_t>(weights.begin() + start, weights.begin() + start + count));
+          ASSERT_EQ(m_db.get_long_term_block_weights(start, count), std::vector<uint64_t>(long_term_weights.begin() + start, long_term_weights.begin() + start + count));
+        }
+      }
+    }
+
+    boost::filesystem::path m_path;
+    BlockchainLMDB m_db;
+    HardFork m_hardfork;
+  };
+}
+
+TEST_F(BlockInfoColumns, add_block)
+{
+  m_db.batch_start();
+  for (uint64_t h = 0; h < NUM_BLOCKS; ++h)
+    add_block();
+  m_db.batch_stop();
+  check();
+
+  // one more block, then enough to fill the next page
+  add_block();
+  check();
+  while (m_db.height() < 3072)
+    add_block();
+  check();
+}
+
+TEST_F(BlockInfoColumns, remove_block)
+{
+  m_db.batch_start();
+  for (uint64_t h = 0; h < NUM_BLOCKS; ++h)
+    add_block();
+  m_db.batch_stop();
+  check();
+
+  // back into the second page, which was cached
+  pop_blocks(NUM_BLOCKS - 2000);
+  check();
+  pop_blocks(1000);
+  check();
+}
+
+TEST_F(BlockInfoColumns, pop_and_readd)
+{
+  m_db.batch_start();
+  for (uint64_t h = 0; h < NUM_BLOCKS; ++h)
+    add_block();
+  m_db.batch_stop();
+  check();
+
+  // a reorg replacing blocks in both cached pages with others of different weights
+  pop_blocks(NUM_BLOCKS - 1000);
+  for (uint64_t h = 1000; h < NUM_BLOCKS; ++h)
+    add_block(5);
+  check();
+
+  m_db.batch_start();
+  pop_blocks(NUM_BLOCKS - 1500);
+  for (uint64_t h = 1500; h < NUM_BLOCKS; ++h)
+    add_block(9);
+  check();
+  m_db.batch_stop();
+  check();
+}
+
+TEST_F(BlockInfoColumns, batch_abort)
+{
+  m_db.batch_start();
+  for (uint64_t h = 0; h < NUM_BLOCKS; ++h)
+    add_block();
+  m_db.batch_stop();
+  check();
+  const std::vector<uint64_t> weights = m_db.get_block_weights(0, NUM_BLOCKS);
+  const std::vector<uint64_t> long_term_weights = m_db.get_long_term_block_weights(0, NUM_BLOCKS);
+
+  // replace blocks in the cached pages, read them within the batch, then drop it all
+  m_db.batch_start();
+  pop_blocks(NUM_BLOCKS - 1000);
+  for (uint64_t h = 1000; h < NUM_BLOCKS + 50; ++h)
+    add_block(3);
+  check();
+  m_db.batch_abort();
+
+  ASSERT_EQ(m_db.height(), NUM_BLOCKS);
+  check();
+  ASSERT_EQ(m_db.get_block_weights(0, NUM_BLOCKS), weights);
+  ASSERT_EQ(m_db.get_long_term_block_weights(0, NUM_BLOCKS), long_term_weights);
+}
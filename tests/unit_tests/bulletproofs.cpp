@@ -32,6 +32,7 @@
 
 #include "ringct/rctOps.h"
 #include "ringct/bulletproofs.h"
+#include "ringct/multiexp.h"
 
 TEST(bulletproofs, valid_zero)
 {
@@ -69,3 +70,24 @@ TEST(bulletproofs, invalid_31)
   rct::Bulletproof proof = bulletproof_PROVE(invalid_amount, rct::skGen());
   ASSERT_FALSE(rct::bulletproof_VERIFY(proof));
 }
+
+TEST(bulletproofs, valid_aggregated_threaded_and_serial)
+{
+  const bool threading = rct::get_multiexp_threading();
+  for (bool enabled: {false, true})
+  {
+    rct::set_multiexp_threading(enabled);
+    std::vector<uint64_t> amounts;
+    rct::keyV gamma;
+    for (size_t i = 0; i < 16; ++i)
+    {
+      amounts.push_back(crypto::rand<uint64_t>());
+      gamma.push_back(rct::skGen());
+    }
+    rct::Bulletproof proof = bulletproof_PROVE(amounts, gamma);
+    ASSERT_TRUE(rct::bulletproof_VERIFY(proof));
+    for (size_t i = 0; i < amounts.size(); ++i)
+      ASSERT_EQ(rct::scalarmult8(proof.V[i]), rct::commit(amounts[i], gamma[i]));
+  }
+  rct::set_multiexp_threading(threading);
+}
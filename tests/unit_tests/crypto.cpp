@@ -81,3 +81,40 @@ TEST(Crypto, null_keys)
   ASSERT_EQ(memcmp(crypto::null_skey.data, zero, 32), 0);
   ASSERT_EQ(memcmp(crypto::null_pkey.data, zero, 32), 0);
 }
+
+TEST(Crypto, generate_key_derivations)
+{
+  crypto::public_key pub;
+  crypto::secret_key sec;
+  crypto::generate_keys(pub, sec);
+
+  // more than one internal chunk, with a key that does not decompress
+  std::vector<crypto::public_key> keys(150);
+  for (auto &key: keys)
+  {
+    crypto::secret_key tmp;
+    crypto::generate_keys(key, tmp);
+  }
+  do
+  {
+    crypto::rand(sizeof(keys[70].data), (uint8_t*)keys[70].data);
+  } while (crypto::check_key(keys[70]));
+
+  std::vector<crypto::key_derivation> derivations(keys.size());
+  std::unique_ptr<bool[]> valid(new bool[keys.size()]);
+  ASSERT_FALSE(crypto::generate_key_derivations(keys.data(), keys.size(), sec, derivations.data(), valid.get()));
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    crypto::key_derivation derivation;
+    const bool r = crypto::generate_key_derivation(keys[i], sec, derivation);
+    ASSERT_EQ(r, valid[i]);
+    if (r)
+    {
+      ASSERT_EQ(memcmp(&derivation, &derivations[i], sizeof(derivation)), 0);
+    }
+  }
+  ASSERT_FALSE(valid[70]);
+
+  ASSERT_TRUE(crypto::generate_key_derivations(keys.data(), 70, sec, derivations.data(), valid.get()));
+  ASSERT_TRUE(crypto::generate_key_derivations(keys.data(), 0, sec, derivations.data(), valid.get()));
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/difficulty_window.h"
+
+static std::vector<uint64_t> timestamps_of(const cryptonote::difficulty_window &w)
+{
+  std::vector<uint64_t> timestamps;
+  std::vector<cryptonote::difficulty_type> difficulties;
+  w.copy(0, w.size(), timestamps, difficulties);
+  for (size_t i = 0; i < timestamps.size(); ++i)
+    EXPECT_EQ(difficulties[i], timestamps[i] * 10);
+  return timestamps;
+}
+
+TEST(difficulty_window, push_drops_oldest)
+{
+  cryptonote::difficulty_window w(3);
+  for (uint64_t i = 1; i <= 5; ++i)
+    w.push_back(i, i * 10);
+  ASSERT_EQ(w.size(), 3);
+  ASSERT_EQ(timestamps_of(w), std::vector<uint64_t>({3, 4, 5}));
+  ASSERT_EQ(w.timestamp(0), 3);
+  ASSERT_EQ(w.cumulative_difficulty(2), 50);
+}
+
+TEST(difficulty_window, pop_and_refill_front)
+{
+  cryptonote::difficulty_window w(4);
+  for (uint64_t i = 1; i <= 6; ++i)
+    w.push_back(i, i * 10);
+  w.pop_back();
+  w.pop_back();
+  ASSERT_EQ(timestamps_of(w), std::vector<uint64_t>({3, 4}));
+  w.push_front(2, 20);
+  w.push_front(1, 10);
+  w.push_front(0, 0); // full, ignored
+  ASSERT_EQ(timestamps_of(w), std::vector<uint64_t>({1, 2, 3, 4}));
+  w.push_back(5, 50);
+  ASSERT_EQ(timestamps_of(w), std::vector<uint64_t>({2, 3, 4, 5}));
+}
+
+TEST(difficulty_window, copy_range)
+{
+  cryptonote::difficulty_window w(8);
+  for (uint64_t i = 1; i <= 10; ++i)
+    w.push_back(i, i * 10);
+  std::vector<uint64_t> timestamps(1, 100);
+  std::vector<cryptonote::difficulty_type> difficulties(1, 1000);
+  w.copy(2, 3, timestamps, difficulties);
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({100, 5, 6, 7}));
+  ASSERT_EQ(difficulties.back(), 70);
+  ASSERT_THROW(w.copy(6, 3, timestamps, difficulties), std::runtime_error);
+}
+
+TEST(difficulty_window, pop_empty)
+{
+  cryptonote::difficulty_window w(2);
+  ASSERT_THROW(w.pop_back(), std::runtime_error);
+  w.clear();
+  ASSERT_EQ(w.size(), 0);
+}
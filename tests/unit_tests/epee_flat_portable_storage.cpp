@@ -0,0 +1,233 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_flat.h"
+
+namespace
+{
+  struct wide_values
+  {
+    uint64_t small;
+    uint64_t big;
+    std::string name;
+    std::vector<uint32_t> numbers;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(small)
+      KV_SERIALIZE(big)
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(numbers)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct narrow_values
+  {
+    uint8_t small;
+    uint64_t big;
+    std::string name;
+    std::vector<uint64_t> numbers;
+    uint32_t missing;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(small)
+      KV_SERIALIZE(big)
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(numbers)
+      KV_SERIALIZE_OPT(missing, (uint32_t)7)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct tiny_values
+  {
+    uint8_t big;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(big)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct abc_values
+  {
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(a)
+      KV_SERIALIZE(b)
+      KV_SERIALIZE(c)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request make_objects()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+    for (size_t n = 0; n < 3; ++n)
+    {
+      cryptonote::block_complete_entry e;
+      e.pruned = n == 1;
+      e.block = std::string(100 + n, 'a' + n);
+      e.block_weight = e.pruned ? 1000 + n : 0;
+      for (size_t t = 0; t < n + 1; ++t)
+        e.txs.push_back({std::string(50 + t, 'x' + t), e.pruned ? crypto::rand<crypto::hash>() : crypto::null_hash});
+      r.blocks.push_back(e);
+    }
+    r.missed_ids.push_back(crypto::rand<crypto::hash>());
+    r.missed_ids.push_back(crypto::rand<crypto::hash>());
+    r.current_blockchain_height = 123456;
+    return r;
+  }
+}
+
+TEST(flat_portable_storage, get_objects_round_trip)
+{
+  const cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_objects();
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+  // misaligned on purpose, blobs are read in place
+  const std::string shifted = "." + buff;
+  epee::serialization::flat_portable_storage ps;
+  ASSERT_TRUE(ps.load_from_binary({(const uint8_t*)shifted.data() + 1, buff.size()}));
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+  ASSERT_TRUE(r2.load(ps));
+
+  ASSERT_EQ(r.blocks.size(), r2.blocks.size());
+  for (size_t n = 0; n < r.blocks.size(); ++n)
+  {
+    EXPECT_EQ(r.blocks[n].pruned, r2.blocks[n].pruned);
+    EXPECT_EQ(r.blocks[n].block, r2.blocks[n].block);
+    EXPECT_EQ(r.blocks[n].block_weight, r2.blocks[n].block_weight);
+    ASSERT_EQ(r.blocks[n].txs.size(), r2.blocks[n].txs.size());
+    for (size_t t = 0; t < r.blocks[n].txs.size(); ++t)
+    {
+      EXPECT_EQ(r.blocks[n].txs[t].blob, r2.blocks[n].txs[t].blob);
+      EXPECT_EQ(r.blocks[n].txs[t].prunable_hash, r2.blocks[n].txs[t].prunable_hash);
+    }
+  }
+  EXPECT_EQ(r.missed_ids, r2.missed_ids);
+  EXPECT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+}
+
+TEST(flat_portable_storage, matches_portable_storage_conversions)
+{
+  wide_values w;
+  w.small = 200;
+  w.big = 1ull << 40;
+  w.name = "flat";
+  w.numbers = {1, 2, 3};
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(w, buff));
+
+  narrow_values n;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(n, buff));
+  EXPECT_EQ(200, n.small);
+  EXPECT_EQ(1ull << 40, n.big);
+  EXPECT_EQ("flat", n.name);
+  EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}), n.numbers);
+  EXPECT_EQ(7, n.missing);
+
+  // out of range, as with portable_storage
+  tiny_values t;
+  EXPECT_FALSE(epee::serialization::load_t_from_binary(t, buff));
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_binary(buff));
+  EXPECT_FALSE(t.load(ps));
+}
+
+TEST(flat_portable_storage, rejects_bad_input)
+{
+  const cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_objects();
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+  epee::serialization::flat_portable_storage ps;
+  for (size_t size = 0; size < buff.size(); size += 7)
+    EXPECT_FALSE(ps.load_from_binary({(const uint8_t*)buff.data(), size}));
+
+  std::string bad_signature = buff;
+  bad_signature[0] ^= 1;
+  EXPECT_FALSE(ps.load_from_binary(bad_signature));
+
+  // root section claiming 2^20 fields
+  std::string huge = buff.substr(0, 9);
+  const uint32_t count = ((1u << 20) << 2) | PORTABLE_RAW_SIZE_MARK_DWORD;
+  huge.append((const char*)&count, sizeof(count));
+  EXPECT_FALSE(ps.load_from_binary(huge));
+
+  // and the storage is still usable afterwards
+  ASSERT_TRUE(ps.load_from_binary(buff));
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+  ASSERT_TRUE(r2.load(ps));
+  EXPECT_EQ(r.blocks.size(), r2.blocks.size());
+}
+
+TEST(flat_portable_storage, unsorted_fields)
+{
+  tiny_values t;
+  t.big = 0;
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(t, buff));
+
+  // names in reverse order, with "b" given twice
+  std::string unsorted = buff.substr(0, 9);
+  unsorted += (char)(4 << 2);
+  for (const auto &field: {std::make_pair('c', 3), std::make_pair('b', 2), std::make_pair('a', 1), std::make_pair('b', 9)})
+  {
+    unsorted += (char)1;
+    unsorted += field.first;
+    unsorted += (char)SERIALIZE_TYPE_UINT8;
+    unsorted += (char)field.second;
+  }
+
+  abc_values v;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(v, unsorted));
+  EXPECT_EQ(1, v.a);
+  EXPECT_EQ(2, v.b); // the first of duplicate names wins, as with portable_storage
+  EXPECT_EQ(3, v.c);
+
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_binary(unsorted));
+  abc_values tree;
+  ASSERT_TRUE(tree.load(ps));
+  EXPECT_EQ(v.b, tree.b);
+}
+
+TEST(flat_portable_storage, read_only)
+{
+  epee::serialization::flat_portable_storage ps;
+  EXPECT_FALSE(ps.set_value("small", (uint64_t)1, nullptr));
+  EXPECT_EQ(nullptr, ps.open_section("section", nullptr, true));
+}
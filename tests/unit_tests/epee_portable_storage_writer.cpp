@@ -0,0 +1,203 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+#include "storages/portable_storage_writer.h"
+
+namespace
+{
+  struct inner
+  {
+    std::string name;
+    uint32_t value;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(value)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  // declared in name order, so both writers emit the same bytes
+  struct sorted_fields
+  {
+    std::vector<inner> a_entries;
+    crypto::hash b_hash;
+    bool c_flag;
+    inner d_child;
+    double e_double;
+    std::vector<std::string> f_names;
+    std::vector<uint64_t> g_numbers;
+    int8_t h_small;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(a_entries)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(b_hash)
+      KV_SERIALIZE(c_flag)
+      KV_SERIALIZE(d_child)
+      KV_SERIALIZE(e_double)
+      KV_SERIALIZE(f_names)
+      KV_SERIALIZE(g_numbers)
+      KV_SERIALIZE(h_small)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct twice
+  {
+    uint64_t first;
+    uint64_t second;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE_N(first, "v")
+      KV_SERIALIZE_N(second, "v")
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct once
+  {
+    uint64_t v;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(v)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  template<class t_struct>
+  std::string store_with_tree(const t_struct &s)
+  {
+    epee::serialization::portable_storage ps;
+    s.store(ps);
+    std::string buff;
+    EXPECT_TRUE(ps.store_to_binary(buff));
+    return buff;
+  }
+
+  template<class t_struct>
+  std::string store_with_writer(const t_struct &s)
+  {
+    epee::serialization::portable_storage_writer writer;
+    s.store(writer);
+    std::string buff;
+    EXPECT_TRUE(writer.store_to_binary(buff));
+    return buff;
+  }
+}
+
+TEST(portable_storage_writer, same_bytes_as_portable_storage)
+{
+  sorted_fields s;
+  for (size_t n = 0; n < 100; ++n)
+    s.a_entries.push_back({std::string(n, 'x'), (uint32_t)n});
+  s.b_hash = crypto::rand<crypto::hash>();
+  s.c_flag = true;
+  s.d_child = {"child", 42};
+  s.e_double = 1.5;
+  for (size_t n = 0; n < 70; ++n)
+    s.f_names.push_back(std::string(n * 5, 'n'));
+  for (size_t n = 0; n < 20000; ++n)
+    s.g_numbers.push_back(n * n);
+  s.h_small = -3;
+
+  EXPECT_EQ(store_with_tree(s), store_with_writer(s));
+
+  sorted_fields empty{};
+  EXPECT_EQ(store_with_tree(empty), store_with_writer(empty));
+}
+
+TEST(portable_storage_writer, get_objects_round_trip)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+  for (size_t n = 0; n < 80; ++n)
+  {
+    cryptonote::block_complete_entry e;
+    e.pruned = n % 2;
+    e.block = std::string(100 + n, 'b');
+    e.block_weight = e.pruned ? 1000 + n : 0;
+    for (size_t t = 0; t < n % 5; ++t)
+      e.txs.push_back({std::string(50 + t, 't'), e.pruned ? crypto::rand<crypto::hash>() : crypto::null_hash});
+    r.blocks.push_back(e);
+  }
+  r.missed_ids.push_back(crypto::rand<crypto::hash>());
+  r.current_blockchain_height = 123456;
+
+  const std::string buff = store_with_writer(r);
+  EXPECT_EQ(store_with_tree(r).size(), buff.size());
+
+  for (int flat = 0; flat < 2; ++flat)
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+    if (flat)
+    {
+      ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff));
+    }
+    else
+    {
+      epee::serialization::portable_storage ps;
+      ASSERT_TRUE(ps.load_from_binary(buff));
+      ASSERT_TRUE(r2.load(ps));
+    }
+    ASSERT_EQ(r.blocks.size(), r2.blocks.size());
+    for (size_t n = 0; n < r.blocks.size(); ++n)
+    {
+      EXPECT_EQ(r.blocks[n].pruned, r2.blocks[n].pruned);
+      EXPECT_EQ(r.blocks[n].block, r2.blocks[n].block);
+      EXPECT_EQ(r.blocks[n].block_weight, r2.blocks[n].block_weight);
+      ASSERT_EQ(r.blocks[n].txs.size(), r2.blocks[n].txs.size());
+      for (size_t t = 0; t < r.blocks[n].txs.size(); ++t)
+      {
+        EXPECT_EQ(r.blocks[n].txs[t].blob, r2.blocks[n].txs[t].blob);
+        EXPECT_EQ(r.blocks[n].txs[t].prunable_hash, r2.blocks[n].txs[t].prunable_hash);
+      }
+    }
+    EXPECT_EQ(r.missed_ids, r2.missed_ids);
+    EXPECT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+  }
+}
+
+TEST(portable_storage_writer, duplicate_names_fall_back)
+{
+  twice t;
+  t.first = 1;
+  t.second = 2;
+
+  epee::serialization::portable_storage_writer writer;
+  EXPECT_THROW(t.store(writer), std::runtime_error);
+
+  // the last value wins, as it always did
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(t, buff));
+  EXPECT_EQ(store_with_tree(t), buff);
+  once o;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(o, buff));
+  EXPECT_EQ(2, o.v);
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/tx_pool.h"
+
+using cryptonote::tx_memory_pool;
+
+static cryptonote::transaction make_tx(const std::vector<crypto::key_image> &k_images)
+{
+  cryptonote::transaction tx;
+  tx.vin.push_back(cryptonote::txin_gen());
+  for (const auto &k_image: k_images)
+  {
+    cryptonote::txin_to_key in;
+    in.amount = 0;
+    in.key_offsets.push_back(1);
+    in.k_image = k_image;
+    tx.vin.push_back(in);
+  }
+  return tx;
+}
+
+TEST(key_image_conflicts, spent)
+{
+  const crypto::key_image ki0 = crypto::rand<crypto::key_image>(), ki1 = crypto::rand<crypto::key_image>(), ki2 = crypto::rand<crypto::key_image>();
+  const std::unordered_set<crypto::key_image> spent{ki1};
+  const cryptonote::transaction tx0 = make_tx({ki0}), tx1 = make_tx({ki2, ki1}), tx2 = make_tx({});
+  std::vector<bool> conflicts;
+  tx_memory_pool::find_key_image_conflicts({&tx0, NULL, &tx1, &tx2}, [&spent](const crypto::key_image &k_image) {
+    return spent.find(k_image) != spent.end();
+  }, conflicts);
+  ASSERT_EQ(conflicts, std::vector<bool>({false, false, true, false}));
+}
+
+TEST(key_image_conflicts, not_against_each_other)
+{
+  const crypto::key_image ki0 = crypto::rand<crypto::key_image>(), ki1 = crypto::rand<crypto::key_image>();
+  const cryptonote::transaction tx0 = make_tx({ki0}), tx1 = make_tx({ki1, ki0}), tx2 = make_tx({ki0});
+  std::vector<bool> conflicts(1, true);
+  tx_memory_pool::find_key_image_conflicts({&tx0, &tx1, &tx2}, [](const crypto::key_image&) { return false; }, conflicts);
+  ASSERT_EQ(conflicts, std::vector<bool>({false, false, false}));
+}
+
+TEST(key_image_conflicts, invalid_tx_does_not_shut_out_a_later_one)
+{
+  // the first tx fails its checks, the second one is valid and spends the same key image,
+  // the third one is valid too, but comes after the second one
+  const crypto::key_image ki = crypto::rand<crypto::key_image>();
+  const cryptonote::transaction tx0 = make_tx({ki}), tx1 = make_tx({ki}), tx2 = make_tx({ki});
+  const std::vector<const cryptonote::transaction*> txs{&tx0, &tx1, &tx2};
+  const std::vector<bool> valid{false, true, true};
+
+  std::unordered_set<crypto::key_image> pool;
+  const auto spent = [&pool](const crypto::key_image &k_image) { return pool.find(k_image) != pool.end(); };
+  std::vector<bool> conflicts;
+  tx_memory_pool::find_key_image_conflicts(txs, spent, conflicts);
+  ASSERT_EQ(conflicts, std::vector<bool>({false, false, false}));
+
+  // the txes go into the pool in the order they came in, as add_tx would take them
+  std::vector<bool> added;
+  for (size_t i = 0; i < txs.size(); ++i)
+  {
+    std::vector<bool> c;
+    tx_memory_pool::find_key_image_conflicts({txs[i]}, spent, c);
+    added.push_back(valid[i] && !c[0]);
+    if (added.back())
+      pool.insert(ki);
+  }
+  ASSERT_EQ(added, std::vector<bool>({false, true, false}));
+}
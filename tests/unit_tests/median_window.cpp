@@ -0,0 +1,98 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <deque>
+#include <limits>
+#include "misc_language.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/median_window.h"
+
+static uint64_t reference_median(const std::deque<uint64_t> &values)
+{
+  std::vector<uint64_t> v(values.begin(), values.end());
+  return epee::misc_utils::median(v);
+}
+
+TEST(median_window, empty)
+{
+  cryptonote::median_window w;
+  ASSERT_TRUE(w.empty());
+  ASSERT_EQ(w.median(), 0);
+  ASSERT_EQ(w.median_with({}, {7}), 7);
+  ASSERT_EQ(w.median(), 0);
+}
+
+TEST(median_window, even_uses_midpoint)
+{
+  cryptonote::median_window w;
+  w.push_back(3);
+  w.push_back(8);
+  ASSERT_EQ(w.median(), 5);
+  w.push_back(std::numeric_limits<uint64_t>::max());
+  w.push_front(std::numeric_limits<uint64_t>::max());
+  ASSERT_EQ(w.median(), epee::misc_utils::get_mid<uint64_t>(8, std::numeric_limits<uint64_t>::max()));
+}
+
+TEST(median_window, median_with_restores)
+{
+  cryptonote::median_window w;
+  for (uint64_t v: {5, 1, 9, 9, 2})
+    w.push_back(v);
+  ASSERT_EQ(w.median(), 5);
+  ASSERT_EQ(w.median_with({9, 9}, {}), 2);
+  ASSERT_EQ(w.median_with({5}, {100, 100}), 9);
+  ASSERT_EQ(w.median_with({100}, {100}), 5);
+  ASSERT_EQ(w.median(), 5);
+  ASSERT_EQ(w.size(), 5);
+}
+
+TEST(median_window, matches_reference)
+{
+  cryptonote::median_window w;
+  std::deque<uint64_t> ref;
+  for (int i = 0; i < 20000; ++i)
+  {
+    const uint64_t value = crypto::rand<uint64_t>() % 64;
+    switch (crypto::rand<uint8_t>() % 4)
+    {
+      case 0: w.push_back(value); ref.push_back(value); break;
+      case 1: w.push_front(value); ref.push_front(value); break;
+      case 2: if (!ref.empty()) { w.pop_back(); ref.pop_back(); } break;
+      case 3: if (!ref.empty()) { w.pop_front(); ref.pop_front(); } break;
+    }
+    ASSERT_EQ(w.size(), ref.size());
+    ASSERT_EQ(w.median(), reference_median(ref));
+    if (!ref.empty())
+    {
+      ASSERT_EQ(w.front(), ref.front());
+      ASSERT_EQ(w.back(), ref.back());
+    }
+  }
+}
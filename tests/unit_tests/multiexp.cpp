@@ -0,0 +1,141 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+#include "common/threadpool.h"
+#include "ringct/rctOps.h"
+#include "ringct/multiexp.h"
+
+namespace
+{
+  std::vector<rct::MultiexpData> make_data(size_t n)
+  {
+    std::vector<rct::MultiexpData> data;
+    data.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+      data.emplace_back(rct::skGen(), rct::scalarmultBase(rct::skGen()));
+    return data;
+  }
+
+  struct multiexp_threading_guard
+  {
+    const bool old;
+    multiexp_threading_guard(bool enabled): old(rct::get_multiexp_threading()) { rct::set_multiexp_threading(enabled); }
+    ~multiexp_threading_guard() { rct::set_multiexp_threading(old); }
+  };
+}
+
+TEST(multiexp, threaded_matches_serial)
+{
+  for (size_t n: {1, 2, 31, 64, 100, 300, 1024})
+  {
+    const std::vector<rct::MultiexpData> data = make_data(n);
+    const auto straus_cache = rct::straus_init_cache(data);
+    const auto pippenger_cache = rct::pippenger_init_cache(data);
+    rct::key serial;
+    {
+      multiexp_threading_guard guard(false);
+      serial = rct::bos_coster_heap_conv_robust(data);
+      ASSERT_EQ(rct::straus(data), serial);
+      ASSERT_EQ(rct::straus(data, straus_cache), serial);
+      ASSERT_EQ(rct::pippenger(data), serial);
+      ASSERT_EQ(rct::pippenger(data, pippenger_cache), serial);
+    }
+    {
+      multiexp_threading_guard guard(true);
+      ASSERT_EQ(rct::straus(data), serial);
+      ASSERT_EQ(rct::straus(data, straus_cache), serial);
+      ASSERT_EQ(rct::straus(data, NULL, 7), serial);
+      ASSERT_EQ(rct::pippenger(data), serial);
+      ASSERT_EQ(rct::pippenger(data, pippenger_cache), serial);
+      ASSERT_EQ(rct::pippenger(data, pippenger_cache, n / 2), serial);
+    }
+  }
+}
+
+TEST(multiexp, zero_scalars)
+{
+  multiexp_threading_guard guard(true);
+  std::vector<rct::MultiexpData> data = make_data(200);
+  for (auto &e: data)
+    e.scalar = rct::zero();
+  ASSERT_EQ(rct::straus(data), rct::identity());
+  ASSERT_EQ(rct::pippenger(data), rct::identity());
+}
+
+TEST(multiexp, parallel_chunks)
+{
+  multiexp_threading_guard guard(true);
+  std::vector<int> seen(1000, 0);
+  const size_t chunks = rct::get_parallel_chunks(seen.size(), 10);
+  ASSERT_GE(chunks, 1);
+  rct::run_parallel_chunks(seen.size(), chunks, [&](size_t chunk, size_t begin, size_t end) {
+    ASSERT_LT(chunk, chunks);
+    for (size_t i = begin; i < end; ++i)
+      ++seen[i];
+  });
+  ASSERT_EQ(std::count(seen.begin(), seen.end(), 1), (long)seen.size());
+
+  EXPECT_THROW(rct::run_parallel_chunks(100, 4, [](size_t chunk, size_t, size_t) {
+    if (chunk == 2)
+      throw std::runtime_error("chunk failed");
+  }), std::runtime_error);
+
+  rct::set_multiexp_threading(false);
+  ASSERT_EQ(rct::get_parallel_chunks(seen.size(), 10), 1);
+}
+
+TEST(multiexp, from_leaf_task)
+{
+  multiexp_threading_guard guard(true);
+  const std::vector<rct::MultiexpData> data = make_data(300);
+  const rct::key expected = rct::bos_coster_heap_conv_robust(data);
+  tools::threadpool &tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  rct::key straus_res, pippenger_res;
+  size_t leaf_chunks = 0;
+  std::vector<int> seen(100, 0);
+  tpool.submit(&waiter, [&] {
+    straus_res = rct::straus(data);
+    pippenger_res = rct::pippenger(data);
+    leaf_chunks = rct::get_parallel_chunks(seen.size(), 1);
+    rct::run_parallel_chunks(seen.size(), 4, [&](size_t, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+        ++seen[i];
+    });
+  }, true);
+  waiter.wait(&tpool);
+  ASSERT_EQ(straus_res, expected);
+  ASSERT_EQ(pippenger_res, expected);
+  ASSERT_EQ(leaf_chunks, 1);
+  ASSERT_EQ(std::count(seen.begin(), seen.end(), 1), (long)seen.size());
+}
@@ -0,0 +1,179 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "net/enums.h"
+#include "net/network_throttle-detail.hpp"
+
+using epee::net_utils::network_throttle;
+using epee::net_utils::token_bucket;
+using epee::net_utils::zone;
+using epee::net_utils::zone_throttle_stats;
+
+namespace
+{
+  // a throttle on a clock the test moves
+  class test_throttle: public network_throttle
+  {
+  public:
+    test_throttle(): network_throttle("test", "test throttle"), now(0) {}
+    virtual double get_time_seconds() const { return now; }
+    double now;
+  };
+
+  zone_throttle_stats get_stats(const network_throttle &throttle, zone z)
+  {
+    zone_throttle_stats stats;
+    memset(&stats, 0xff, sizeof(stats));
+    throttle.get_stats(z, stats);
+    return stats;
+  }
+}
+
+TEST(token_bucket, starts_full)
+{
+  token_bucket bucket;
+  bucket.set_rate(1000);
+  ASSERT_EQ(0, bucket.take(600, 10));
+  ASSERT_EQ(0, bucket.take(400, 10));
+  ASSERT_DOUBLE_EQ(0.1, bucket.take(100, 10));
+}
+
+TEST(token_bucket, refill)
+{
+  token_bucket bucket;
+  bucket.set_rate(1000);
+  ASSERT_EQ(0, bucket.take(1000, 0));
+  ASSERT_DOUBLE_EQ(0.25, bucket.take(500, 0.25));
+  ASSERT_EQ(0, bucket.take(500, 1));
+
+  // the clock going back does not refill
+  ASSERT_DOUBLE_EQ(0.5, bucket.take(500, 0.5));
+  ASSERT_DOUBLE_EQ(0.5, bucket.take(0, 1));
+
+  // and the bucket holds one second worth at most
+  ASSERT_DOUBLE_EQ(0.5, bucket.take(1500, 100));
+}
+
+TEST(token_bucket, debt_past_bucket_size)
+{
+  token_bucket bucket;
+  bucket.set_rate(1000);
+  ASSERT_DOUBLE_EQ(4, bucket.take(5000, 0));
+  ASSERT_NEAR(3.001, bucket.take(1, 1), 1e-9);
+  ASSERT_NEAR(0.002, bucket.take(0, 3.999), 1e-9);
+  ASSERT_EQ(0, bucket.take(0, 4.002));
+}
+
+TEST(token_bucket, lower_rate_drops_tokens)
+{
+  token_bucket bucket;
+  bucket.set_rate(1000);
+  ASSERT_EQ(0, bucket.take(0, 0));
+  bucket.set_rate(100);
+  ASSERT_DOUBLE_EQ(1, bucket.take(200, 0));
+}
+
+TEST(token_bucket, zero_rate_passes_through)
+{
+  token_bucket bucket;
+  ASSERT_EQ(0, bucket.take(1000000, 0));
+  bucket.set_rate(1000);
+  ASSERT_DOUBLE_EQ(9, bucket.take(10000, 0));
+  bucket.set_rate(0);
+  ASSERT_EQ(0, bucket.take(1000000, 0));
+}
+
+TEST(network_throttle, per_zone)
+{
+  test_throttle throttle;
+  throttle.set_target_speed(1);
+  ASSERT_EQ(0, throttle.handle_trafic_throttled(512, zone::public_));
+  ASSERT_DOUBLE_EQ(0.5, throttle.handle_trafic_throttled(1024, zone::tor));
+  throttle.now = 0.25;
+  ASSERT_DOUBLE_EQ(0.5, throttle.handle_trafic_throttled(256, zone::tor));
+  throttle.now = 10;
+  ASSERT_EQ(0, throttle.handle_trafic_throttled(128, zone::public_));
+
+  zone_throttle_stats stats = get_stats(throttle, zone::public_);
+  ASSERT_EQ(2, stats.packets);
+  ASSERT_EQ(640, stats.bytes);
+  ASSERT_EQ(0, stats.deferrals);
+  ASSERT_EQ(0, stats.deferred_ms);
+  stats = get_stats(throttle, zone::tor);
+  ASSERT_EQ(2, stats.packets);
+  ASSERT_EQ(1280, stats.bytes);
+  ASSERT_EQ(2, stats.deferrals);
+  ASSERT_EQ(1000, stats.deferred_ms);
+  for (zone z: {zone::invalid, zone::i2p})
+  {
+    stats = get_stats(throttle, z);
+    ASSERT_EQ(0, stats.packets);
+    ASSERT_EQ(0, stats.bytes);
+  }
+
+  uint64_t total_packets, total_bytes;
+  throttle.get_stats(total_packets, total_bytes);
+  ASSERT_EQ(4, total_packets);
+  ASSERT_EQ(1920, total_bytes);
+}
+
+TEST(network_throttle, zone_out_of_range)
+{
+  test_throttle throttle;
+  throttle.set_target_speed(1);
+  ASSERT_DOUBLE_EQ(1, throttle.handle_trafic_throttled(2048, static_cast<zone>(4)));
+  ASSERT_DOUBLE_EQ(2, throttle.handle_trafic_throttled(1024, static_cast<zone>(255)));
+
+  // still throttled and counted in the totals, but in no zone
+  for (zone z: {zone::invalid, zone::public_, zone::i2p, zone::tor, static_cast<zone>(4), static_cast<zone>(255)})
+  {
+    const zone_throttle_stats stats = get_stats(throttle, z);
+    ASSERT_EQ(0, stats.packets);
+    ASSERT_EQ(0, stats.bytes);
+    ASSERT_EQ(0, stats.deferrals);
+    ASSERT_EQ(0, stats.deferred_ms);
+  }
+  uint64_t total_packets, total_bytes;
+  throttle.get_stats(total_packets, total_bytes);
+  ASSERT_EQ(2, total_packets);
+  ASSERT_EQ(3072, total_bytes);
+}
+
+TEST(network_throttle, zero_rate_passes_through)
+{
+  test_throttle throttle;
+  throttle.set_target_speed(0);
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(0, throttle.handle_trafic_throttled(1024 * 1024, zone::public_));
+  const zone_throttle_stats stats = get_stats(throttle, zone::public_);
+  ASSERT_EQ(100, stats.packets);
+  ASSERT_EQ(100 * 1024 * 1024, stats.bytes);
+  ASSERT_EQ(0, stats.deferrals);
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/output_cache.h"
+
+static cryptonote::output_data_t make_output(uint64_t height)
+{
+  cryptonote::output_data_t data;
+  memset(&data, 0, sizeof(data));
+  data.height = height;
+  return data;
+}
+
+TEST(output_cache, find_insert)
+{
+  cryptonote::output_cache cache(4);
+  ASSERT_TRUE(cache.find(0, 5) == NULL);
+  cache.insert(0, 5, make_output(50));
+  cryptonote::output_cache::entry *e = cache.find(0, 5);
+  ASSERT_TRUE(e != NULL);
+  ASSERT_EQ(e->data.height, 50);
+  ASSERT_FALSE(e->has_txid);
+  ASSERT_TRUE(cache.find(1, 5) == NULL);
+  ASSERT_EQ(cache.hits(), 1);
+  ASSERT_EQ(cache.misses(), 2);
+}
+
+TEST(output_cache, txid)
+{
+  cryptonote::output_cache cache(4);
+  cryptonote::output_cache::entry &e = cache.insert(0, 1, make_output(10));
+  e.txid = crypto::hash{};
+  e.txid.data[0] = 1;
+  e.has_txid = true;
+  const cryptonote::output_cache::entry *found = cache.find(0, 1);
+  ASSERT_TRUE(found != NULL);
+  ASSERT_TRUE(found->has_txid);
+  ASSERT_EQ(found->txid.data[0], 1);
+}
+
+TEST(output_cache, bounded)
+{
+  cryptonote::output_cache cache(4);
+  for (uint64_t i = 0; i < 100; ++i)
+    cache.insert(0, i, make_output(i));
+  size_t found = 0;
+  for (uint64_t i = 0; i < 100; ++i)
+    if (cache.find(0, i))
+      ++found;
+  ASSERT_LE(found, 8);
+  // the latest ones are still there
+  ASSERT_TRUE(cache.find(0, 99) != NULL);
+}
+
+TEST(output_cache, recently_used_survive)
+{
+  cryptonote::output_cache cache(4);
+  cache.insert(0, 0, make_output(0));
+  for (uint64_t i = 1; i < 100; ++i)
+  {
+    cache.insert(0, i, make_output(i));
+    ASSERT_TRUE(cache.find(0, 0) != NULL);
+  }
+}
+
+TEST(output_cache, clear)
+{
+  cryptonote::output_cache cache(4);
+  for (uint64_t i = 0; i < 6; ++i)
+    cache.insert(0, i, make_output(i));
+  cache.clear();
+  for (uint64_t i = 0; i < 6; ++i)
+    ASSERT_TRUE(cache.find(0, i) == NULL);
+}
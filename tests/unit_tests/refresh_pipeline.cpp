@@ -0,0 +1,197 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "wallet/refresh_pipeline.h"
+
+namespace
+{
+  // a batch is just the height it starts at and its block count
+  typedef std::pair<uint64_t, uint64_t> batch_t;
+  typedef tools::refresh_pipeline<batch_t> pipeline_t;
+
+  void fetch(pipeline_t &pipeline, uint64_t expected_height, uint64_t expected_count)
+  {
+    uint64_t height, count;
+    ASSERT_TRUE(pipeline.start_fetch(height, count));
+    ASSERT_EQ(expected_height, height);
+    ASSERT_EQ(expected_count, count);
+  }
+
+  void deliver(pipeline_t &pipeline, uint64_t height, uint64_t count, uint64_t nblocks)
+  {
+    pipeline.end_fetch();
+    pipeline.add(height, count, {height, nblocks}, nblocks, nblocks * 10);
+  }
+
+  void commit(pipeline_t &pipeline, uint64_t expected_height, uint64_t expected_count)
+  {
+    batch_t batch;
+    ASSERT_TRUE(pipeline.take(batch));
+    ASSERT_EQ(expected_height, batch.first);
+    ASSERT_EQ(expected_count, batch.second);
+    pipeline.committed(batch.second);
+  }
+}
+
+TEST(refresh_pipeline, commits_in_order)
+{
+  pipeline_t pipeline(1000, 1250, 100, 1000000);
+  fetch(pipeline, 1000, 100);
+  fetch(pipeline, 1100, 100);
+  fetch(pipeline, 1200, 50);
+  uint64_t height, count;
+  ASSERT_FALSE(pipeline.start_fetch(height, count));
+  ASSERT_FALSE(pipeline.finished());
+
+  deliver(pipeline, 1200, 50, 50);
+  deliver(pipeline, 1100, 100, 100);
+  batch_t batch;
+  ASSERT_FALSE(pipeline.take(batch));
+  deliver(pipeline, 1000, 100, 100);
+  ASSERT_TRUE(pipeline.finished());
+
+  commit(pipeline, 1000, 100);
+  commit(pipeline, 1100, 100);
+  commit(pipeline, 1200, 50);
+  ASSERT_FALSE(pipeline.waiting());
+  ASSERT_EQ(0, pipeline.ready_size());
+}
+
+TEST(refresh_pipeline, short_batches_are_refetched)
+{
+  pipeline_t pipeline(0, 200, 100, 1000000);
+  fetch(pipeline, 0, 100);
+  deliver(pipeline, 0, 100, 30);
+  fetch(pipeline, 30, 70);
+  fetch(pipeline, 100, 100);
+  deliver(pipeline, 30, 70, 70);
+  deliver(pipeline, 100, 100, 100);
+  ASSERT_TRUE(pipeline.finished());
+  commit(pipeline, 0, 30);
+  commit(pipeline, 30, 70);
+  commit(pipeline, 100, 100);
+  ASSERT_FALSE(pipeline.waiting());
+}
+
+TEST(refresh_pipeline, busy_ranges_are_requeued)
+{
+  pipeline_t pipeline(0, 200, 100, 1000000);
+  fetch(pipeline, 0, 100);
+  fetch(pipeline, 100, 100);
+  pipeline.end_fetch();
+  pipeline.requeue(0, 100);
+  fetch(pipeline, 0, 100);
+  deliver(pipeline, 0, 100, 100);
+  deliver(pipeline, 100, 100, 100);
+  ASSERT_TRUE(pipeline.finished());
+}
+
+TEST(refresh_pipeline, over_budget_only_fetches_commit_height)
+{
+  pipeline_t pipeline(0, 500, 100, 1500);
+  fetch(pipeline, 0, 100);
+  fetch(pipeline, 100, 100);
+  fetch(pipeline, 200, 100);
+  deliver(pipeline, 100, 100, 100);
+  deliver(pipeline, 200, 100, 100);
+  ASSERT_EQ(2000, pipeline.ready_size());
+
+  // the batch at the commit height comes back short, the rest of it goes out once
+  // the commit stage gets there
+  deliver(pipeline, 0, 100, 40);
+  uint64_t height, count;
+  ASSERT_FALSE(pipeline.start_fetch(height, count));
+  commit(pipeline, 0, 40);
+  fetch(pipeline, 40, 60);
+  ASSERT_FALSE(pipeline.start_fetch(height, count));
+  deliver(pipeline, 40, 60, 60);
+
+  commit(pipeline, 40, 60);
+  commit(pipeline, 100, 100);
+  commit(pipeline, 200, 100);
+  fetch(pipeline, 300, 100);
+}
+
+TEST(refresh_pipeline, daemon_chain_shrinks)
+{
+  pipeline_t pipeline(100, 600, 100, 1000000);
+  fetch(pipeline, 100, 100);
+  fetch(pipeline, 200, 100);
+  fetch(pipeline, 300, 100);
+  fetch(pipeline, 400, 100);
+  fetch(pipeline, 500, 100);
+  deliver(pipeline, 200, 100, 100);
+  deliver(pipeline, 400, 100, 100);
+  ASSERT_EQ(2000, pipeline.ready_size());
+
+  // the daemon refused the fetch from 500, and now reports a height of 350
+  pipeline.end_fetch();
+  pipeline.truncate(350);
+  ASSERT_EQ(350, pipeline.end_height());
+  ASSERT_EQ(1000, pipeline.ready_size());
+  uint64_t height, count;
+  ASSERT_FALSE(pipeline.start_fetch(height, count));
+
+  // a busy range past the end is not retried, what was in flight below it still comes in
+  pipeline.requeue(400, 100);
+  ASSERT_FALSE(pipeline.start_fetch(height, count));
+  deliver(pipeline, 300, 100, 100);
+  ASSERT_FALSE(pipeline.finished());
+  deliver(pipeline, 100, 100, 100);
+  ASSERT_TRUE(pipeline.finished());
+
+  commit(pipeline, 100, 100);
+  commit(pipeline, 200, 100);
+  commit(pipeline, 300, 100);
+  ASSERT_FALSE(pipeline.waiting());
+  batch_t batch;
+  ASSERT_FALSE(pipeline.take(batch));
+  ASSERT_EQ(0, pipeline.ready_size());
+}
+
+TEST(refresh_pipeline, empty_batch_ends_chain)
+{
+  pipeline_t pipeline(0, 300, 100, 1000000);
+  fetch(pipeline, 0, 100);
+  fetch(pipeline, 100, 100);
+  fetch(pipeline, 200, 100);
+  deliver(pipeline, 200, 100, 100);
+  deliver(pipeline, 100, 100, 0);
+  ASSERT_EQ(100, pipeline.end_height());
+  ASSERT_EQ(0, pipeline.ready_size());
+  deliver(pipeline, 0, 100, 100);
+  ASSERT_TRUE(pipeline.finished());
+  commit(pipeline, 0, 100);
+  ASSERT_FALSE(pipeline.waiting());
+
+  // and the end never moves back up
+  pipeline.truncate(200);
+  ASSERT_EQ(100, pipeline.end_height());
+}
@@ -38,6 +38,7 @@
 #include "ringct/rctSigs.h"
 #include "ringct/rctOps.h"
 #include "device/device.hpp"
+#include "common/threadpool.h"
 
 using namespace std;
 using namespace crypto;
@@ -1061,3 +1062,122 @@ TEST(ringct, key_ostream)
     out.str()
   );
 }
+
+TEST(ringct, fixed_base_precomp)
+{
+  ge_p3 G_p3;
+  ASSERT_EQ(ge_frombytes_vartime(&G_p3, rct::G.bytes), 0);
+  static ge_fixed_base_table table;
+  ge_fixed_base_precomp(table, &G_p3);
+  for (int n = 0; n < 64; ++n)
+  {
+    const rct::key a = n == 0 ? rct::zero() : n == 1 ? rct::identity() : rct::skGen();
+    ge_p3 p0, p1;
+    ge_scalarmult_base(&p0, a.bytes);
+    ge_scalarmult_fixed_base(&p1, a.bytes, table);
+    rct::key k0, k1;
+    ge_p3_tobytes(k0.bytes, &p0);
+    ge_p3_tobytes(k1.bytes, &p1);
+    ASSERT_EQ(k0, k1);
+  }
+}
+
+TEST(ringct, fixed_base_H)
+{
+  for (int n = 0; n < 64; ++n)
+  {
+    const rct::key a = rct::skGen(), b = n == 0 ? rct::zero() : rct::skGen();
+    ASSERT_EQ(rct::scalarmultH(b), rct::scalarmultKey(rct::H, b));
+    rct::key C;
+    rct::addKeys2H(C, a, b);
+    ASSERT_EQ(C, rct::addKeys(rct::scalarmultBase(a), rct::scalarmultKey(rct::H, b)));
+    rct::key C2;
+    rct::addKeys2(C2, a, b, rct::H);
+    ASSERT_EQ(C, C2);
+  }
+
+  // unreduced scalars give the same points as the variable base code
+  rct::key a, b;
+  memset(a.bytes, 0x7f, sizeof(a.bytes));
+  memset(b.bytes, 0x3e, sizeof(b.bytes));
+  ge_p2 p2;
+  ge_double_scalarmult_base_vartime(&p2, b.bytes, &ge_p3_H, a.bytes);
+  rct::key expected, C;
+  ge_tobytes(expected.bytes, &p2);
+  rct::addKeys2H(C, a, b);
+  ASSERT_EQ(C, expected);
+  ASSERT_EQ(rct::commit(1000, a), rct::addKeys(rct::scalarmultBase(a), rct::scalarmultKey(rct::H, rct::d2h(1000))));
+}
+
+static rct::rctSig make_simple_rct_sig_with_inputs(size_t n_inputs)
+{
+  const std::vector<uint64_t> inputs(n_inputs, 1000);
+  const uint64_t outputs[] = {n_inputs * 1000 - 1};
+  return make_sample_simple_rct_sig(n_inputs, inputs.data(), 1, outputs, 1);
+}
+
+static void break_input(rct::rctSig &s, size_t i)
+{
+  s.p.MGs[i].ss[0][0] = rct::skGen();
+}
+
+TEST(ringct, simple_reports_failed_input)
+{
+  rct::rctSig s = make_simple_rct_sig_with_inputs(4);
+  std::vector<bool> verified;
+  size_t failed_input = 0;
+  ASSERT_TRUE(verRctNonSemanticsSimple(s, verified, &failed_input));
+  ASSERT_EQ(verified, std::vector<bool>(4, true));
+
+  break_input(s, 2);
+  verified.clear();
+  ASSERT_FALSE(verRctNonSemanticsSimple(s, verified, &failed_input));
+  ASSERT_EQ(failed_input, 2);
+  ASSERT_EQ(verified.size(), 4);
+  ASSERT_FALSE(verified[2]);
+}
+
+TEST(ringct, simple_skips_verified_inputs)
+{
+  rct::rctSig s = make_simple_rct_sig_with_inputs(3);
+  break_input(s, 1);
+  std::vector<bool> verified(3, false);
+  verified[1] = true;
+  size_t failed_input = 7;
+  ASSERT_TRUE(verRctNonSemanticsSimple(s, verified, &failed_input));
+  ASSERT_EQ(verified, std::vector<bool>(3, true));
+  ASSERT_EQ(failed_input, 7);
+
+  verified.assign(3, false);
+  ASSERT_FALSE(verRctNonSemanticsSimple(s, verified, &failed_input));
+  ASSERT_EQ(failed_input, 1);
+}
+
+TEST(ringct, simple_rejects_verified_of_wrong_size)
+{
+  const rct::rctSig s = make_simple_rct_sig_with_inputs(2);
+  size_t failed_input = 7;
+  for (size_t size: {1, 3})
+  {
+    std::vector<bool> verified(size, false);
+    ASSERT_FALSE(verRctNonSemanticsSimple(s, verified, &failed_input));
+    ASSERT_EQ(verified, std::vector<bool>(size, false));
+    ASSERT_EQ(failed_input, 7);
+  }
+}
+
+TEST(ringct, simple_cancels_after_failed_input)
+{
+  // the first input fails, and is among the first ones checked; by the time
+  // it's done, most of the others have not started yet, and never do
+  const size_t n_inputs = 4 * (tools::threadpool::getInstance().get_max_concurrency() + 1);
+  rct::rctSig s = make_simple_rct_sig_with_inputs(n_inputs);
+  break_input(s, 0);
+  std::vector<bool> verified;
+  size_t failed_input = n_inputs;
+  ASSERT_FALSE(verRctNonSemanticsSimple(s, verified, &failed_input));
+  ASSERT_EQ(failed_input, 0);
+  ASSERT_EQ(verified.size(), n_inputs);
+  ASSERT_FALSE(verified[0]);
+  ASSERT_LT(std::count(verified.begin(), verified.end(), true), n_inputs - 1);
+}
@@ -0,0 +1,119 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <boost/thread/thread.hpp>
+#include "rpc/rpc_limiter.h"
+
+TEST(rpc_limiter, unlimited)
+{
+  cryptonote::rpc_limiter limiter;
+  for (int i = 0; i < 100; ++i)
+    ASSERT_TRUE(limiter.enter("get_info", cryptonote::rpc_limiter::rpc_class_cheap));
+  ASSERT_EQ(limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_cheap).in_flight, 100);
+  for (int i = 0; i < 100; ++i)
+    limiter.leave("get_info", cryptonote::rpc_limiter::rpc_class_cheap);
+  ASSERT_EQ(limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_cheap).in_flight, 0);
+}
+
+TEST(rpc_limiter, class_limit)
+{
+  cryptonote::rpc_limiter limiter;
+  limiter.set_class_limit(cryptonote::rpc_limiter::rpc_class_expensive, 2);
+  ASSERT_TRUE(limiter.enter("get_outs", cryptonote::rpc_limiter::rpc_class_expensive));
+  ASSERT_TRUE(limiter.enter("get_transactions", cryptonote::rpc_limiter::rpc_class_expensive));
+  ASSERT_FALSE(limiter.enter("get_outs", cryptonote::rpc_limiter::rpc_class_expensive));
+  ASSERT_TRUE(limiter.enter("get_info", cryptonote::rpc_limiter::rpc_class_cheap));
+
+  cryptonote::rpc_limiter::class_stats stats = limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_expensive);
+  ASSERT_EQ(stats.in_flight, 2);
+  ASSERT_EQ(stats.rejected, 1);
+
+  limiter.leave("get_outs", cryptonote::rpc_limiter::rpc_class_expensive);
+  ASSERT_TRUE(limiter.enter("get_outs", cryptonote::rpc_limiter::rpc_class_expensive));
+}
+
+TEST(rpc_limiter, method_limit)
+{
+  cryptonote::rpc_limiter limiter;
+  ASSERT_TRUE(limiter.set_method_limits({"get_output_distribution:1"}));
+  ASSERT_TRUE(limiter.enter("get_output_distribution", cryptonote::rpc_limiter::rpc_class_expensive));
+  ASSERT_FALSE(limiter.enter("get_output_distribution", cryptonote::rpc_limiter::rpc_class_expensive));
+  ASSERT_TRUE(limiter.enter("get_outs", cryptonote::rpc_limiter::rpc_class_expensive));
+  // a rejected call must not hold on to its class slot
+  ASSERT_EQ(limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_expensive).in_flight, 2);
+  limiter.leave("get_output_distribution", cryptonote::rpc_limiter::rpc_class_expensive);
+  ASSERT_TRUE(limiter.enter("get_output_distribution", cryptonote::rpc_limiter::rpc_class_expensive));
+}
+
+TEST(rpc_limiter, queue)
+{
+  cryptonote::rpc_limiter limiter;
+  limiter.set_class_limit(cryptonote::rpc_limiter::rpc_class_expensive, 1);
+  limiter.set_class_queue(cryptonote::rpc_limiter::rpc_class_expensive, 1, 10000);
+  ASSERT_TRUE(limiter.enter("get_blocks", cryptonote::rpc_limiter::rpc_class_expensive));
+
+  bool entered = false;
+  boost::thread waiter([&]{ entered = limiter.enter("get_blocks", cryptonote::rpc_limiter::rpc_class_expensive); });
+  while (limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_expensive).waiting == 0)
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+  // the queue is full, so this one is refused at once
+  ASSERT_FALSE(limiter.enter("get_blocks", cryptonote::rpc_limiter::rpc_class_expensive));
+
+  limiter.leave("get_blocks", cryptonote::rpc_limiter::rpc_class_expensive);
+  waiter.join();
+  ASSERT_TRUE(entered);
+  cryptonote::rpc_limiter::class_stats stats = limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_expensive);
+  ASSERT_EQ(stats.in_flight, 1);
+  ASSERT_EQ(stats.waiting, 0);
+  ASSERT_EQ(stats.queued, 1);
+  ASSERT_EQ(stats.rejected, 1);
+}
+
+TEST(rpc_limiter, queue_timeout)
+{
+  cryptonote::rpc_limiter limiter;
+  limiter.set_class_limit(cryptonote::rpc_limiter::rpc_class_expensive, 1);
+  limiter.set_class_queue(cryptonote::rpc_limiter::rpc_class_expensive, 4, 20);
+  ASSERT_TRUE(limiter.enter("get_outs", cryptonote::rpc_limiter::rpc_class_expensive));
+  ASSERT_FALSE(limiter.enter("get_outs", cryptonote::rpc_limiter::rpc_class_expensive));
+  cryptonote::rpc_limiter::class_stats stats = limiter.get_class_stats(cryptonote::rpc_limiter::rpc_class_expensive);
+  ASSERT_EQ(stats.in_flight, 1);
+  ASSERT_EQ(stats.waiting, 0);
+  ASSERT_EQ(stats.rejected, 1);
+}
+
+TEST(rpc_limiter, parse)
+{
+  cryptonote::rpc_limiter limiter;
+  ASSERT_FALSE(limiter.set_method_limits({"get_outs"}));
+  ASSERT_FALSE(limiter.set_method_limits({":3"}));
+  ASSERT_FALSE(limiter.set_method_limits({"get_outs:x"}));
+  ASSERT_TRUE(limiter.set_method_limits({"get_outs:3", "get_transactions:0"}));
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_config.h"
+#include "cryptonote_protocol/tx_sketch.h"
+
+static std::vector<uint32_t> random_ids(size_t count)
+{
+  std::vector<uint32_t> ids;
+  while (ids.size() < count)
+  {
+    const uint32_t id = crypto::rand<uint32_t>();
+    if (id && std::find(ids.begin(), ids.end(), id) == ids.end())
+      ids.push_back(id);
+  }
+  return ids;
+}
+
+TEST(tx_sketch, empty)
+{
+  cryptonote::tx_sketch sketch(8);
+  std::vector<uint32_t> ids;
+  ASSERT_TRUE(sketch.empty());
+  ASSERT_TRUE(sketch.decode(ids));
+  ASSERT_TRUE(ids.empty());
+}
+
+TEST(tx_sketch, add_twice_cancels)
+{
+  cryptonote::tx_sketch sketch(8);
+  sketch.add(1234);
+  ASSERT_FALSE(sketch.empty());
+  sketch.add(1234);
+  ASSERT_TRUE(sketch.empty());
+}
+
+TEST(tx_sketch, decode_difference)
+{
+  for (size_t diff = 1; diff < 32; ++diff)
+  {
+    const std::vector<uint32_t> common = random_ids(500), ids = random_ids(diff);
+    cryptonote::tx_sketch a(32), b(32);
+    for (uint32_t id: common)
+    {
+      a.add(id);
+      b.add(id);
+    }
+    for (size_t n = 0; n < ids.size(); ++n)
+      (n & 1 ? a : b).add(ids[n]);
+
+    a.merge(b);
+    std::vector<uint32_t> decoded;
+    ASSERT_TRUE(a.decode(decoded));
+    std::sort(decoded.begin(), decoded.end());
+    std::vector<uint32_t> expected = ids;
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(decoded, expected);
+  }
+}
+
+TEST(tx_sketch, overload_fails)
+{
+  cryptonote::tx_sketch sketch(16);
+  for (uint32_t id: random_ids(40))
+    sketch.add(id);
+  std::vector<uint32_t> ids;
+  ASSERT_FALSE(sketch.decode(ids));
+  ASSERT_TRUE(ids.empty());
+}
+
+TEST(tx_sketch, merge_truncates)
+{
+  const std::vector<uint32_t> ids = random_ids(4);
+  cryptonote::tx_sketch small(8), large(24);
+  small.add(ids[0]);
+  small.add(ids[1]);
+  large.add(ids[2]);
+  large.add(ids[3]);
+  large.merge(small);
+  ASSERT_EQ(large.capacity(), 8);
+  std::vector<uint32_t> decoded;
+  ASSERT_TRUE(large.decode(decoded));
+  ASSERT_EQ(decoded.size(), 4);
+}
+
+TEST(tx_sketch, serialization)
+{
+  cryptonote::tx_sketch sketch(12), loaded;
+  for (uint32_t id: random_ids(5))
+    sketch.add(id);
+  const std::string blob = sketch.serialize();
+  ASSERT_EQ(blob.size(), 12 * sizeof(uint32_t));
+  ASSERT_TRUE(loaded.deserialize(blob));
+  ASSERT_EQ(loaded.serialize(), blob);
+  std::vector<uint32_t> ids;
+  ASSERT_TRUE(loaded.decode(ids));
+  ASSERT_EQ(ids.size(), 5);
+
+  ASSERT_FALSE(loaded.deserialize(std::string(7, '\0')));
+  ASSERT_FALSE(loaded.deserialize(std::string((P2P_TX_RECONCILIATION_MAX_CAPACITY + 1) * sizeof(uint32_t), '\0')));
+}
@@ -0,0 +1,308 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "crypto/crypto.h"
+#include "cryptonote_core/txpool_block_template.h"
+
+using cryptonote::txpool_block_template;
+
+namespace
+{
+  const uint64_t HEIGHT = 1000;
+  const size_t MEDIAN_WEIGHT = 262144;
+  const uint64_t ALREADY_GENERATED_COINS = 1000000000000000;
+  const uint8_t VERSION = 17;
+
+  // the pool as far as the template sees it: fee order and readiness
+  class test_pool
+  {
+  public:
+    test_pool(): m_received(0) {}
+
+    txpool_block_template::tx_info add(size_t weight, uint64_t fee, const std::vector<crypto::key_image> &k_images, bool ready = true)
+    {
+      const crypto::hash txid = crypto::rand<crypto::hash>();
+      entry &e = m_txs[txid];
+      e.info.txid = txid;
+      e.info.weight = weight;
+      e.info.fee = fee;
+      for (const auto &k_image: k_images)
+      {
+        cryptonote::txin_to_key in;
+        in.amount = 0;
+        in.key_offsets.push_back(1);
+        in.k_image = k_image;
+        e.tx.vin.push_back(in);
+      }
+      e.ready = ready;
+      e.received = m_received++;
+      return e.info;
+    }
+
+    cryptonote::transaction remove(const crypto::hash &txid)
+    {
+      const auto i = m_txs.find(txid);
+      const cryptonote::transaction tx = i->second.tx;
+      m_txs.erase(i);
+      return tx;
+    }
+
+    std::vector<crypto::hash> txids() const
+    {
+      std::vector<crypto::hash> txids;
+      for (const auto &i: m_txs)
+        txids.push_back(i.first);
+      return txids;
+    }
+
+    // highest fee per byte first, then oldest first, like the pool's sorted container
+    std::vector<txpool_block_template::tx_info> sorted() const
+    {
+      std::vector<const entry*> entries;
+      for (const auto &i: m_txs)
+        entries.push_back(&i.second);
+      std::sort(entries.begin(), entries.end(), [](const entry *a, const entry *b) {
+        const double fa = a->info.fee / (double)a->info.weight, fb = b->info.fee / (double)b->info.weight;
+        return fa != fb ? fa > fb : a->received < b->received;
+      });
+      std::vector<txpool_block_template::tx_info> txs;
+      for (const entry *e: entries)
+        txs.push_back(e->info);
+      return txs;
+    }
+
+    txpool_block_template::ready_callback ready() const
+    {
+      return [this](const crypto::hash &txid, cryptonote::transaction &tx) {
+        const entry &e = m_txs.at(txid);
+        tx = e.tx;
+        return e.ready;
+      };
+    }
+
+  private:
+    struct entry
+    {
+      txpool_block_template::tx_info info;
+      cryptonote::transaction tx;
+      bool ready;
+      uint64_t received;
+    };
+
+    std::unordered_map<crypto::hash, entry> m_txs;
+    uint64_t m_received;
+  };
+
+  void build(txpool_block_template &bt, const test_pool &pool, const crypto::hash &prev_id, uint64_t height = HEIGHT)
+  {
+    bt.build(prev_id, height, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS, VERSION, pool.sorted(), pool.ready());
+  }
+
+  // a template still valid must be what a rebuild would give
+  void check(const txpool_block_template &bt, const test_pool &pool, const crypto::hash &prev_id, uint64_t height = HEIGHT)
+  {
+    if (!bt.valid())
+      return;
+    txpool_block_template fresh;
+    build(fresh, pool, prev_id, height);
+    const std::unordered_set<crypto::hash> expected(fresh.tx_hashes().begin(), fresh.tx_hashes().end());
+    const std::unordered_set<crypto::hash> picked(bt.tx_hashes().begin(), bt.tx_hashes().end());
+    ASSERT_EQ(bt.tx_hashes().size(), picked.size());
+    ASSERT_EQ(expected, picked);
+    ASSERT_EQ(fresh.total_weight(), bt.total_weight());
+    ASSERT_EQ(fresh.fee(), bt.fee());
+    ASSERT_EQ(fresh.coinbase(), bt.coinbase());
+  }
+}
+
+TEST(txpool_block_template, add_and_remove)
+{
+  const crypto::hash prev_id = crypto::rand<crypto::hash>();
+  test_pool pool;
+  pool.add(2000, 100000, {crypto::rand<crypto::key_image>()});
+  pool.add(3000, 400000, {crypto::rand<crypto::key_image>()});
+  pool.add(1500, 900000, {crypto::rand<crypto::key_image>()}, false);
+
+  txpool_block_template bt;
+  ASSERT_FALSE(bt.valid());
+  build(bt, pool, prev_id);
+  ASSERT_TRUE(bt.valid());
+  ASSERT_EQ(2, bt.tx_hashes().size());
+  ASSERT_EQ(5000, bt.total_weight());
+  ASSERT_EQ(500000, bt.fee());
+  ASSERT_TRUE(bt.matches(prev_id, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS, VERSION));
+
+  const crypto::key_image k_image = crypto::rand<crypto::key_image>();
+  const txpool_block_template::tx_info added = pool.add(4000, 200000, {crypto::rand<crypto::key_image>(), k_image});
+  bt.add(prev_id, added, pool.ready());
+  ASSERT_TRUE(bt.valid());
+  ASSERT_EQ(3, bt.tx_hashes().size());
+  check(bt, pool, prev_id);
+
+  // a tx which is not ready does not get in
+  const txpool_block_template::tx_info not_ready = pool.add(1000, 800000, {crypto::rand<crypto::key_image>()}, false);
+  bt.add(prev_id, not_ready, pool.ready());
+  ASSERT_TRUE(bt.valid());
+  ASSERT_EQ(3, bt.tx_hashes().size());
+  check(bt, pool, prev_id);
+
+  for (const crypto::hash &txid: {added.txid, not_ready.txid})
+  {
+    const cryptonote::transaction tx = pool.remove(txid);
+    bt.remove(txid, tx);
+    ASSERT_TRUE(bt.valid());
+    check(bt, pool, prev_id);
+  }
+  ASSERT_EQ(2, bt.tx_hashes().size());
+
+  // the removed tx does not keep its key images from another one
+  bt.add(prev_id, pool.add(4000, 200000, {k_image}), pool.ready());
+  ASSERT_TRUE(bt.valid());
+  ASSERT_EQ(3, bt.tx_hashes().size());
+  check(bt, pool, prev_id);
+}
+
+TEST(txpool_block_template, key_image_conflict_invalidates)
+{
+  const crypto::hash prev_id = crypto::rand<crypto::hash>();
+  const crypto::key_image k_image = crypto::rand<crypto::key_image>();
+  test_pool pool;
+  pool.add(2000, 100000, {k_image});
+
+  txpool_block_template bt;
+  build(bt, pool, prev_id);
+  bt.add(prev_id, pool.add(2000, 500000, {crypto::rand<crypto::key_image>(), k_image}), pool.ready());
+  ASSERT_FALSE(bt.valid());
+
+  // the rebuild picks the better paying one, and leaves the template incomplete
+  build(bt, pool, prev_id);
+  ASSERT_TRUE(bt.valid());
+  ASSERT_EQ(500000, bt.fee());
+  bt.add(prev_id, pool.add(1000, 100000, {crypto::rand<crypto::key_image>()}), pool.ready());
+  ASSERT_FALSE(bt.valid());
+  build(bt, pool, prev_id);
+  const crypto::hash txid = bt.tx_hashes().front();
+  bt.remove(txid, pool.remove(txid));
+  ASSERT_FALSE(bt.valid());
+}
+
+TEST(txpool_block_template, penalty_zone_invalidates)
+{
+  const crypto::hash prev_id = crypto::rand<crypto::hash>();
+  test_pool pool;
+  txpool_block_template bt;
+  build(bt, pool, prev_id);
+
+  // fees high enough for a rebuild to go past the median
+  const uint64_t fee = bt.coinbase() / 20;
+  size_t added = 0;
+  while (bt.valid())
+  {
+    bt.add(prev_id, pool.add(30000, fee + added, {crypto::rand<crypto::key_image>()}), pool.ready());
+    check(bt, pool, prev_id);
+    ++added;
+  }
+  ASSERT_GT(added * 30000, MEDIAN_WEIGHT);
+  ASSERT_LE((added - 1) * 30000, MEDIAN_WEIGHT);
+
+  build(bt, pool, prev_id);
+  ASSERT_GT(bt.total_weight(), MEDIAN_WEIGHT);
+  const crypto::hash txid = bt.tx_hashes().front();
+  bt.remove(txid, pool.remove(txid));
+  ASSERT_FALSE(bt.valid());
+}
+
+TEST(txpool_block_template, chain_change)
+{
+  const crypto::hash prev_id = crypto::rand<crypto::hash>(), next_id = crypto::rand<crypto::hash>();
+  test_pool pool;
+  pool.add(2000, 100000, {crypto::rand<crypto::key_image>()});
+  txpool_block_template bt;
+  build(bt, pool, prev_id);
+  ASSERT_FALSE(bt.matches(next_id, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS, VERSION));
+  ASSERT_FALSE(bt.matches(prev_id, MEDIAN_WEIGHT + 1, ALREADY_GENERATED_COINS, VERSION));
+  ASSERT_FALSE(bt.matches(prev_id, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS + 1, VERSION));
+  ASSERT_FALSE(bt.matches(prev_id, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS, VERSION + 1));
+
+  // a tx coming in after a block was added, before the pool was told
+  bt.add(next_id, pool.add(2000, 100000, {crypto::rand<crypto::key_image>()}), pool.ready());
+  ASSERT_FALSE(bt.valid());
+
+  // on_blockchain_inc and on_blockchain_dec
+  for (const crypto::hash &id: {next_id, prev_id})
+  {
+    build(bt, pool, id);
+    ASSERT_TRUE(bt.matches(id, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS, VERSION));
+    bt.invalidate();
+    ASSERT_FALSE(bt.matches(id, MEDIAN_WEIGHT, ALREADY_GENERATED_COINS, VERSION));
+  }
+}
+
+TEST(txpool_block_template, matches_rebuild)
+{
+  const crypto::hash prev_id = crypto::rand<crypto::hash>();
+  std::vector<crypto::key_image> k_images;
+  for (int i = 0; i < 50; ++i)
+    k_images.push_back(crypto::rand<crypto::key_image>());
+
+  test_pool pool;
+  txpool_block_template bt;
+  size_t kept = 0;
+  for (int i = 0; i < 2000; ++i)
+  {
+    const bool was_valid = bt.valid();
+    const std::vector<crypto::hash> txids = pool.txids();
+    if (txids.size() > 30 || (!txids.empty() && crypto::rand<uint32_t>() % 3 == 0))
+    {
+      const crypto::hash txid = txids[crypto::rand<uint32_t>() % txids.size()];
+      bt.remove(txid, pool.remove(txid));
+    }
+    else
+    {
+      // some txes double spend a key image, some are not ready yet
+      std::vector<crypto::key_image> spent{crypto::rand<crypto::key_image>()};
+      if (crypto::rand<uint32_t>() % 8 == 0)
+        spent.push_back(k_images[crypto::rand<uint32_t>() % k_images.size()]);
+      const bool ready = crypto::rand<uint32_t>() % 8 != 0;
+      bt.add(prev_id, pool.add(1000 + crypto::rand<uint32_t>() % 9000, 10000 + crypto::rand<uint32_t>() % 1000000, spent, ready), pool.ready());
+    }
+    check(bt, pool, prev_id);
+    if (was_valid && bt.valid())
+      ++kept;
+
+    // the next template request rebuilds it, and so does a block once in a while
+    if (!bt.valid() || crypto::rand<uint32_t>() % 50 == 0)
+      build(bt, pool, prev_id);
+  }
+  ASSERT_GT(kept, 100);
+}
@@ -0,0 +1,154 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_core/txpool_index.h"
+
+static cryptonote::txpool_tx_meta_t make_meta(uint64_t weight, bool do_not_relay = false)
+{
+  cryptonote::txpool_tx_meta_t meta;
+  memset(&meta, 0, sizeof(meta));
+  meta.weight = weight;
+  meta.fee = weight * 10;
+  meta.do_not_relay = do_not_relay;
+  return meta;
+}
+
+TEST(txpool_index, empty)
+{
+  cryptonote::txpool_index index;
+  const auto snap = index.get_snapshot();
+  ASSERT_EQ(snap->count(), 0);
+  ASSERT_EQ(snap->weight(), 0);
+  ASSERT_EQ(snap->find(crypto::rand<crypto::hash>()), nullptr);
+  ASSERT_EQ(snap->find(crypto::rand<crypto::key_image>()), nullptr);
+}
+
+TEST(txpool_index, add_update_remove)
+{
+  cryptonote::txpool_index index;
+  const crypto::hash txid0 = crypto::rand<crypto::hash>(), txid1 = crypto::rand<crypto::hash>();
+  ASSERT_TRUE(index.add_tx(txid0, make_meta(100), "blob0"));
+  ASSERT_TRUE(index.add_tx(txid1, make_meta(200, true), "blob1"));
+  ASSERT_FALSE(index.add_tx(txid0, make_meta(100), "blob0"));
+  index.publish();
+
+  auto snap = index.get_snapshot();
+  ASSERT_EQ(snap->count(), 2);
+  ASSERT_EQ(snap->count(false), 1);
+  ASSERT_EQ(snap->weight(), 300);
+  auto e = snap->find(txid1);
+  ASSERT_NE(e, nullptr);
+  ASSERT_EQ(*e->blob, "blob1");
+  ASSERT_EQ(e->meta.weight, 200);
+
+  ASSERT_TRUE(index.update_tx(txid1, make_meta(250)));
+  index.publish();
+  snap = index.get_snapshot();
+  ASSERT_EQ(snap->count(false), 2);
+  ASSERT_EQ(snap->weight(), 350);
+  ASSERT_EQ(*snap->find(txid1)->blob, "blob1");
+
+  ASSERT_TRUE(index.remove_tx(txid0));
+  ASSERT_FALSE(index.remove_tx(txid0));
+  index.publish();
+  snap = index.get_snapshot();
+  ASSERT_EQ(snap->count(), 1);
+  ASSERT_EQ(snap->weight(), 250);
+  ASSERT_EQ(snap->find(txid0), nullptr);
+}
+
+TEST(txpool_index, key_images)
+{
+  cryptonote::txpool_index index;
+  const crypto::key_image ki = crypto::rand<crypto::key_image>();
+  const crypto::hash txid0 = crypto::rand<crypto::hash>(), txid1 = crypto::rand<crypto::hash>();
+  index.add_key_image(ki, txid0);
+  index.add_key_image(ki, txid1);
+  index.publish();
+  const std::vector<crypto::hash> *txids = index.get_snapshot()->find(ki);
+  ASSERT_NE(txids, nullptr);
+  ASSERT_EQ(txids->size(), 2);
+
+  ASSERT_TRUE(index.remove_key_image(ki, txid0));
+  ASSERT_FALSE(index.remove_key_image(ki, txid0));
+  ASSERT_TRUE(index.remove_key_image(ki, txid1));
+  index.publish();
+  ASSERT_EQ(index.get_snapshot()->find(ki), nullptr);
+}
+
+TEST(txpool_index, snapshot_isolation)
+{
+  cryptonote::txpool_index index;
+  const crypto::hash txid = crypto::rand<crypto::hash>();
+  ASSERT_TRUE(index.add_tx(txid, make_meta(100), "blob"));
+  index.publish();
+  const auto before = index.get_snapshot();
+
+  ASSERT_TRUE(index.remove_tx(txid));
+  ASSERT_EQ(index.current().find(txid), nullptr);
+  ASSERT_NE(index.get_snapshot()->find(txid), nullptr);
+  index.publish();
+
+  ASSERT_EQ(index.get_snapshot()->find(txid), nullptr);
+  ASSERT_NE(before->find(txid), nullptr);
+  ASSERT_EQ(before->count(), 1);
+}
+
+TEST(txpool_index, discard)
+{
+  cryptonote::txpool_index index;
+  const crypto::hash txid0 = crypto::rand<crypto::hash>(), txid1 = crypto::rand<crypto::hash>();
+  ASSERT_TRUE(index.add_tx(txid0, make_meta(100), "blob0"));
+  index.publish();
+
+  ASSERT_TRUE(index.add_tx(txid1, make_meta(100), "blob1"));
+  ASSERT_TRUE(index.remove_tx(txid0));
+  index.discard();
+  ASSERT_NE(index.current().find(txid0), nullptr);
+  ASSERT_EQ(index.current().find(txid1), nullptr);
+  ASSERT_EQ(index.get_snapshot()->count(), 1);
+}
+
+TEST(txpool_index, clear)
+{
+  cryptonote::txpool_index index;
+  for (int i = 0; i < 100; ++i)
+    ASSERT_TRUE(index.add_tx(crypto::rand<crypto::hash>(), make_meta(10), "blob"));
+  index.publish();
+  ASSERT_EQ(index.get_snapshot()->count(), 100);
+  size_t n = 0;
+  index.get_snapshot()->for_each([&n](const crypto::hash&, const cryptonote::txpool_index::entry&) { ++n; return true; });
+  ASSERT_EQ(n, 100);
+
+  index.clear();
+  index.publish();
+  ASSERT_EQ(index.get_snapshot()->count(), 0);
+  ASSERT_EQ(index.get_snapshot()->weight(), 0);
+}
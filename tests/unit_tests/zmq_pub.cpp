@@ -0,0 +1,357 @@
+// Copyright (c) 2019-2020, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "serialization/json_object.h"
+#include "wallstreetbets_mq/zmq_pub.h"
+
+using wallstreetbetsMQ::ZmqPub;
+
+namespace
+{
+  // published until every subscriber got it, so we know the publisher saw all the subscriptions
+  const char sync_payload[] = "{\"split_height\":0,\"new_height\":0}";
+
+  class subscriber
+  {
+  public:
+    subscriber(zmq::context_t &context, const std::string &endpoint, const std::vector<std::string> &prefixes, int queue_size = 1000):
+      m_socket(context, ZMQ_SUB), m_synced(false)
+    {
+      m_socket.setsockopt<int>(ZMQ_RCVHWM, queue_size);
+      m_socket.setsockopt<int>(ZMQ_LINGER, 0);
+      for (const std::string &prefix: prefixes)
+        m_socket.setsockopt(ZMQ_SUBSCRIBE, prefix.data(), prefix.size());
+      const std::string sync_topic = ZmqPub::topic_name(ZmqPub::json_minimal_chain_reorg);
+      m_socket.setsockopt(ZMQ_SUBSCRIBE, sync_topic.data(), sync_topic.size());
+      m_socket.connect(endpoint);
+    }
+
+    bool synced() const { return m_synced; }
+
+    // the next message which is not a sync one, false if none comes in time
+    bool recv(std::string &topic, std::string &payload, long timeout_ms = 2000)
+    {
+      while (true)
+      {
+        zmq::pollitem_t item = {(void*)m_socket, 0, ZMQ_POLLIN, 0};
+        if (zmq::poll(&item, 1, timeout_ms) == 0)
+          return false;
+        zmq::message_t topic_msg, payload_msg;
+        m_socket.recv(&topic_msg);
+        EXPECT_TRUE(topic_msg.more());
+        m_socket.recv(&payload_msg);
+        EXPECT_FALSE(payload_msg.more());
+        topic.assign(topic_msg.data<char>(), topic_msg.size());
+        payload.assign(payload_msg.data<char>(), payload_msg.size());
+        if (payload != sync_payload)
+          return true;
+        m_synced = true;
+      }
+    }
+
+    // the topics of all the messages waiting
+    std::vector<std::string> topics()
+    {
+      std::vector<std::string> topics;
+      std::string topic, payload;
+      while (recv(topic, payload, 200))
+        topics.push_back(topic);
+      return topics;
+    }
+
+  private:
+    zmq::socket_t m_socket;
+    bool m_synced;
+  };
+
+  void sync(ZmqPub &pub, const std::vector<subscriber*> &subscribers)
+  {
+    for (int i = 0; i < 500; ++i)
+    {
+      pub.on_reorg(0, 0);
+      bool synced = true;
+      for (subscriber *s: subscribers)
+      {
+        std::string topic, payload;
+        ASSERT_FALSE(s->recv(topic, payload, 10));
+        synced = synced && s->synced();
+      }
+      if (synced)
+        return;
+    }
+    FAIL() << "Subscriptions never reached the publisher";
+  }
+
+  rapidjson::Document parse(const std::string &payload)
+  {
+    rapidjson::Document doc;
+    EXPECT_FALSE(doc.Parse(payload.c_str()).HasParseError()) << payload;
+    return doc;
+  }
+
+  cryptonote::block make_block(uint32_t nonce, size_t tx_count)
+  {
+    cryptonote::block b;
+    b.major_version = 16;
+    b.minor_version = 16;
+    b.timestamp = 1600000000;
+    b.prev_id = crypto::rand<crypto::hash>();
+    b.nonce = nonce;
+    b.miner_tx.version = 1;
+    b.miner_tx.unlock_time = 60;
+    b.miner_tx.vin.push_back(cryptonote::txin_gen{1000});
+    b.tx_hashes.resize(tx_count, crypto::rand<crypto::hash>());
+    return b;
+  }
+}
+
+TEST(zmq_pub, topic_mask)
+{
+  ASSERT_EQ(0, ZmqPub::topic_mask({}));
+  ASSERT_EQ((1u << ZmqPub::topic_count) - 1, ZmqPub::topic_mask({""}));
+  ASSERT_EQ((1u << ZmqPub::json_minimal_chain_main) | (1u << ZmqPub::json_minimal_txpool_add) | (1u << ZmqPub::json_minimal_chain_reorg),
+      ZmqPub::topic_mask({"json-minimal-"}));
+  ASSERT_EQ((1u << ZmqPub::json_full_chain_main) | (1u << ZmqPub::bin_full_chain_main),
+      ZmqPub::topic_mask({"json-full-chain", "bin-"}));
+  ASSERT_EQ(1u << ZmqPub::json_full_miner_data, ZmqPub::topic_mask({"json-full-miner_data"}));
+
+  // a prefix matches the start of a topic, never the other way around
+  ASSERT_EQ(0, ZmqPub::topic_mask({"json-full-miner_data-", "chain_main", "JSON-", "x"}));
+  for (size_t t = 0; t < ZmqPub::topic_count; ++t)
+    ASSERT_EQ(1u << t, ZmqPub::topic_mask({ZmqPub::topic_name(static_cast<ZmqPub::topic>(t))}));
+}
+
+TEST(zmq_pub, subscribers_get_matching_topics)
+{
+  ZmqPub pub;
+  ASSERT_TRUE(pub.init("tcp://127.0.0.1:*", 100));
+  pub.run();
+
+  zmq::context_t context;
+  subscriber all(context, pub.endpoint(), {""});
+  subscriber minimal(context, pub.endpoint(), {"json-minimal-"});
+  subscriber miner(context, pub.endpoint(), {"json-full-miner"});
+  subscriber bin(context, pub.endpoint(), {"bin-full-chain_main", "json-full-txpool_add"});
+  sync(pub, {&all, &minimal, &miner, &bin});
+
+  const cryptonote::block b = make_block(0, 2);
+  const cryptonote::transaction &tx = b.miner_tx;
+  const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+  pub.on_block(100, b);
+  pub.on_txpool_add({{cryptonote::get_transaction_hash(tx), &tx, &blob, 100, 1000}});
+  pub.on_miner_data(cryptonote::miner_data{16, 101, crypto::null_hash, crypto::null_hash, 1000, 300000, 1000000});
+
+  // the sync topic is always subscribed to, so reorgs are left out here
+  ASSERT_EQ(std::vector<std::string>({"json-full-chain_main", "json-minimal-chain_main", "bin-full-chain_main",
+      "json-full-txpool_add", "json-minimal-txpool_add", "json-full-miner_data"}), all.topics());
+  ASSERT_EQ(std::vector<std::string>({"json-minimal-chain_main", "json-minimal-txpool_add"}), minimal.topics());
+  ASSERT_EQ(std::vector<std::string>({"json-full-miner_data"}), miner.topics());
+  ASSERT_EQ(std::vector<std::string>({"bin-full-chain_main", "json-full-txpool_add"}), bin.topics());
+}
+
+TEST(zmq_pub, block_payloads)
+{
+  ZmqPub pub;
+  ASSERT_TRUE(pub.init("tcp://127.0.0.1:*", 100));
+  pub.run();
+  zmq::context_t context;
+  subscriber sub(context, pub.endpoint(), {"json-full-chain_main", "json-minimal-chain_main", "bin-full-chain_main"});
+  sync(pub, {&sub});
+
+  const cryptonote::block b = make_block(42, 3);
+  const crypto::hash id = cryptonote::get_block_hash(b);
+  pub.on_block(1234, b);
+
+  std::string topic, payload;
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("json-full-chain_main", topic);
+  rapidjson::Document doc = parse(payload);
+  ASSERT_TRUE(doc.IsArray());
+  ASSERT_EQ(1, doc.Size());
+  cryptonote::block full;
+  cryptonote::json::fromJsonValue(doc[0u], full);
+  ASSERT_EQ(id, cryptonote::get_block_hash(full));
+
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("json-minimal-chain_main", topic);
+  doc = parse(payload);
+  ASSERT_TRUE(doc.IsObject());
+  uint64_t first_height;
+  crypto::hash first_prev_id;
+  std::vector<crypto::hash> ids;
+  cryptonote::json::fromJsonValue(doc["first_height"], first_height);
+  cryptonote::json::fromJsonValue(doc["first_prev_id"], first_prev_id);
+  cryptonote::json::fromJsonValue(doc["ids"], ids);
+  ASSERT_EQ(1234, first_height);
+  ASSERT_EQ(b.prev_id, first_prev_id);
+  ASSERT_EQ(std::vector<crypto::hash>({id}), ids);
+
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("bin-full-chain_main", topic);
+  cryptonote::block bin;
+  ASSERT_TRUE(cryptonote::parse_and_validate_block_from_blob(payload, bin));
+  ASSERT_EQ(id, cryptonote::get_block_hash(bin));
+}
+
+TEST(zmq_pub, txpool_reorg_and_miner_payloads)
+{
+  ZmqPub pub;
+  ASSERT_TRUE(pub.init("tcp://127.0.0.1:*", 100));
+  pub.run();
+  zmq::context_t context;
+  subscriber sub(context, pub.endpoint(), {"json-full-txpool_add", "json-minimal-txpool_add", "json-full-miner_data"});
+  sync(pub, {&sub});
+
+  const cryptonote::transaction tx = make_block(0, 0).miner_tx;
+  const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+  const crypto::hash txid = cryptonote::get_transaction_hash(tx), other_txid = crypto::rand<crypto::hash>();
+  pub.on_txpool_add({});
+  pub.on_txpool_add({{txid, &tx, &blob, 1500, 20000}, {other_txid, NULL, NULL, 2500, 30000}});
+
+  std::string topic, payload;
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("json-full-txpool_add", topic);
+  rapidjson::Document doc = parse(payload);
+  ASSERT_TRUE(doc.IsArray());
+  ASSERT_EQ(1, doc.Size());
+  cryptonote::transaction full;
+  cryptonote::json::fromJsonValue(doc[0u], full);
+  ASSERT_EQ(txid, cryptonote::get_transaction_hash(full));
+
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("json-minimal-txpool_add", topic);
+  doc = parse(payload);
+  ASSERT_TRUE(doc.IsArray());
+  ASSERT_EQ(2, doc.Size());
+  const crypto::hash expected_ids[] = {txid, other_txid};
+  const uint64_t expected_blob_sizes[] = {blob.size(), 0}, expected_weights[] = {1500, 2500}, expected_fees[] = {20000, 30000};
+  for (rapidjson::SizeType i = 0; i < 2; ++i)
+  {
+    crypto::hash id;
+    uint64_t blob_size, weight, fee;
+    cryptonote::json::fromJsonValue(doc[i]["id"], id);
+    cryptonote::json::fromJsonValue(doc[i]["blob_size"], blob_size);
+    cryptonote::json::fromJsonValue(doc[i]["weight"], weight);
+    cryptonote::json::fromJsonValue(doc[i]["fee"], fee);
+    ASSERT_EQ(expected_ids[i], id);
+    ASSERT_EQ(expected_blob_sizes[i], blob_size);
+    ASSERT_EQ(expected_weights[i], weight);
+    ASSERT_EQ(expected_fees[i], fee);
+  }
+
+  pub.on_reorg(500, 498);
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("json-minimal-chain_reorg", topic);
+  ASSERT_EQ("{\"split_height\":500,\"new_height\":498}", payload);
+
+  const cryptonote::miner_data data{16, 1001, crypto::rand<crypto::hash>(), crypto::rand<crypto::hash>(), 123456789, 300000, 987654321};
+  pub.on_miner_data(data);
+  ASSERT_TRUE(sub.recv(topic, payload));
+  ASSERT_EQ("json-full-miner_data", topic);
+  doc = parse(payload);
+  ASSERT_TRUE(doc.IsObject());
+  cryptonote::miner_data parsed;
+  cryptonote::json::fromJsonValue(doc["major_version"], parsed.major_version);
+  cryptonote::json::fromJsonValue(doc["height"], parsed.height);
+  cryptonote::json::fromJsonValue(doc["prev_id"], parsed.prev_id);
+  cryptonote::json::fromJsonValue(doc["seed_hash"], parsed.seed_hash);
+  cryptonote::json::fromJsonValue(doc["difficulty"], parsed.difficulty);
+  cryptonote::json::fromJsonValue(doc["median_weight"], parsed.median_weight);
+  cryptonote::json::fromJsonValue(doc["already_generated_coins"], parsed.already_generated_coins);
+  ASSERT_EQ(data.major_version, parsed.major_version);
+  ASSERT_EQ(data.height, parsed.height);
+  ASSERT_EQ(data.prev_id, parsed.prev_id);
+  ASSERT_EQ(data.seed_hash, parsed.seed_hash);
+  ASSERT_EQ(data.difficulty, parsed.difficulty);
+  ASSERT_EQ(data.median_weight, parsed.median_weight);
+  ASSERT_EQ(data.already_generated_coins, parsed.already_generated_coins);
+
+  ASSERT_FALSE(sub.recv(topic, payload, 200));
+}
+
+TEST(zmq_pub, slow_subscriber_queue_overflows)
+{
+  static const size_t queue_size = 10;
+  static const uint32_t block_count = 1000;
+
+  ZmqPub pub;
+  ASSERT_TRUE(pub.init("tcp://127.0.0.1:*", queue_size));
+  pub.run();
+  zmq::context_t context;
+  subscriber slow(context, pub.endpoint(), {"bin-full-chain_main"}, 1);
+  subscriber fast(context, pub.endpoint(), {"bin-full-chain_main"});
+  sync(pub, {&slow, &fast});
+
+  // the fast one keeps reading while the blocks go out, the slow one only once they all did
+  std::vector<uint32_t> fast_nonces;
+  std::thread reader([&fast, &fast_nonces]() {
+    std::string topic, payload;
+    while (fast.recv(topic, payload, 1000))
+    {
+      cryptonote::block b;
+      if (!cryptonote::parse_and_validate_block_from_blob(payload, b))
+        break;
+      fast_nonces.push_back(b.nonce);
+    }
+  });
+
+  // blocks of ~32 kB, so the socket buffers hold only so many
+  for (uint32_t nonce = 0; nonce < block_count; ++nonce)
+  {
+    pub.on_block(nonce, make_block(nonce, 1000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  reader.join();
+
+  std::vector<uint32_t> slow_nonces;
+  std::string topic, payload;
+  while (slow.recv(topic, payload, 500))
+  {
+    ASSERT_EQ("bin-full-chain_main", topic);
+    cryptonote::block b;
+    ASSERT_TRUE(cryptonote::parse_and_validate_block_from_blob(payload, b));
+    slow_nonces.push_back(b.nonce);
+  }
+
+  // what the slow one got is whole and in order, it lost most of the rest (its
+  // queue is 10 blocks, the socket buffers hold some more), and the other one
+  // was not held up
+  ASSERT_FALSE(slow_nonces.empty());
+  ASSERT_TRUE(std::is_sorted(slow_nonces.begin(), slow_nonces.end()));
+  ASSERT_TRUE(std::adjacent_find(slow_nonces.begin(), slow_nonces.end()) == slow_nonces.end());
+  ASSERT_LT(slow_nonces.size(), (block_count - pub.dropped()) / 2);
+  ASSERT_TRUE(std::is_sorted(fast_nonces.begin(), fast_nonces.end()));
+  ASSERT_GT(fast_nonces.size(), slow_nonces.size());
+}